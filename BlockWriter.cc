@@ -0,0 +1,128 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "./BlockWriter.h"
+
+namespace hw4 {
+
+BlockWriter::BlockWriter(const std::string& file_name, size_t block_bytes)
+  : file_name_(file_name), block_bytes_(block_bytes), fd_(-1), ok_(false),
+    reserved_bytes_(0), flushed_(0), num_writes_(0) { }
+
+BlockWriter::~BlockWriter() {
+  if (fd_ != -1) {
+    Close(false);
+  }
+}
+
+bool BlockWriter::Open(size_t reserved_bytes) {
+  fd_ = open(file_name_.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0666);
+  if (fd_ == -1) {
+    return false;
+  }
+  ok_ = true;
+  reserved_bytes_ = reserved_bytes;
+  flushed_ = reserved_bytes;
+  block_.reserve(block_bytes_);
+  return true;
+}
+
+bool BlockWriter::Append(const void* buf, size_t len) {
+  if (!ok_) {
+    return false;
+  }
+  const uint8_t* bytes = static_cast<const uint8_t*>(buf);
+  if (block_.size() + len > block_bytes_) {
+    if (!Flush()) {
+      return false;
+    }
+
+    // Something at least a block long goes straight to the file rather
+    // than through the block.
+    if (len >= block_bytes_) {
+      crc_.Fold(bytes, len);
+      ok_ = WriteAt(bytes, len, flushed_);
+      flushed_ += len;
+      return ok_;
+    }
+  }
+  block_.insert(block_.end(), bytes, bytes + len);
+  return true;
+}
+
+bool BlockWriter::Finish(const void* buf, size_t len) {
+  if (fd_ == -1) {
+    return false;
+  }
+  // The file is flushed to disk before it is closed, so that once
+  // Finish() returns true the file can be renamed over another, or the
+  // files it replaces removed, without a crash losing both.
+  bool ok = ok_ && len <= reserved_bytes_ && Flush() &&
+            WriteAt(buf, len, 0) && fdatasync(fd_) == 0;
+  ok_ = false;
+  return Close(ok);
+}
+
+bool BlockWriter::WriteAt(const void* buf, size_t len, int64_t offset) {
+  const uint8_t* bytes = static_cast<const uint8_t*>(buf);
+  while (len > 0) {
+    ssize_t wrote = pwrite(fd_, bytes, len, offset);
+    num_writes_++;
+    if (wrote == -1 && errno == EINTR) {
+      continue;
+    }
+    if (wrote <= 0) {
+      return false;
+    }
+    bytes += wrote;
+    len -= wrote;
+    offset += wrote;
+  }
+  return true;
+}
+
+uint32_t BlockWriter::checksum() const {
+  CRC32 crc(crc_);
+  crc.Fold(block_.data(), block_.size());
+  return crc.GetFinalCRC();
+}
+
+bool BlockWriter::Flush() {
+  // Blocks are checksummed as they go out, a block at a time, which is
+  // much faster than a record at a time.
+  crc_.Fold(block_.data(), block_.size());
+  ok_ = ok_ && WriteAt(block_.data(), block_.size(), flushed_);
+  flushed_ += block_.size();
+  block_.clear();
+  return ok_;
+}
+
+bool BlockWriter::Close(bool keep) {
+  if (close(fd_) != 0) {
+    keep = false;
+  }
+  fd_ = -1;
+  if (!keep) {
+    unlink(file_name_.c_str());
+  }
+  return keep;
+}
+
+}  // namespace hw4
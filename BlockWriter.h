@@ -0,0 +1,107 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_BLOCKWRITER_H_
+#define HW4_BLOCKWRITER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "./CRC32.h"
+
+namespace hw4 {
+
+// How many bytes a BlockWriter gathers before it writes them out.
+static const size_t kWriteBlockBytes = 1 << 20;
+
+// A BlockWriter writes a new file front to back: what is appended to
+// it is gathered into blocks of kWriteBlockBytes and written out a
+// block at a time, so a file goes to disk in a few large sequential
+// writes rather than in many small ones.  The first few bytes of the
+// file can be left for later -- an index file's header, which holds a
+// checksum of everything after it -- and are written last, with one
+// more write.  The writer checksums what is appended as it goes, so
+// the file never has to be read back.
+//
+// Errors stick: once a write fails, Append() and Finish() return
+// false, and the file is removed when the writer is finished or
+// destroyed.
+class BlockWriter {
+ public:
+  // Memorizes the name of the file to write, and how big a block is;
+  // does not create it.
+  explicit BlockWriter(const std::string& file_name,
+                       size_t block_bytes = kWriteBlockBytes);
+
+  // If the file hasn't been finished, removes it.
+  virtual ~BlockWriter();
+
+  // Creates the file (replacing any file already there), leaving its
+  // first "reserved_bytes" bytes for Finish() to fill in.  Returns
+  // false if it can't be created.
+  bool Open(size_t reserved_bytes);
+
+  // Appends the "len" bytes at "buf" to the file.  Returns false if
+  // they (or anything before them) couldn't be written.
+  bool Append(const void* buf, size_t len);
+
+  // Appends "record" in disk (network) byte order.
+  template <typename T>
+  bool AppendRecord(T record) {
+    record.ToDiskFormat();
+    return Append(&record, sizeof(record));
+  }
+
+  // Where in the file the next appended byte goes.
+  int64_t offset() const { return flushed_ + block_.size(); }
+
+  // The CRC32 of everything appended so far.
+  uint32_t checksum() const;
+
+  // How many write()s the file has taken so far.
+  uint64_t num_writes() const { return num_writes_; }
+
+  // Writes out what is left of the last block, fills the reserved
+  // bytes at the start of the file with the "len" bytes at "buf"
+  // ("len" must not be more than were reserved), flushes the file to
+  // disk, and closes it.  Returns false, and removes the file, if any
+  // of it couldn't be written or flushed.
+  bool Finish(const void* buf, size_t len);
+
+ private:
+  // Writes the "len" bytes at "buf" to the file at "offset", a write()
+  // at a time.
+  bool WriteAt(const void* buf, size_t len, int64_t offset);
+
+  // Writes out the current block.
+  bool Flush();
+
+  // Closes the file and, if "keep" is false or it can't be closed,
+  // removes it.  Returns true if the file was kept.
+  bool Close(bool keep);
+
+  std::string file_name_;
+  size_t block_bytes_;
+  int fd_;
+  bool ok_;
+  size_t reserved_bytes_;
+  int64_t flushed_;              // how much of the file has been written
+  std::vector<uint8_t> block_;   // what has been appended since
+  CRC32 crc_;                    // the checksum of what has been written
+  uint64_t num_writes_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_BLOCKWRITER_H_
@@ -0,0 +1,261 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+
+#include <stdint.h>
+#include <stddef.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define HW4_CRC32_PCLMUL 1
+#endif
+
+#include "./CRC32.h"
+
+namespace hw4 {
+
+// The lookup tables: table[0] is the usual bytewise table, and
+// table[k][b] is the CRC of byte b followed by k zero bytes, which is
+// what lets kSliceBy8 look up eight bytes independently.
+struct CRC32Tables {
+  CRC32Tables() {
+    for (uint32_t b = 0; b < 256; b++) {
+      uint32_t crc = b;
+      for (int bit = 0; bit < 8; bit++) {
+        crc = (crc >> 1) ^ (crc & 1 ? 0xEDB88320 : 0);
+      }
+      table[0][b] = crc;
+    }
+    for (int k = 1; k < 8; k++) {
+      for (uint32_t b = 0; b < 256; b++) {
+        uint32_t prev = table[k - 1][b];
+        table[k][b] = (prev >> 8) ^ table[0][prev & 0xFF];
+      }
+    }
+  }
+
+  uint32_t table[8][256];
+};
+
+// Returns the tables, building them the first time.
+static const CRC32Tables& Tables();
+
+// Folds the "len" bytes at "p" into "crc" (which, like CRC32::crc_, is
+// the running register, not the final checksum) a byte at a time, and
+// returns the result.
+static uint32_t FoldBytewise(uint32_t crc, const uint8_t* p, size_t len);
+
+// Like FoldBytewise(), but eight bytes at a time.
+static uint32_t FoldSliceBy8(uint32_t crc, const uint8_t* p, size_t len);
+
+#ifdef HW4_CRC32_PCLMUL
+// Like FoldBytewise(), but with carry-less multiplications.  "len"
+// must be at least 64 and a multiple of 16.
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t FoldPclmul(uint32_t crc, const uint8_t* p, size_t len);
+#endif
+
+// Combine() treats running a CRC over zero bytes as a linear map on
+// its 32 bits, i.e. a 32x32 matrix over GF(2), stored as one column
+// per word.  GF2Times() returns "matrix" times "vec", and GF2Square()
+// sets "square" to "matrix" times itself.
+static uint32_t GF2Times(const uint32_t* matrix, uint32_t vec);
+static void GF2Square(uint32_t* const square, const uint32_t* matrix);
+
+CRC32::CRC32(Method method) : method_(method), crc_(0xFFFFFFFF) {
+  if (method_ == kAuto) {
+    method_ = HasPclmul() ? kPclmul : kSliceBy8;
+  } else if (method_ == kPclmul && !HasPclmul()) {
+    method_ = kSliceBy8;
+  }
+}
+
+bool CRC32::HasPclmul() {
+#ifdef HW4_CRC32_PCLMUL
+  static const bool has_pclmul = __builtin_cpu_supports("pclmul") &&
+                                 __builtin_cpu_supports("sse4.1");
+  return has_pclmul;
+#else
+  return false;
+#endif
+}
+
+void CRC32::Fold(const void* buf, size_t len) {
+  const uint8_t* p = static_cast<const uint8_t*>(buf);
+  if (method_ == kBytewise) {
+    crc_ = FoldBytewise(crc_, p, len);
+    return;
+  }
+#ifdef HW4_CRC32_PCLMUL
+  if (method_ == kPclmul && len >= 64) {
+    size_t bulk = len & ~static_cast<size_t>(15);
+    crc_ = FoldPclmul(crc_, p, bulk);
+    p += bulk;
+    len -= bulk;
+  }
+#endif
+  crc_ = FoldSliceBy8(crc_, p, len);
+}
+
+uint32_t CRC32::Combine(uint32_t crc1, uint32_t crc2, uint64_t len2) {
+  // Appending len2 zero bytes to the first piece takes crc1 to what it
+  // would be before the second piece's bytes are XORed in; that is
+  // done by squaring the one-zero-bit operator up to a byte, and then
+  // applying the powers of it that len2's bits call for.
+  if (len2 == 0) {
+    return crc1;
+  }
+  uint32_t odd[32], even[32];
+  odd[0] = 0xEDB88320;
+  for (int n = 1; n < 32; n++) {
+    odd[n] = 1u << (n - 1);
+  }
+  GF2Square(even, odd);   // two zero bits
+  GF2Square(odd, even);   // four zero bits
+  while (len2 > 0) {
+    GF2Square(even, odd);
+    if (len2 & 1) {
+      crc1 = GF2Times(even, crc1);
+    }
+    len2 >>= 1;
+    if (len2 == 0) {
+      break;
+    }
+    GF2Square(odd, even);
+    if (len2 & 1) {
+      crc1 = GF2Times(odd, crc1);
+    }
+    len2 >>= 1;
+  }
+  return crc1 ^ crc2;
+}
+
+static const CRC32Tables& Tables() {
+  static const CRC32Tables tables;
+  return tables;
+}
+
+static uint32_t FoldBytewise(uint32_t crc, const uint8_t* p, size_t len) {
+  const uint32_t* table = Tables().table[0];
+  for (size_t i = 0; i < len; i++) {
+    crc = (crc >> 8) ^ table[(crc ^ p[i]) & 0xFF];
+  }
+  return crc;
+}
+
+static uint32_t FoldSliceBy8(uint32_t crc, const uint8_t* p, size_t len) {
+  const CRC32Tables& tables = Tables();
+  const uint32_t (*t)[256] = tables.table;
+  for (; len >= 8; p += 8, len -= 8) {
+    uint32_t lo = (p[0] | p[1] << 8 | p[2] << 16 |
+                   static_cast<uint32_t>(p[3]) << 24) ^ crc;
+    uint32_t hi = p[4] | p[5] << 8 | p[6] << 16 |
+                  static_cast<uint32_t>(p[7]) << 24;
+    crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^
+          t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^
+          t[3][hi & 0xFF] ^ t[2][(hi >> 8) & 0xFF] ^
+          t[1][(hi >> 16) & 0xFF] ^ t[0][hi >> 24];
+  }
+  return FoldBytewise(crc, p, len);
+}
+
+#ifdef HW4_CRC32_PCLMUL
+__attribute__((target("pclmul,sse4.1")))
+static uint32_t FoldPclmul(uint32_t crc, const uint8_t* p, size_t len) {
+  // The folding constants for the reflected CRC-32 polynomial, from
+  // the end of Intel's paper: x^(4*128+64) mod P and x^(4*128) mod P
+  // for folding 64 bytes at a time, the same for 16 bytes, then for
+  // folding 128 bits down to 64, and finally P and mu for the Barrett
+  // reduction.
+  alignas(16) static const uint64_t k1k2[] = {0x0154442bd4, 0x01c6e41596};
+  alignas(16) static const uint64_t k3k4[] = {0x01751997d0, 0x00ccaa009e};
+  alignas(16) static const uint64_t k5k0[] = {0x0163cd6124, 0x0000000000};
+  alignas(16) static const uint64_t poly[] = {0x01db710641, 0x01f7011641};
+
+  // Four 128-bit accumulators, each folded forward 64 bytes at a time.
+  __m128i x1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+  __m128i x2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+  __m128i x3 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32));
+  __m128i x4 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 48));
+  x1 = _mm_xor_si128(x1, _mm_cvtsi32_si128(crc));
+  __m128i k = _mm_load_si128(reinterpret_cast<const __m128i*>(k1k2));
+  p += 64;
+  len -= 64;
+  for (; len >= 64; p += 64, len -= 64) {
+    __m128i x5 = _mm_clmulepi64_si128(x1, k, 0x00);
+    __m128i x6 = _mm_clmulepi64_si128(x2, k, 0x00);
+    __m128i x7 = _mm_clmulepi64_si128(x3, k, 0x00);
+    __m128i x8 = _mm_clmulepi64_si128(x4, k, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+    x2 = _mm_clmulepi64_si128(x2, k, 0x11);
+    x3 = _mm_clmulepi64_si128(x3, k, 0x11);
+    x4 = _mm_clmulepi64_si128(x4, k, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, x5), _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(p)));
+    x2 = _mm_xor_si128(_mm_xor_si128(x2, x6), _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(p + 16)));
+    x3 = _mm_xor_si128(_mm_xor_si128(x3, x7), _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(p + 32)));
+    x4 = _mm_xor_si128(_mm_xor_si128(x4, x8), _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(p + 48)));
+  }
+
+  // Fold the four accumulators into one, and then fold in the rest 16
+  // bytes at a time.
+  k = _mm_load_si128(reinterpret_cast<const __m128i*>(k3k4));
+  __m128i folded[] = {x2, x3, x4};
+  for (const __m128i& next : folded) {
+    __m128i x5 = _mm_clmulepi64_si128(x1, k, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, next), x5);
+  }
+  for (; len >= 16; p += 16, len -= 16) {
+    __m128i x5 = _mm_clmulepi64_si128(x1, k, 0x00);
+    x1 = _mm_clmulepi64_si128(x1, k, 0x11);
+    x1 = _mm_xor_si128(_mm_xor_si128(x1, _mm_loadu_si128(
+        reinterpret_cast<const __m128i*>(p))), x5);
+  }
+
+  // Fold 128 bits down to 64...
+  __m128i mask = _mm_setr_epi32(~0, 0, ~0, 0);
+  x2 = _mm_clmulepi64_si128(x1, k, 0x10);
+  x1 = _mm_xor_si128(_mm_srli_si128(x1, 8), x2);
+  k = _mm_loadl_epi64(reinterpret_cast<const __m128i*>(k5k0));
+  x2 = _mm_srli_si128(x1, 4);
+  x1 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+
+  // ...and Barrett-reduce that to 32.
+  k = _mm_load_si128(reinterpret_cast<const __m128i*>(poly));
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x1, mask), k, 0x10);
+  x2 = _mm_clmulepi64_si128(_mm_and_si128(x2, mask), k, 0x00);
+  x1 = _mm_xor_si128(x1, x2);
+  return _mm_extract_epi32(x1, 1);
+}
+#endif
+
+static uint32_t GF2Times(const uint32_t* matrix, uint32_t vec) {
+  uint32_t sum = 0;
+  for (; vec != 0; vec >>= 1, matrix++) {
+    if (vec & 1) {
+      sum ^= *matrix;
+    }
+  }
+  return sum;
+}
+
+static void GF2Square(uint32_t* const square, const uint32_t* matrix) {
+  for (int n = 0; n < 32; n++) {
+    square[n] = GF2Times(matrix, matrix[n]);
+  }
+}
+
+}  // namespace hw4
@@ -0,0 +1,76 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+
+#ifndef HW4_CRC32_H_
+#define HW4_CRC32_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace hw4 {
+
+// A CRC32 computes the same checksum as hw3::CRC32 -- the reflected
+// CRC-32 of zlib and Ethernet, which index file headers hold -- but
+// takes its input a buffer at a time rather than a byte at a time, so
+// that it can work on several bytes at once:
+//
+//  - kBytewise looks each byte up in a 256-entry table, as hw3::CRC32
+//    does.
+//
+//  - kSliceBy8 looks up eight bytes at a time in eight tables, one per
+//    byte position, which breaks the chain of dependent lookups that
+//    holds kBytewise back.
+//
+//  - kPclmul folds 64 bytes at a time with carry-less multiplications
+//    (PCLMULQDQ), as in Intel's "Fast CRC Computation for Generic
+//    Polynomials Using PCLMULQDQ Instruction", finishing off whatever
+//    is left over with kSliceBy8.  (SSE4.2's crc32 instruction is no
+//    help: it computes CRC-32C, a different checksum.)
+//
+//  - kAuto picks kPclmul when the CPU has it, and kSliceBy8 otherwise.
+//
+// All of them give the same answer.
+class CRC32 {
+ public:
+  enum Method { kBytewise, kSliceBy8, kPclmul, kAuto };
+
+  // Starts a new checksum, to be computed as "method" says.  kPclmul
+  // falls back to kSliceBy8 on CPUs that don't have it.
+  explicit CRC32(Method method = kAuto);
+
+  // Folds the "len" bytes at "buf" into the checksum.
+  void Fold(const void* buf, size_t len);
+
+  // Returns the checksum of everything folded in so far.
+  uint32_t GetFinalCRC() const { return crc_ ^ 0xFFFFFFFF; }
+
+  // The method actually in use.
+  Method method() const { return method_; }
+
+  // Returns true if this CPU can run kPclmul.
+  static bool HasPclmul();
+
+  // Returns the checksum of two pieces of data, one after the other,
+  // given "crc1", the checksum of the first, and "crc2" and "len2", the
+  // checksum and length of the second.  Takes O(log len2) time, so a
+  // file written out of order can be checksummed without reading it
+  // back.
+  static uint32_t Combine(uint32_t crc1, uint32_t crc2, uint64_t len2);
+
+ private:
+  Method method_;
+  uint32_t crc_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_CRC32_H_
@@ -0,0 +1,139 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <arpa/inet.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "./DocNamePool.h"
+#include "./PostingCodec.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+const size_t DocNamePool::kBlockNames;
+
+// Appends "value" to "out" in network byte order.
+static void PutUint32(uint32_t value, vector<uint8_t>* const out);
+
+// Reads the network byte order uint32 at "p".
+static uint32_t GetUint32(const uint8_t* p);
+
+void DocNamePool::Build(const vector<string>& names,
+                        vector<uint8_t>* const out) {
+  Builder builder(names.size(), out);
+  for (const string& name : names) {
+    builder.Add(name);
+  }
+}
+
+DocNamePool::Builder::Builder(size_t num_names, vector<uint8_t>* const out)
+  : out_(out), start_(out->size()), num_added_(0) {
+  uint32_t num_blocks = (num_names + kBlockNames - 1) / kBlockNames;
+  PutUint32(num_names, out_);
+  out_->resize(out_->size() + num_blocks * sizeof(uint32_t));
+}
+
+void DocNamePool::Builder::Add(const string& name) {
+  size_t i = num_added_++;
+  if (i % kBlockNames == 0) {
+    uint32_t offset = htonl(out_->size() - start_);
+    memcpy(&(*out_)[start_ + (1 + i / kBlockNames) * sizeof(uint32_t)],
+           &offset, sizeof(offset));
+    PutVarint(name.size(), out_);
+    out_->insert(out_->end(), name.begin(), name.end());
+    prev_ = name;
+    return;
+  }
+  size_t shared = 0;
+  while (shared < name.size() && shared < prev_.size() &&
+         name[shared] == prev_[shared]) {
+    shared++;
+  }
+  PutVarint(shared, out_);
+  PutVarint(name.size() - shared, out_);
+  out_->insert(out_->end(), name.begin() + shared, name.end());
+  prev_ = name;
+}
+
+bool DocNamePool::Parse(const uint8_t* data, size_t len) {
+  data_ = nullptr;
+  len_ = num_names_ = 0;
+  if (len < sizeof(uint32_t)) {
+    return false;
+  }
+  uint32_t num_names = GetUint32(data);
+  uint64_t num_blocks = (static_cast<uint64_t>(num_names) + kBlockNames - 1) /
+                        kBlockNames;
+  if ((1 + num_blocks) * sizeof(uint32_t) > len) {
+    return false;
+  }
+
+  // The blocks must come one after the other, after the offsets.
+  uint64_t prev = (1 + num_blocks) * sizeof(uint32_t);
+  for (uint64_t b = 0; b < num_blocks; b++) {
+    uint32_t offset = GetUint32(data + (1 + b) * sizeof(uint32_t));
+    if (offset < prev || offset >= len) {
+      return false;
+    }
+    prev = offset + 1;
+  }
+
+  data_ = data;
+  len_ = len;
+  num_names_ = num_names;
+  return true;
+}
+
+bool DocNamePool::Lookup(DocID_t doc_id, string* const name) const {
+  if (!valid() || doc_id == 0 || doc_id > num_names_) {
+    return false;
+  }
+
+  // Decode the block's names up to this one.
+  size_t block = (doc_id - 1) / kBlockNames;
+  size_t n = (doc_id - 1) % kBlockNames + 1;
+  const uint8_t* p =
+      data_ + GetUint32(data_ + (1 + block) * sizeof(uint32_t));
+  const uint8_t* end = data_ + len_;
+  name->clear();
+  for (size_t i = 0; i < n; i++) {
+    uint64_t shared = 0, suffix_len;
+    if ((i > 0 && !GetVarint(&p, end, &shared)) ||
+        !GetVarint(&p, end, &suffix_len) ||
+        shared > name->size() ||
+        suffix_len > static_cast<uint64_t>(end - p)) {
+      return false;
+    }
+    name->resize(shared);
+    name->append(reinterpret_cast<const char*>(p), suffix_len);
+    p += suffix_len;
+  }
+  return true;
+}
+
+static void PutUint32(uint32_t value, vector<uint8_t>* const out) {
+  value = htonl(value);
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+  out->insert(out->end(), bytes, bytes + sizeof(value));
+}
+
+static uint32_t GetUint32(const uint8_t* p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return ntohl(value);
+}
+
+}  // namespace hw4
@@ -0,0 +1,106 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_DOCNAMEPOOL_H_
+#define HW4_DOCNAMEPOOL_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+#include "./libhw3/LayoutStructs.h"
+
+namespace hw4 {
+
+// A DocNamePool holds the names of an index's documents, numbered 1,
+// 2, ..., N, front-coded as a TermDictionary's words are (see
+// TermDictionary.h): the names are cut into blocks of kBlockNames in
+// docID order, the first name of each block is stored whole, and every
+// other name is stored as the length of the prefix it shares with the
+// name before it plus the rest of the name.  A crawl numbers the files
+// of a directory one after the other, so neighbouring names share
+// long path prefixes, and the pool is a fraction of the size of the
+// names themselves.
+//
+// Unlike the doctable's hash table, the pool is indexed by docID
+// directly: a dense array gives where each block starts, so finding a
+// name takes no hashing or chain walking, just decoding at most
+// kBlockNames - 1 names before it.
+//
+// The encoded form (all fixed-width fields in network byte order) is:
+//
+//   uint32 num_names
+//   uint32 block_offsets[(num_names + kBlockNames - 1) / kBlockNames]
+//          (from the start of the encoding; block b holds docIDs
+//          b * kBlockNames + 1 onwards)
+//   the blocks, each:
+//     varint name_len, then the name's bytes
+//     for each of the block's other names:
+//       varint shared_len, varint suffix_len, then the suffix's bytes
+//
+// A DocNamePool doesn't own its bytes; whoever calls Parse() must keep
+// them alive.
+class DocNamePool {
+ public:
+  // Names are looked up one at a time, by docID, rather than scanned
+  // in order as a TermDictionary's words are, so the blocks are kept
+  // shorter than kBlockTerms.
+  static const size_t kBlockNames = 8;
+
+  DocNamePool() : data_(nullptr), len_(0), num_names_(0) { }
+  virtual ~DocNamePool() { }
+
+  // Appends the encoded form of "names", where names[i] is the name of
+  // document i + 1, to "out".
+  static void Build(const std::vector<std::string>& names,
+                    std::vector<uint8_t>* const out);
+
+  // Builds the same encoding a name at a time, as a TermDictionary's
+  // Builder does: the names of documents 1 to "num_names" are Add()ed
+  // in docID order.
+  class Builder {
+   public:
+    Builder(size_t num_names, std::vector<uint8_t>* const out);
+    void Add(const std::string& name);
+
+   private:
+    std::vector<uint8_t>* out_;
+    size_t start_;       // where in *out_ the encoding starts
+    size_t num_added_;
+    std::string prev_;   // the name added last
+  };
+
+  // Makes this a view of the encoded pool held in the "len" bytes at
+  // "data".  Returns false (and leaves the pool empty) if the bytes
+  // aren't a well-formed pool.
+  bool Parse(const uint8_t* data, size_t len);
+
+  // Returns true if Parse() has succeeded.
+  bool valid() const { return data_ != nullptr; }
+
+  // The number of names in the pool, i.e. the highest docID.
+  size_t size() const { return num_names_; }
+
+  // Decodes the name of document "doc_id" into "name", reusing its
+  // storage.  Returns false if there is no such document.
+  bool Lookup(DocID_t doc_id, std::string* const name) const;
+
+ private:
+  const uint8_t* data_;
+  size_t len_;
+  uint32_t num_names_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_DOCNAMEPOOL_H_
@@ -17,6 +17,8 @@
 #include <map>
 #include <string>
 #include <sstream>
+#include <utility>
+#include <vector>
 
 namespace hw4 {
 
@@ -55,6 +57,20 @@ class HttpResponse {
     body_ += body_fragment;
   }
 
+  // Adds a "name: value" header, which goes out before the
+  // "Content-length:" header.  Any control characters in "value" (which
+  // might otherwise end the header early and start another) are
+  // replaced with spaces.
+  void AddHeader(const std::string& name, const std::string& value) {
+    std::string clean = value;
+    for (char& c : clean) {
+      if (static_cast<unsigned char>(c) < 0x20 || c == 0x7f) {
+        c = ' ';
+      }
+    }
+    headers_.push_back(std::make_pair(name, clean));
+  }
+
   // A method to generate a std::string of the HTTP response, suitable for
   // writing back to the client.
   //
@@ -68,6 +84,9 @@ class HttpResponse {
     if (!content_type_.empty()) {
       resp << "Content-type: " << content_type_ << "\r\n";
     }
+    for (const auto& header : headers_) {
+      resp << header.first << ": " << header.second << "\r\n";
+    }
     resp << "Content-length: " << body_.size() << "\r\n";
     resp << "\r\n";
     resp << body_;
@@ -87,6 +106,9 @@ class HttpResponse {
   // The HTTP content type string to pass back in the header.  Optional.
   std::string content_type_;
 
+  // Any other headers, in the order they were added.
+  std::vector<std::pair<std::string, std::string>> headers_;
+
   // The body of the response.
   std::string body_;
 };
@@ -9,7 +9,16 @@
  * author.
  */
 
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
 #include <boost/algorithm/string.hpp>
+#include <algorithm>
 #include <iostream>
 #include <map>
 #include <memory>
@@ -22,18 +31,26 @@
 #include "./HttpRequest.h"
 #include "./HttpUtils.h"
 #include "./HttpServer.h"
-#include "./libhw3/QueryProcessor.h"
+#include "./IndexBuilder.h"
+#include "./IndexWriter.h"
+#include "./RequestLane.h"
+#include "./QueryCache.h"
+#include "./QueryEngine.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
 
 using std::cerr;
 using std::cout;
 using std::endl;
 using std::list;
 using std::map;
+using std::shared_ptr;
 using std::string;
 using std::stringstream;
 using std::unique_ptr;
 using std::vector;
-using hw3::QueryProcessor;
 
 namespace hw4 {
 ///////////////////////////////////////////////////////////////////////////////
@@ -59,31 +76,192 @@ static const char* kThreegleStr =
   "</form>\n"
   "</center><p>\n";
 
+// How many results go on a page of query results, unless the request
+// asks ("per_page=") for some other number, and the most it may ask for.
+static const size_t kDefaultResultsPerPage = 25;
+static const size_t kMaxResultsPerPage = 1000;
+
 // static
 const int HttpServer::kNumThreads = 100;
+const int HttpServer::kStaticLaneWorkers = 32;
+const int HttpServer::kStaticLaneQueueLimit = 32;
+const int HttpServer::kQueryLaneWorkers = 8;
+const int HttpServer::kQueryLaneQueueLimit = 16;
+const size_t HttpServer::kQueryCacheBytes = 16 * 1024 * 1024;
+const int HttpServer::kQueryCacheShards = 16;
+
+// The classes of request that we handle.  Static file and query
+// requests each get their own RequestLane; stats requests are cheap
+// and answered directly so they still work when the lanes are full.
+// Admin requests are answered directly too, and only for clients on
+// this host.
+enum RequestClass {
+  kStaticRequest,
+  kQueryRequest,
+  kStatsRequest,
+  kAdminRequest
+};
 
 // This is the function that threads are dispatched into
 // in order to process new client connections.
 static void HttpServer_ThrFn(ThreadPool::Task* t);
 
-// Given a request, produce a response.
+// Decide which class a freshly-parsed request belongs to.
+static RequestClass ClassifyRequest(const HttpRequest& req);
+
+// Given a request, produce a response.  Queries run against "engine",
+// and their results are cached if "cache" is still at "generation".
 static HttpResponse ProcessRequest(const HttpRequest& req,
                             const string& base_dir,
-                            const list<string>& indices);
+                            const QueryEngine& engine,
+                            QueryCache* cache, uint64_t generation);
+
+// Run a static file or query request inside its lane, producing either
+// the real response or a "503 Service Unavailable" if the lane is full.
+static HttpResponse ProcessRequestInLane(const HttpRequest& req,
+                                  const HttpServerTask& hst,
+                                  RequestLane* lane);
+
+// Produce a plain-text report of the per-lane statistics.
+static HttpResponse ProcessStatsRequest(const HttpServerTask& hst);
+
+// Carry out an admin request ("/admin/reload" reloads the indices; see
+// HttpServer::RequestReload()), answering it with a plain-text report.
+static HttpResponse ProcessAdminRequest(const HttpRequest& req,
+                                        const HttpServerTask& hst);
+
+// Returns true if "addr", as ServerSocket::Accept() formats client
+// addresses, is a loopback address.
+static bool IsLoopbackAddress(const string& addr);
 
 // Process a file request.
 static HttpResponse ProcessFileRequest(const string& uri,
                                 const string& base_dir);
 
-// Process a query request.
+// Process a query request, answering it from "cache" if possible.
 static HttpResponse ProcessQueryRequest(const string& uri,
-                                 const list<string>& indices);
+                                 const QueryEngine& engine,
+                                 QueryCache* cache, uint64_t generation);
+
+// Returns the page of "k" ranked results that starts "offset" results
+// into the ranking of "query", from "cache" if it has them and
+// otherwise from "engine" (in which case they are offered to the
+// cache, as of "generation").
+static QueryCache::Results RunQuery(const vector<string>& query,
+                                    size_t offset, size_t k,
+                                    const QueryEngine& engine,
+                                    QueryCache* cache, uint64_t generation);
+
+// Returns the value of the URL argument "name" as a positive number,
+// or "default_value" if it is missing or isn't one.
+static size_t PositiveArg(const map<string, string>& args,
+                          const string& name, size_t default_value);
+
+// Returns a link to page "page" of the results for "query", with
+// "per_page" results on each page.
+static string PageLink(const string& query, size_t page, size_t per_page,
+                       const string& text);
+
+// Frees the engines in "engines", which "lock" (held on entry and on
+// return) guards, leaving it empty.  The lock is let go of while they
+// are freed.
+static void FreeEngines(vector<const QueryEngine*>* const engines,
+                        pthread_mutex_t* const lock);
+
+// Flushes the directory holding "file_name" to disk, so that a file
+// renamed into it stays renamed after a crash.  Returns false if the
+// directory couldn't be opened or flushed.
+static bool SyncDirectoryOf(const string& file_name);
 
 
 ///////////////////////////////////////////////////////////////////////////////
 // HttpServer
 ///////////////////////////////////////////////////////////////////////////////
+struct HttpServer::EngineOwner {
+  EngineOwner() : server(nullptr) {
+    Verify333(pthread_mutex_init(&lock, nullptr) == 0);
+  }
+  ~EngineOwner() {
+    Verify333(pthread_mutex_destroy(&lock) == 0);
+  }
+
+  // The server, or null once it is being destroyed.  lock guards it,
+  // and is held while a deleter hands an engine to the server, so that
+  // the server can't go away in the middle of it.
+  pthread_mutex_t lock;
+  HttpServer* server;
+};
+
+HttpServer::HttpServer(uint16_t port, const string& static_file_dir_path,
+                       const list<string>& indices,
+                       const IndexReaderOptions& index_options,
+                       uint32_t query_fanout, uint32_t compact_seconds,
+                       Verification verification)
+  : socket_(port), static_file_dir_path_(static_file_dir_path),
+    index_options_(index_options), query_fanout_(query_fanout),
+    compact_seconds_(compact_seconds), verification_(verification),
+    indices_(indices), owner_(std::make_shared<EngineOwner>()),
+    engine_(NewEngine(indices)), reloads_(0), failed_reloads_(0),
+    maintenance_running_(false), stopping_(false),
+    reloads_requested_(0), reloads_done_(0), last_reload_ok_(false),
+    cache_(kQueryCacheBytes, kQueryCacheShards),
+    static_lane_("static", kStaticLaneWorkers, kStaticLaneQueueLimit),
+    query_lane_("query", kQueryLaneWorkers, kQueryLaneQueueLimit) {
+  Verify333(pthread_mutex_init(&engine_lock_, nullptr) == 0);
+  Verify333(pthread_mutex_init(&maintenance_lock_, nullptr) == 0);
+  Verify333(pthread_cond_init(&maintenance_cond_, nullptr) == 0);
+  Verify333(pthread_cond_init(&reload_cond_, nullptr) == 0);
+  owner_->server = this;
+  if (compact_seconds_ > 0) {
+    indices_ = FindSegments();
+    engine_ = NewEngine(indices_);
+  }
+}
+
+HttpServer::~HttpServer() {
+  // Engines that are let go of from here on are freed by their deleters.
+  Verify333(pthread_mutex_lock(&owner_->lock) == 0);
+  owner_->server = nullptr;
+  Verify333(pthread_mutex_unlock(&owner_->lock) == 0);
+  if (maintenance_running_) {
+    Verify333(pthread_mutex_lock(&maintenance_lock_) == 0);
+    stopping_ = true;
+    Verify333(pthread_cond_signal(&maintenance_cond_) == 0);
+    Verify333(pthread_cond_broadcast(&reload_cond_) == 0);
+    Verify333(pthread_mutex_unlock(&maintenance_lock_) == 0);
+    Verify333(pthread_join(maintenance_, nullptr) == 0);
+  }
+  Verify333(pthread_cond_destroy(&reload_cond_) == 0);
+  Verify333(pthread_cond_destroy(&maintenance_cond_) == 0);
+  Verify333(pthread_mutex_destroy(&maintenance_lock_) == 0);
+  Verify333(pthread_mutex_destroy(&engine_lock_) == 0);
+}
+
 bool HttpServer::Run(void) {
+  // Open the indices up front, so that queries don't have to.  Nothing
+  // else has the engine yet, so it can still be opened in place.
+  // Checksumming reads every byte of every index, so it can be left
+  // for later.
+  bool verify_now = verification_ == kVerifyAtStartup;
+  cout << "  opening the search indices..." << endl;
+  if (!std::const_pointer_cast<QueryEngine>(engine_)->Open(verify_now)) {
+    cerr << endl << "Couldn't open the search indices." << endl;
+    return false;
+  }
+  // The maintenance thread always runs, to do any reloads asked for.
+  if (!verify_now) {
+    cout << "  verifying the search indices in the background..." << endl;
+  }
+  if (compact_seconds_ > 0) {
+    cout << "  compacting index segments every " << compact_seconds_
+         << " seconds..." << endl;
+  }
+  Verify333(pthread_mutex_lock(&maintenance_lock_) == 0);
+  Verify333(pthread_create(&maintenance_, nullptr, &MaintenanceThread,
+                           this) == 0);
+  maintenance_running_ = true;
+  Verify333(pthread_mutex_unlock(&maintenance_lock_) == 0);
+
   // Create the server listening socket.
   int listen_fd;
   cout << "  creating and binding the listening socket..." << endl;
@@ -99,7 +277,10 @@ bool HttpServer::Run(void) {
   while (1) {
     HttpServerTask* hst = new HttpServerTask(HttpServer_ThrFn);
     hst->base_dir = static_file_dir_path_;
-    hst->indices = &indices_;
+    hst->server = this;
+    hst->cache = &cache_;
+    hst->static_lane = &static_lane_;
+    hst->query_lane = &query_lane_;
     if (!socket_.Accept(&hst->client_fd,
                     &hst->c_addr,
                     &hst->c_port,
@@ -116,6 +297,277 @@ bool HttpServer::Run(void) {
   return true;
 }
 
+shared_ptr<const QueryEngine> HttpServer::engine() const {
+  Verify333(pthread_mutex_lock(&engine_lock_) == 0);
+  shared_ptr<const QueryEngine> engine = engine_;
+  Verify333(pthread_mutex_unlock(&engine_lock_) == 0);
+  return engine;
+}
+
+bool HttpServer::CompactSegments() {
+  if (indices_.size() < 2) {
+    return false;
+  }
+  uint64_t start = RequestLane::NowMicros();
+
+  // The merge writes a version 3 index, so it can only take version 3
+  // segments (see MergeIndexFiles()); older ones have to be rebuilt.
+  // (The engine is let go of before it might have to be retired.)
+  {
+    shared_ptr<const QueryEngine> current = engine();
+    for (const unique_ptr<IndexReader>& index : current->indices()) {
+      if (index->format_version() < 3) {
+        cerr << "  can't compact " << index->file_name() << ", a version "
+             << index->format_version() << " index; rebuild it with"
+             << " buildindex" << endl;
+        return false;
+      }
+    }
+  }
+
+  // Merge oldest first, so that the deltas win, into a file next to the
+  // base, which then replaces the base in one rename.  The old engine
+  // keeps the old base open (or mapped, or loaded) until the last query
+  // using it is done.
+  vector<string> segments(indices_.rbegin(), indices_.rend());
+  const string& base = segments.front();
+  string merged = base + ".compacting";
+  MergeStats stats;
+  if (MergeIndexFiles(segments, merged.c_str(), 3, &stats) == 0) {
+    cerr << "  couldn't compact the index segments into " << base << endl;
+    return false;
+  }
+  if (rename(merged.c_str(), base.c_str()) != 0) {
+    unlink(merged.c_str());
+    cerr << "  couldn't replace " << base << endl;
+    return false;
+  }
+
+  // The merged file was flushed to disk before it was closed; once the
+  // rename is too, the deltas it holds can go.  If the rename can't be
+  // made durable, the deltas stay, and are merged again next time.
+  if (!SyncDirectoryOf(base)) {
+    cerr << "  couldn't flush the rename of " << base << endl;
+    return false;
+  }
+  shared_ptr<QueryEngine> engine = NewEngine(list<string>{base});
+  if (!engine->Open(true)) {
+    cerr << "  couldn't open the compacted index " << base << endl;
+    return false;
+  }
+
+  SwapEngine(engine, list<string>{base});
+  for (size_t i = 1; i < segments.size(); i++) {
+    unlink(segments[i].c_str());
+  }
+
+  cout << "  compacted " << segments.size() << " index segments into "
+       << base << ": " << stats.docs_out << " documents ("
+       << stats.docs_in - stats.docs_out << " dropped) in "
+       << (RequestLane::NowMicros() - start) / 1000 << " ms" << endl;
+  return true;
+}
+
+bool HttpServer::VerifyIndices() {
+  uint64_t start = RequestLane::NowMicros();
+  shared_ptr<const QueryEngine> current = engine();
+  list<string> good;
+  for (const unique_ptr<IndexReader>& index : current->indices()) {
+    if (index->VerifyChecksum()) {
+      good.push_back(index->file_name());
+    } else {
+      cerr << "  index file \"" << index->file_name() << "\" is corrupt;"
+           << " no longer querying it" << endl;
+    }
+  }
+  if (good.size() == current->indices().size()) {
+    cout << "  verified " << good.size() << " index files in "
+         << (RequestLane::NowMicros() - start) / 1000 << " ms" << endl;
+    return true;
+  }
+
+  // The good indices were just checksummed, so needn't be again.
+  shared_ptr<QueryEngine> engine = NewEngine(good);
+  if (!engine->Open(false)) {
+    cerr << "  couldn't reopen the good index files" << endl;
+    return false;
+  }
+  SwapEngine(engine, good);
+  return false;
+}
+
+bool HttpServer::ReloadIndices() {
+  uint64_t start = RequestLane::NowMicros();
+  list<string> indices = compact_seconds_ > 0 ? FindSegments() : indices_;
+  shared_ptr<QueryEngine> engine = NewEngine(indices);
+  bool opened = engine->Open(true);
+  Verify333(pthread_mutex_lock(&engine_lock_) == 0);
+  if (opened) {
+    reloads_++;
+  } else {
+    failed_reloads_++;
+  }
+  Verify333(pthread_mutex_unlock(&engine_lock_) == 0);
+  if (!opened) {
+    cerr << "  couldn't reload the search indices;"
+         << " still querying the old ones" << endl;
+    return false;
+  }
+
+  SwapEngine(engine, indices);
+  cout << "  reloaded " << indices.size() << " index files in "
+       << (RequestLane::NowMicros() - start) / 1000 << " ms" << endl;
+  return true;
+}
+
+bool HttpServer::RequestReload() {
+  Verify333(pthread_mutex_lock(&maintenance_lock_) == 0);
+  if (!maintenance_running_) {
+    // Nobody would ever do the reload.
+    Verify333(pthread_mutex_unlock(&maintenance_lock_) == 0);
+    return false;
+  }
+  uint64_t ticket = ++reloads_requested_;
+  Verify333(pthread_cond_signal(&maintenance_cond_) == 0);
+  while (!stopping_ && reloads_done_ < ticket) {
+    Verify333(pthread_cond_wait(&reload_cond_, &maintenance_lock_) == 0);
+  }
+  bool ok = reloads_done_ >= ticket && last_reload_ok_;
+  Verify333(pthread_mutex_unlock(&maintenance_lock_) == 0);
+  return ok;
+}
+
+string HttpServer::StatsString() const {
+  Verify333(pthread_mutex_lock(&engine_lock_) == 0);
+  size_t num_indices = engine_->indices().size();
+  uint64_t reloads = reloads_, failed_reloads = failed_reloads_;
+  Verify333(pthread_mutex_unlock(&engine_lock_) == 0);
+
+  stringstream ss;
+  ss << "indices: files=" << num_indices
+     << " reloads=" << reloads
+     << " failed_reloads=" << failed_reloads;
+  return ss.str();
+}
+
+list<string> HttpServer::FindSegments() const {
+  const string& base = indices_.back();
+  vector<string> named;
+  if (!ListSegments(base, &named)) {
+    return indices_;
+  }
+  list<string> segments(named.rbegin(), named.rend() - 1);
+  for (const string& index : indices_) {
+    struct stat st;
+    if (index != base &&
+        std::find(named.begin(), named.end(), index) == named.end() &&
+        stat(index.c_str(), &st) == 0) {
+      segments.push_back(index);
+    }
+  }
+  segments.push_back(base);
+  return segments;
+}
+
+void HttpServer::SwapEngine(const shared_ptr<const QueryEngine>& engine,
+                            const list<string>& indices) {
+  // Swap the engine in, and only then forget the results of the old
+  // one, so that no query against the old engine can fill the cache
+  // back up after it has been emptied (see QueryCache::Insert()).  Our
+  // reference to the old engine is let go of outside the lock.
+  Verify333(pthread_mutex_lock(&engine_lock_) == 0);
+  shared_ptr<const QueryEngine> old = engine_;
+  engine_ = engine;
+  Verify333(pthread_mutex_unlock(&engine_lock_) == 0);
+  cache_.Invalidate();
+  indices_ = indices;
+}
+
+shared_ptr<QueryEngine> HttpServer::NewEngine(const list<string>& indices) {
+  shared_ptr<EngineOwner> owner = owner_;
+  return shared_ptr<QueryEngine>(
+      new QueryEngine(indices, index_options_, query_fanout_),
+      [owner](const QueryEngine* engine) {
+        Verify333(pthread_mutex_lock(&owner->lock) == 0);
+        HttpServer* server = owner->server;
+        if (server != nullptr) {
+          server->RetireEngine(engine);
+        }
+        Verify333(pthread_mutex_unlock(&owner->lock) == 0);
+        if (server == nullptr) {
+          delete engine;
+        }
+      });
+}
+
+void HttpServer::RetireEngine(const QueryEngine* engine) {
+  Verify333(pthread_mutex_lock(&maintenance_lock_) == 0);
+  bool handed_off = maintenance_running_ && !stopping_;
+  if (handed_off) {
+    retired_.push_back(engine);
+    Verify333(pthread_cond_signal(&maintenance_cond_) == 0);
+  }
+  Verify333(pthread_mutex_unlock(&maintenance_lock_) == 0);
+  if (!handed_off) {
+    delete engine;
+  }
+}
+
+void* HttpServer::MaintenanceThread(void* arg) {
+  HttpServer* server = static_cast<HttpServer*>(arg);
+  if (server->verification_ == kVerifyInBackground) {
+    server->VerifyIndices();
+  }
+  Verify333(pthread_mutex_lock(&server->maintenance_lock_) == 0);
+  struct timespec deadline;
+  Verify333(clock_gettime(CLOCK_REALTIME, &deadline) == 0);
+  deadline.tv_sec += server->compact_seconds_;
+  while (!server->stopping_) {
+    // Sleep until a reload is asked for, an engine is retired or, if
+    // compaction is on, the next compaction is due.  Neither reloads nor
+    // retirements push compactions back.
+    bool compact_due = false;
+    while (!server->stopping_ && !compact_due &&
+           server->reloads_done_ == server->reloads_requested_ &&
+           server->retired_.empty()) {
+      if (server->compact_seconds_ == 0) {
+        Verify333(pthread_cond_wait(&server->maintenance_cond_,
+                                    &server->maintenance_lock_) == 0);
+      } else {
+        compact_due = pthread_cond_timedwait(&server->maintenance_cond_,
+                                             &server->maintenance_lock_,
+                                             &deadline) != 0;
+      }
+    }
+    if (server->stopping_) {
+      break;
+    }
+
+    if (!server->retired_.empty()) {
+      FreeEngines(&server->retired_, &server->maintenance_lock_);
+    } else if (server->reloads_done_ < server->reloads_requested_) {
+      // Everyone who has asked so far gets this reload.
+      uint64_t reloads_requested = server->reloads_requested_;
+      Verify333(pthread_mutex_unlock(&server->maintenance_lock_) == 0);
+      bool ok = server->ReloadIndices();
+      Verify333(pthread_mutex_lock(&server->maintenance_lock_) == 0);
+      server->reloads_done_ = reloads_requested;
+      server->last_reload_ok_ = ok;
+      Verify333(pthread_cond_broadcast(&server->reload_cond_) == 0);
+    } else {
+      Verify333(pthread_mutex_unlock(&server->maintenance_lock_) == 0);
+      server->CompactSegments();
+      Verify333(pthread_mutex_lock(&server->maintenance_lock_) == 0);
+      Verify333(clock_gettime(CLOCK_REALTIME, &deadline) == 0);
+      deadline.tv_sec += server->compact_seconds_;
+    }
+  }
+  // RetireEngine() frees engines itself from here on.
+  FreeEngines(&server->retired_, &server->maintenance_lock_);
+  Verify333(pthread_mutex_unlock(&server->maintenance_lock_) == 0);
+  return nullptr;
+}
+
 static void HttpServer_ThrFn(ThreadPool::Task* t) {
   // Cast back our HttpServerTask structure with all of our new
   // client's information in it.
@@ -147,9 +599,24 @@ static void HttpServer_ThrFn(ThreadPool::Task* t) {
       break;
     }
 
-    // proccess request
-    HttpResponse this_response = ProcessRequest(this_request, hst->base_dir,
-                                                *hst->indices);
+    // classify the request and process it in the appropriate lane
+    HttpResponse this_response;
+    switch (ClassifyRequest(this_request)) {
+      case kStaticRequest:
+        this_response = ProcessRequestInLane(this_request, *hst,
+                                             hst->static_lane);
+        break;
+      case kQueryRequest:
+        this_response = ProcessRequestInLane(this_request, *hst,
+                                             hst->query_lane);
+        break;
+      case kStatsRequest:
+        this_response = ProcessStatsRequest(*hst);
+        break;
+      case kAdminRequest:
+        this_response = ProcessAdminRequest(this_request, *hst);
+        break;
+    }
 
     // write the response
     if (!client_connection.WriteResponse(this_response)) {
@@ -158,16 +625,110 @@ static void HttpServer_ThrFn(ThreadPool::Task* t) {
   }
 }
 
+static RequestClass ClassifyRequest(const HttpRequest& req) {
+  if (req.uri().substr(0, 8) == "/static/") {
+    return kStaticRequest;
+  }
+  if (req.uri() == "/stats") {
+    return kStatsRequest;
+  }
+  if (req.uri().substr(0, 7) == "/admin/") {
+    return kAdminRequest;
+  }
+  return kQueryRequest;
+}
+
+static HttpResponse ProcessRequestInLane(const HttpRequest& req,
+                                  const HttpServerTask& hst,
+                                  RequestLane* lane) {
+  if (!lane->Enter(nullptr)) {
+    // The lane's queue is full; shed the request rather than letting
+    // it pile up behind the others.
+    HttpResponse ret;
+    ret.set_protocol("HTTP/1.1");
+    ret.set_response_code(503);
+    ret.set_message("Service Unavailable");
+    ret.set_content_type("text/html");
+    ret.AppendToBody("<html><body>The server is busy; "
+                     "please try again later.</body></html>\n");
+    return ret;
+  }
+
+  uint64_t start = RequestLane::NowMicros();
+  // Note the cache's generation before picking up the engine, so that
+  // if the compactor swaps the engine out in between, the old engine's
+  // results aren't cached.
+  uint64_t generation = hst.cache->generation();
+  shared_ptr<const QueryEngine> engine = hst.server->engine();
+  HttpResponse ret = ProcessRequest(req, hst.base_dir, *engine, hst.cache,
+                                    generation);
+  lane->Exit(RequestLane::NowMicros() - start);
+  return ret;
+}
+
+static HttpResponse ProcessStatsRequest(const HttpServerTask& hst) {
+  HttpResponse ret;
+  ret.AppendToBody(hst.static_lane->StatsString() + "\n");
+  ret.AppendToBody(hst.query_lane->StatsString() + "\n");
+  ret.AppendToBody(hst.cache->StatsString() + "\n");
+  ret.AppendToBody(hst.server->StatsString() + "\n");
+  ret.set_content_type("text/plain");
+  ret.set_response_code(200);
+  ret.set_protocol("HTTP/1.1");
+  ret.set_message("Success");
+  return ret;
+}
+
+static HttpResponse ProcessAdminRequest(const HttpRequest& req,
+                                        const HttpServerTask& hst) {
+  HttpResponse ret;
+  ret.set_content_type("text/plain");
+  ret.set_protocol("HTTP/1.1");
+  if (!IsLoopbackAddress(hst.c_addr)) {
+    ret.set_response_code(403);
+    ret.set_message("Forbidden");
+    ret.AppendToBody("admin requests must come from this host\n");
+    return ret;
+  }
+  if (req.uri() != "/admin/reload") {
+    ret.set_response_code(404);
+    ret.set_message("Not Found");
+    ret.AppendToBody("unknown admin request\n");
+    return ret;
+  }
+
+  // Queries carry on in the lanes while the maintenance thread reloads.
+  if (!hst.server->RequestReload()) {
+    ret.set_response_code(500);
+    ret.set_message("Internal Server Error");
+    ret.AppendToBody("reload failed; still querying the old indices\n");
+    return ret;
+  }
+  ret.set_response_code(200);
+  ret.set_message("Success");
+  ret.AppendToBody("reloaded\n");
+  ret.AppendToBody(hst.server->StatsString() + "\n");
+  return ret;
+}
+
+static bool IsLoopbackAddress(const string& addr) {
+  // The listening socket is IPv6, so IPv4 clients show up as
+  // IPv4-mapped addresses.
+  return addr == "::1" || addr.substr(0, 4) == "127." ||
+      addr.substr(0, 11) == "::ffff:127.";
+}
+
 static HttpResponse ProcessRequest(const HttpRequest& req,
                             const string& base_dir,
-                            const list<string>& indices) {
+                            const QueryEngine& engine,
+                            QueryCache* cache, uint64_t generation) {
   // Is the user asking for a static file?
-  if (req.uri().substr(0, 8) == "/static/") {
+  if (ClassifyRequest(req) == kStaticRequest) {
     return ProcessFileRequest(req.uri(), base_dir);
   }
 
   // The user must be asking for a query.
-  return ProcessQueryRequest(req.uri(), indices);
+  return ProcessQueryRequest(req.uri(), engine, cache, generation);
 }
 
 static HttpResponse ProcessFileRequest(const string& uri,
@@ -252,7 +813,8 @@ static HttpResponse ProcessFileRequest(const string& uri,
 }
 
 static HttpResponse ProcessQueryRequest(const string& uri,
-                                 const list<string>& indices) {
+                                 const QueryEngine& engine,
+                                 QueryCache* cache, uint64_t generation) {
   // The response we're building up.
   HttpResponse ret;
 
@@ -269,8 +831,10 @@ static HttpResponse ProcessQueryRequest(const string& uri,
   //    search terms from a typed-in search query.  convert them
   //    to lower case.
   //
-  // 4. Initialize and use hw3::QueryProcessor to process queries with the
-  //    search indices.
+  // 4. Use the server's shared QueryEngine to process queries with the
+  //    search indices, unless the QueryCache already has the answer.
+  //    Only one page of results ("page" and "per_page" in the URI) is
+  //    ranked and shown at a time, with links to the pages around it.
   //
   // 5. With your results, try figuring out how to hyperlink results to file
   //    contents, like in solution_binaries/http333d. (Hint: Look into HTML
@@ -292,21 +856,43 @@ static HttpResponse ProcessQueryRequest(const string& uri,
       // get terms of search from URI
       string query = terms_itr->second;
 
-      // convert to lowercase
-      boost::algorithm::to_lower(query);
-
-      // split terms based on " " delimiter
+      // split terms based on " " delimiter, and convert them to
+      // lowercase, except for the boolean operators (a lowercase "or"
+      // is just a word)
       vector<string> query_vector;
       boost::algorithm::split(query_vector, query, boost::is_any_of(" "),
                               boost::token_compress_on);
+      for (string& term : query_vector) {
+        if (!QueryEngine::IsBooleanOperator(term)) {
+          boost::algorithm::to_lower(term);
+        }
+      }
+      query = boost::algorithm::join(query_vector, " ");
+
+      // work out which page of results is wanted; pages count from 1
+      size_t per_page = std::min(
+          PositiveArg(args, "per_page", kDefaultResultsPerPage),
+          kMaxResultsPerPage);
+      size_t page_num = PositiveArg(args, "page", 1);
+      size_t offset = (page_num - 1) * per_page;
+      if (offset / per_page != page_num - 1) {
+        offset = SIZE_MAX;   // so far past the end that nothing is there
+      }
 
-      // process query
-      QueryProcessor query_processor(indices);
-      vector<QueryProcessor::QueryResult> results
-            = query_processor.ProcessQuery(query_vector);
+      // process query; with "debug=1", bypass the cache and report how
+      // the engine planned the query in an X-Query-Plan header
+      QueryCache::Results page;
+      if (PositiveArg(args, "debug", 0) == 1) {
+        page = std::make_shared<const QueryEngine::ResultPage>(
+            engine.ProcessQuery(query_vector, offset, per_page, true));
+        ret.AddHeader("X-Query-Plan", page->plan);
+      } else {
+        page = RunQuery(query_vector, offset, per_page, engine, cache,
+                        generation);
+      }
 
       stringstream num_results_stream;
-      num_results_stream << results.size();
+      num_results_stream << page->total;
       string num_results;
       num_results_stream >> num_results;
 
@@ -317,7 +903,8 @@ static HttpResponse ProcessQueryRequest(const string& uri,
       ret.AppendToBody("</b>\n<p>");
 
       // add hyperlinked search results to body of response
-      vector<QueryProcessor::QueryResult>::iterator itr = results.begin();
+      const vector<QueryEngine::QueryResult>& results = page->results;
+      vector<QueryEngine::QueryResult>::const_iterator itr = results.begin();
       ret.AppendToBody("<ul>");
       while (itr != results.end()) {
         ret.AppendToBody("<li> <a href = \"/static/" +
@@ -333,6 +920,26 @@ static HttpResponse ProcessQueryRequest(const string& uri,
         itr++;
       }
       ret.AppendToBody("</ul>\n");
+
+      // and links to the neighbouring pages, if there are any
+      bool has_prev = page_num > 1 && offset < page->total;
+      bool has_next = offset < page->total &&
+                      page->total - offset > per_page;
+      if (has_prev || has_next) {
+        ret.AppendToBody("<p>");
+        if (has_prev) {
+          ret.AppendToBody(PageLink(query, page_num - 1, per_page,
+                                    "&lt; Previous"));
+        }
+        if (has_prev && has_next) {
+          ret.AppendToBody(" | ");
+        }
+        if (has_next) {
+          ret.AppendToBody(PageLink(query, page_num + 1, per_page,
+                                    "Next &gt;"));
+        }
+        ret.AppendToBody("\n");
+      }
     }
   }  // end if
 
@@ -346,4 +953,69 @@ static HttpResponse ProcessQueryRequest(const string& uri,
   return ret;
 }
 
+static QueryCache::Results RunQuery(const vector<string>& query,
+                                    size_t offset, size_t k,
+                                    const QueryEngine& engine,
+                                    QueryCache* cache, uint64_t generation) {
+  uint64_t start = RequestLane::NowMicros();
+  string key = QueryCache::PageKey(query, offset, k);
+  QueryCache::Results results = cache->Lookup(key);
+  if (results != nullptr) {
+    cache->RecordLatency(true, RequestLane::NowMicros() - start);
+    return results;
+  }
+
+  results = std::make_shared<const QueryEngine::ResultPage>(
+      engine.ProcessQuery(query, offset, k));
+  cache->Insert(key, generation, results);
+  cache->RecordLatency(false, RequestLane::NowMicros() - start);
+  return results;
+}
+
+static size_t PositiveArg(const map<string, string>& args,
+                          const string& name, size_t default_value) {
+  map<string, string>::const_iterator it = args.find(name);
+  if (it == args.end()) {
+    return default_value;
+  }
+  char* end;
+  unsigned long long value = strtoull(it->second.c_str(), &end, 10);
+  if (it->second.empty() || *end != '\0' || value == 0 ||
+      it->second[0] == '-') {
+    return default_value;
+  }
+  return static_cast<size_t>(value);
+}
+
+static string PageLink(const string& query, size_t page, size_t per_page,
+                       const string& text) {
+  return "<a href=\"/query?terms=" + URIEncode(query) +
+         "&amp;page=" + std::to_string(page) +
+         "&amp;per_page=" + std::to_string(per_page) + "\">" + text + "</a>";
+}
+
+static void FreeEngines(vector<const QueryEngine*>* const engines,
+                        pthread_mutex_t* const lock) {
+  vector<const QueryEngine*> doomed;
+  doomed.swap(*engines);
+  Verify333(pthread_mutex_unlock(lock) == 0);
+  for (const QueryEngine* engine : doomed) {
+    delete engine;
+  }
+  Verify333(pthread_mutex_lock(lock) == 0);
+}
+
+static bool SyncDirectoryOf(const string& file_name) {
+  size_t slash = file_name.rfind('/');
+  string dir = slash == string::npos ? "." :
+               slash == 0 ? "/" : file_name.substr(0, slash);
+  int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY);
+  if (fd == -1) {
+    return false;
+  }
+  bool ok = fsync(fd) == 0;
+  close(fd);
+  return ok;
+}
+
 }  // namespace hw4
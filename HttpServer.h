@@ -12,10 +12,16 @@
 #ifndef HW4_HTTPSERVER_H_
 #define HW4_HTTPSERVER_H_
 
+#include <pthread.h>
 #include <stdint.h>
-#include <string>
 #include <list>
+#include <memory>
+#include <string>
+#include <vector>
 
+#include "./QueryCache.h"
+#include "./QueryEngine.h"
+#include "./RequestLane.h"
 #include "./ThreadPool.h"
 #include "./ServerSocket.h"
 
@@ -24,22 +30,48 @@ namespace hw4 {
 // The HttpServer class contains the main logic for the web server.
 class HttpServer {
  public:
+  // When the server checks the indices' checksums:
+  //  - kVerifyAtStartup: as it opens them, before it accepts any
+  //    connections, so a corrupt index keeps the server from starting.
+  //  - kVerifyInBackground: on a background thread once the server is
+  //    up; queries are answered meanwhile, and an index that turns out
+  //    to be corrupt is dropped (see VerifyIndices()).
+  enum Verification { kVerifyAtStartup, kVerifyInBackground };
+
   // Creates a new HttpServer object for port "port" and serving
   // files out of path "static_file_dir_path".  The indices for
-  // query processing are located in the "indices" list. The constructor
-  // does not do anything except memorize these variables.
+  // query processing are located in the "indices" list, and are read
+  // as "index_options" says; each query is spread across up to
+  // "query_fanout" threads (see QueryEngine).
+  //
+  // If "compact_seconds" isn't 0, the indices are taken to be the
+  // segments of one index, newest first as QueryEngine expects: delta
+  // indices (see kTombstoneSection in IndexWriter.h) on top of the
+  // base index at the end of the list.  Deltas on disk that are named
+  // for the base (see ListSegments() in IndexBuilder.h) join the list,
+  // and are looked for again on every reload.  Every "compact_seconds"
+  // seconds, a background thread folds any deltas into the base (see
+  // CompactSegments()).  The indices' checksums are verified as
+  // "verification" says.
+  //
+  // The constructor does not do anything except memorize these
+  // variables (looking for the deltas named for the base, if compaction
+  // is on) and set up the (empty) request lanes.
   explicit HttpServer(uint16_t port,
                       const std::string& static_file_dir_path,
-                      const std::list<std::string>& indices)
-    : socket_(port), static_file_dir_path_(static_file_dir_path),
-      indices_(indices) { }
+                      const std::list<std::string>& indices,
+                      const IndexReaderOptions& index_options =
+                        IndexReaderOptions(),
+                      uint32_t query_fanout = 1,
+                      uint32_t compact_seconds = 0,
+                      Verification verification = kVerifyAtStartup);
 
-  // The destructor closes the listening socket if it is open and
-  // also terminates any threads in the threadpool.
-  virtual ~HttpServer() { }
+  // The destructor stops the maintenance thread.
+  virtual ~HttpServer();
 
-  // Creates a listening socket for the server and launches it, accepting
-  // connections and dispatching them to worker threads.
+  // Opens the search indices, then creates a listening socket for the
+  // server and launches it, accepting connections and dispatching them
+  // to worker threads.
   //
   // Returns: true if the server was able to start and run and false otherwise.
   //
@@ -47,11 +79,149 @@ class HttpServer {
   // a SIGTERM signal to the server process (i.e., kill pid, ctrl+C).
   bool Run();
 
+  // Returns the query engine that new queries should use.  A query
+  // holds on to the engine it got for as long as it runs, so that the
+  // engine can be swapped out from under it; an engine that has been
+  // swapped out is freed once the last query lets go of it (see
+  // RetireEngine()).
+  std::shared_ptr<const QueryEngine> engine() const;
+
+  // Folds the delta indices into the base index: merges all of the
+  // indices into a new file (see MergeIndexFiles()), renames it over
+  // the base, swaps in an engine that queries just the base, empties
+  // the query cache, and deletes the deltas.  Queries keep running
+  // against the old engine meanwhile.  Returns false (and leaves the
+  // indices as they were) if there are no deltas or the merge fails.
+  bool CompactSegments();
+
+  // Verifies the checksum of each index the current engine queries
+  // (see IndexReader::VerifyChecksum()).  If any are corrupt, swaps in
+  // an engine without them and empties the query cache.  Returns false
+  // if any were corrupt.
+  bool VerifyIndices();
+
+  // Reopens the index files from scratch, checksums them, and swaps in
+  // an engine that queries them, so that an index rebuilt and renamed
+  // over its old file name starts being queried.  If compaction is on,
+  // the segments are looked for again first (see FindSegments()), so
+  // that the deltas deltaindex has written since start being queried
+  // too.  Queries keep running
+  // against the old engine meanwhile, and the old engine is freed once
+  // the last of them is done with it; the reload doesn't wait for that.
+  // Returns false (and keeps the old engine) if any of the indices
+  // can't be opened or is corrupt.
+  bool ReloadIndices();
+
+  // Asks the maintenance thread to ReloadIndices(), and waits for it to
+  // finish.  Any number of threads can ask at once; requests that come
+  // in while a reload is waiting to start share it.  Returns whether
+  // the reload worked, or false if the server is stopping or hasn't
+  // been Run() yet.
+  bool RequestReload();
+
+  // Returns a one-line, human-readable summary of the indices being
+  // queried and of the reloads so far.
+  std::string StatsString() const;
+
  private:
+  // Swaps "engine", which queries "indices", in for the current engine,
+  // and empties the query cache.  Queries may still be using the old
+  // engine; it is freed when the last of them lets go of it.
+  void SwapEngine(const std::shared_ptr<const QueryEngine>& engine,
+                  const std::list<std::string>& indices);
+
+  // Returns the segments the indices now consist of, newest first: the
+  // deltas on disk that are named for the base index (see
+  // ListSegments() in IndexBuilder.h), newest first, then the rest of
+  // the current indices that are still there, ending with the base.
+  std::list<std::string> FindSegments() const;
+
+  // Returns a new, unopened engine for "indices".  When the last
+  // reference to it goes away, it is handed to RetireEngine() rather
+  // than deleted there and then.
+  std::shared_ptr<QueryEngine> NewEngine(
+      const std::list<std::string>& indices);
+
+  // Frees "engine", which nothing uses any more.  If the maintenance
+  // thread is running, it is handed to that thread to free, so that it
+  // is closed (or unmapped, or unloaded) there rather than on whichever
+  // worker thread let go of it last; otherwise it is freed right away.
+  void RetireEngine(const QueryEngine* engine);
+
+  // What an engine's deleter reaches the server through.  It outlives
+  // the server if an engine does, and then frees engines itself.
+  struct EngineOwner;
+
+  // The maintenance thread's start routine; "arg" is the HttpServer.
+  // The thread verifies the indices if that was left for the
+  // background, and then does any reloads that are asked for and, if
+  // compaction is on, compacts the segments every compact_seconds_
+  // seconds.
+  static void* MaintenanceThread(void* arg);
+
   ServerSocket socket_;
   std::string static_file_dir_path_;
+  IndexReaderOptions index_options_;
+  uint32_t query_fanout_;
+  uint32_t compact_seconds_;
+  Verification verification_;
+
+  // The index files, newest first.  Only Run(), before the maintenance
+  // thread starts, and the maintenance thread touch it.
   std::list<std::string> indices_;
+
+  // The query engine is opened when the server starts, and is shared
+  // (read-only) by all of the worker threads; the maintenance thread
+  // replaces it with a new one whenever the indices change.
+  // engine_lock_ guards the pointer itself, not the engine, and the
+  // reload counts.
+  std::shared_ptr<EngineOwner> owner_;
+  mutable pthread_mutex_t engine_lock_;
+  std::shared_ptr<const QueryEngine> engine_;
+  uint64_t reloads_;
+  uint64_t failed_reloads_;
+
+  // The maintenance thread, and what it waits on between compactions;
+  // stopping_ (guarded by maintenance_lock_, as is maintenance_running_)
+  // tells it to quit.
+  pthread_t maintenance_;
+  bool maintenance_running_;
+  pthread_mutex_t maintenance_lock_;
+  pthread_cond_t maintenance_cond_;
+  bool stopping_;
+
+  // RequestReload() bumps reloads_requested_ and waits on reload_cond_
+  // until the maintenance thread has caught reloads_done_ up to it;
+  // last_reload_ok_ is how the latest reload went.  All three are
+  // guarded by maintenance_lock_.
+  pthread_cond_t reload_cond_;
+  uint64_t reloads_requested_;
+  uint64_t reloads_done_;
+  bool last_reload_ok_;
+
+  // Engines that RetireEngine() has handed to the maintenance thread to
+  // free, guarded by maintenance_lock_.
+  std::vector<const QueryEngine*> retired_;
+
+  // Ranked results of recent queries, shared by all of the worker
+  // threads.
+  QueryCache cache_;
+
+  // Once a connection thread has parsed a request, it processes the
+  // request inside the lane for that request's class, so that slow
+  // queries can't hold up static file requests.  The lane budgets add
+  // up to less than kNumThreads, so there are always connection threads
+  // left over to read (and, if need be, shed) new requests.
+  RequestLane static_lane_;
+  RequestLane query_lane_;
+
   static const int kNumThreads;
+  static const int kStaticLaneWorkers;
+  static const int kStaticLaneQueueLimit;
+  static const int kQueryLaneWorkers;
+  static const int kQueryLaneQueueLimit;
+  static const size_t kQueryCacheBytes;
+  static const int kQueryCacheShards;
 };
 
 class HttpServerTask : public ThreadPool::Task {
@@ -63,7 +233,10 @@ class HttpServerTask : public ThreadPool::Task {
   uint16_t c_port;
   std::string c_addr, c_dns, s_addr, s_dns;
   std::string base_dir;
-  std::list<std::string>* indices;
+  HttpServer* server;
+  QueryCache* cache;
+  RequestLane* static_lane;
+  RequestLane* query_lane;
 };
 
 }  // namespace hw4
@@ -13,6 +13,7 @@
 // that come in useful throughput the assignment.
 
 #include <arpa/inet.h>
+#include <ctype.h>
 #include <errno.h>
 #include <limits.h>
 #include <netdb.h>
@@ -182,6 +183,24 @@ string URIDecode(const string& from) {
   return retstr;
 }
 
+// Replace every character that isn't unreserved in a URI with a
+// "%XY" token.
+string URIEncode(const string& from) {
+  static const char* kHexDigits = "0123456789ABCDEF";
+  string retstr;
+  for (unsigned int pos = 0; pos < from.length(); pos++) {
+    unsigned char c = from[pos];
+    if (isalnum(c) || c == '-' || c == '.' || c == '_' || c == '~') {
+      retstr.append(1, c);
+    } else {
+      retstr.append(1, '%');
+      retstr.append(1, kHexDigits[c >> 4]);
+      retstr.append(1, kHexDigits[c & 0xF]);
+    }
+  }
+  return retstr;
+}
+
 void URLParser::Parse(const string& url) {
   url_ = url;
 
@@ -59,6 +59,12 @@ std::string EscapeHtml(const std::string& from);
 //
 std::string URIDecode(const std::string& from);
 
+// This function performs URI encoding, the reverse of URIDecode():
+// every character other than an unreserved one (letters, digits, and
+// "-", ".", "_", "~") is replaced by "%" and its two-digit hex code.
+// Use it to build links whose arguments contain user input.
+std::string URIEncode(const std::string& from);
+
 // A URL that's part of a web request has the following structure:
 //
 //   /foo/bar/baz?field=value&field2=value2
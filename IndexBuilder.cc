@@ -0,0 +1,446 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <dirent.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./IndexBuilder.h"
+#include "./IndexReader.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+  #include "libhw1/HashTable.h"
+  #include "libhw2/FileParser.h"
+}
+
+using std::pair;
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+namespace hw4 {
+
+// Everything the threads of one crawl share.
+struct Crawl {
+  Crawl() : next(0), folded(0) {
+    Verify333(pthread_mutex_init(&lock, nullptr) == 0);
+    Verify333(pthread_cond_init(&cond, nullptr) == 0);
+  }
+  ~Crawl() {
+    Verify333(pthread_mutex_destroy(&lock) == 0);
+    Verify333(pthread_cond_destroy(&cond) == 0);
+  }
+
+  vector<string> files;   // every file in the tree, in crawl order
+
+  // Guards the fields below; cond is broadcast whenever a file is
+  // parsed or folded.  parsed[i] holds file i's word positions from
+  // when it is parsed until it is folded, and is null if it can't be
+  // read or has no words.
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  vector<HashTable*> parsed;
+  vector<bool> ready;     // ready[i]: file i has been parsed
+  size_t next;            // the next file to claim
+  size_t folded;          // how many files have been folded
+};
+
+// Appends the path of every regular file under directory "dir" to
+// "files", in the order that CrawlFileTree() visits them.
+static void ListFiles(const string& dir, vector<string>* const files);
+
+// Reads and parses file "file_name" into a table of its words'
+// positions.  Returns null if it can't be read or has no words.
+static HashTable* ParseFile(const string& file_name);
+
+// Fills "deltas" with the number and name of each delta named for base
+// index file "base" (see ListSegments()), in increasing order.  Returns
+// false if the directory that holds "base" can't be read.
+static bool FindDeltas(const string& base,
+                       vector<pair<uint64_t, string>>* const deltas);
+
+// If "crawl" has a file that may be claimed, claims it, parses it
+// (with the lock dropped), and returns true.  Must be called with
+// crawl->lock held.
+static bool ParseNextFile(Crawl* const crawl);
+
+// A helper thread's start routine: parses the files of the Crawl
+// "arg" until none are left to claim.
+static void* ParseFiles(void* arg);
+
+// Returns the hash ShardFiles() picks a file's shard by.
+static uint64_t ShardHash(const string& file_name);
+
+// One shard for ParallelParseShards() to index.
+struct ShardParse {
+  const vector<string>* files;
+  uint32_t num_threads;
+  DocTable* doctable;
+  MemIndex* index;
+};
+
+// The start routine of a ParallelParseShards() thread; indexes the
+// ShardParse "arg".
+static void* ParseShard(void* arg);
+
+// Adds the document "file_name" and its word positions "table" to
+// "doctable" and "index", and frees the table.
+static void FoldFile(const string& file_name, HashTable* table,
+                     DocTable* doctable, MemIndex* index);
+
+bool ParallelCrawlFileTree(const char* root_dir, uint32_t num_threads,
+                           DocTable** const doctable,
+                           MemIndex** const index) {
+  // Listing the tree is quick next to reading the files in it, so one
+  // thread does it up front.
+  vector<string> files;
+  if (!ListFileTree(root_dir, &files)) {
+    return false;
+  }
+  ParallelParseFiles(files, num_threads, doctable, index);
+  return true;
+}
+
+bool ListFileTree(const char* root_dir, vector<string>* const files) {
+  struct stat st;
+  if (stat(root_dir, &st) != 0 || !S_ISDIR(st.st_mode)) {
+    return false;
+  }
+  files->clear();
+  ListFiles(root_dir, files);
+  return true;
+}
+
+void ParallelParseFiles(const vector<string>& files, uint32_t num_threads,
+                        DocTable** const doctable, MemIndex** const index) {
+  Crawl crawl;
+  crawl.files = files;
+  size_t num_files = crawl.files.size();
+  crawl.parsed.assign(num_files, nullptr);
+  crawl.ready.assign(num_files, false);
+
+  uint32_t num_helpers = num_threads > 1 ? num_threads - 1 : 0;
+  if (num_helpers > num_files) {
+    num_helpers = num_files;
+  }
+  vector<pthread_t> helpers(num_helpers);
+  for (pthread_t& helper : helpers) {
+    Verify333(pthread_create(&helper, nullptr, &ParseFiles, &crawl) == 0);
+  }
+
+  *doctable = DocTable_Allocate();
+  *index = MemIndex_Allocate();
+  for (size_t i = 0; i < num_files; i++) {
+    Verify333(pthread_mutex_lock(&crawl.lock) == 0);
+    while (!crawl.ready[i]) {
+      // Rather than wait for whoever is parsing file i, parse
+      // something else.
+      if (!ParseNextFile(&crawl)) {
+        Verify333(pthread_cond_wait(&crawl.cond, &crawl.lock) == 0);
+      }
+    }
+    HashTable* table = crawl.parsed[i];
+    crawl.parsed[i] = nullptr;
+    crawl.folded = i + 1;
+    Verify333(pthread_cond_broadcast(&crawl.cond) == 0);
+    Verify333(pthread_mutex_unlock(&crawl.lock) == 0);
+
+    if (table != nullptr) {
+      FoldFile(crawl.files[i], table, *doctable, *index);
+    }
+  }
+
+  for (pthread_t& helper : helpers) {
+    Verify333(pthread_join(helper, nullptr) == 0);
+  }
+}
+
+void ShardFiles(const vector<string>& files, uint32_t num_shards,
+                ShardPartition partition,
+                vector<vector<string>>* const shards) {
+  if (num_shards == 0) {
+    num_shards = 1;
+  }
+  shards->assign(num_shards, vector<string>());
+  for (size_t i = 0; i < files.size(); i++) {
+    uint32_t shard = partition == kShardByRange ?
+        static_cast<uint32_t>(i * num_shards / files.size()) :
+        static_cast<uint32_t>(ShardHash(files[i]) % num_shards);
+    (*shards)[shard].push_back(files[i]);
+  }
+}
+
+void ParallelParseShards(const vector<vector<string>>& shards,
+                         uint32_t num_threads,
+                         vector<DocTable*>* const doctables,
+                         vector<MemIndex*>* const indices) {
+  // Each shard's thread folds that shard's files in, and parses with
+  // its share of the rest of the threads.
+  size_t num_shards = shards.size();
+  vector<ShardParse> parses(num_shards);
+  for (size_t i = 0; i < num_shards; i++) {
+    uint32_t share = num_threads / num_shards +
+                     (i < num_threads % num_shards ? 1 : 0);
+    parses[i] = {&shards[i], share > 0 ? share : 1, nullptr, nullptr};
+  }
+  vector<pthread_t> threads(num_shards > 0 ? num_shards - 1 : 0);
+  for (size_t i = 0; i < threads.size(); i++) {
+    Verify333(pthread_create(&threads[i], nullptr, &ParseShard,
+                             &parses[i + 1]) == 0);
+  }
+  if (num_shards > 0) {
+    ParseShard(&parses[0]);
+  }
+  for (pthread_t& thread : threads) {
+    Verify333(pthread_join(thread, nullptr) == 0);
+  }
+
+  doctables->clear();
+  indices->clear();
+  for (const ShardParse& parse : parses) {
+    doctables->push_back(parse.doctable);
+    indices->push_back(parse.index);
+  }
+}
+
+uint64_t CrawlStartTime() {
+  struct timespec now;
+  Verify333(clock_gettime(CLOCK_REALTIME, &now) == 0);
+  return now.tv_sec * UINT64_C(1000000000) + now.tv_nsec;
+}
+
+bool PlanDelta(const char* root_dir, const vector<string>& segments,
+               vector<string>* const changed,
+               vector<string>* const tombstones) {
+  vector<string> files;
+  if (!ListFileTree(root_dir, &files)) {
+    return false;
+  }
+
+  // Replay the segments, oldest first, to find the documents the index
+  // has a live copy of, and when the crawl that read each one started.
+  unordered_map<string, uint64_t> live;
+  IndexReaderOptions options;
+  options.backend = IndexReaderOptions::kPread;
+  vector<DocID_t> doc_ids;
+  string name;
+  for (const string& segment : segments) {
+    std::unique_ptr<IndexReader> reader(IndexReader::Create(segment, options));
+    struct stat st;
+    if (!reader->Open(false) || !reader->ListDocs(&doc_ids) ||
+        stat(segment.c_str(), &st) != 0) {
+      return false;
+    }
+    for (const string& tombstone : reader->tombstones()) {
+      live.erase(tombstone);
+    }
+    // A segment that doesn't say when its crawl started was written
+    // after it, at least.
+    uint64_t written = st.st_mtim.tv_sec * UINT64_C(1000000000) +
+                       st.st_mtim.tv_nsec;
+    for (DocID_t doc_id : doc_ids) {
+      if (!reader->LookupDocName(doc_id, &name)) {
+        return false;
+      }
+      uint64_t crawled = reader->crawl_time(doc_id);
+      live[name] = crawled != 0 ? crawled : written;
+    }
+  }
+
+  changed->clear();
+  tombstones->clear();
+  for (const string& file : files) {
+    struct stat st;
+    auto it = live.find(file);
+    bool is_live = it != live.end();
+    if (is_live && stat(file.c_str(), &st) == 0 &&
+        st.st_mtim.tv_sec * UINT64_C(1000000000) + st.st_mtim.tv_nsec +
+          kCrawlTimeSlackNanos < it->second) {
+      live.erase(it);
+      continue;
+    }
+    changed->push_back(file);
+    if (is_live) {
+      tombstones->push_back(file);
+      live.erase(it);
+    }
+  }
+  // Whatever is left was deleted.
+  for (const auto& doc : live) {
+    tombstones->push_back(doc.first);
+  }
+  std::sort(tombstones->begin(), tombstones->end());
+  return true;
+}
+
+bool ListSegments(const string& base, vector<string>* const segments) {
+  vector<pair<uint64_t, string>> deltas;
+  if (!FindDeltas(base, &deltas)) {
+    return false;
+  }
+  segments->assign(1, base);
+  for (const auto& delta : deltas) {
+    segments->push_back(delta.second);
+  }
+  return true;
+}
+
+string NextDeltaName(const string& base) {
+  vector<pair<uint64_t, string>> deltas;
+  FindDeltas(base, &deltas);
+  uint64_t next = deltas.empty() ? 1 : deltas.back().first + 1;
+  return base + ".delta." + std::to_string(next);
+}
+
+static void ListFiles(const string& dir, vector<string>* const files) {
+  DIR* d = opendir(dir.c_str());
+  if (d == nullptr) {
+    return;
+  }
+  struct dirent* entry;
+  while ((entry = readdir(d)) != nullptr) {
+    // Skip ".", "..", and hidden files.
+    if (entry->d_name[0] == '.') {
+      continue;
+    }
+    string path = dir + "/" + entry->d_name;
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) {
+      continue;
+    }
+    if (S_ISDIR(st.st_mode)) {
+      ListFiles(path, files);
+    } else if (S_ISREG(st.st_mode)) {
+      files->push_back(path);
+    }
+  }
+  closedir(d);
+}
+
+static uint64_t ShardHash(const string& file_name) {
+  // FNV's low bits depend only on the low bits of the input, so mix
+  // them up (as TermFilter does) before taking the hash mod anything.
+  uint64_t h = FNVHash64((unsigned char*) file_name.data(), file_name.size());
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+static void* ParseShard(void* arg) {
+  ShardParse* parse = static_cast<ShardParse*>(arg);
+  ParallelParseFiles(*parse->files, parse->num_threads, &parse->doctable,
+                     &parse->index);
+  return nullptr;
+}
+
+static HashTable* ParseFile(const string& file_name) {
+  int size;
+  char* contents = ReadFileToString(file_name.c_str(), &size);
+  if (contents == nullptr) {
+    return nullptr;
+  }
+  HashTable* table = ParseIntoWordPositionsTable(contents);
+  free(contents);
+  return table;
+}
+
+static bool ParseNextFile(Crawl* const crawl) {
+  // Don't get too far ahead of the fold: every parsed file waits in
+  // memory until it is folded.
+  size_t i = crawl->next;
+  if (i == crawl->files.size() || i >= crawl->folded + kParseAhead) {
+    return false;
+  }
+  crawl->next++;
+  Verify333(pthread_mutex_unlock(&crawl->lock) == 0);
+  HashTable* table = ParseFile(crawl->files[i]);
+  Verify333(pthread_mutex_lock(&crawl->lock) == 0);
+  crawl->parsed[i] = table;
+  crawl->ready[i] = true;
+  Verify333(pthread_cond_broadcast(&crawl->cond) == 0);
+  return true;
+}
+
+static void* ParseFiles(void* arg) {
+  Crawl* crawl = static_cast<Crawl*>(arg);
+  Verify333(pthread_mutex_lock(&crawl->lock) == 0);
+  while (crawl->next < crawl->files.size()) {
+    if (!ParseNextFile(crawl)) {
+      Verify333(pthread_cond_wait(&crawl->cond, &crawl->lock) == 0);
+    }
+  }
+  Verify333(pthread_mutex_unlock(&crawl->lock) == 0);
+  return nullptr;
+}
+
+static void FoldFile(const string& file_name, HashTable* table,
+                     DocTable* doctable, MemIndex* index) {
+  DocID_t doc_id = DocTable_Add(doctable, const_cast<char*>(file_name.c_str()));
+  HTIterator* it = HTIterator_Allocate(table);
+  for (; HTIterator_IsValid(it); HTIterator_Next(it)) {
+    HTKeyValue_t kv;
+    HTIterator_Get(it, &kv);
+    WordPositions* wp = static_cast<WordPositions*>(kv.value);
+
+    // The index takes over the word and its positions, so only the
+    // WordPositions itself is left to free.
+    MemIndex_AddPostingList(index, wp->word, doc_id, wp->positions);
+    wp->word = nullptr;
+    wp->positions = nullptr;
+  }
+  HTIterator_Free(it);
+  HashTable_Free(table, &free);
+}
+
+static bool FindDeltas(const string& base,
+                       vector<pair<uint64_t, string>>* const deltas) {
+  size_t slash = base.rfind('/');
+  string dir = slash == string::npos ? "." : base.substr(0, slash + 1);
+  string prefix = (slash == string::npos ? base : base.substr(slash + 1)) +
+                  ".delta.";
+  DIR* d = opendir(dir.c_str());
+  if (d == nullptr) {
+    return false;
+  }
+  deltas->clear();
+  struct dirent* entry;
+  while ((entry = readdir(d)) != nullptr) {
+    // Only a run of digits may follow the prefix, so that a delta still
+    // being written under some other name isn't taken for one.
+    string name = entry->d_name;
+    if (name.size() <= prefix.size() ||
+        name.compare(0, prefix.size(), prefix) != 0 ||
+        name.find_first_not_of("0123456789", prefix.size()) !=
+          string::npos ||
+        name.size() - prefix.size() > 18) {
+      continue;
+    }
+    deltas->push_back({std::stoull(name.substr(prefix.size())),
+                       slash == string::npos ? name : dir + name});
+  }
+  closedir(d);
+  std::sort(deltas->begin(), deltas->end());
+  return true;
+}
+
+}  // namespace hw4
@@ -0,0 +1,141 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_INDEXBUILDER_H_
+#define HW4_INDEXBUILDER_H_
+
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+extern "C" {
+  #include "libhw2/DocTable.h"
+  #include "libhw2/MemIndex.h"
+}
+
+namespace hw4 {
+
+// How many files ParallelCrawlFileTree() may have parsed ahead of the
+// file it is folding into the index.
+static const uint32_t kParseAhead = 256;
+
+// Crawls the directory tree rooted at "root_dir" into a new DocTable
+// and MemIndex, just as libhw2's CrawlFileTree() does, but reads and
+// parses the files on "num_threads" threads: the calling thread and
+// num_threads - 1 helpers.
+//
+// Reading and parsing a file (tokenizing it into a table of each
+// word's positions) is most of the work of a crawl, and the files can
+// be parsed in any order.  Adding a parsed file's words to the
+// MemIndex can't be done concurrently, so the calling thread folds the
+// parsed files in, one at a time and in crawl order, while the helpers
+// parse the files after them; whenever the next file to fold isn't
+// parsed yet, the calling thread parses a file itself rather than
+// wait.  Because files are folded in crawl order, documents get the
+// same docIDs, and the index the same contents, as CrawlFileTree()
+// would give them.  At most kParseAhead files are parsed but not yet
+// folded at any time, which bounds how much memory the parsed files
+// can take up.
+//
+// Returns false (and allocates nothing) if "root_dir" isn't a
+// directory.  The caller must free the DocTable and MemIndex.
+bool ParallelCrawlFileTree(const char* root_dir, uint32_t num_threads,
+                           DocTable** const doctable,
+                           MemIndex** const index);
+
+// Fills "files" with the path of every regular file under "root_dir",
+// in the order CrawlFileTree() visits them; a file's path is also its
+// document name.  Returns false if "root_dir" isn't a directory.
+bool ListFileTree(const char* root_dir, std::vector<std::string>* const files);
+
+// Like ParallelCrawlFileTree(), but indexes just the files "files",
+// in that order.
+void ParallelParseFiles(const std::vector<std::string>& files,
+                        uint32_t num_threads, DocTable** const doctable,
+                        MemIndex** const index);
+
+// How ShardFiles() splits a crawl's files among shards:
+//  - kShardByRange: into runs of consecutive files, so that each shard
+//    holds a range of the docIDs that one index of all of them would
+//    give its documents;
+//  - kShardByHash: by a hash of each file's name, so that a file stays
+//    in the same shard no matter what else is in the tree.
+enum ShardPartition { kShardByRange, kShardByHash };
+
+// Splits "files" (e.g. from ListFileTree()) into "num_shards" lists of
+// files, as "partition" says, keeping their order within each list.
+void ShardFiles(const std::vector<std::string>& files, uint32_t num_shards,
+                ShardPartition partition,
+                std::vector<std::vector<std::string>>* const shards);
+
+// Indexes each list of files in "shards" into a DocTable and MemIndex
+// of its own, as ParallelParseFiles() does, but does all of the shards
+// at once, so that there is a thread folding each shard's files in
+// rather than one for the whole crawl.  The "num_threads" threads are
+// shared out among the shards, with at least one for each.  The caller
+// must free the DocTables and MemIndexes (see WriteShardedIndex() in
+// IndexWriter.h for writing them out).
+void ParallelParseShards(const std::vector<std::vector<std::string>>& shards,
+                         uint32_t num_threads,
+                         std::vector<DocTable*>* const doctables,
+                         std::vector<MemIndex*>* const indices);
+
+// Returns the current time in nanoseconds since the epoch, which is
+// what a crawl that is about to start records as its crawl time (see
+// kCrawlTimesSection in IndexWriter.h).
+uint64_t CrawlStartTime();
+
+// How long before a document's crawl time its file must have last been
+// modified for PlanDelta() to count the document as up to date.  Files'
+// times come from a coarser clock than CrawlStartTime()'s, and can lag
+// it a little.
+static const uint64_t kCrawlTimeSlackNanos = 1000000000;
+
+// Works out what a delta index (see kTombstoneSection in IndexWriter.h)
+// must hold to bring the index whose segments are "segments" -- a base
+// index file and then the deltas on top of it, oldest first -- up to
+// date with the files under "root_dir":
+//
+//  - "changed" gets the files that are new, or that have been modified
+//    since the crawl that indexed the segments' copy of them started
+//    (or, for a segment that doesn't record its crawl times, since
+//    the segment was written), in crawl order; and
+//
+//  - "tombstones" gets the documents that the segments hold copies of
+//    which must be hidden: the changed files they already have, and the
+//    ones that are no longer there at all.
+//
+// Returns false if "root_dir" isn't a directory or a segment can't be
+// read.
+bool PlanDelta(const char* root_dir, const std::vector<std::string>& segments,
+               std::vector<std::string>* const changed,
+               std::vector<std::string>* const tombstones);
+
+// The deltas on top of base index file "base" can be named for it:
+// "base.delta.1", "base.delta.2", and so on, numbered in the order they
+// were written.  That way the segments can be found from the base's
+// name alone, by deltaindex and by a server that reloads them.
+//
+// Fills "segments" with "base" followed by the deltas so named that
+// are next to it, oldest first, which is the order PlanDelta() and
+// MergeIndexFiles() take them in.  Returns false if the directory that
+// holds "base" can't be read.
+bool ListSegments(const std::string& base,
+                  std::vector<std::string>* const segments);
+
+// Returns the name of the next delta on top of base index file "base",
+// numbered one past the newest delta next to it (see ListSegments()).
+std::string NextDeltaName(const std::string& base);
+
+}  // namespace hw4
+
+#endif  // HW4_INDEXBUILDER_H_
@@ -0,0 +1,347 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "./IndexFile.h"
+#include "./libhw3/Utils.h"
+
+using std::string;
+using std::vector;
+using hw3::BucketListHeader;
+using hw3::BucketRecord;
+using hw3::DoctableElementHeader;
+using hw3::ElementPositionRecord;
+using hw3::IndexFileHeader;
+using hw3::IndexFileOffset_t;
+using hw3::WordPostingsHeader;
+
+namespace hw4 {
+
+// The most bytes ReadBuffer(), and the most elements the buffers that
+// hold a hash table chain, keep room for between lookups.  A thread
+// that reads an unusually long posting list or chain gives the memory
+// back when it is done with it.
+static const size_t kMaxKeptReadBytes = 1024 * 1024;
+static const size_t kMaxKeptChainElements = 1024;
+
+IndexFile::IndexFile(const string& file_name, bool build_term_dictionary)
+  : IndexReader(file_name), fd_(-1),
+    build_term_dictionary_(build_term_dictionary) { }
+
+IndexFile::~IndexFile() {
+  if (fd_ != -1) {
+    close(fd_);
+  }
+  fd_ = -1;
+}
+
+bool IndexFile::Open(bool validate) {
+  fd_ = open(file_name().c_str(), O_RDONLY);
+  if (fd_ == -1) {
+    return false;
+  }
+
+  // Read and sanity check the header.
+  if (!ReadAt(0, &header_, sizeof(header_))) {
+    return false;
+  }
+  header_.ToHostFormat();
+  struct stat st;
+  if (fstat(fd_, &st) == -1 || !CheckHeader(header_, st.st_size)) {
+    return false;
+  }
+  if (validate && !VerifyChecksum()) {
+    return false;
+  }
+
+  // Keep a copy of any sections after the index, the term filter among
+  // them; they're small next to the index itself.
+  int64_t sections_offset = sizeof(IndexFileHeader) +
+                            static_cast<int64_t>(header_.doctable_bytes) +
+                            header_.index_bytes;
+  if (st.st_size > sections_offset) {
+    vector<uint8_t> sections(st.st_size - sections_offset);
+    if (!ReadAt(sections_offset, sections.data(), sections.size()) ||
+        !CopySections(sections.data(), sections.size())) {
+      return false;
+    }
+  }
+
+  // The doctable follows the header, and the index follows the doctable.
+  // Remember where they are and how many buckets they have, so that
+  // lookups don't have to re-read the bucket list headers.
+  BucketListHeader blh;
+  doctable_offset_ = sizeof(IndexFileHeader);
+  if (!ReadAt(doctable_offset_, &blh, sizeof(blh))) {
+    return false;
+  }
+  blh.ToHostFormat();
+  doctable_num_buckets_ = blh.num_buckets;
+  if (doctable_num_buckets_ <= 0) {
+    return false;
+  }
+  vector<uint8_t> records(doctable_num_buckets_ * sizeof(BucketRecord));
+  if (!ReadAt(doctable_offset_ + sizeof(blh), records.data(),
+              records.size())) {
+    return false;
+  }
+  CountDocs(records.data(), doctable_num_buckets_);
+
+  index_offset_ = doctable_offset_ + header_.doctable_bytes;
+  if (!ReadAt(index_offset_, &blh, sizeof(blh))) {
+    return false;
+  }
+  blh.ToHostFormat();
+  index_num_buckets_ = blh.num_buckets;
+  if (doctable_num_buckets_ <= 0 || index_num_buckets_ <= 0) {
+    return false;
+  }
+
+  if (build_term_dictionary_ && !has_term_dictionary()) {
+    return ReadTermDictionary();
+  }
+  return true;
+}
+
+bool IndexFile::LookupWord(const string& word,
+                           PostingList* const postings) const {
+  vector<uint8_t>& bytes = ReadBuffer();
+  IndexFileOffset_t table;
+  bool ok = MayContain(word) && ReadPostings(word, &bytes, &table) &&
+            ParsePostings(bytes.data(), bytes.size(), table, postings);
+  TrimBuffer(&bytes, kMaxKeptReadBytes);
+  return ok;
+}
+
+bool IndexFile::LookupDocFrequency(const string& word,
+                                   size_t* const df) const {
+  // A version 1 docID table's length is in its bucket records, which
+  // come first, but there's no knowing how many there are without
+  // reading them; a compressed list's is in its first few bytes.
+  vector<uint8_t>& bytes = ReadBuffer();
+  IndexFileOffset_t table;
+  size_t max_bytes = format_version() >= 2 ? kDocFrequencyBytes : SIZE_MAX;
+  bool ok = MayContain(word) &&
+            ReadPostings(word, &bytes, &table, max_bytes) &&
+            ParseDocFrequency(bytes.data(), bytes.size(), df);
+  TrimBuffer(&bytes, kMaxKeptReadBytes);
+  return ok;
+}
+
+bool IndexFile::LookupPositions(
+    const string& word, const vector<DocID_t>& doc_ids,
+    vector<vector<DocPositionOffset_t>>* const positions) const {
+  vector<uint8_t>& bytes = ReadBuffer();
+  IndexFileOffset_t table;
+  bool ok = MayContain(word) && ReadPostings(word, &bytes, &table) &&
+            ParsePositions(bytes.data(), bytes.size(), table, doc_ids,
+                           positions);
+  TrimBuffer(&bytes, kMaxKeptReadBytes);
+  return ok;
+}
+
+bool IndexFile::ReadPostings(const string& word, vector<uint8_t>* const bytes,
+                             IndexFileOffset_t* const offset,
+                             size_t max_bytes) const {
+  HTKey_t key = FNVHash64((unsigned char*) word.c_str(), word.size());
+  static thread_local vector<IndexFileOffset_t> elements;
+  if (!LookupElementPositions(index_offset_, index_num_buckets_,
+                              key, &elements)) {
+    return false;
+  }
+
+  // Each element is a WordPostingsHeader followed by the word and then
+  // its postings.  Read the header and the word with a single pread,
+  // since we know how long the word we're looking for is.
+  static thread_local vector<uint8_t> buf;
+  buf.resize(sizeof(WordPostingsHeader) + word.size());
+  bool found = false;
+  for (IndexFileOffset_t element : elements) {
+    if (!ReadAt(element, buf.data(), buf.size())) {
+      continue;
+    }
+    WordPostingsHeader wph;
+    memcpy(&wph, buf.data(), sizeof(wph));
+    wph.ToHostFormat();
+    if (wph.word_bytes != static_cast<int16_t>(word.size()) ||
+        memcmp(buf.data() + sizeof(wph), word.data(), word.size()) != 0) {
+      continue;
+    }
+
+    // Found it.  Pull all of its postings into memory with one read
+    // and walk them there, rather than seeking around the file.
+    *offset = element + sizeof(wph) + wph.word_bytes;
+    bytes->resize(std::min<size_t>(std::max(wph.postings_bytes, 0),
+                                   max_bytes));
+    found = ReadAt(*offset, bytes->data(), bytes->size());
+    break;
+  }
+  TrimBuffer(&elements, kMaxKeptChainElements);
+  return found;
+}
+
+bool IndexFile::LookupDocName(DocID_t doc_id, string* const name) const {
+  // The pool is in memory, so a name takes no reads.
+  if (has_doc_name_pool()) {
+    return doc_names().Lookup(doc_id, name);
+  }
+
+  static thread_local vector<IndexFileOffset_t> elements;
+  if (!LookupElementPositions(doctable_offset_, doctable_num_buckets_,
+                              doc_id, &elements)) {
+    return false;
+  }
+
+  bool found = false;
+  for (IndexFileOffset_t element : elements) {
+    DoctableElementHeader deh;
+    if (!ReadAt(element, &deh, sizeof(deh))) {
+      break;
+    }
+    deh.ToHostFormat();
+    if (deh.doc_id != doc_id) {
+      continue;
+    }
+
+    // Read the name straight into the caller's string.
+    name->resize(deh.file_name_bytes);
+    found = ReadAt(element + sizeof(deh), &(*name)[0], name->size());
+    break;
+  }
+  TrimBuffer(&elements, kMaxKeptChainElements);
+  return found;
+}
+
+bool IndexFile::ListDocs(vector<DocID_t>* const doc_ids) const {
+  if (has_doc_name_pool()) {
+    ListPooledDocs(doc_ids);
+    return true;
+  }
+
+  // A bucket's number is a key that hashes to it.
+  doc_ids->clear();
+  vector<IndexFileOffset_t> elements;
+  for (int32_t b = 0; b < doctable_num_buckets_; b++) {
+    if (!LookupElementPositions(doctable_offset_, doctable_num_buckets_,
+                                b, &elements)) {
+      return false;
+    }
+    for (IndexFileOffset_t element : elements) {
+      DoctableElementHeader deh;
+      if (!ReadAt(element, &deh, sizeof(deh))) {
+        return false;
+      }
+      deh.ToHostFormat();
+      doc_ids->push_back(deh.doc_id);
+    }
+  }
+  std::sort(doc_ids->begin(), doc_ids->end());
+  return true;
+}
+
+bool IndexFile::ReadTermDictionary() {
+  // As in ListDocs(), a bucket's number is a key that hashes to it.
+  vector<string> words;
+  vector<IndexFileOffset_t> elements;
+  for (int32_t b = 0; b < index_num_buckets_; b++) {
+    if (!LookupElementPositions(index_offset_, index_num_buckets_, b,
+                                &elements)) {
+      return false;
+    }
+    for (IndexFileOffset_t element : elements) {
+      WordPostingsHeader wph;
+      if (!ReadAt(element, &wph, sizeof(wph))) {
+        return false;
+      }
+      wph.ToHostFormat();
+      if (wph.word_bytes < 0) {
+        return false;
+      }
+      string word(wph.word_bytes, '\0');
+      if (!ReadAt(element + sizeof(wph), &word[0], word.size())) {
+        return false;
+      }
+      words.push_back(std::move(word));
+    }
+  }
+  std::sort(words.begin(), words.end());
+  BuildTermDictionary(words);
+  return true;
+}
+
+vector<uint8_t>& IndexFile::ReadBuffer() {
+  static thread_local vector<uint8_t> bytes;
+  return bytes;
+}
+
+bool IndexFile::ReadAt(int64_t offset, void* buf, size_t len) const {
+  uint8_t* dst = static_cast<uint8_t*>(buf);
+  while (len > 0) {
+    ssize_t res = pread(fd_, dst, len, offset);
+    if (res == -1) {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+    if (res == 0) {
+      // Hit EOF before reading everything we wanted.
+      return false;
+    }
+    dst += res;
+    offset += res;
+    len -= res;
+  }
+  return true;
+}
+
+bool IndexFile::LookupElementPositions(
+    IndexFileOffset_t table_offset, int32_t num_buckets,
+    HTKey_t key, vector<IndexFileOffset_t>* const positions) const {
+  int32_t bucket = static_cast<int32_t>(key % num_buckets);
+  BucketRecord br;
+  if (!ReadAt(table_offset + sizeof(BucketListHeader) + bucket * sizeof(br),
+              &br, sizeof(br))) {
+    return false;
+  }
+  br.ToHostFormat();
+
+  // The chain's element positions are stored contiguously, so grab
+  // them all at once.
+  positions->clear();
+  if (br.chain_num_elements == 0) {
+    return true;
+  }
+  static thread_local vector<ElementPositionRecord> records;
+  records.resize(br.chain_num_elements);
+  bool ok = ReadAt(br.position, records.data(),
+                   records.size() * sizeof(ElementPositionRecord));
+  if (ok) {
+    positions->reserve(records.size());
+    for (ElementPositionRecord& epr : records) {
+      epr.ToHostFormat();
+      positions->push_back(epr.position);
+    }
+  }
+  TrimBuffer(&records, kMaxKeptChainElements);
+  return ok;
+}
+
+}  // namespace hw4
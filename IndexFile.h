@@ -0,0 +1,115 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_INDEXFILE_H_
+#define HW4_INDEXFILE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+extern "C" {
+  #include "libhw1/HashTable.h"
+}
+#include "./libhw3/LayoutStructs.h"
+#include "./IndexReader.h"
+#include "./PostingList.h"
+
+namespace hw4 {
+
+// An IndexFile is an IndexReader that reads with pread() at explicit
+// offsets.  Unlike hw3::FileIndexReader and friends, which share a
+// FILE* and move its file position around with fseek/fread, it has no
+// mutable state once Open() succeeds, so a single IndexFile can be
+// shared by any number of threads.  Every lookup still costs a few
+// system calls (except for words the index's term filter, which it
+// keeps in memory, rules out); see MappedIndexFile for a reader that
+// needs none.
+class IndexFile : public IndexReader {
+ public:
+  // Memorizes the name of the index file; does not open it.  If
+  // "build_term_dictionary" is true, Open() makes a term dictionary for
+  // a file that has none (see IndexReaderOptions).
+  explicit IndexFile(const std::string& file_name,
+                     bool build_term_dictionary = false);
+
+  // Closes the index file if it is open.
+  virtual ~IndexFile();
+
+  // IndexReader methods.
+  bool Open(bool validate) override;
+  bool LookupWord(const std::string& word,
+                  PostingList* const postings) const override;
+  bool LookupDocFrequency(const std::string& word,
+                          size_t* const df) const override;
+  bool LookupPositions(
+      const std::string& word, const std::vector<DocID_t>& doc_ids,
+      std::vector<std::vector<DocPositionOffset_t>>* const positions)
+      const override;
+  bool LookupDocName(DocID_t doc_id,
+                     std::string* const name) const override;
+  bool ListDocs(std::vector<DocID_t>* const doc_ids) const override;
+  size_t MemoryFootprint() const override {
+    return sizeof(*this) + sections_footprint();
+  }
+
+ private:
+  // Reads exactly "len" bytes at "offset" into "buf".  Returns false on
+  // a read error or if the file is too short.
+  bool ReadAt(int64_t offset, void* buf, size_t len) const;
+
+  // The buffer the calling thread reads postings into.  Its capacity
+  // is kept from lookup to lookup, so once it has grown to fit the
+  // longest list a thread has read, lookups stop allocating -- unless
+  // the list was unusually long, in which case the lookup gives the
+  // memory back when it is done.
+  static std::vector<uint8_t>& ReadBuffer();
+
+  // Returns (through "positions") the file offsets of all of the
+  // elements in the bucket "key" hashes to in the on-disk hash table
+  // that starts at "table_offset" and has "num_buckets" buckets.
+  bool LookupElementPositions(
+      hw3::IndexFileOffset_t table_offset, int32_t num_buckets,
+      HTKey_t key, std::vector<hw3::IndexFileOffset_t>* const positions) const;
+
+  // Reads every word out of the index hash table and makes a term
+  // dictionary of them.  Returns false on a read error.
+  bool ReadTermDictionary();
+
+  // Finds "word" in the index and reads its postings (or, at most, the
+  // first "max_bytes" bytes of them) into "bytes", setting "offset" to
+  // where they start in the file.  Returns false if the word isn't
+  // there.
+  bool ReadPostings(const std::string& word, std::vector<uint8_t>* const bytes,
+                    hw3::IndexFileOffset_t* const offset,
+                    size_t max_bytes = SIZE_MAX) const;
+
+  int fd_;
+  hw3::IndexFileHeader header_;
+
+  // Where the doctable and index hash tables start, and how many
+  // buckets each one has.
+  hw3::IndexFileOffset_t doctable_offset_;
+  int32_t doctable_num_buckets_;
+  hw3::IndexFileOffset_t index_offset_;
+  int32_t index_num_buckets_;
+
+  bool build_term_dictionary_;
+
+  // Disable copying; an IndexFile owns its file descriptor.
+  IndexFile(const IndexFile&) = delete;
+  IndexFile& operator=(const IndexFile&) = delete;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_INDEXFILE_H_
@@ -0,0 +1,439 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "./IndexReader.h"
+#include "./CRC32.h"
+#include "./IndexFile.h"
+#include "./IndexWriter.h"
+#include "./MappedIndexFile.h"
+#include "./PostingCodec.h"
+#include "./ResidentIndex.h"
+#include "./libhw3/Utils.h"
+
+using std::string;
+using std::vector;
+using hw3::BucketListHeader;
+using hw3::BucketRecord;
+using hw3::DocIDElementHeader;
+using hw3::DocIDElementPosition;
+using hw3::ElementPositionRecord;
+using hw3::IndexFileHeader;
+using hw3::IndexFileOffset_t;
+
+namespace hw4 {
+
+// A varint of up to 64 bits takes at most 10 bytes.
+const size_t IndexReader::kDocFrequencyBytes = 10;
+
+const size_t IndexReader::kChecksumChunkBytes = 1024 * 1024;
+
+IndexReader* IndexReader::Create(const string& file_name,
+                                 const IndexReaderOptions& options) {
+  switch (options.backend) {
+    case IndexReaderOptions::kPread:
+      return new IndexFile(file_name, options.build_term_dictionary);
+    case IndexReaderOptions::kMmap:
+      return new MappedIndexFile(file_name, options.populate,
+                                 options.huge_pages);
+    case IndexReaderOptions::kResident:
+      return new ResidentIndex(file_name);
+  }
+  return nullptr;
+}
+
+bool IndexReader::VerifyChecksum() const {
+  int fd = open(file_name_.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+  struct stat st;
+  bool ok = fstat(fd, &st) == 0 && st.st_size == file_size_ &&
+            file_size_ >= static_cast<int64_t>(sizeof(IndexFileHeader));
+  CRC32 crc;
+  vector<uint8_t> buf(kChecksumChunkBytes);
+  int64_t offset = sizeof(IndexFileHeader);
+  while (ok && offset < file_size_) {
+    size_t len = std::min<int64_t>(file_size_ - offset, buf.size());
+    ssize_t got = pread(fd, buf.data(), len, offset);
+    if (got == -1 && errno == EINTR) {
+      continue;
+    }
+    ok = got > 0;
+    if (ok) {
+      crc.Fold(buf.data(), got);
+      offset += got;
+    }
+  }
+  close(fd);
+  return ok && crc.GetFinalCRC() == checksum_;
+}
+
+bool IndexReader::CheckHeader(const IndexFileHeader& header,
+                              int64_t file_size) {
+  if (header.magic_number == hw3::kMagicNumber) {
+    format_version_ = 1;
+  } else if (header.magic_number == kMagicNumberV2) {
+    format_version_ = 2;
+  } else if (header.magic_number == kMagicNumberV3) {
+    format_version_ = 3;
+  } else {
+    return false;
+  }
+  if (header.doctable_bytes < 0 || header.index_bytes < 0) {
+    return false;
+  }
+
+  checksum_ = header.checksum;
+  file_size_ = file_size;
+
+  // Only version 1 files have no sections after the index.
+  int64_t tables_end = static_cast<int64_t>(sizeof(IndexFileHeader)) +
+                       header.doctable_bytes + header.index_bytes;
+  return format_version_ >= 2 ? file_size >= tables_end :
+                                file_size == tables_end;
+}
+
+void IndexReader::CountDocs(const uint8_t* records, int32_t num_buckets) {
+  num_docs_ = 0;
+  for (int32_t b = 0; b < num_buckets; b++) {
+    BucketRecord br;
+    memcpy(&br, records + b * sizeof(br), sizeof(br));
+    br.ToHostFormat();
+    num_docs_ += std::max(br.chain_num_elements, 0);
+  }
+}
+
+void IndexReader::SetDocLengths(vector<DocID_t> doc_ids,
+                                vector<uint32_t> lengths) {
+  uint64_t total_words = 0;
+  for (uint32_t length : lengths) {
+    total_words += length;
+  }
+  length_ids_.swap(doc_ids);
+  lengths_.swap(lengths);
+  average_doc_length_ =
+      num_docs_ > 0 ? static_cast<double>(total_words) / num_docs_ : 0;
+}
+
+uint32_t IndexReader::doc_length(DocID_t doc_id) const {
+  if (length_ids_.empty()) {
+    return 0;
+  }
+
+  // The docIDs hw2 hands out run 1, 2, 3, ..., so the lengths can
+  // usually be indexed directly.
+  DocID_t first = length_ids_.front();
+  if (length_ids_.back() - first == length_ids_.size() - 1) {
+    return doc_id >= first && doc_id - first < length_ids_.size() ?
+           lengths_[doc_id - first] : 0;
+  }
+  auto it = std::lower_bound(length_ids_.begin(), length_ids_.end(), doc_id);
+  return it != length_ids_.end() && *it == doc_id ?
+         lengths_[it - length_ids_.begin()] : 0;
+}
+
+bool IndexReader::ParseSections(const uint8_t* buf, size_t len) {
+  size_t offset = 0;
+  while (offset < len) {
+    SectionHeader sh;
+    if (!ParseAt(buf, len, offset, &sh) ||
+        sh.section_bytes > len - offset - sizeof(sh)) {
+      return false;
+    }
+    const uint8_t* section = buf + offset + sizeof(sh);
+    if (sh.tag == kTermDictionarySection &&
+        !dictionary_.Parse(section, sh.section_bytes)) {
+      return false;
+    }
+    if (sh.tag == kWordPositionsSection) {
+      word_positions_ = true;
+    }
+    if (sh.tag == kTermFilterSection &&
+        !filter_.Parse(section, sh.section_bytes)) {
+      return false;
+    }
+    if (sh.tag == kDocLengthsSection &&
+        !ParseDocLengths(section, sh.section_bytes)) {
+      return false;
+    }
+    if (sh.tag == kTombstoneSection &&
+        !ParseTombstones(section, sh.section_bytes)) {
+      return false;
+    }
+    if (sh.tag == kDocNamesSection &&
+        !doc_names_.Parse(section, sh.section_bytes)) {
+      return false;
+    }
+    if (sh.tag == kShardSection && !ParseShard(section, sh.section_bytes)) {
+      return false;
+    }
+    if (sh.tag == kCrawlTimesSection &&
+        !ParseCrawlTimes(section, sh.section_bytes)) {
+      return false;
+    }
+    offset += sizeof(sh) + sh.section_bytes;
+  }
+  // A shard is scored as part of its collection, whichever section
+  // came first.
+  if (is_shard() && shard_.collection_docs > 0) {
+    average_doc_length_ = static_cast<double>(shard_.collection_words) /
+                          shard_.collection_docs;
+  }
+  return true;
+}
+
+bool IndexReader::ParseDocLengths(const uint8_t* buf, size_t len) {
+  const uint8_t* p = buf;
+  const uint8_t* end = buf + len;
+  uint64_t num_docs, total_words;
+  if (!GetVarint(&p, end, &num_docs) || !GetVarint(&p, end, &total_words)) {
+    return false;
+  }
+  length_ids_.clear();
+  lengths_.clear();
+  uint64_t doc_id = 0;
+  while (p < end) {
+    uint64_t gap, length;
+    if (!GetVarint(&p, end, &gap) || !GetVarint(&p, end, &length) ||
+        (gap == 0 && !length_ids_.empty()) || gap > UINT64_MAX - doc_id ||
+        length > UINT32_MAX) {
+      return false;
+    }
+    doc_id += gap;
+    length_ids_.push_back(doc_id);
+    lengths_.push_back(length);
+  }
+  average_doc_length_ =
+      num_docs > 0 ? static_cast<double>(total_words) / num_docs : 0;
+  return true;
+}
+
+bool IndexReader::ParseTombstones(const uint8_t* buf, size_t len) {
+  const uint8_t* p = buf;
+  const uint8_t* end = buf + len;
+  uint64_t num_names;
+  if (!GetVarint(&p, end, &num_names) || num_names > len) {
+    return false;
+  }
+  tombstones_.clear();
+  tombstones_.reserve(num_names);
+  for (uint64_t i = 0; i < num_names; i++) {
+    uint64_t name_len;
+    if (!GetVarint(&p, end, &name_len) ||
+        name_len > static_cast<uint64_t>(end - p)) {
+      return false;
+    }
+    tombstones_.emplace_back(reinterpret_cast<const char*>(p), name_len);
+    p += name_len;
+  }
+  return p == end && std::is_sorted(tombstones_.begin(), tombstones_.end());
+}
+
+bool IndexReader::ParseShard(const uint8_t* buf, size_t len) {
+  const uint8_t* p = buf;
+  const uint8_t* end = buf + len;
+  uint64_t shard, num_shards;
+  ShardInfo info;
+  if (!GetVarint(&p, end, &info.set_id) || !GetVarint(&p, end, &shard) ||
+      !GetVarint(&p, end, &num_shards) ||
+      !GetVarint(&p, end, &info.collection_docs) ||
+      !GetVarint(&p, end, &info.collection_words) || p != end ||
+      num_shards == 0 || num_shards > UINT32_MAX || shard >= num_shards) {
+    return false;
+  }
+  info.shard = shard;
+  info.num_shards = num_shards;
+  shard_ = info;
+  return true;
+}
+
+bool IndexReader::ParseCrawlTimes(const uint8_t* buf, size_t len) {
+  const uint8_t* p = buf;
+  const uint8_t* end = buf + len;
+  uint64_t num_runs;
+  if (!GetVarint(&p, end, &num_runs) || num_runs > len) {
+    return false;
+  }
+  crawl_times_.clear();
+  crawl_times_.reserve(num_runs);
+  uint64_t doc_id = 0;
+  for (uint64_t i = 0; i < num_runs; i++) {
+    uint64_t gap, time;
+    if (!GetVarint(&p, end, &gap) || !GetVarint(&p, end, &time) ||
+        (gap == 0 && i > 0) || gap > UINT64_MAX - doc_id) {
+      return false;
+    }
+    doc_id += gap;
+    crawl_times_.push_back({doc_id, time});
+  }
+  return p == end;
+}
+
+uint64_t IndexReader::crawl_time(DocID_t doc_id) const {
+  // The last run that starts at or before the document.
+  auto it = std::upper_bound(
+      crawl_times_.begin(), crawl_times_.end(), doc_id,
+      [](DocID_t id, const std::pair<DocID_t, uint64_t>& run) {
+        return id < run.first;
+      });
+  return it == crawl_times_.begin() ? 0 : (it - 1)->second;
+}
+
+void IndexReader::ListPooledDocs(vector<DocID_t>* const doc_ids) const {
+  doc_ids->clear();
+  doc_ids->reserve(doc_names_.size());
+  for (DocID_t doc_id = 1; doc_id <= doc_names_.size(); doc_id++) {
+    doc_ids->push_back(doc_id);
+  }
+}
+
+bool IndexReader::CopySections(const uint8_t* buf, size_t len) {
+  section_copy_.assign(buf, buf + len);
+  return ParseSections(section_copy_.data(), section_copy_.size());
+}
+
+void IndexReader::BuildTermDictionary(const vector<string>& terms) {
+  section_copy_.clear();
+  TermDictionary::Build(terms, &section_copy_);
+  section_copy_.shrink_to_fit();
+  dictionary_.Parse(section_copy_.data(), section_copy_.size());
+}
+
+bool IndexReader::ParsePostings(const uint8_t* buf, size_t len,
+                                IndexFileOffset_t offset,
+                                PostingList* const postings) const {
+  if (format_version_ >= 2) {
+    return DecodePostings(buf, len, postings, format_version_ == 3);
+  }
+  return ParseDocIDTable(buf, len, offset, postings);
+}
+
+bool IndexReader::ParseDocFrequency(const uint8_t* buf, size_t len,
+                                    size_t* const df) const {
+  if (format_version_ >= 2) {
+    // A compressed posting list starts with how many documents it has.
+    const uint8_t* p = buf;
+    uint64_t num_docs;
+    if (!GetVarint(&p, buf + len, &num_docs) || num_docs > SIZE_MAX) {
+      return false;
+    }
+    *df = num_docs;
+    return true;
+  }
+
+  // A version 1 docID table is a hash table of one element per
+  // document, so its bucket records say how many there are.
+  BucketListHeader blh;
+  if (!ParseAt(buf, len, 0, &blh)) {
+    return false;
+  }
+  *df = 0;
+  for (int32_t b = 0; b < blh.num_buckets; b++) {
+    BucketRecord br;
+    if (!ParseAt(buf, len, sizeof(blh) + b * sizeof(br), &br)) {
+      return false;
+    }
+    *df += std::max(br.chain_num_elements, 0);
+  }
+  return true;
+}
+
+bool IndexReader::ParsePositions(
+    const uint8_t* buf, size_t len, IndexFileOffset_t offset,
+    const vector<DocID_t>& doc_ids,
+    vector<vector<DocPositionOffset_t>>* const positions) const {
+  if (format_version_ >= 2) {
+    return DecodePositions(buf, len, doc_ids, positions,
+                           format_version_ == 3);
+  }
+
+  // A version 1 docID table is a hash table keyed by docID, so each
+  // document's positions can be found directly.
+  BucketListHeader blh;
+  if (!ParseAt(buf, len, 0, &blh) || blh.num_buckets <= 0) {
+    return false;
+  }
+  positions->resize(doc_ids.size());
+  for (size_t i = 0; i < doc_ids.size(); i++) {
+    BucketRecord br;
+    int64_t bucket = doc_ids[i] % blh.num_buckets;
+    if (!ParseAt(buf, len, sizeof(blh) + bucket * sizeof(br), &br)) {
+      return false;
+    }
+    bool found = false;
+    for (int32_t e = 0; e < br.chain_num_elements && !found; e++) {
+      ElementPositionRecord epr;
+      DocIDElementHeader deh;
+      if (!ParseAt(buf, len, br.position - offset + e * sizeof(epr), &epr) ||
+          !ParseAt(buf, len, epr.position - offset, &deh)) {
+        return false;
+      }
+      if (deh.doc_id != doc_ids[i]) {
+        continue;
+      }
+      found = true;
+      vector<DocPositionOffset_t>& out = (*positions)[i];
+      out.resize(std::max(deh.num_positions, 0));
+      for (size_t j = 0; j < out.size(); j++) {
+        DocIDElementPosition dep;
+        if (!ParseAt(buf, len, epr.position - offset + sizeof(deh) +
+                               j * sizeof(dep), &dep)) {
+          return false;
+        }
+        out[j] = dep.position;
+      }
+    }
+    if (!found) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool IndexReader::ParseDocIDTable(const uint8_t* table, size_t len,
+                                  IndexFileOffset_t table_offset,
+                                  PostingList* const postings) {
+  BucketListHeader blh;
+  if (!ParseAt(table, len, 0, &blh)) {
+    return false;
+  }
+  postings->Clear();
+  for (int32_t b = 0; b < blh.num_buckets; b++) {
+    BucketRecord br;
+    if (!ParseAt(table, len, sizeof(blh) + b * sizeof(br), &br)) {
+      return false;
+    }
+    for (int32_t e = 0; e < br.chain_num_elements; e++) {
+      ElementPositionRecord epr;
+      DocIDElementHeader deh;
+      if (!ParseAt(table, len,
+                   br.position - table_offset + e * sizeof(epr), &epr) ||
+          !ParseAt(table, len, epr.position - table_offset, &deh)) {
+        return false;
+      }
+      postings->Append(deh.doc_id, deh.num_positions);
+    }
+  }
+  postings->SortByDocID();
+  return true;
+}
+
+}  // namespace hw4
@@ -0,0 +1,357 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_INDEXREADER_H_
+#define HW4_INDEXREADER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "./libhw3/LayoutStructs.h"
+#include "./DocNamePool.h"
+#include "./IndexWriter.h"
+#include "./PostingList.h"
+#include "./TermDictionary.h"
+#include "./TermFilter.h"
+
+namespace hw4 {
+
+// Knobs for how the QueryEngine gets at its index files.
+struct IndexReaderOptions {
+  // Which IndexReader implementation to use:
+  //  - kPread reads what it needs with pread() (see IndexFile.h)
+  //  - kMmap maps the whole file into memory (see MappedIndexFile.h)
+  //  - kResident decodes the whole index into memory when it is
+  //    opened (see ResidentIndex.h)
+  enum Backend { kPread, kMmap, kResident };
+  Backend backend = kMmap;
+
+  // kMmap only: fault the whole file in when it is opened
+  // (MAP_POPULATE), rather than one page at a time as queries touch it.
+  bool populate = false;
+
+  // kMmap only: ask the kernel to back the mapping with huge pages
+  // (MADV_HUGEPAGE).  This is only a hint; most filesystems ignore it.
+  bool huge_pages = false;
+
+  // kPread only: if the file has no term dictionary (see
+  // IndexReader::has_term_dictionary()), as version 1 files don't, make
+  // one when it is opened, by reading every word out of its index hash
+  // table, so that its words can be walked in order (see ExpandFrom()).
+  // That costs a couple of reads per word.  ResidentIndex always makes
+  // one, from the words it decodes.
+  bool build_term_dictionary = false;
+};
+
+// An IndexReader is a read-only view of one index file in the hw3
+// on-disk format (see libhw3/LayoutStructs.h), in any version of it
+// (see IndexWriter.h).  Subclasses decide how the bytes get from the
+// file into memory.  Once Open() succeeds, an
+// IndexReader has no mutable state, so a single reader can be shared
+// by any number of threads.
+class IndexReader {
+ public:
+  virtual ~IndexReader() { }
+
+  // Returns a new (unopened) reader for "file_name" of the kind that
+  // "options" asks for.  The caller owns the returned reader.
+  static IndexReader* Create(const std::string& file_name,
+                             const IndexReaderOptions& options);
+
+  // Opens the index file and reads its header and the headers of its
+  // doctable and index hash tables.  If "validate" is true, also
+  // checks the file's CRC32 checksum against the one in the header.
+  //
+  // Returns false if the file can't be read or isn't a valid index.
+  virtual bool Open(bool validate) = 0;
+
+  // Checks the file's CRC32 checksum against the one in its header, as
+  // Open(true) does, but for a reader that is already open, and
+  // without getting in the way of lookups: the file is read afresh,
+  // a chunk at a time.  This lets a server open its indices with
+  // Open(false), start answering queries, and verify them in the
+  // background.  Returns false if the checksums differ, or if the file
+  // can't be read or is no longer the size it was when it was opened.
+  bool VerifyChecksum() const;
+
+  // Looks up "word" in the index.  Returns false if the word isn't in
+  // the index; otherwise returns true and fills "postings" with the
+  // documents containing the word, in docID order.
+  virtual bool LookupWord(const std::string& word,
+                          PostingList* const postings) const = 0;
+
+  // Looks up how many documents contain "word", without decoding its
+  // postings.  Returns false if the word isn't in the index.
+  virtual bool LookupDocFrequency(const std::string& word,
+                                  size_t* const df) const = 0;
+
+  // Looks up where "word" appears in each of the documents "doc_ids",
+  // which must be in increasing docID order and must all contain the
+  // word, so that (*positions)[i] holds the word's positions in
+  // doc_ids[i], in increasing order.  Only those documents' positions
+  // are decoded.  Returns false if the word or any of the documents
+  // can't be found.
+  virtual bool LookupPositions(
+      const std::string& word, const std::vector<DocID_t>& doc_ids,
+      std::vector<std::vector<DocPositionOffset_t>>* const positions)
+      const = 0;
+
+  // Looks up the name of document "doc_id".  Returns false if there is
+  // no such document.  Readers of files with a document name pool (see
+  // has_doc_name_pool()) decode the name from the pool, reusing the
+  // storage "name" already has.
+  virtual bool LookupDocName(DocID_t doc_id,
+                             std::string* const name) const = 0;
+
+  // Fills "doc_ids" with the docID of every document in the index, in
+  // increasing order.  Returns false if the doctable can't be read.
+  virtual bool ListDocs(std::vector<DocID_t>* const doc_ids) const = 0;
+
+  // Returns roughly how many bytes of memory the reader holds on to
+  // (allocated or mapped) while it is open.
+  virtual size_t MemoryFootprint() const = 0;
+
+  const std::string& file_name() const { return file_name_; }
+
+  // The version of the index file format (1, 2, or 3); 0 until Open()
+  // has read the header.
+  int format_version() const { return format_version_; }
+
+  // How many documents the index holds.
+  size_t num_docs() const { return num_docs_; }
+
+  // True if the reader knows how many words each document has, which
+  // BM25 ranking normalizes by (see Scoring.h).  Version 3 files carry
+  // the lengths; a ResidentIndex works them out for older files as it
+  // loads them, but the other readers of older files don't have them.
+  bool has_doc_lengths() const { return !length_ids_.empty(); }
+
+  // How many words document "doc_id" has, or 0 if that isn't known.
+  uint32_t doc_length(DocID_t doc_id) const;
+
+  // How many words the index's documents have on average, or 0 if that
+  // isn't known.
+  double average_doc_length() const { return average_doc_length_; }
+
+  // True if the reader has a sorted dictionary of the index's words,
+  // which is what ExpandPrefix() and ExpandRange() need.  Version 2
+  // files carry one; a ResidentIndex builds one for a version 1 file
+  // as it loads it, but the other readers of version 1 files don't
+  // have one.
+  bool has_term_dictionary() const { return dictionary_.valid(); }
+
+  // True if the file's positions are word numbers rather than byte
+  // offsets (see kWordPositionsSection in IndexWriter.h), which phrase
+  // and proximity queries need.
+  bool has_word_positions() const { return word_positions_; }
+
+  // True if the reader has a Bloom filter of the index's words (see
+  // TermFilter.h).  Version 2 and 3 files carry one.
+  bool has_term_filter() const { return filter_.valid(); }
+
+  // True if the reader has the documents' names in a DocNamePool (see
+  // kDocNamesSection in IndexWriter.h), which it then looks names up
+  // in rather than in the doctable.  Version 2 and 3 files whose docIDs
+  // have no gaps carry one.
+  bool has_doc_name_pool() const { return doc_names_.valid(); }
+
+  // Returns false if "word" is certainly not in the index, which the
+  // term filter can tell without looking for it, and true if it may
+  // be.  Without a term filter, any word may be.
+  bool MayContain(const std::string& word) const {
+    return filter_.MayContain(word);
+  }
+
+  // The names of the documents that the index deletes or replaces in
+  // the indices older than it (see kTombstoneSection in IndexWriter.h),
+  // in sorted order.  Only delta indices have any.
+  const std::vector<std::string>& tombstones() const { return tombstones_; }
+
+  // True if the index is one shard of a collection split across several
+  // index files (see kShardSection in IndexWriter.h), in which case
+  // shard() says where it stands.  A shard's average_doc_length() is
+  // the whole collection's.
+  bool is_shard() const { return shard_.num_shards > 0; }
+  const ShardInfo& shard() const { return shard_; }
+
+  // When the crawl that read document "doc_id"'s file started, in
+  // nanoseconds since the epoch (see kCrawlTimesSection in
+  // IndexWriter.h), or 0 if the index doesn't say.
+  uint64_t crawl_time(DocID_t doc_id) const;
+
+  // Appends the index's words that start with "prefix" (or, for
+  // ExpandRange(), the words w with first <= w <= last, and for
+  // ExpandFrom(), the words w with first <= w) to "terms", in sorted
+  // order, stopping after "max_terms" of them.  Returns false if it had
+  // to stop short.  Without a term dictionary, finds no words.
+  bool ExpandPrefix(const std::string& prefix, size_t max_terms,
+                    std::vector<std::string>* const terms) const {
+    return dictionary_.ExpandPrefix(prefix, max_terms, terms);
+  }
+  bool ExpandRange(const std::string& first, const std::string& last,
+                   size_t max_terms,
+                   std::vector<std::string>* const terms) const {
+    return dictionary_.ExpandRange(first, last, max_terms, terms);
+  }
+  bool ExpandFrom(const std::string& first, size_t max_terms,
+                  std::vector<std::string>* const terms) const {
+    return dictionary_.ExpandFrom(first, max_terms, terms);
+  }
+
+ protected:
+  explicit IndexReader(const std::string& file_name)
+    : file_name_(file_name), format_version_(0), checksum_(0),
+      file_size_(0), word_positions_(false), num_docs_(0),
+      average_doc_length_(0) { }
+
+  // Copies a T out of the "len" bytes at "buf", "offset" bytes in,
+  // converting it to host format.  Returns false if T would run past
+  // the end of the buffer.
+  template <typename T>
+  static bool ParseAt(const uint8_t* buf, size_t len, int64_t offset,
+                      T* out) {
+    if (offset < 0 || offset + sizeof(T) > len) {
+      return false;
+    }
+    memcpy(out, buf + offset, sizeof(T));
+    out->ToHostFormat();
+    return true;
+  }
+
+  // Checks a header that has already been converted to host format
+  // against the size of the file it came from, and notes which format
+  // version the file is in and what its checksum should be.
+  bool CheckHeader(const hw3::IndexFileHeader& header, int64_t file_size);
+
+  // Notes how many documents the index holds, from the "num_buckets"
+  // BucketRecords of the doctable, held in disk format at "records".
+  void CountDocs(const uint8_t* records, int32_t num_buckets);
+  void set_num_docs(size_t num_docs) { num_docs_ = num_docs; }
+
+  // Sets the document lengths, for readers of files that don't carry
+  // them: document doc_ids[i] has lengths[i] words.  "doc_ids" must be
+  // in increasing order.  num_docs() must already be set.
+  void SetDocLengths(std::vector<DocID_t> doc_ids,
+                     std::vector<uint32_t> lengths);
+
+  // Picks out the sections this reader knows about from the "len" bytes
+  // of version 2 or 3 sections at "buf" (see IndexWriter.h), which
+  // must stay put for as long as the reader is open.  Returns false if
+  // the sections are malformed.
+  bool ParseSections(const uint8_t* buf, size_t len);
+
+  // Like ParseSections(), but first copies the sections, so that the
+  // caller needn't keep "buf" around.
+  bool CopySections(const uint8_t* buf, size_t len);
+
+  // Makes the term dictionary from "terms", which must be sorted and
+  // have no duplicates, for readers of files that don't carry one.
+  void BuildTermDictionary(const std::vector<std::string>& terms);
+
+  // How many bytes CopySections(), BuildTermDictionary(), the
+  // document lengths, and the tombstones hold on to.
+  size_t sections_footprint() const {
+    size_t bytes = section_copy_.capacity() +
+                   length_ids_.capacity() * sizeof(DocID_t) +
+                   lengths_.capacity() * sizeof(uint32_t) +
+                   tombstones_.capacity() * sizeof(std::string);
+    for (const std::string& name : tombstones_) {
+      bytes += name.capacity();
+    }
+    return bytes;
+  }
+
+  // Fills "postings" from the postings of a word, held in the "len"
+  // bytes at "buf", which start "offset" bytes into the file.  Parses
+  // them as a docID table or as a compressed posting list, depending on
+  // the file's format version.
+  bool ParsePostings(const uint8_t* buf, size_t len,
+                     hw3::IndexFileOffset_t offset,
+                     PostingList* const postings) const;
+
+  // Like ParsePostings(), but only sets "df" to how many documents the
+  // postings list.  Only the first kDocFrequencyBytes bytes of a
+  // version 2 or 3 posting list are needed for that.
+  bool ParseDocFrequency(const uint8_t* buf, size_t len,
+                         size_t* const df) const;
+  static const size_t kDocFrequencyBytes;
+
+  // Like ParsePostings(), but fills "positions" with the positions of
+  // documents "doc_ids" (see LookupPositions()).
+  bool ParsePositions(const uint8_t* buf, size_t len,
+                      hw3::IndexFileOffset_t offset,
+                      const std::vector<DocID_t>& doc_ids,
+                      std::vector<std::vector<DocPositionOffset_t>>* const
+                        positions) const;
+
+  // The document name pool; see has_doc_name_pool().
+  const DocNamePool& doc_names() const { return doc_names_; }
+
+  // Fills "doc_ids" with the docIDs the document name pool names, 1
+  // through doc_names().size().
+  void ListPooledDocs(std::vector<DocID_t>* const doc_ids) const;
+
+  // Fills "postings" from the on-disk docID table held in the "len"
+  // bytes at "table".  "table_offset" is where the table starts in the
+  // file; the table's internal pointers are file offsets.
+  static bool ParseDocIDTable(const uint8_t* table, size_t len,
+                              hw3::IndexFileOffset_t table_offset,
+                              PostingList* const postings);
+
+ private:
+  // Parses a kDocLengthsSection held in the "len" bytes at "buf".
+  bool ParseDocLengths(const uint8_t* buf, size_t len);
+
+  // Parses a kTombstoneSection held in the "len" bytes at "buf".
+  bool ParseTombstones(const uint8_t* buf, size_t len);
+
+  // Parses a kShardSection held in the "len" bytes at "buf".
+  bool ParseShard(const uint8_t* buf, size_t len);
+
+  // Parses a kCrawlTimesSection held in the "len" bytes at "buf".
+  bool ParseCrawlTimes(const uint8_t* buf, size_t len);
+
+  // How many bytes VerifyChecksum() reads at a time.
+  static const size_t kChecksumChunkBytes;
+
+  std::string file_name_;
+  int format_version_;
+  uint32_t checksum_;
+  int64_t file_size_;
+  bool word_positions_;
+  TermDictionary dictionary_;
+  TermFilter filter_;
+  DocNamePool doc_names_;
+
+  // The documents that have lengths, in docID order, and their lengths.
+  size_t num_docs_;
+  std::vector<DocID_t> length_ids_;
+  std::vector<uint32_t> lengths_;
+  double average_doc_length_;
+
+  std::vector<std::string> tombstones_;
+  ShardInfo shard_;
+
+  // The first docID of each run of documents with the same crawl time,
+  // in increasing order, and that time.
+  std::vector<std::pair<DocID_t, uint64_t>> crawl_times_;
+
+  // The bytes behind dictionary_ and filter_, when the reader owns them.
+  std::vector<uint8_t> section_copy_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_INDEXREADER_H_
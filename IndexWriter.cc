@@ -0,0 +1,1313 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <pthread.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "./BlockWriter.h"
+#include "./CRC32.h"
+#include "./DocNamePool.h"
+#include "./IndexWriter.h"
+#include "./IndexReader.h"
+#include "./PostingCodec.h"
+#include "./Scoring.h"
+#include "./TermDictionary.h"
+#include "./TermFilter.h"
+#include "./libhw3/LayoutStructs.h"
+#include "./libhw3/Utils.h"
+
+extern "C" {
+  #include "libhw1/HashTable.h"
+  #include "libhw1/LinkedList.h"
+}
+
+using std::pair;
+using std::string;
+using std::unordered_map;
+using std::vector;
+using hw3::BucketListHeader;
+using hw3::BucketRecord;
+using hw3::DocIDElementHeader;
+using hw3::DocIDElementPosition;
+using hw3::DoctableElementHeader;
+using hw3::ElementPositionRecord;
+using hw3::IndexFileHeader;
+using hw3::WordPostingsHeader;
+
+namespace hw4 {
+
+// One element of an on-disk hash table: the key it is hashed by, and
+// the bytes it is made of.
+struct Element {
+  HTKey_t key;
+  vector<uint8_t> bytes;
+};
+
+// Appends "record" to "out" in disk (network) byte order.
+template <typename T>
+static void AppendRecord(T record, vector<uint8_t>* const out) {
+  record.ToDiskFormat();
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&record);
+  out->insert(out->end(), bytes, bytes + sizeof(record));
+}
+
+// For each document, the sorted byte offsets of all of its words.
+typedef unordered_map<DocID_t, vector<DocPositionOffset_t>> WordOffsets;
+
+// Makes one element per document in "dt": a DoctableElementHeader
+// followed by the document's name.  Returns false if a name is too
+// long for the format.
+static bool DocTableElements(DocTable* dt, vector<Element>* const elements);
+
+// Fills "names" with the name of each document in "dt", names[i]
+// being document i + 1's.  Returns false if the docIDs don't run 1, 2,
+// ..., N, which a DocNamePool needs.
+static bool DocNames(DocTable* dt, vector<string>* const names);
+
+// Gathers the byte offsets of every word of every document in "mi".
+static void GatherWordOffsets(MemIndex* mi, WordOffsets* const offsets);
+
+// Makes one element per word in "mi": a WordPostingsHeader, the word,
+// and the word's compressed postings, with each position turned from a
+// byte offset into a word number by looking it up in "offsets".  If
+// "avgdl" is positive, the postings get impact bounds, taking each
+// document's length from "offsets".  Also appends each word to
+// "words".  Returns false if a word is too long for the format.
+static bool IndexElements(MemIndex* mi, const WordOffsets& offsets,
+                          double avgdl, vector<Element>* const elements,
+                          vector<string>* const words);
+
+// Appends the contents of a kDocLengthsSection to "out".  "lengths"
+// holds each document with words and how many it has, in docID order.
+static void DocLengths(const vector<pair<DocID_t, uint64_t>>& lengths,
+                       uint64_t num_docs, vector<uint8_t>* const out);
+
+// Appends the contents of a kTombstoneSection naming "names" (which
+// needn't be sorted, and may repeat) to "out".
+static void Tombstones(vector<string> names, vector<uint8_t>* const out);
+
+// Appends the contents of a kShardSection for "shard" to "out".
+static void Shard(const ShardInfo& shard, vector<uint8_t>* const out);
+
+// Appends the contents of a kCrawlTimesSection to "out": "runs" holds
+// the first docID of each run of documents, in increasing order, and
+// when the crawl that read them started.
+static void CrawlTimes(const vector<pair<DocID_t, uint64_t>>& runs,
+                       vector<uint8_t>* const out);
+
+// One shard for WriteShardedIndex() to write, and how that went.
+struct ShardWrite {
+  MemIndex* mi;
+  DocTable* dt;
+  const char* file_name;
+  int version;
+  ShardInfo info;
+  int64_t bytes;
+};
+
+// The start routine of a WriteShardedIndex() thread; writes the
+// ShardWrite "arg".
+static void* WriteShard(void* arg);
+
+// Appends a section tagged "tag" and holding "contents" to "out".
+static void AppendSection(uint32_t tag, const vector<uint8_t>& contents,
+                          vector<uint8_t>* const out);
+
+// Where the parts of an on-disk hash table go: the bucket records
+// come first, then each bucket's chain of element positions followed
+// by the elements themselves.
+struct TableLayout {
+  vector<vector<size_t>> buckets;   // the elements in each bucket
+  vector<int64_t> chains;           // where each bucket's chain starts
+  vector<int64_t> positions;        // where each element starts
+  int64_t end;                      // where the table ends
+};
+
+// Lays out a hash table that starts "offset" bytes into the file, of
+// elements with keys "keys" that are "sizes" bytes long, with about
+// "load" elements per bucket.  Returns false if the table would run
+// past what a 32-bit file offset can reach.
+static bool LayOutTable(const vector<HTKey_t>& keys,
+                        const vector<int64_t>& sizes, int64_t offset,
+                        int64_t load, TableLayout* const layout);
+
+// Lays "elements" out as an on-disk hash table that will start
+// "offset" bytes into the file, appending it to "out".  Returns false
+// if the table would run past what a 32-bit file offset can reach.
+static bool BuildTable(const vector<Element>& elements, int64_t offset,
+                       vector<uint8_t>* const out);
+
+// Writes an on-disk hash table to "out", starting where "out" is, of
+// elements with keys "keys" that are "sizes" bytes long; element e is
+// appended to "out" by write_element(e), so it needn't be in memory
+// before then.  The table has about "load" elements per bucket.
+// Returns false if the table would run past what a 32-bit file offset
+// can reach, or couldn't be written.
+static bool WriteTable(const vector<HTKey_t>& keys,
+                       const vector<int64_t>& sizes,
+                       const std::function<bool(size_t)>& write_element,
+                       BlockWriter* const out, int64_t load = 1);
+
+// Like WriteTable() above, but for elements already laid out in memory.
+static bool WriteTable(const vector<Element>& elements,
+                       BlockWriter* const out);
+
+// Appends the version 1 index element for "wp" to "out": a
+// WordPostingsHeader, the word, and a hash table from each docID to
+// the word's positions in that document.  If "out" is null, appends
+// nothing.  Returns the element's size in bytes, or -1 if it is too
+// big for the format or couldn't be written.
+static int64_t WordPostingsV1(WordPostings* wp, BlockWriter* const out);
+
+// How many documents a version 1 docID table has per bucket.  Readers
+// read a word's docID table whole, so longer chains cost little, and
+// the table takes up less room.
+static const int64_t kDocIDTableLoad = 4;
+
+// One input of MergeIndexFiles().
+struct MergeInput {
+  std::unique_ptr<IndexReader> reader;
+  vector<DocID_t> doc_ids;   // the input's docIDs, in increasing order
+  vector<DocID_t> new_ids;   // new_ids[i] is doc_ids[i]'s docID in the
+                             // merged index, or 0 if it isn't kept
+  uint64_t file_time = 0;    // when the file was last modified, in
+                             // nanoseconds since the epoch
+};
+
+// How many words of each input's term dictionary MergeIndexFiles()
+// reads in at a time.
+static const size_t kMergeWordBatch = 1024;
+
+// How far a walk over one merge input's words has got: a batch of the
+// words from its term dictionary, and the next of them to merge.
+struct WordCursor {
+  vector<string> batch;
+  size_t next = 0;
+  bool complete = false;  // true if there are no words after the batch
+};
+
+// A document name that MergeIndexFiles() has already seen, by its hash:
+// the name of document doc_ids[index] of input "input", or, if
+// "tombstone" is true, that input's tombstones()[index].
+struct SeenName {
+  uint64_t hash;
+  uint32_t input;
+  bool tombstone;
+  size_t index;
+};
+
+// Opens index file "file_name" as an input of a version "version"
+// merge, and lists its documents.  Returns false if it can't be read
+// or can't go into such a merge.
+static bool OpenMergeInput(const string& file_name, int version,
+                           MergeInput* const input);
+
+// Moves "cursor" on to the next batch of "reader"'s words: the first
+// kMergeWordBatch of them if it hasn't read any yet, and otherwise the
+// kMergeWordBatch after the last word of the batch it has.
+static void NextWordBatch(const IndexReader& reader,
+                          WordCursor* const cursor);
+
+// Calls fn(word) on each word that any of "inputs" has, in sorted
+// order, until fn returns false or the words run out.  The inputs'
+// term dictionaries are merged a batch of words at a time, so their
+// words are never all in memory at once.
+template <typename Fn>
+static void ForEachMergedWord(const vector<MergeInput>& inputs, Fn fn);
+
+// Sets *found to whether "name", whose hash is "hash", is one of the
+// names in "seen", which is in hash order.  Only the names whose hashes
+// match are read back to compare.  Returns false if one can't be read.
+static bool FindName(const vector<MergeInput>& inputs,
+                     const vector<SeenName>& seen, uint64_t hash,
+                     const string& name, bool* const found);
+
+// Numbers the documents of "inputs" in the merged index, dropping all
+// but the last copy of each (see MergeIndexFiles()), and makes one
+// doctable element per document kept, appending the encoded
+// DocNamePool of their names to "pool".  Returns false if a name can't
+// be read or is too long for the format.
+static bool NumberDocs(vector<MergeInput>* const inputs,
+                       vector<Element>* const elements,
+                       vector<uint8_t>* const pool);
+
+// Gathers the postings of "word" from each of "inputs", in the merged
+// index's docIDs, and appends them, compressed, to "out".  If
+// "lengths" isn't null, the postings get impact bounds, taking each
+// document's length from (*lengths)[docID].  Returns false if an
+// input's postings can't be read.
+static bool MergePostings(const vector<MergeInput>& inputs,
+                          const string& word,
+                          const vector<uint32_t>* lengths, double avgdl,
+                          vector<uint8_t>* const out);
+
+int64_t WriteIndex(MemIndex* mi, DocTable* dt, const char* file_name) {
+  vector<Element> elements;
+  if (!DocTableElements(dt, &elements)) {
+    return 0;
+  }
+
+  // Each word's postings are sized up front, so that the index table
+  // can be laid out before any of it is written, and are then put
+  // together one word at a time as the table is written.
+  vector<WordPostings*> words;
+  vector<HTKey_t> keys;
+  vector<int64_t> sizes;
+  HTIterator* it = HTIterator_Allocate(mi);
+  bool ok = true;
+  for (; ok && HTIterator_IsValid(it); HTIterator_Next(it)) {
+    HTKeyValue_t kv;
+    HTIterator_Get(it, &kv);
+    WordPostings* wp = static_cast<WordPostings*>(kv.value);
+    int64_t size = WordPostingsV1(wp, nullptr);
+    if (size < 0) {
+      ok = false;
+      break;
+    }
+    words.push_back(wp);
+    keys.push_back(FNVHash64(reinterpret_cast<unsigned char*>(wp->word),
+                             strlen(wp->word)));
+    sizes.push_back(size);
+  }
+  HTIterator_Free(it);
+  if (!ok) {
+    return 0;
+  }
+
+  BlockWriter out(file_name);
+  if (!out.Open(sizeof(IndexFileHeader)) || !WriteTable(elements, &out)) {
+    return 0;
+  }
+  int64_t doctable_bytes = out.offset() - sizeof(IndexFileHeader);
+  elements.clear();
+  elements.shrink_to_fit();
+  auto write_word = [&words, &out](size_t w) {
+    return WordPostingsV1(words[w], &out) >= 0;
+  };
+  if (!WriteTable(keys, sizes, write_word, &out)) {
+    return 0;
+  }
+  int64_t file_size = out.offset();
+  IndexFileHeader header(hw3::kMagicNumber, out.checksum(), doctable_bytes,
+                         file_size - sizeof(IndexFileHeader) -
+                         doctable_bytes);
+  header.ToDiskFormat();
+  return out.Finish(&header, sizeof(header)) ? file_size : 0;
+}
+
+int64_t WriteCompressedIndex(MemIndex* mi, DocTable* dt,
+                             const char* file_name, int version,
+                             const vector<string>& tombstones,
+                             const ShardInfo* shard, uint64_t crawl_time) {
+  if (version != 2 && version != 3) {
+    return 0;
+  }
+
+  // Every element of the file is put together in memory first, and the
+  // file is then written front to back, with the header (and its
+  // checksum) going in last.
+  vector<Element> doc_elements, elements;
+  if (!DocTableElements(dt, &doc_elements)) {
+    return 0;
+  }
+  vector<string> words;
+  WordOffsets offsets;
+  GatherWordOffsets(mi, &offsets);
+  uint64_t num_docs = DocTable_NumDocs(dt), total_words = 0;
+  for (const auto& doc : offsets) {
+    total_words += doc.second.size();
+  }
+  double avgdl = 0;
+  if (version == 3) {
+    // A positive avgdl is what asks IndexElements for impacts, so even
+    // an index with no words gets one.
+    avgdl = num_docs > 0 && total_words > 0 ?
+            static_cast<double>(total_words) / num_docs : 1.0;
+    // A shard's documents are scored as part of the whole collection.
+    if (shard != nullptr && shard->collection_docs > 0 &&
+        shard->collection_words > 0) {
+      avgdl = static_cast<double>(shard->collection_words) /
+              shard->collection_docs;
+    }
+  }
+  if (!IndexElements(mi, offsets, avgdl, &elements, &words)) {
+    return 0;
+  }
+
+  // The sections after the index: the term dictionary, the marker
+  // that says positions are word numbers, the term filter, (in
+  // version 3) the document lengths, any tombstones, the document
+  // names, where the index stands in its collection, if it is a
+  // shard, and when its crawl started, if that is known.
+  vector<uint8_t> sections, contents;
+  std::sort(words.begin(), words.end());
+  TermDictionary::Build(words, &contents);
+  AppendSection(kTermDictionarySection, contents, &sections);
+  AppendSection(kWordPositionsSection, {}, &sections);
+  contents.clear();
+  TermFilter::Build(words, &contents);
+  AppendSection(kTermFilterSection, contents, &sections);
+  if (version == 3) {
+    vector<pair<DocID_t, uint64_t>> lengths;
+    for (const auto& doc : offsets) {
+      lengths.push_back({doc.first, doc.second.size()});
+    }
+    std::sort(lengths.begin(), lengths.end());
+    contents.clear();
+    DocLengths(lengths, num_docs, &contents);
+    AppendSection(kDocLengthsSection, contents, &sections);
+  }
+  if (!tombstones.empty()) {
+    contents.clear();
+    Tombstones(tombstones, &contents);
+    AppendSection(kTombstoneSection, contents, &sections);
+  }
+  vector<string> names;
+  if (DocNames(dt, &names)) {
+    contents.clear();
+    DocNamePool::Build(names, &contents);
+    AppendSection(kDocNamesSection, contents, &sections);
+  }
+  if (shard != nullptr) {
+    contents.clear();
+    Shard(*shard, &contents);
+    AppendSection(kShardSection, contents, &sections);
+  }
+  if (crawl_time != 0) {
+    contents.clear();
+    CrawlTimes({{1, crawl_time}}, &contents);
+    AppendSection(kCrawlTimesSection, contents, &sections);
+  }
+
+  BlockWriter out(file_name);
+  if (!out.Open(sizeof(IndexFileHeader)) || !WriteTable(doc_elements, &out)) {
+    return 0;
+  }
+  int64_t doctable_bytes = out.offset() - sizeof(IndexFileHeader);
+  if (!WriteTable(elements, &out)) {
+    return 0;
+  }
+  int64_t index_bytes = out.offset() - sizeof(IndexFileHeader) -
+                        doctable_bytes;
+  int64_t file_size = out.offset() + sections.size();
+  if (!out.Append(sections.data(), sections.size())) {
+    return 0;
+  }
+  IndexFileHeader header(version == 3 ? kMagicNumberV3 : kMagicNumberV2,
+                         out.checksum(), doctable_bytes, index_bytes);
+  header.ToDiskFormat();
+  return out.Finish(&header, sizeof(header)) ? file_size : 0;
+}
+
+uint64_t CountWords(MemIndex* mi) {
+  uint64_t words = 0;
+  HTIterator* it = HTIterator_Allocate(mi);
+  for (; HTIterator_IsValid(it); HTIterator_Next(it)) {
+    HTKeyValue_t kv;
+    HTIterator_Get(it, &kv);
+    WordPostings* wp = static_cast<WordPostings*>(kv.value);
+    HTIterator* doc_it = HTIterator_Allocate(wp->postings);
+    for (; HTIterator_IsValid(doc_it); HTIterator_Next(doc_it)) {
+      HTKeyValue_t doc;
+      HTIterator_Get(doc_it, &doc);
+      words += LinkedList_NumElements(static_cast<LinkedList*>(doc.value));
+    }
+    HTIterator_Free(doc_it);
+  }
+  HTIterator_Free(it);
+  return words;
+}
+
+int64_t WriteShardedIndex(const vector<MemIndex*>& mis,
+                          const vector<DocTable*>& dts,
+                          const vector<string>& file_names, int version) {
+  size_t num_shards = mis.size();
+  if (num_shards == 0 || dts.size() != num_shards ||
+      file_names.size() != num_shards || num_shards > UINT32_MAX) {
+    return 0;
+  }
+
+  // Every shard needs the whole collection's totals before any of them
+  // can be written, and an ID that tells this collection's shards from
+  // any other's.
+  ShardInfo info;
+  struct timespec now;
+  clock_gettime(CLOCK_REALTIME, &now);
+  info.set_id = (static_cast<uint64_t>(now.tv_sec) << 32) ^
+                (static_cast<uint64_t>(now.tv_nsec) << 8) ^ getpid();
+  info.num_shards = num_shards;
+  for (size_t i = 0; i < num_shards; i++) {
+    info.collection_docs += DocTable_NumDocs(dts[i]);
+    info.collection_words += CountWords(mis[i]);
+  }
+
+  // A shard that can't get a thread of its own is written on this one.
+  vector<ShardWrite> writes(num_shards);
+  vector<pthread_t> threads(num_shards);
+  vector<bool> started(num_shards, false);
+  for (size_t i = 0; i < num_shards; i++) {
+    writes[i] = {mis[i], dts[i], file_names[i].c_str(), version, info, 0};
+    writes[i].info.shard = i;
+    started[i] = pthread_create(&threads[i], nullptr, &WriteShard,
+                                &writes[i]) == 0;
+    if (!started[i]) {
+      WriteShard(&writes[i]);
+    }
+  }
+  int64_t total_bytes = 0;
+  bool ok = true;
+  for (size_t i = 0; i < num_shards; i++) {
+    if (started[i]) {
+      pthread_join(threads[i], nullptr);
+    }
+    total_bytes += writes[i].bytes;
+    ok = ok && writes[i].bytes > 0;
+  }
+  if (!ok) {
+    for (size_t i = 0; i < num_shards; i++) {
+      if (writes[i].bytes > 0) {
+        unlink(file_names[i].c_str());
+      }
+    }
+    return 0;
+  }
+  return total_bytes;
+}
+
+int64_t MergeIndexFiles(const vector<string>& inputs, const char* file_name,
+                        int version, MergeStats* const stats) {
+  if (version != 2 && version != 3) {
+    return 0;
+  }
+  MergeStats merged;
+  vector<MergeInput> sources(inputs.size());
+  for (size_t i = 0; i < inputs.size(); i++) {
+    if (!OpenMergeInput(inputs[i], version, &sources[i])) {
+      return 0;
+    }
+    struct stat st;
+    if (stat(inputs[i].c_str(), &st) == 0) {
+      merged.bytes_in += st.st_size;
+      sources[i].file_time = st.st_mtim.tv_sec * UINT64_C(1000000000) +
+                             st.st_mtim.tv_nsec;
+    }
+    merged.docs_in += sources[i].doc_ids.size();
+    merged.tombstones += sources[i].reader->tombstones().size();
+  }
+
+  // The doctable is small next to the postings, so it is laid out in
+  // memory, as WriteCompressedIndex() does.
+  vector<Element> elements;
+  vector<uint8_t> doctable, pool;
+  if (!NumberDocs(&sources, &elements, &pool) ||
+      !BuildTable(elements, sizeof(IndexFileHeader), &doctable)) {
+    return 0;
+  }
+  merged.docs_out = elements.size();
+  elements.clear();
+  elements.shrink_to_fit();
+
+  // Impacts are relative to the merged index's average document length.
+  vector<uint32_t> lengths;
+  double avgdl = 0;
+  if (version == 3) {
+    uint64_t total_words = 0;
+    lengths.assign(merged.docs_out + 1, 0);
+    for (const MergeInput& input : sources) {
+      for (size_t i = 0; i < input.doc_ids.size(); i++) {
+        if (input.new_ids[i] != 0) {
+          lengths[input.new_ids[i]] = input.reader->doc_length(
+              input.doc_ids[i]);
+          total_words += lengths[input.new_ids[i]];
+        }
+      }
+    }
+    avgdl = merged.docs_out > 0 && total_words > 0 ?
+            static_cast<double>(total_words) / merged.docs_out : 1.0;
+  }
+
+  // Each kept document keeps its crawl time.  The documents of each
+  // input are numbered together, so the times come in runs.
+  vector<pair<DocID_t, uint64_t>> crawl_times;
+  for (const MergeInput& input : sources) {
+    for (size_t i = 0; i < input.doc_ids.size(); i++) {
+      if (input.new_ids[i] == 0) {
+        continue;
+      }
+      uint64_t time = input.reader->crawl_time(input.doc_ids[i]);
+      if (time == 0) {
+        time = input.file_time;
+      }
+      if (crawl_times.empty() || crawl_times.back().second != time) {
+        crawl_times.push_back({input.new_ids[i], time});
+      }
+    }
+  }
+
+  // Positions are copied as they are, so the merged index only has word
+  // positions if every input does; otherwise, some of them are byte
+  // offsets (see kWordPositionsSection).
+  bool word_positions = true;
+  for (const MergeInput& input : sources) {
+    word_positions = word_positions && input.reader->has_word_positions();
+  }
+
+  // Every input has a term dictionary, so the merged index's words are
+  // the union of theirs, which ForEachMergedWord() walks in order.  It
+  // walks them three times over -- once to count them, once to merge
+  // their postings, and once to build the merged dictionary and filter
+  // -- which is cheap next to merging the postings, and means they are
+  // never gathered in memory.
+  size_t num_words = 0;
+  ForEachMergedWord(sources, [&num_words](const string&) {
+    num_words++;
+    return true;
+  });
+
+  // The index hash table gets one bucket per word.  Its elements are
+  // streamed out after the bucket records one word at a time, and the
+  // chains of element positions go after the elements, once every
+  // element's position is known; the doctable and the bucket records
+  // are filled in last.  Words whose documents were all dropped are
+  // left out, which leaves a few buckets empty.
+  int64_t index_offset = sizeof(IndexFileHeader) + doctable.size();
+  int64_t num_buckets = std::max<int64_t>(1, num_words);
+  if (num_buckets > INT32_MAX) {
+    return 0;
+  }
+  int64_t cursor = index_offset + sizeof(BucketListHeader) +
+                   num_buckets * sizeof(BucketRecord);
+  BlockWriter out(file_name);
+  bool ok = cursor <= INT32_MAX && out.Open(cursor);
+
+  vector<pair<int64_t, int64_t>> placed;   // (bucket, element position)
+  vector<bool> kept;                       // whether each word was kept
+  vector<uint8_t> postings;
+  if (ok) {
+    ForEachMergedWord(sources, [&](const string& word) {
+      postings.clear();
+      if (word.size() > INT16_MAX ||
+          !MergePostings(sources, word, version == 3 ? &lengths : nullptr,
+                         avgdl, &postings) ||
+          postings.size() > INT32_MAX) {
+        ok = false;
+        return false;
+      }
+      kept.push_back(!postings.empty());
+      if (postings.empty()) {
+        return true;
+      }
+      WordPostingsHeader wph(word.size(), postings.size());
+      HTKey_t key = FNVHash64((unsigned char*) word.data(), word.size());
+      placed.push_back({key % num_buckets, cursor});
+      cursor += sizeof(wph) + word.size() + postings.size();
+      ok = cursor <= INT32_MAX && out.AppendRecord(wph) &&
+           out.Append(word.data(), word.size()) &&
+           out.Append(postings.data(), postings.size());
+      merged.words++;
+      return ok;
+    });
+  }
+  if (!ok || kept.size() != num_words) {
+    return 0;
+  }
+
+  // The chains, bucket by bucket.
+  std::stable_sort(placed.begin(), placed.end(),
+                   [](const pair<int64_t, int64_t>& a,
+                      const pair<int64_t, int64_t>& b) {
+                     return a.first < b.first;
+                   });
+  vector<uint8_t> table, chains;
+  AppendRecord(BucketListHeader(num_buckets), &table);
+  size_t next = 0;
+  for (int64_t b = 0; b < num_buckets; b++) {
+    size_t first = next;
+    for (; next < placed.size() && placed[next].first == b; next++) {
+      AppendRecord(ElementPositionRecord(placed[next].second), &chains);
+    }
+    AppendRecord(BucketRecord(next - first, cursor + first *
+                              sizeof(ElementPositionRecord)), &table);
+  }
+  cursor += chains.size();
+  int64_t index_bytes = cursor - index_offset;
+
+  // The sections, as WriteCompressedIndex() writes them.
+  vector<uint8_t> sections, contents, filter;
+  TermDictionary::Builder dictionary(merged.words, &contents);
+  TermFilter::Builder filter_builder(merged.words, &filter);
+  size_t w = 0;
+  ForEachMergedWord(sources, [&](const string& word) {
+    if (kept[w++]) {
+      dictionary.Add(word);
+      filter_builder.Add(word);
+    }
+    return w < kept.size();
+  });
+  AppendSection(kTermDictionarySection, contents, &sections);
+  if (word_positions) {
+    AppendSection(kWordPositionsSection, {}, &sections);
+  }
+  AppendSection(kTermFilterSection, filter, &sections);
+  if (version == 3) {
+    vector<pair<DocID_t, uint64_t>> doc_lengths;
+    for (DocID_t doc_id = 1; doc_id < lengths.size(); doc_id++) {
+      if (lengths[doc_id] > 0) {
+        doc_lengths.push_back({doc_id, lengths[doc_id]});
+      }
+    }
+    contents.clear();
+    DocLengths(doc_lengths, merged.docs_out, &contents);
+    AppendSection(kDocLengthsSection, contents, &sections);
+  }
+  AppendSection(kDocNamesSection, pool, &sections);
+  if (!crawl_times.empty()) {
+    contents.clear();
+    CrawlTimes(crawl_times, &contents);
+    AppendSection(kCrawlTimesSection, contents, &sections);
+  }
+  int64_t file_size = cursor + sections.size();
+  ok = ok && out.Append(chains.data(), chains.size()) &&
+       out.Append(sections.data(), sections.size());
+
+  // What was streamed out has been checksummed on the way; the
+  // doctable and bucket records are checksummed now and combined with
+  // it, and go in front of it with the header, in one last write.
+  CRC32 crc;
+  crc.Fold(doctable.data(), doctable.size());
+  crc.Fold(table.data(), table.size());
+  IndexFileHeader header(version == 3 ? kMagicNumberV3 : kMagicNumberV2,
+                         CRC32::Combine(crc.GetFinalCRC(), out.checksum(),
+                                        file_size - index_offset -
+                                        table.size()),
+                         doctable.size(), index_bytes);
+  vector<uint8_t> front;
+  AppendRecord(header, &front);
+  front.insert(front.end(), doctable.begin(), doctable.end());
+  front.insert(front.end(), table.begin(), table.end());
+  if (!ok || !out.Finish(front.data(), front.size())) {
+    return 0;
+  }
+  if (stats != nullptr) {
+    *stats = merged;
+  }
+  return file_size;
+}
+
+static bool DocTableElements(DocTable* dt, vector<Element>* const elements) {
+  HTIterator* it = HTIterator_Allocate(DT_GetIDToNameTable(dt));
+  bool ok = true;
+  for (; ok && HTIterator_IsValid(it); HTIterator_Next(it)) {
+    HTKeyValue_t kv;
+    HTIterator_Get(it, &kv);
+    const char* name = static_cast<const char*>(kv.value);
+    size_t name_len = strlen(name);
+    if (name_len > INT16_MAX) {
+      ok = false;
+      break;
+    }
+
+    Element element;
+    element.key = kv.key;
+    AppendRecord(DoctableElementHeader(kv.key, name_len), &element.bytes);
+    element.bytes.insert(element.bytes.end(), name, name + name_len);
+    elements->push_back(std::move(element));
+  }
+  HTIterator_Free(it);
+  return ok;
+}
+
+static bool DocNames(DocTable* dt, vector<string>* const names) {
+  vector<pair<DocID_t, const char*>> docs;
+  HTIterator* it = HTIterator_Allocate(DT_GetIDToNameTable(dt));
+  for (; HTIterator_IsValid(it); HTIterator_Next(it)) {
+    HTKeyValue_t kv;
+    HTIterator_Get(it, &kv);
+    docs.push_back({kv.key, static_cast<const char*>(kv.value)});
+  }
+  HTIterator_Free(it);
+  std::sort(docs.begin(), docs.end());
+  for (size_t i = 0; i < docs.size(); i++) {
+    if (docs[i].first != i + 1) {
+      return false;
+    }
+    names->push_back(docs[i].second);
+  }
+  return true;
+}
+
+static void GatherWordOffsets(MemIndex* mi, WordOffsets* const offsets) {
+  HTIterator* it = HTIterator_Allocate(mi);
+  for (; HTIterator_IsValid(it); HTIterator_Next(it)) {
+    HTKeyValue_t kv;
+    HTIterator_Get(it, &kv);
+    WordPostings* wp = static_cast<WordPostings*>(kv.value);
+    HTIterator* doc_it = HTIterator_Allocate(wp->postings);
+    for (; HTIterator_IsValid(doc_it); HTIterator_Next(doc_it)) {
+      HTKeyValue_t doc;
+      HTIterator_Get(doc_it, &doc);
+      vector<DocPositionOffset_t>& doc_offsets = (*offsets)[doc.key];
+      LLIterator* pos_it =
+          LLIterator_Allocate(static_cast<LinkedList*>(doc.value));
+      for (; LLIterator_IsValid(pos_it); LLIterator_Next(pos_it)) {
+        LLPayload_t payload;
+        LLIterator_Get(pos_it, &payload);
+        doc_offsets.push_back(static_cast<DocPositionOffset_t>(
+            reinterpret_cast<uintptr_t>(payload)));
+      }
+      LLIterator_Free(pos_it);
+    }
+    HTIterator_Free(doc_it);
+  }
+  HTIterator_Free(it);
+
+  for (auto& doc : *offsets) {
+    std::sort(doc.second.begin(), doc.second.end());
+  }
+}
+
+static bool IndexElements(MemIndex* mi, const WordOffsets& offsets,
+                          double avgdl, vector<Element>* const elements,
+                          vector<string>* const words) {
+  HTIterator* it = HTIterator_Allocate(mi);
+  bool ok = true;
+  vector<pair<DocID_t, LinkedList*>> docs;
+  vector<DocID_t> doc_ids;
+  vector<vector<DocPositionOffset_t>> positions;
+  vector<uint32_t> impacts;
+  vector<uint8_t> postings;
+  for (; ok && HTIterator_IsValid(it); HTIterator_Next(it)) {
+    HTKeyValue_t kv;
+    HTIterator_Get(it, &kv);
+    WordPostings* wp = static_cast<WordPostings*>(kv.value);
+    size_t word_len = strlen(wp->word);
+    if (word_len > INT16_MAX) {
+      ok = false;
+      break;
+    }
+
+    // The in-memory postings are a hash table from docID to a list of
+    // positions; the compressed ones need them in docID order.
+    docs.clear();
+    HTIterator* doc_it = HTIterator_Allocate(wp->postings);
+    for (; HTIterator_IsValid(doc_it); HTIterator_Next(doc_it)) {
+      HTKeyValue_t doc;
+      HTIterator_Get(doc_it, &doc);
+      docs.push_back({doc.key, static_cast<LinkedList*>(doc.value)});
+    }
+    HTIterator_Free(doc_it);
+    std::sort(docs.begin(), docs.end());
+
+    doc_ids.clear();
+    impacts.clear();
+    positions.assign(docs.size(), vector<DocPositionOffset_t>());
+    for (size_t i = 0; i < docs.size(); i++) {
+      doc_ids.push_back(docs[i].first);
+      LLIterator* pos_it = LLIterator_Allocate(docs[i].second);
+      for (; LLIterator_IsValid(pos_it); LLIterator_Next(pos_it)) {
+        LLPayload_t payload;
+        LLIterator_Get(pos_it, &payload);
+        positions[i].push_back(static_cast<DocPositionOffset_t>(
+            reinterpret_cast<uintptr_t>(payload)));
+      }
+      LLIterator_Free(pos_it);
+      std::sort(positions[i].begin(), positions[i].end());
+
+      // A word's number is how many words of the document come before it.
+      const vector<DocPositionOffset_t>& doc_offsets =
+          offsets.at(docs[i].first);
+      for (DocPositionOffset_t& pos : positions[i]) {
+        pos = std::lower_bound(doc_offsets.begin(), doc_offsets.end(), pos) -
+              doc_offsets.begin();
+      }
+      if (avgdl > 0) {
+        impacts.push_back(QuantizeImpact(BM25Weight(
+            positions[i].size(), doc_offsets.size(), avgdl)));
+      }
+    }
+    postings.clear();
+    EncodePostings(doc_ids, positions, &postings,
+                   avgdl > 0 ? &impacts : nullptr);
+    if (postings.size() > INT32_MAX) {
+      ok = false;
+      break;
+    }
+
+    Element element;
+    element.key = FNVHash64(reinterpret_cast<unsigned char*>(wp->word),
+                            word_len);
+    AppendRecord(WordPostingsHeader(word_len, postings.size()),
+                 &element.bytes);
+    element.bytes.insert(element.bytes.end(), wp->word, wp->word + word_len);
+    element.bytes.insert(element.bytes.end(), postings.begin(),
+                         postings.end());
+    elements->push_back(std::move(element));
+    words->emplace_back(wp->word, word_len);
+  }
+  HTIterator_Free(it);
+  return ok;
+}
+
+static void DocLengths(const vector<pair<DocID_t, uint64_t>>& lengths,
+                       uint64_t num_docs, vector<uint8_t>* const out) {
+  uint64_t total_words = 0;
+  for (const auto& length : lengths) {
+    total_words += length.second;
+  }
+
+  PutVarint(num_docs, out);
+  PutVarint(total_words, out);
+  DocID_t prev = 0;
+  for (const auto& length : lengths) {
+    PutVarint(length.first - prev, out);
+    PutVarint(length.second, out);
+    prev = length.first;
+  }
+}
+
+static void Tombstones(vector<string> names, vector<uint8_t>* const out) {
+  std::sort(names.begin(), names.end());
+  names.erase(std::unique(names.begin(), names.end()), names.end());
+  PutVarint(names.size(), out);
+  for (const string& name : names) {
+    PutVarint(name.size(), out);
+    out->insert(out->end(), name.begin(), name.end());
+  }
+}
+
+static void Shard(const ShardInfo& shard, vector<uint8_t>* const out) {
+  PutVarint(shard.set_id, out);
+  PutVarint(shard.shard, out);
+  PutVarint(shard.num_shards, out);
+  PutVarint(shard.collection_docs, out);
+  PutVarint(shard.collection_words, out);
+}
+
+static void CrawlTimes(const vector<pair<DocID_t, uint64_t>>& runs,
+                       vector<uint8_t>* const out) {
+  PutVarint(runs.size(), out);
+  DocID_t prev = 0;
+  for (const auto& run : runs) {
+    PutVarint(run.first - prev, out);
+    PutVarint(run.second, out);
+    prev = run.first;
+  }
+}
+
+static void* WriteShard(void* arg) {
+  ShardWrite* write = static_cast<ShardWrite*>(arg);
+  write->bytes = WriteCompressedIndex(write->mi, write->dt, write->file_name,
+                                      write->version, vector<string>(),
+                                      &write->info);
+  return nullptr;
+}
+
+static void AppendSection(uint32_t tag, const vector<uint8_t>& contents,
+                          vector<uint8_t>* const out) {
+  AppendRecord(SectionHeader(tag, contents.size()), out);
+  out->insert(out->end(), contents.begin(), contents.end());
+}
+
+static bool LayOutTable(const vector<HTKey_t>& keys,
+                        const vector<int64_t>& sizes, int64_t offset,
+                        int64_t load, TableLayout* const layout) {
+  int64_t num_buckets = std::max<int64_t>(1, keys.size() / load);
+  if (num_buckets > INT32_MAX) {
+    return false;
+  }
+  layout->buckets.assign(num_buckets, vector<size_t>());
+  for (size_t i = 0; i < keys.size(); i++) {
+    layout->buckets[keys[i] % num_buckets].push_back(i);
+  }
+
+  int64_t cursor = offset + sizeof(BucketListHeader) +
+                   num_buckets * sizeof(BucketRecord);
+  layout->chains.resize(num_buckets);
+  layout->positions.resize(keys.size());
+  for (int64_t b = 0; b < num_buckets; b++) {
+    layout->chains[b] = cursor;
+    cursor += layout->buckets[b].size() * sizeof(ElementPositionRecord);
+    for (size_t e : layout->buckets[b]) {
+      layout->positions[e] = cursor;
+      cursor += sizes[e];
+    }
+  }
+  layout->end = cursor;
+  return cursor <= INT32_MAX;
+}
+
+static bool BuildTable(const vector<Element>& elements, int64_t offset,
+                       vector<uint8_t>* const out) {
+  vector<HTKey_t> keys;
+  vector<int64_t> sizes;
+  for (const Element& element : elements) {
+    keys.push_back(element.key);
+    sizes.push_back(element.bytes.size());
+  }
+  // About one element per bucket keeps the chains short.
+  TableLayout layout;
+  if (!LayOutTable(keys, sizes, offset, 1, &layout)) {
+    return false;
+  }
+
+  out->reserve(out->size() + layout.end - offset);
+  AppendRecord(BucketListHeader(layout.buckets.size()), out);
+  for (size_t b = 0; b < layout.buckets.size(); b++) {
+    AppendRecord(BucketRecord(layout.buckets[b].size(), layout.chains[b]),
+                 out);
+  }
+  for (const vector<size_t>& bucket : layout.buckets) {
+    for (size_t e : bucket) {
+      AppendRecord(ElementPositionRecord(layout.positions[e]), out);
+    }
+    for (size_t e : bucket) {
+      out->insert(out->end(), elements[e].bytes.begin(),
+                  elements[e].bytes.end());
+    }
+  }
+  return true;
+}
+
+static bool WriteTable(const vector<HTKey_t>& keys,
+                       const vector<int64_t>& sizes,
+                       const std::function<bool(size_t)>& write_element,
+                       BlockWriter* const out, int64_t load) {
+  TableLayout layout;
+  if (!LayOutTable(keys, sizes, out->offset(), load, &layout) ||
+      !out->AppendRecord(BucketListHeader(layout.buckets.size()))) {
+    return false;
+  }
+  for (size_t b = 0; b < layout.buckets.size(); b++) {
+    if (!out->AppendRecord(BucketRecord(layout.buckets[b].size(),
+                                        layout.chains[b]))) {
+      return false;
+    }
+  }
+  for (const vector<size_t>& bucket : layout.buckets) {
+    for (size_t e : bucket) {
+      if (!out->AppendRecord(ElementPositionRecord(layout.positions[e]))) {
+        return false;
+      }
+    }
+
+    // An element that doesn't come out the size it was laid out as
+    // would throw off every position after it.
+    for (size_t e : bucket) {
+      if (!write_element(e) ||
+          out->offset() != layout.positions[e] + sizes[e]) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+static bool WriteTable(const vector<Element>& elements,
+                       BlockWriter* const out) {
+  vector<HTKey_t> keys;
+  vector<int64_t> sizes;
+  for (const Element& element : elements) {
+    keys.push_back(element.key);
+    sizes.push_back(element.bytes.size());
+  }
+  auto write_element = [&elements, out](size_t e) {
+    return out->Append(elements[e].bytes.data(), elements[e].bytes.size());
+  };
+  return WriteTable(keys, sizes, write_element, out);
+}
+
+static int64_t WordPostingsV1(WordPostings* wp, BlockWriter* const out) {
+  size_t word_len = strlen(wp->word);
+  if (word_len > INT16_MAX) {
+    return -1;
+  }
+
+  // The docID table's elements are each a DocIDElementHeader followed
+  // by the document's positions, in the order they were found.
+  vector<pair<DocID_t, LinkedList*>> docs;
+  vector<HTKey_t> keys;
+  vector<int64_t> sizes;
+  HTIterator* doc_it = HTIterator_Allocate(wp->postings);
+  for (; HTIterator_IsValid(doc_it); HTIterator_Next(doc_it)) {
+    HTKeyValue_t doc;
+    HTIterator_Get(doc_it, &doc);
+    LinkedList* positions = static_cast<LinkedList*>(doc.value);
+    docs.push_back({doc.key, positions});
+    keys.push_back(doc.key);
+    sizes.push_back(sizeof(DocIDElementHeader) +
+                    LinkedList_NumElements(positions) *
+                    sizeof(DocIDElementPosition));
+  }
+  HTIterator_Free(doc_it);
+  TableLayout layout;
+  if (!LayOutTable(keys, sizes, 0, kDocIDTableLoad, &layout)) {
+    return -1;
+  }
+  int64_t size = sizeof(WordPostingsHeader) + word_len + layout.end;
+  if (out == nullptr) {
+    return size;
+  }
+
+  auto write_doc = [&docs, out](size_t d) {
+    LinkedList* positions = docs[d].second;
+    bool ok = out->AppendRecord(DocIDElementHeader(
+        docs[d].first, LinkedList_NumElements(positions)));
+    LLIterator* pos_it = LLIterator_Allocate(positions);
+    for (; ok && LLIterator_IsValid(pos_it); LLIterator_Next(pos_it)) {
+      LLPayload_t payload;
+      LLIterator_Get(pos_it, &payload);
+      DocIDElementPosition dep;
+      dep.position = static_cast<DocPositionOffset_t>(
+          reinterpret_cast<uintptr_t>(payload));
+      ok = out->AppendRecord(dep);
+    }
+    LLIterator_Free(pos_it);
+    return ok;
+  };
+  bool ok = out->AppendRecord(WordPostingsHeader(word_len, layout.end)) &&
+            out->Append(wp->word, word_len) &&
+            WriteTable(keys, sizes, write_doc, out, kDocIDTableLoad);
+  return ok ? size : -1;
+}
+
+static bool OpenMergeInput(const string& file_name, int version,
+                           MergeInput* const input) {
+  // Read with pread(), so that only what is being merged is in memory.
+  // A version 1 file has no term dictionary to walk its words in order
+  // with, so the reader makes one from its hash table.  A version 3
+  // merge needs its inputs' document lengths, which only version 3
+  // files carry.
+  IndexReaderOptions options;
+  options.backend = IndexReaderOptions::kPread;
+  options.build_term_dictionary = true;
+  input->reader.reset(IndexReader::Create(file_name, options));
+  const IndexReader& reader = *input->reader;
+  return input->reader->Open(true) &&
+         (version == 2 || reader.format_version() >= 3) &&
+         reader.has_term_dictionary() && reader.ListDocs(&input->doc_ids);
+}
+
+static void NextWordBatch(const IndexReader& reader,
+                          WordCursor* const cursor) {
+  // A batch after the first starts with the last word of the batch
+  // before, which has already been merged.
+  bool first = cursor->batch.empty();
+  string after = first ? "" : cursor->batch.back();
+  cursor->batch.clear();
+  cursor->next = first ? 0 : 1;
+  cursor->complete = reader.ExpandFrom(after, kMergeWordBatch + 1,
+                                       &cursor->batch);
+}
+
+template <typename Fn>
+static void ForEachMergedWord(const vector<MergeInput>& inputs, Fn fn) {
+  vector<WordCursor> cursors(inputs.size());
+  for (size_t i = 0; i < inputs.size(); i++) {
+    NextWordBatch(*inputs[i].reader, &cursors[i]);
+  }
+
+  // There are only ever a few inputs, so the next word is found by
+  // looking at each of them rather than with a heap.
+  string word;
+  while (1) {
+    const string* least = nullptr;
+    for (const WordCursor& cursor : cursors) {
+      if (cursor.next < cursor.batch.size() &&
+          (least == nullptr || cursor.batch[cursor.next] < *least)) {
+        least = &cursor.batch[cursor.next];
+      }
+    }
+    if (least == nullptr) {
+      return;
+    }
+    word = *least;
+    for (size_t i = 0; i < cursors.size(); i++) {
+      WordCursor& cursor = cursors[i];
+      if (cursor.next < cursor.batch.size() &&
+          cursor.batch[cursor.next] == word &&
+          ++cursor.next == cursor.batch.size() && !cursor.complete) {
+        NextWordBatch(*inputs[i].reader, &cursor);
+      }
+    }
+    if (!fn(word)) {
+      return;
+    }
+  }
+}
+
+static bool FindName(const vector<MergeInput>& inputs,
+                     const vector<SeenName>& seen, uint64_t hash,
+                     const string& name, bool* const found) {
+  *found = false;
+  auto it = std::lower_bound(seen.begin(), seen.end(), hash,
+                             [](const SeenName& a, uint64_t b) {
+                               return a.hash < b;
+                             });
+  string other;
+  for (; it != seen.end() && it->hash == hash; it++) {
+    const MergeInput& input = inputs[it->input];
+    if (it->tombstone) {
+      other = input.reader->tombstones()[it->index];
+    } else if (!input.reader->LookupDocName(input.doc_ids[it->index],
+                                            &other)) {
+      return false;
+    }
+    if (other == name) {
+      *found = true;
+      return true;
+    }
+  }
+  return true;
+}
+
+static bool NumberDocs(vector<MergeInput>* const inputs,
+                       vector<Element>* const elements,
+                       vector<uint8_t>* const pool) {
+  string name;
+  size_t num_kept = 0;
+  {
+    // Mark which copy of each document is kept, last input first.  A
+    // document is dropped if a later input has it or a tombstone for
+    // it.  The names seen so far are remembered by their hashes, in
+    // hash order, rather than whole.
+    vector<SeenName> seen, added;
+    auto by_hash = [](const SeenName& a, const SeenName& b) {
+      return a.hash < b.hash;
+    };
+    for (size_t i = inputs->size(); i-- > 0; ) {
+      MergeInput& input = (*inputs)[i];
+      const vector<string>& tombstones = input.reader->tombstones();
+      input.new_ids.assign(input.doc_ids.size(), 0);
+      added.clear();
+      for (size_t j = 0; j < input.doc_ids.size(); j++) {
+        bool found;
+        if (!input.reader->LookupDocName(input.doc_ids[j], &name)) {
+          return false;
+        }
+        uint64_t hash = FNVHash64((unsigned char*) name.data(), name.size());
+        if (!FindName(*inputs, seen, hash, name, &found)) {
+          return false;
+        }
+        if (!found) {
+          input.new_ids[j] = 1;
+          num_kept++;
+          added.push_back({hash, static_cast<uint32_t>(i), false, j});
+        }
+      }
+      for (size_t t = 0; t < tombstones.size(); t++) {
+        uint64_t hash = FNVHash64((unsigned char*) tombstones[t].data(),
+                                  tombstones[t].size());
+        added.push_back({hash, static_cast<uint32_t>(i), true, t});
+      }
+      std::sort(added.begin(), added.end(), by_hash);
+      size_t middle = seen.size();
+      seen.insert(seen.end(), added.begin(), added.end());
+      std::inplace_merge(seen.begin(), seen.begin() + middle, seen.end(),
+                         by_hash);
+    }
+  }
+
+  DocNamePool::Builder names(num_kept, pool);
+  DocID_t next_id = 1;
+  for (MergeInput& input : *inputs) {
+    for (size_t j = 0; j < input.doc_ids.size(); j++) {
+      if (input.new_ids[j] == 0) {
+        continue;
+      }
+      if (!input.reader->LookupDocName(input.doc_ids[j], &name) ||
+          name.size() > INT16_MAX) {
+        return false;
+      }
+      input.new_ids[j] = next_id++;
+
+      Element element;
+      element.key = input.new_ids[j];
+      AppendRecord(DoctableElementHeader(element.key, name.size()),
+                   &element.bytes);
+      element.bytes.insert(element.bytes.end(), name.begin(), name.end());
+      elements->push_back(std::move(element));
+      names.Add(name);
+    }
+  }
+  return true;
+}
+
+static bool MergePostings(const vector<MergeInput>& inputs,
+                          const string& word,
+                          const vector<uint32_t>* lengths, double avgdl,
+                          vector<uint8_t>* const out) {
+  vector<DocID_t> doc_ids, old_ids;
+  vector<vector<DocPositionOffset_t>> positions, input_positions;
+  PostingList postings;
+  for (const MergeInput& input : inputs) {
+    if (!input.reader->LookupWord(word, &postings)) {
+      continue;
+    }
+
+    // Both the postings and the input's docIDs are in increasing order,
+    // and renumbering keeps that order, so the merged list comes out in
+    // docID order without sorting.
+    old_ids.clear();
+    auto doc = input.doc_ids.begin();
+    for (DocID_t doc_id : postings.doc_ids()) {
+      doc = std::lower_bound(doc, input.doc_ids.end(), doc_id);
+      if (doc == input.doc_ids.end() || *doc != doc_id) {
+        return false;
+      }
+      DocID_t new_id = input.new_ids[doc - input.doc_ids.begin()];
+      if (new_id != 0) {
+        old_ids.push_back(doc_id);
+        doc_ids.push_back(new_id);
+      }
+    }
+    if (old_ids.empty()) {
+      continue;
+    }
+    input_positions.clear();
+    if (!input.reader->LookupPositions(word, old_ids, &input_positions)) {
+      return false;
+    }
+    positions.reserve(positions.size() + input_positions.size());
+    for (vector<DocPositionOffset_t>& doc_positions : input_positions) {
+      positions.push_back(std::move(doc_positions));
+    }
+  }
+  if (doc_ids.empty()) {
+    return true;
+  }
+
+  vector<uint32_t> impacts;
+  if (lengths != nullptr) {
+    impacts.reserve(doc_ids.size());
+    for (size_t i = 0; i < doc_ids.size(); i++) {
+      impacts.push_back(QuantizeImpact(BM25Weight(
+          positions[i].size(), (*lengths)[doc_ids[i]], avgdl)));
+    }
+  }
+  EncodePostings(doc_ids, positions, out,
+                 lengths != nullptr ? &impacts : nullptr);
+  return true;
+}
+
+}  // namespace hw4
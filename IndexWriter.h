@@ -0,0 +1,243 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_INDEXWRITER_H_
+#define HW4_INDEXWRITER_H_
+
+#include <arpa/inet.h>
+#include <stdint.h>
+
+#include <string>
+#include <vector>
+
+extern "C" {
+  #include "libhw2/DocTable.h"
+  #include "libhw2/MemIndex.h"
+}
+
+namespace hw4 {
+
+// Index files come in three versions, told apart by their magic number:
+//
+//  - Version 1 is the format hw3::WriteIndex writes, with magic number
+//    hw3::kMagicNumber.  Each word's postings are an on-disk hash table
+//    of fixed-width docID and position records.
+//
+//  - Version 2 (kMagicNumberV2) is the same file in every other
+//    respect -- the same header, the same CRC32 over everything after
+//    it, the same doctable, and the same index hash table of words --
+//    except that each word's WordPostingsHeader is followed by its
+//    postings in the compressed form described in PostingCodec.h, and
+//    that the index may be followed by extra sections.
+//
+//  - Version 3 (kMagicNumberV3) is version 2 with impact bounds for
+//    BM25 ranking (see Scoring.h) in each compressed posting list, and
+//    a kDocLengthsSection.
+//
+// Every IndexReader reads all three versions.
+static const uint32_t kMagicNumberV2 = 0xCAFEF00E;
+static const uint32_t kMagicNumberV3 = 0xCAFEF00F;
+
+// Each extra section of a version 2 or 3 file is a SectionHeader followed by
+// section_bytes bytes of the section's contents.  The sections run from
+// the end of the index to the end of the file (the header's
+// doctable_bytes and index_bytes don't count them), and the checksum
+// covers them like everything else.  Readers skip sections they don't
+// know about, so new kinds of section can be added without a new
+// format version.
+struct SectionHeader {
+  uint32_t tag;
+  uint32_t section_bytes;
+
+  SectionHeader() { }
+  SectionHeader(uint32_t t, uint32_t sb) : tag(t), section_bytes(sb) { }
+
+  void ToDiskFormat() {
+    tag = htonl(tag);
+    section_bytes = htonl(section_bytes);
+  }
+  void ToHostFormat() {
+    tag = ntohl(tag);
+    section_bytes = ntohl(section_bytes);
+  }
+} __attribute__((packed));
+
+// The kinds of section:
+//  - kTermDictionarySection holds the index's words, sorted, as a
+//    TermDictionary (see TermDictionary.h).
+//  - kWordPositionsSection is empty; its presence means that the
+//    file's word positions count words (the first word of a document
+//    is at position 0, the next at 1, and so on) rather than bytes, as
+//    the positions hw2 produces (and version 1 files hold) do.  Phrase
+//    and proximity queries need word positions.
+//  - kDocLengthsSection holds how many words each document has, as
+//    varints: the number of documents, the total number of words in
+//    them, and then, in docID order, each document's docID (less the
+//    previous one's, or less 0) and word count.  Documents with no
+//    words are left out.
+//  - kTermFilterSection holds a Bloom filter of the index's words, as a
+//    TermFilter (see TermFilter.h), so that readers can tell that a
+//    word isn't in the index without looking for it.
+//  - kTombstoneSection holds the names of documents that the index
+//    deletes or replaces, as varints: the number of names, and then,
+//    in sorted order, each name's length followed by its bytes.  An
+//    index with tombstones is a delta: it is meant to be queried (or
+//    merged) together with older indices, and hides the documents it
+//    names in all of them, whether or not it has a newer copy of the
+//    document itself.
+//  - kDocNamesSection holds the names of the documents, by docID, as
+//    a DocNamePool (see DocNamePool.h), so that readers can look a
+//    name up without going through the doctable.  Only indices whose
+//    docIDs run 1, 2, ..., N without gaps have one.
+//  - kShardSection marks the index as one shard of a collection whose
+//    documents were split across several index files (see
+//    WriteShardedIndex()), as varints: a ShardInfo's set_id, shard,
+//    num_shards, collection_docs and collection_words, in that order.
+//    A version 3 shard's impact bounds are worked out with the whole
+//    collection's average document length, which is what readers
+//    score its documents with too.
+//  - kCrawlTimesSection holds when the crawls that read the documents'
+//    files started, in nanoseconds since the epoch, as varints: the
+//    number of runs of documents, and then, for each run in docID
+//    order, the docID of its first document (less the previous run's,
+//    or less 0) and when its crawl started.  A run goes up to the next
+//    one's first document.  An index's copy of a document is up to date
+//    with its file if the file hasn't been modified since its crawl
+//    started (see PlanDelta() in IndexBuilder.h); the index file's own
+//    time says nothing, since merging rewrites it.
+static const uint32_t kTermDictionarySection = 0x44494354;   // "DICT"
+static const uint32_t kWordPositionsSection = 0x57504F53;    // "WPOS"
+static const uint32_t kDocLengthsSection = 0x444C454E;       // "DLEN"
+static const uint32_t kTermFilterSection = 0x424C4F4D;       // "BLOM"
+static const uint32_t kTombstoneSection = 0x544F4D42;        // "TOMB"
+static const uint32_t kDocNamesSection = 0x444E414D;         // "DNAM"
+static const uint32_t kShardSection = 0x53485244;            // "SHRD"
+static const uint32_t kCrawlTimesSection = 0x4352574C;       // "CRWL"
+
+// Where a shard (see kShardSection) stands in its collection.
+struct ShardInfo {
+  uint64_t set_id = 0;            // the same in every shard of a collection
+  uint32_t shard = 0;             // this shard's number, from 0
+  uint32_t num_shards = 0;        // how many shards the collection has
+  uint64_t collection_docs = 0;   // how many documents all of them hold
+  uint64_t collection_words = 0;  // how many words all of those documents
+                                  // have between them
+};
+
+// Writes the contents of "mi" and "dt" to a new index file named
+// "file_name", replacing any file already there, in version 1 of the
+// format.  The file is the same as the one hw3::WriteIndex() writes,
+// except perhaps for the number of buckets in its hash tables, but is
+// written differently: hw3::WriteIndex() seeks back and forth to fill
+// in each table's buckets and chains as it goes, a few bytes per
+// write, while this lays each table out before writing any of it, and
+// then writes the whole file front to back through a BlockWriter (see
+// BlockWriter.h), a block at a time.  Only the header is written out of
+// order, last.  Returns the size of the file in bytes, or 0 if it
+// couldn't be written (in which case no file is left behind).
+int64_t WriteIndex(MemIndex* mi, DocTable* dt, const char* file_name);
+
+// Writes the contents of "mi" and "dt" to a new index file named
+// "file_name", replacing any file already there, in format "version"
+// (2 or 3), with word positions and a term filter.  If "tombstones"
+// isn't empty, the file is a delta that deletes or replaces the
+// documents it names (see kTombstoneSection).  If "shard" isn't null,
+// the file is that shard of a collection (see kShardSection).  If
+// "crawl_time" isn't 0, it is when the crawl that read the documents'
+// files started (see kCrawlTimesSection).  Like WriteIndex(), it writes
+// the file front to back, a block at a time.
+// Returns the size of the file in bytes, or 0 if it couldn't be written
+// (in which case no file is left behind).
+int64_t WriteCompressedIndex(MemIndex* mi, DocTable* dt,
+                             const char* file_name, int version = 3,
+                             const std::vector<std::string>& tombstones =
+                               std::vector<std::string>(),
+                             const ShardInfo* shard = nullptr,
+                             uint64_t crawl_time = 0);
+
+// Returns how many words the documents of "mi" have between them, i.e.
+// how many positions it holds.
+uint64_t CountWords(MemIndex* mi);
+
+// Writes a collection of documents split into shards: shard i's
+// contents, "mis[i]" and "dts[i]", go to a new index file named
+// "file_names[i]" in format "version" (2 or 3), as WriteCompressedIndex()
+// writes it, marked as shard i of the collection (see kShardSection).
+// Each shard's documents are numbered on their own, and a document
+// should be in only one shard.  The shards are written concurrently,
+// each on a thread of its own.
+//
+// Returns the total size of the files in bytes, or 0 if any of them
+// couldn't be written (in which case none of them are left behind).
+int64_t WriteShardedIndex(const std::vector<MemIndex*>& mis,
+                          const std::vector<DocTable*>& dts,
+                          const std::vector<std::string>& file_names,
+                          int version = 3);
+
+// What MergeIndexFiles() merged.
+struct MergeStats {
+  uint64_t bytes_in = 0;    // the total size of the input files
+  uint64_t docs_in = 0;     // how many documents the inputs hold
+  uint64_t docs_out = 0;    // how many of those the merged index keeps
+  uint64_t words = 0;       // how many distinct words it has
+  uint64_t tombstones = 0;  // how many tombstones the inputs hold
+};
+
+// Merges the index files "inputs" into one new index file named
+// "file_name", replacing any file already there, in format "version"
+// (2 or 3).  The inputs are checksummed as they are opened.  A version
+// 2 merge takes inputs of any version; a version 3 merge needs their
+// document lengths, and so takes only version 3 inputs.  A version 1
+// input's words are read out of its hash table when it is opened (see
+// IndexReaderOptions::build_term_dictionary), and its positions, which
+// are byte offsets, are copied as they are: if any input is a version 1
+// file, the merged index's positions aren't word positions (see
+// kWordPositionsSection), and phrase and proximity queries don't match
+// in it.
+//
+// The merged index's documents are numbered 1, 2, ... in input order,
+// and then in docID order within each input.  A document (i.e. a
+// document name) in more than one input is kept only from the last
+// input that has it, so merging an index with a newer one over the
+// same files keeps the newer copies, and a document that a later input
+// has a tombstone for (see kTombstoneSection) isn't kept at all.  The
+// tombstones themselves aren't carried over: merging a base index with
+// the deltas on top of it gives an index that stands on its own.  Each
+// kept document's crawl time is (see kCrawlTimesSection), or, for an
+// input without crawl times, the time the input file was last modified.
+//
+// Unlike WriteCompressedIndex(), the merge doesn't hold the postings in
+// memory: it reads the inputs a word at a time with pread() and
+// streams each merged posting list to the file, a block at a time,
+// past room left for the header, the doctable and the hash table's
+// buckets, which it fills in with one last write.  It walks the words
+// in order by merging the inputs' term dictionaries a batch of words
+// at a time.  Its memory use is not bounded, though: nothing else is
+// spilled to disk, so it grows with the number of words and documents
+// merged.  Besides one word's postings and a batch of each input's
+// words, it holds on to the parts of the merged index that go in the
+// file after the postings or in front of them -- the doctable, the
+// hash table's buckets and chains (about 36 bytes per word), and the
+// encoded term dictionary, filter and document name pool -- and about
+// 40 bytes per input document (plus 4 per document for a version 3
+// merge) to number the documents, as well as the term dictionary made
+// for each version 1 input.
+//
+// Returns the size of the file in bytes, or 0 if an input can't be
+// read or the file couldn't be written (in which case no file is left
+// behind).  If "stats" isn't null, fills it in.
+int64_t MergeIndexFiles(const std::vector<std::string>& inputs,
+                        const char* file_name, int version = 3,
+                        MergeStats* const stats = nullptr);
+
+}  // namespace hw4
+
+#endif  // HW4_INDEXWRITER_H_
@@ -0,0 +1,302 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "./CRC32.h"
+#include "./MappedIndexFile.h"
+#include "./libhw3/Utils.h"
+
+using std::string;
+using std::vector;
+using hw3::BucketListHeader;
+using hw3::BucketRecord;
+using hw3::DoctableElementHeader;
+using hw3::ElementPositionRecord;
+using hw3::IndexFileHeader;
+using hw3::IndexFileOffset_t;
+using hw3::WordPostingsHeader;
+
+namespace hw4 {
+
+// Applies madvise() "advice" to the pages spanning [start, end) of the
+// mapping at "base", widening the range out to page boundaries as
+// madvise() requires.  The advice is only a hint, so errors are ignored.
+static void AdviseRange(const uint8_t* base, size_t length,
+                        size_t start, size_t end, int advice);
+
+MappedIndexFile::MappedIndexFile(const string& file_name,
+                                 bool populate, bool huge_pages)
+  : IndexReader(file_name), populate_(populate), huge_pages_(huge_pages),
+    base_(nullptr), length_(0) { }
+
+MappedIndexFile::~MappedIndexFile() {
+  if (base_ != nullptr) {
+    munmap(const_cast<uint8_t*>(base_), length_);
+  }
+  base_ = nullptr;
+}
+
+bool MappedIndexFile::Open(bool validate) {
+  int fd = open(file_name().c_str(), O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1 ||
+      st.st_size < static_cast<off_t>(sizeof(IndexFileHeader))) {
+    close(fd);
+    return false;
+  }
+
+  int flags = MAP_SHARED;
+#ifdef MAP_POPULATE
+  if (populate_) {
+    flags |= MAP_POPULATE;
+  }
+#endif
+  void* addr = mmap(nullptr, st.st_size, PROT_READ, flags, fd, 0);
+  // The mapping keeps its own reference to the file.
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return false;
+  }
+  base_ = static_cast<const uint8_t*>(addr);
+  length_ = st.st_size;
+
+  IndexFileHeader header;
+  if (!ParseAt(base_, length_, 0, &header) ||
+      !CheckHeader(header, length_)) {
+    return false;
+  }
+
+  doctable_offset_ = sizeof(IndexFileHeader);
+  index_offset_ = doctable_offset_ + header.doctable_bytes;
+  size_t sections_offset = index_offset_ + header.index_bytes;
+  if (!ParseSections(base_ + sections_offset, length_ - sections_offset)) {
+    return false;
+  }
+  BucketListHeader blh;
+  if (!ParseAt(base_, length_, doctable_offset_, &blh)) {
+    return false;
+  }
+  doctable_num_buckets_ = blh.num_buckets;
+  if (!ParseAt(base_, length_, index_offset_, &blh)) {
+    return false;
+  }
+  index_num_buckets_ = blh.num_buckets;
+  if (doctable_num_buckets_ <= 0 || index_num_buckets_ <= 0 ||
+      doctable_offset_ + sizeof(blh) +
+      static_cast<size_t>(doctable_num_buckets_) * sizeof(BucketRecord) >
+      length_) {
+    return false;
+  }
+  CountDocs(base_ + doctable_offset_ + sizeof(blh), doctable_num_buckets_);
+
+  Advise();
+
+  if (validate) {
+    // Checksumming reads the whole file once, front to back.
+    CRC32 crc;
+    crc.Fold(base_ + sizeof(IndexFileHeader),
+             length_ - sizeof(IndexFileHeader));
+    if (crc.GetFinalCRC() != header.checksum) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool MappedIndexFile::LookupWord(const string& word,
+                                 PostingList* const postings) const {
+  IndexFileOffset_t table;
+  int32_t len;
+  return MayContain(word) && FindPostings(word, &table, &len) &&
+         ParsePostings(base_ + table, len, table, postings);
+}
+
+bool MappedIndexFile::LookupDocFrequency(const string& word,
+                                         size_t* const df) const {
+  IndexFileOffset_t table;
+  int32_t len;
+  return MayContain(word) && FindPostings(word, &table, &len) &&
+         ParseDocFrequency(base_ + table, len, df);
+}
+
+bool MappedIndexFile::LookupPositions(
+    const string& word, const vector<DocID_t>& doc_ids,
+    vector<vector<DocPositionOffset_t>>* const positions) const {
+  IndexFileOffset_t table;
+  int32_t len;
+  return MayContain(word) && FindPostings(word, &table, &len) &&
+         ParsePositions(base_ + table, len, table, doc_ids, positions);
+}
+
+bool MappedIndexFile::FindPostings(const string& word,
+                                   IndexFileOffset_t* const offset,
+                                   int32_t* const len) const {
+  HTKey_t key = FNVHash64((unsigned char*) word.c_str(), word.size());
+  IndexFileOffset_t chain;
+  int32_t chain_len;
+  if (!LookupChain(index_offset_, index_num_buckets_, key,
+                   &chain, &chain_len)) {
+    return false;
+  }
+
+  for (int32_t e = 0; e < chain_len; e++) {
+    ElementPositionRecord epr;
+    WordPostingsHeader wph;
+    if (!ParseAt(base_, length_, chain + e * sizeof(epr), &epr) ||
+        !ParseAt(base_, length_, epr.position, &wph)) {
+      return false;
+    }
+    int64_t word_offset = epr.position + sizeof(wph);
+    if (wph.word_bytes != static_cast<int16_t>(word.size()) ||
+        !InBounds(word_offset, wph.word_bytes) ||
+        memcmp(base_ + word_offset, word.data(), word.size()) != 0) {
+      continue;
+    }
+
+    // Found it.  Its postings are right there in the mapping.
+    *offset = word_offset + wph.word_bytes;
+    *len = wph.postings_bytes;
+    return InBounds(*offset, *len);
+  }
+  return false;
+}
+
+bool MappedIndexFile::LookupDocName(DocID_t doc_id,
+                                    string* const name) const {
+  if (has_doc_name_pool()) {
+    return doc_names().Lookup(doc_id, name);
+  }
+
+  IndexFileOffset_t chain;
+  int32_t chain_len;
+  if (!LookupChain(doctable_offset_, doctable_num_buckets_, doc_id,
+                   &chain, &chain_len)) {
+    return false;
+  }
+
+  for (int32_t e = 0; e < chain_len; e++) {
+    ElementPositionRecord epr;
+    DoctableElementHeader deh;
+    if (!ParseAt(base_, length_, chain + e * sizeof(epr), &epr) ||
+        !ParseAt(base_, length_, epr.position, &deh)) {
+      return false;
+    }
+    if (deh.doc_id != doc_id) {
+      continue;
+    }
+
+    int64_t name_offset = epr.position + sizeof(deh);
+    if (!InBounds(name_offset, deh.file_name_bytes)) {
+      return false;
+    }
+    name->assign(reinterpret_cast<const char*>(base_ + name_offset),
+                 deh.file_name_bytes);
+    return true;
+  }
+  return false;
+}
+
+bool MappedIndexFile::ListDocs(vector<DocID_t>* const doc_ids) const {
+  if (has_doc_name_pool()) {
+    ListPooledDocs(doc_ids);
+    return true;
+  }
+
+  // A bucket's number is a key that hashes to it.
+  doc_ids->clear();
+  for (int32_t b = 0; b < doctable_num_buckets_; b++) {
+    IndexFileOffset_t chain;
+    int32_t chain_len;
+    if (!LookupChain(doctable_offset_, doctable_num_buckets_, b,
+                     &chain, &chain_len)) {
+      return false;
+    }
+    for (int32_t e = 0; e < chain_len; e++) {
+      ElementPositionRecord epr;
+      DoctableElementHeader deh;
+      if (!ParseAt(base_, length_, chain + e * sizeof(epr), &epr) ||
+          !ParseAt(base_, length_, epr.position, &deh)) {
+        return false;
+      }
+      doc_ids->push_back(deh.doc_id);
+    }
+  }
+  std::sort(doc_ids->begin(), doc_ids->end());
+  return true;
+}
+
+bool MappedIndexFile::LookupChain(IndexFileOffset_t table_offset,
+                                  int32_t num_buckets, HTKey_t key,
+                                  IndexFileOffset_t* chain,
+                                  int32_t* chain_len) const {
+  int32_t bucket = static_cast<int32_t>(key % num_buckets);
+  BucketRecord br;
+  if (!ParseAt(base_, length_,
+               table_offset + sizeof(BucketListHeader) + bucket * sizeof(br),
+               &br)) {
+    return false;
+  }
+  if (!InBounds(br.position, static_cast<int64_t>(br.chain_num_elements) *
+                             sizeof(ElementPositionRecord))) {
+    return false;
+  }
+  *chain = br.position;
+  *chain_len = br.chain_num_elements;
+  return true;
+}
+
+void MappedIndexFile::Advise() const {
+  // Posting lists make up most of the index, and each one is read from
+  // start to finish.
+  AdviseRange(base_, length_, index_offset_, length_, MADV_SEQUENTIAL);
+
+  // The doctable is only ever probed for one name at a time, and the
+  // index's bucket array is probed once per query word.
+  size_t index_buckets_end = index_offset_ + sizeof(BucketListHeader) +
+      static_cast<size_t>(index_num_buckets_) * sizeof(BucketRecord);
+  AdviseRange(base_, length_, 0, index_offset_, MADV_RANDOM);
+  AdviseRange(base_, length_, index_offset_, index_buckets_end, MADV_RANDOM);
+
+#ifdef MADV_HUGEPAGE
+  if (huge_pages_) {
+    AdviseRange(base_, length_, 0, length_, MADV_HUGEPAGE);
+  }
+#endif
+}
+
+static void AdviseRange(const uint8_t* base, size_t length,
+                        size_t start, size_t end, int advice) {
+  static const size_t page_size = sysconf(_SC_PAGESIZE);
+  if (end > length) {
+    end = length;
+  }
+  if (start >= end) {
+    return;
+  }
+  start -= start % page_size;
+  end = (end + page_size - 1) / page_size * page_size;
+  madvise(const_cast<uint8_t*>(base) + start, end - start, advice);
+}
+
+}  // namespace hw4
@@ -0,0 +1,115 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_MAPPEDINDEXFILE_H_
+#define HW4_MAPPEDINDEXFILE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+extern "C" {
+  #include "libhw1/HashTable.h"
+}
+#include "./libhw3/LayoutStructs.h"
+#include "./IndexReader.h"
+#include "./PostingList.h"
+
+namespace hw4 {
+
+// A MappedIndexFile is an IndexReader that maps the entire index file
+// into memory with mmap() when it is opened, and then interprets the
+// LayoutStructs.h records in place.  A lookup is just pointer
+// arithmetic over the mapping -- no system calls and no copying through
+// stdio or read buffers -- so once the pages an index uses are resident
+// in the page cache, queries never enter the kernel.
+//
+// When it opens the file, a MappedIndexFile tells the kernel how it is
+// going to be read: the bucket arrays of the two hash tables are probed
+// at random (MADV_RANDOM, so a probe doesn't drag in read-ahead it will
+// never use), while the rest of the index is mostly posting lists that
+// are walked front to back (MADV_SEQUENTIAL).
+class MappedIndexFile : public IndexReader {
+ public:
+  // Memorizes the name of the index file; does not open it.  If
+  // "populate" is true, Open() pre-faults the whole file (MAP_POPULATE)
+  // so that the first queries don't pay for page faults.  If
+  // "huge_pages" is true, Open() asks for the mapping to be backed by
+  // huge pages where the kernel and filesystem support it.
+  explicit MappedIndexFile(const std::string& file_name,
+                           bool populate = false,
+                           bool huge_pages = false);
+
+  // Unmaps the index file if it is mapped.
+  virtual ~MappedIndexFile();
+
+  // IndexReader methods.
+  bool Open(bool validate) override;
+  bool LookupWord(const std::string& word,
+                  PostingList* const postings) const override;
+  bool LookupDocFrequency(const std::string& word,
+                          size_t* const df) const override;
+  bool LookupPositions(
+      const std::string& word, const std::vector<DocID_t>& doc_ids,
+      std::vector<std::vector<DocPositionOffset_t>>* const positions)
+      const override;
+  bool LookupDocName(DocID_t doc_id,
+                     std::string* const name) const override;
+  bool ListDocs(std::vector<DocID_t>* const doc_ids) const override;
+  size_t MemoryFootprint() const override { return length_; }
+
+ private:
+  // Finds the bucket "key" hashes to in the on-disk hash table that
+  // starts at "table_offset" and has "num_buckets" buckets.  Returns
+  // (through "chain" and "chain_len") the offset of the bucket's array
+  // of ElementPositionRecords, and how many records it holds.
+  bool LookupChain(hw3::IndexFileOffset_t table_offset, int32_t num_buckets,
+                   HTKey_t key, hw3::IndexFileOffset_t* chain,
+                   int32_t* chain_len) const;
+
+  // Finds "word" in the index, setting "offset" and "len" to where its
+  // postings are in the mapping.  Returns false if the word isn't there.
+  bool FindPostings(const std::string& word,
+                    hw3::IndexFileOffset_t* const offset,
+                    int32_t* const len) const;
+
+  // Returns true if [offset, offset + len) lies inside the mapping.
+  bool InBounds(int64_t offset, int64_t len) const {
+    return offset >= 0 && len >= 0 &&
+           offset + len <= static_cast<int64_t>(length_);
+  }
+
+  // Gives the kernel the access-pattern hints described above.
+  void Advise() const;
+
+  bool populate_;
+  bool huge_pages_;
+
+  // The mapping, and its length (the length of the file).
+  const uint8_t* base_;
+  size_t length_;
+
+  // Where the doctable and index hash tables start, and how many
+  // buckets each one has.
+  hw3::IndexFileOffset_t doctable_offset_;
+  int32_t doctable_num_buckets_;
+  hw3::IndexFileOffset_t index_offset_;
+  int32_t index_num_buckets_;
+
+  // Disable copying; a MappedIndexFile owns its mapping.
+  MappedIndexFile(const MappedIndexFile&) = delete;
+  MappedIndexFile& operator=(const MappedIndexFile&) = delete;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_MAPPEDINDEXFILE_H_
@@ -0,0 +1,505 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define HW4_POSTINGCODEC_SSSE3 1
+#endif
+
+#include "./PostingCodec.h"
+
+using std::vector;
+
+namespace hw4 {
+
+// Returns how many bytes (1 to 4) StreamVByte needs for "value".
+static int StreamVByteLength(uint32_t value);
+
+// One entry of a posting list's block directory.
+struct BlockInfo {
+  uint64_t last_doc_gap, bytes, max_count, max_impact;
+};
+
+// Reads the document count, the impact bound (if "impacts" is true;
+// otherwise *max_impact is set to 0), and the block directory of the
+// compressed posting list held in [*p, end), advancing *p to the first
+// block.  Returns false if they are malformed.
+static bool ParseDirectory(const uint8_t** p, const uint8_t* end,
+                           bool impacts, uint64_t* num_docs,
+                           uint64_t* max_impact,
+                           vector<BlockInfo>* const directory);
+
+// Does the work of DecodePostings(), parsing the list's block directory
+// into "directory" and gathering its block impact bounds (if "impacts"
+// is true) in "block_max_impacts".
+static bool DecodePostingsWith(const uint8_t* buf, size_t len,
+                               PostingList* const postings, bool impacts,
+                               vector<BlockInfo>* const directory,
+                               vector<uint32_t>* const block_max_impacts);
+
+// Decodes the "n" docIDs and counts at the start of the block held in
+// [*p, block_end), whose first docID gap is from "*prev", into
+// "doc_ids" and "counts", advancing *p to the block's positions and
+// *prev to its last docID.  Returns false if the block is malformed.
+static bool DecodeBlockDocs(const uint8_t** p, const uint8_t* block_end,
+                            size_t n, DocID_t* prev, DocID_t* doc_ids,
+                            uint32_t* counts);
+
+// Decodes "n" StreamVByte values whose control bytes are at "control"
+// and whose data starts at *data, one value at a time.  Returns false
+// if the data runs past "end".
+static bool StreamVByteDecodeScalar(const uint8_t* control,
+                                    const uint8_t** data,
+                                    const uint8_t* end, size_t n,
+                                    uint32_t* out);
+
+#ifdef HW4_POSTINGCODEC_SSSE3
+// Like StreamVByteDecodeScalar(), but unpacks four values at a time
+// with a byte shuffle, falling back to the scalar decoder for the last
+// few values (whose 16-byte loads could run off the end).
+__attribute__((target("ssse3")))
+static bool StreamVByteDecodeSSSE3(const uint8_t* control,
+                                   const uint8_t** data,
+                                   const uint8_t* end, size_t n,
+                                   uint32_t* out);
+#endif
+
+void PutVarint(uint64_t value, vector<uint8_t>* const out) {
+  while (value >= 0x80) {
+    out->push_back(static_cast<uint8_t>(value) | 0x80);
+    value >>= 7;
+  }
+  out->push_back(static_cast<uint8_t>(value));
+}
+
+bool GetVarint(const uint8_t** p, const uint8_t* end, uint64_t* value) {
+  uint64_t result = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    if (*p >= end) {
+      return false;
+    }
+    uint8_t byte = *(*p)++;
+    result |= static_cast<uint64_t>(byte & 0x7F) << shift;
+    if ((byte & 0x80) == 0) {
+      *value = result;
+      return true;
+    }
+  }
+  return false;
+}
+
+void StreamVByteEncode(const uint32_t* in, size_t n,
+                       vector<uint8_t>* const out) {
+  size_t control = out->size();
+  out->resize(control + (n + 3) / 4, 0);
+  for (size_t i = 0; i < n; i++) {
+    int length = StreamVByteLength(in[i]);
+    (*out)[control + i / 4] |= (length - 1) << (2 * (i % 4));
+    for (int b = 0; b < length; b++) {
+      out->push_back(static_cast<uint8_t>(in[i] >> (8 * b)));
+    }
+  }
+}
+
+bool StreamVByteDecode(const uint8_t** p, const uint8_t* end, size_t n,
+                       uint32_t* out) {
+  size_t control_bytes = (n + 3) / 4;
+  if (static_cast<size_t>(end - *p) < control_bytes) {
+    return false;
+  }
+  const uint8_t* control = *p;
+  const uint8_t* data = *p + control_bytes;
+#ifdef HW4_POSTINGCODEC_SSSE3
+  static const bool has_ssse3 = __builtin_cpu_supports("ssse3");
+  bool ok = has_ssse3 ?
+            StreamVByteDecodeSSSE3(control, &data, end, n, out) :
+            StreamVByteDecodeScalar(control, &data, end, n, out);
+#else
+  bool ok = StreamVByteDecodeScalar(control, &data, end, n, out);
+#endif
+  if (ok) {
+    *p = data;
+  }
+  return ok;
+}
+
+void EncodePostings(const vector<DocID_t>& doc_ids,
+                    const vector<vector<DocPositionOffset_t>>& positions,
+                    vector<uint8_t>* const out,
+                    const vector<uint32_t>* impacts) {
+  size_t num_docs = doc_ids.size();
+  uint32_t max_impact = 0;
+  size_t num_blocks = (num_docs + kPostingsBlockSize - 1) / kPostingsBlockSize;
+  vector<uint8_t> directory, blocks;
+  vector<uint32_t> values;
+  DocID_t prev = 0;
+
+  for (size_t first = 0; first < num_docs; first += kPostingsBlockSize) {
+    size_t last = std::min(first + kPostingsBlockSize, num_docs);
+    size_t block_start = blocks.size();
+
+    uint8_t flags = 0;
+    for (size_t i = first; i < last; i++) {
+      if (doc_ids[i] - (i == first ? prev : doc_ids[i - 1]) > UINT32_MAX) {
+        flags |= kWideGaps;
+      }
+    }
+    blocks.push_back(flags);
+
+    // DocID gaps.
+    values.clear();
+    for (size_t i = first; i < last; i++) {
+      uint64_t gap = doc_ids[i] - (i == first ? prev : doc_ids[i - 1]);
+      if (flags & kWideGaps) {
+        PutVarint(gap, &blocks);
+      } else {
+        values.push_back(static_cast<uint32_t>(gap));
+      }
+    }
+    if (!(flags & kWideGaps)) {
+      StreamVByteEncode(values.data(), values.size(), &blocks);
+    }
+
+    // Counts.
+    values.clear();
+    uint32_t max_count = 0;
+    for (size_t i = first; i < last; i++) {
+      values.push_back(positions[i].size());
+      max_count = std::max(max_count, values.back());
+    }
+    StreamVByteEncode(values.data(), values.size(), &blocks);
+
+    // Positions, each document's delta coded on its own so that any one
+    // document's positions can be decoded without the others'.
+    values.clear();
+    for (size_t i = first; i < last; i++) {
+      DocPositionOffset_t prev_pos = 0;
+      for (DocPositionOffset_t pos : positions[i]) {
+        values.push_back(pos - prev_pos);
+        prev_pos = pos;
+      }
+    }
+    StreamVByteEncode(values.data(), values.size(), &blocks);
+
+    PutVarint(doc_ids[last - 1] - prev, &directory);
+    PutVarint(blocks.size() - block_start, &directory);
+    PutVarint(max_count, &directory);
+    if (impacts != nullptr) {
+      uint32_t block_max = *std::max_element(impacts->begin() + first,
+                                             impacts->begin() + last);
+      PutVarint(block_max, &directory);
+      max_impact = std::max(max_impact, block_max);
+    }
+    prev = doc_ids[last - 1];
+  }
+
+  PutVarint(num_docs, out);
+  PutVarint(num_blocks, out);
+  if (impacts != nullptr) {
+    PutVarint(max_impact, out);
+  }
+  out->insert(out->end(), directory.begin(), directory.end());
+  out->insert(out->end(), blocks.begin(), blocks.end());
+}
+
+bool DecodePostings(const uint8_t* buf, size_t len,
+                    PostingList* const postings, bool impacts) {
+  // Every lookup on a thread parses its directory into the same buffer,
+  // so answering a query doesn't allocate one per word.  A directory has
+  // an entry per block, so a buffer is kept only while it is no bigger
+  // than kMaxKeptPostings postings' worth.
+  static thread_local vector<BlockInfo> directory;
+  static thread_local vector<uint32_t> block_max_impacts;
+  bool ok = DecodePostingsWith(buf, len, postings, impacts, &directory,
+                               &block_max_impacts);
+  TrimBuffer(&directory, kMaxKeptPostings / kPostingsBlockSize);
+  TrimBuffer(&block_max_impacts, kMaxKeptPostings / kPostingsBlockSize);
+  return ok;
+}
+
+bool DecodePositions(const uint8_t* buf, size_t len,
+                     const vector<DocID_t>& doc_ids,
+                     vector<vector<DocPositionOffset_t>>* const positions,
+                     bool impacts) {
+  const uint8_t* p = buf;
+  const uint8_t* end = buf + len;
+  uint64_t num_docs, max_impact;
+  vector<BlockInfo> directory;
+  if (!ParseDirectory(&p, end, impacts, &num_docs, &max_impact,
+                      &directory)) {
+    return false;
+  }
+
+  positions->resize(doc_ids.size());
+  DocID_t block_ids[kPostingsBlockSize];
+  uint32_t counts[kPostingsBlockSize];
+  vector<uint32_t> deltas;
+  size_t want = 0;   // the next of doc_ids to find
+  DocID_t last_doc = 0;
+  for (size_t b = 0; b < directory.size() && want < doc_ids.size(); b++) {
+    if (directory[b].bytes > static_cast<size_t>(end - p)) {
+      return false;
+    }
+    const uint8_t* block_end = p + directory[b].bytes;
+    DocID_t prev = last_doc;
+    last_doc += directory[b].last_doc_gap;
+
+    // The directory says which docIDs a block covers, so blocks holding
+    // none of the documents we want are never decoded.
+    if (doc_ids[want] > last_doc) {
+      p = block_end;
+      continue;
+    }
+    size_t n = std::min<uint64_t>(kPostingsBlockSize,
+                                  num_docs - b * kPostingsBlockSize);
+    if (!DecodeBlockDocs(&p, block_end, n, &prev, block_ids, counts) ||
+        prev != last_doc) {
+      return false;
+    }
+    uint64_t num_positions = 0;
+    for (size_t i = 0; i < n; i++) {
+      num_positions += counts[i];
+    }
+    // Every position takes at least a byte, which bounds a sane count.
+    if (num_positions > static_cast<size_t>(block_end - p)) {
+      return false;
+    }
+    deltas.resize(num_positions);
+    if (!StreamVByteDecode(&p, block_end, num_positions, deltas.data())) {
+      return false;
+    }
+
+    size_t first = 0;   // where block_ids[i]'s positions start in deltas
+    for (size_t i = 0; i < n && want < doc_ids.size(); i++) {
+      if (block_ids[i] > doc_ids[want]) {
+        return false;   // doc_ids[want] isn't in the list
+      }
+      if (block_ids[i] == doc_ids[want]) {
+        vector<DocPositionOffset_t>& out = (*positions)[want++];
+        out.resize(counts[i]);
+        DocPositionOffset_t pos = 0;
+        for (uint32_t j = 0; j < counts[i]; j++) {
+          pos += deltas[first + j];
+          out[j] = pos;
+        }
+      }
+      first += counts[i];
+    }
+    p = block_end;
+  }
+  return want == doc_ids.size();
+}
+
+static bool ParseDirectory(const uint8_t** p, const uint8_t* end,
+                           bool impacts, uint64_t* num_docs,
+                           uint64_t* max_impact,
+                           vector<BlockInfo>* const directory) {
+  uint64_t num_blocks;
+  // Every document takes at least two bytes (its gap and its count), so
+  // a document count bigger than that is garbage; catch it before
+  // reserving room for it.
+  if (!GetVarint(p, end, num_docs) || !GetVarint(p, end, &num_blocks) ||
+      *num_docs > static_cast<size_t>(end - *p) ||
+      num_blocks != (*num_docs + kPostingsBlockSize - 1) /
+                    kPostingsBlockSize) {
+    return false;
+  }
+  *max_impact = 0;
+  if (impacts && !GetVarint(p, end, max_impact)) {
+    return false;
+  }
+  directory->resize(num_blocks);
+  for (BlockInfo& block : *directory) {
+    block.max_impact = 0;
+    if (!GetVarint(p, end, &block.last_doc_gap) ||
+        !GetVarint(p, end, &block.bytes) ||
+        !GetVarint(p, end, &block.max_count) ||
+        (impacts && !GetVarint(p, end, &block.max_impact))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool DecodePostingsWith(const uint8_t* buf, size_t len,
+                               PostingList* const postings, bool impacts,
+                               vector<BlockInfo>* const directory,
+                               vector<uint32_t>* const block_max_impacts) {
+  const uint8_t* p = buf;
+  const uint8_t* end = buf + len;
+  uint64_t num_docs, max_impact;
+  if (!ParseDirectory(&p, end, impacts, &num_docs, &max_impact,
+                      directory) ||
+      max_impact > UINT32_MAX) {
+    return false;
+  }
+
+  postings->Clear();
+  postings->set_max_impact(max_impact);
+  postings->Reserve(num_docs);
+  DocID_t doc_ids[kPostingsBlockSize];
+  uint32_t counts[kPostingsBlockSize];
+  DocID_t prev = 0, last_doc = 0;
+  for (size_t b = 0; b < directory->size(); b++) {
+    if ((*directory)[b].bytes > static_cast<size_t>(end - p)) {
+      return false;
+    }
+    const uint8_t* block_end = p + (*directory)[b].bytes;
+    size_t n = std::min<uint64_t>(kPostingsBlockSize,
+                                  num_docs - b * kPostingsBlockSize);
+    if (!DecodeBlockDocs(&p, block_end, n, &prev, doc_ids, counts)) {
+      return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+      postings->Append(doc_ids[i], static_cast<int32_t>(counts[i]));
+    }
+    last_doc += (*directory)[b].last_doc_gap;
+    if (prev != last_doc) {
+      return false;
+    }
+
+    // The positions aren't needed to answer a query, so skip them.
+    p = block_end;
+  }
+  if (impacts) {
+    block_max_impacts->clear();
+    for (const BlockInfo& block : *directory) {
+      if (block.max_impact > max_impact) {
+        return false;
+      }
+      block_max_impacts->push_back(block.max_impact);
+    }
+    postings->set_block_max_impacts(kPostingsBlockSize,
+                                    block_max_impacts->data(),
+                                    block_max_impacts->size());
+  }
+  return true;
+}
+
+static bool DecodeBlockDocs(const uint8_t** p, const uint8_t* block_end,
+                            size_t n, DocID_t* prev, DocID_t* doc_ids,
+                            uint32_t* counts) {
+  if (*p == block_end) {
+    return false;
+  }
+  uint8_t flags = *(*p)++;
+  if (flags & kWideGaps) {
+    for (size_t i = 0; i < n; i++) {
+      uint64_t gap;
+      if (!GetVarint(p, block_end, &gap)) {
+        return false;
+      }
+      *prev += gap;
+      doc_ids[i] = *prev;
+    }
+  } else {
+    // The counts array doubles as room for the gaps.
+    if (!StreamVByteDecode(p, block_end, n, counts)) {
+      return false;
+    }
+    for (size_t i = 0; i < n; i++) {
+      *prev += counts[i];
+      doc_ids[i] = *prev;
+    }
+  }
+  return StreamVByteDecode(p, block_end, n, counts);
+}
+
+static int StreamVByteLength(uint32_t value) {
+  if (value < (1U << 8)) {
+    return 1;
+  } else if (value < (1U << 16)) {
+    return 2;
+  } else if (value < (1U << 24)) {
+    return 3;
+  }
+  return 4;
+}
+
+static bool StreamVByteDecodeScalar(const uint8_t* control,
+                                    const uint8_t** data,
+                                    const uint8_t* end, size_t n,
+                                    uint32_t* out) {
+  const uint8_t* p = *data;
+  for (size_t i = 0; i < n; i++) {
+    int length = ((control[i / 4] >> (2 * (i % 4))) & 0x3) + 1;
+    if (end - p < length) {
+      return false;
+    }
+    uint32_t value = 0;
+    for (int b = 0; b < length; b++) {
+      value |= static_cast<uint32_t>(p[b]) << (8 * b);
+    }
+    out[i] = value;
+    p += length;
+  }
+  *data = p;
+  return true;
+}
+
+#ifdef HW4_POSTINGCODEC_SSSE3
+// For every control byte, the shuffle that moves its four values'
+// bytes into four 32-bit lanes (0xFF zeroes a byte), and the total
+// number of data bytes the four values take up.
+struct ShuffleTable {
+  ShuffleTable() {
+    for (int c = 0; c < 256; c++) {
+      uint8_t* mask = masks[c];
+      int src = 0;
+      for (int lane = 0; lane < 4; lane++) {
+        int length = ((c >> (2 * lane)) & 0x3) + 1;
+        for (int b = 0; b < 4; b++) {
+          mask[4 * lane + b] = b < length ? src + b : 0xFF;
+        }
+        src += length;
+      }
+      lengths[c] = src;
+    }
+  }
+
+  alignas(16) uint8_t masks[256][16];
+  uint8_t lengths[256];
+};
+
+__attribute__((target("ssse3")))
+static bool StreamVByteDecodeSSSE3(const uint8_t* control,
+                                   const uint8_t** data,
+                                   const uint8_t* end, size_t n,
+                                   uint32_t* out) {
+  static const ShuffleTable table;
+  const uint8_t* p = *data;
+  size_t i = 0;
+  for (; i + 4 <= n && end - p >= 16; i += 4) {
+    uint8_t c = control[i / 4];
+    __m128i in = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    __m128i mask =
+        _mm_load_si128(reinterpret_cast<const __m128i*>(table.masks[c]));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i),
+                     _mm_shuffle_epi8(in, mask));
+    p += table.lengths[c];
+  }
+
+  // The remaining values start on a control byte boundary, since i is a
+  // multiple of 4.
+  if (!StreamVByteDecodeScalar(control + i / 4, &p, end, n - i, out + i)) {
+    return false;
+  }
+  *data = p;
+  return true;
+}
+#endif
+
+}  // namespace hw4
@@ -0,0 +1,115 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_POSTINGCODEC_H_
+#define HW4_POSTINGCODEC_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include "./libhw3/LayoutStructs.h"
+#include "./PostingList.h"
+
+namespace hw4 {
+
+// The compressed posting list format used by version 2 index files
+// (see IndexWriter.h).  In a version 1 file each word's postings are an
+// on-disk hash table of fixed-width DocIDElementHeaders and positions;
+// in a version 2 file they are a single compressed blob instead:
+//
+//   varint num_docs
+//   varint num_blocks
+//   varint max_impact      (version 3 only: the largest impact of the
+//                           word in any document; see Scoring.h)
+//   num_blocks block directory entries, each:
+//     varint last_doc_gap  (the block's last docID, less the previous
+//                           block's last docID, or less 0)
+//     varint block_bytes   (the size of the block's data)
+//     varint max_count     (the largest count in the block)
+//     varint max_impact    (version 3 only: the largest impact in the
+//                           block)
+//   num_blocks blocks of up to kPostingsBlockSize documents, each:
+//     uint8 flags
+//     the docID gaps: each docID less the one before it (the first one
+//       less the previous block's last docID), as StreamVByte, or as
+//       varints if the block has kWideGaps set
+//     the counts (number of positions), as StreamVByte
+//     the positions of every document in the block, each document's
+//       delta coded from 0, as StreamVByte
+//
+// Varints are LEB128: seven bits per byte, low bits first, with the
+// top bit set on every byte but the last.  StreamVByte packs n 32-bit
+// values as ceil(n / 4) control bytes, each holding the byte lengths
+// (1 to 4, minus 1) of four values in two-bit fields, followed by the
+// values' significant bytes, little-endian.  Splitting the lengths from
+// the data like that is what lets the decoder unpack four values with a
+// single SSSE3 shuffle.
+//
+// The block directory lets a reader skip straight to the block that
+// might hold a docID, and past the positions of blocks it doesn't need.
+static const size_t kPostingsBlockSize = 128;
+
+// Block flags.
+static const uint8_t kWideGaps = 0x1;   // some docID gap needs > 32 bits
+
+// Appends the compressed form of a posting list to "out".  "doc_ids"
+// must be in increasing order, and "positions[i]" holds the (increasing)
+// positions of the word in document doc_ids[i].  If "impacts" isn't
+// null, it holds the word's impact in each document, and the list is
+// written in the version 3 form, with impact bounds.
+void EncodePostings(const std::vector<DocID_t>& doc_ids,
+                    const std::vector<std::vector<DocPositionOffset_t>>&
+                      positions,
+                    std::vector<uint8_t>* const out,
+                    const std::vector<uint32_t>* impacts = nullptr);
+
+// Decodes the docIDs and counts of the compressed posting list held in
+// the "len" bytes at "buf" into "postings", along with its impact bound
+// if "impacts" says the list is in the version 3 form.  Returns false
+// if the bytes aren't a well-formed posting list.
+bool DecodePostings(const uint8_t* buf, size_t len,
+                    PostingList* const postings, bool impacts = false);
+
+// Decodes the positions of documents "doc_ids" (which must be in
+// increasing order) from the compressed posting list held in the "len"
+// bytes at "buf", so that (*positions)[i] holds the positions of
+// doc_ids[i].  Only the blocks that hold one of the documents are
+// decoded; the directory is used to skip past the rest.  Returns false
+// if the bytes aren't a well-formed posting list or one of the
+// documents isn't in it.
+bool DecodePositions(const uint8_t* buf, size_t len,
+                     const std::vector<DocID_t>& doc_ids,
+                     std::vector<std::vector<DocPositionOffset_t>>* const
+                       positions,
+                     bool impacts = false);
+
+// Appends "value" to "out" as a varint.
+void PutVarint(uint64_t value, std::vector<uint8_t>* const out);
+
+// Reads a varint from the bytes in [*p, end), advancing *p past it.
+// Returns false if the varint runs off the end or is over 64 bits.
+bool GetVarint(const uint8_t** p, const uint8_t* end, uint64_t* value);
+
+// Appends the "n" values in "in" to "out" in StreamVByte format.
+void StreamVByteEncode(const uint32_t* in, size_t n,
+                       std::vector<uint8_t>* const out);
+
+// Decodes "n" StreamVByte values from the bytes in [*p, end) into
+// "out", advancing *p past them.  Uses SSSE3 when the CPU has it.
+// Returns false if the values run off the end.
+bool StreamVByteDecode(const uint8_t** p, const uint8_t* end, size_t n,
+                       uint32_t* out);
+
+}  // namespace hw4
+
+#endif  // HW4_POSTINGCODEC_H_
@@ -0,0 +1,188 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+#include "./PostingIterator.h"
+
+using std::unique_ptr;
+using std::vector;
+
+namespace hw4 {
+
+const DocID_t PostingIterator::kEnd = UINT64_MAX;
+
+TermIterator::TermIterator(const PostingList* postings)
+  : postings_(postings), pos_(0) {
+  Settle();
+}
+
+void TermIterator::Next() {
+  pos_++;
+  Settle();
+}
+
+void TermIterator::SeekTo(DocID_t target) {
+  if (doc_id_ >= target) {
+    return;
+  }
+  // Invariant: the doc at lo is < target.
+  const vector<DocID_t>& doc_ids = postings_->doc_ids();
+  size_t lo = pos_, step = 1;
+  while (lo + step < doc_ids.size() && doc_ids[lo + step] < target) {
+    lo += step;
+    step *= 2;
+  }
+  size_t hi = std::min(lo + step + 1, doc_ids.size());
+  pos_ = std::lower_bound(doc_ids.begin() + lo + 1, doc_ids.begin() + hi,
+                          target) - doc_ids.begin();
+  Settle();
+}
+
+void TermIterator::Settle() {
+  if (pos_ < postings_->size()) {
+    doc_id_ = postings_->doc_id(pos_);
+    count_ = postings_->count(pos_);
+  } else {
+    doc_id_ = kEnd;
+    count_ = 0;
+  }
+}
+
+AndIterator::AndIterator(vector<unique_ptr<PostingIterator>> required,
+                         vector<unique_ptr<PostingIterator>> excluded)
+  : required_(std::move(required)), excluded_(std::move(excluded)) {
+  std::stable_sort(required_.begin(), required_.end(),
+                   [](const unique_ptr<PostingIterator>& a,
+                      const unique_ptr<PostingIterator>& b) {
+                     return a->cost() < b->cost();
+                   });
+  Settle();
+}
+
+void AndIterator::Next() {
+  required_[0]->Next();
+  Settle();
+}
+
+void AndIterator::SeekTo(DocID_t target) {
+  if (doc_id_ >= target) {
+    return;
+  }
+  required_[0]->SeekTo(target);
+  Settle();
+}
+
+void AndIterator::Settle() {
+  DocID_t target = required_[0]->doc_id();
+  while (target != kEnd) {
+    // Bring the others up to the target; the first to overshoot it
+    // sets a new one, which the cheapest iterator then seeks to.
+    size_t i = 1;
+    while (i < required_.size()) {
+      required_[i]->SeekTo(target);
+      if (required_[i]->doc_id() != target) {
+        break;
+      }
+      i++;
+    }
+    if (i < required_.size()) {
+      required_[0]->SeekTo(required_[i]->doc_id());
+      target = required_[0]->doc_id();
+      continue;
+    }
+
+    bool excluded = false;
+    for (const unique_ptr<PostingIterator>& it : excluded_) {
+      it->SeekTo(target);
+      if (it->doc_id() == target) {
+        excluded = true;
+        break;
+      }
+    }
+    if (!excluded) {
+      doc_id_ = target;
+      count_ = 0;
+      for (const unique_ptr<PostingIterator>& it : required_) {
+        count_ += it->count();
+      }
+      return;
+    }
+    required_[0]->Next();
+    target = required_[0]->doc_id();
+  }
+  doc_id_ = kEnd;
+  count_ = 0;
+}
+
+OrIterator::OrIterator(vector<unique_ptr<PostingIterator>> children)
+  : children_(std::move(children)), cost_(0) {
+  for (const unique_ptr<PostingIterator>& child : children_) {
+    cost_ += child->cost();
+    at_.push_back(child.get());
+  }
+  heap_.reserve(children_.size());
+  Settle();
+}
+
+void OrIterator::Next() {
+  for (PostingIterator* child : at_) {
+    child->Next();
+  }
+  Settle();
+}
+
+void OrIterator::SeekTo(DocID_t target) {
+  if (doc_id_ >= target) {
+    return;
+  }
+  for (PostingIterator* child : at_) {
+    child->SeekTo(target);
+  }
+  while (!heap_.empty() && heap_.front()->doc_id() < target) {
+    std::pop_heap(heap_.begin(), heap_.end(), Later);
+    heap_.back()->SeekTo(target);
+    if (heap_.back()->doc_id() == kEnd) {
+      heap_.pop_back();
+    } else {
+      std::push_heap(heap_.begin(), heap_.end(), Later);
+    }
+  }
+  Settle();
+}
+
+void OrIterator::Settle() {
+  for (PostingIterator* child : at_) {
+    if (child->doc_id() != kEnd) {
+      heap_.push_back(child);
+      std::push_heap(heap_.begin(), heap_.end(), Later);
+    }
+  }
+  at_.clear();
+  if (heap_.empty()) {
+    doc_id_ = kEnd;
+    count_ = 0;
+    return;
+  }
+  doc_id_ = heap_.front()->doc_id();
+  count_ = 0;
+  while (!heap_.empty() && heap_.front()->doc_id() == doc_id_) {
+    std::pop_heap(heap_.begin(), heap_.end(), Later);
+    at_.push_back(heap_.back());
+    heap_.pop_back();
+    count_ += at_.back()->count();
+  }
+}
+
+}  // namespace hw4
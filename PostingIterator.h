@@ -0,0 +1,139 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+
+#ifndef HW4_POSTINGITERATOR_H_
+#define HW4_POSTINGITERATOR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <memory>
+#include <vector>
+
+#include "./PostingList.h"
+
+namespace hw4 {
+
+// A PostingIterator walks, in increasing docID order, the documents
+// that match one node of a boolean query (see QueryEngine), along with
+// the total number of times the node's words appear in each of them.
+// Iterators nest into a tree that mirrors the query, and each node
+// works out its next document from its children's on demand, so the
+// documents matching a subexpression are never gathered into a list
+// of their own: only the root's matches ever are.
+//
+// An iterator starts at its first document; doc_id() is kEnd once it
+// has moved past its last.
+class PostingIterator {
+ public:
+  static const DocID_t kEnd;
+
+  PostingIterator() : doc_id_(kEnd), count_(0) { }
+  virtual ~PostingIterator() { }
+
+  // The document the iterator is at, and how many times the words it
+  // matched appear there.
+  DocID_t doc_id() const { return doc_id_; }
+  int32_t count() const { return count_; }
+
+  // Moves to the next matching document.
+  virtual void Next() = 0;
+
+  // Moves to the first matching document >= "target".  Does nothing if
+  // the iterator is already there.
+  virtual void SeekTo(DocID_t target) = 0;
+
+  // About how many documents the iterator will visit.  A conjunction
+  // drives its walk from its cheapest child.
+  virtual size_t cost() const = 0;
+
+ protected:
+  DocID_t doc_id_;
+  int32_t count_;
+};
+
+// Walks a single posting list, which must outlive it.  SeekTo()
+// gallops forward from the current position, so skipping a long way
+// costs O(log distance) rather than a step per document.
+class TermIterator : public PostingIterator {
+ public:
+  explicit TermIterator(const PostingList* postings);
+
+  void Next() override;
+  void SeekTo(DocID_t target) override;
+  size_t cost() const override { return postings_->size(); }
+
+ private:
+  // Loads the document at pos_.
+  void Settle();
+
+  const PostingList* postings_;
+  size_t pos_;
+};
+
+// The documents that every one of "required" matches and none of
+// "excluded" does; a document's count is the sum of its counts in the
+// required iterators.  The required iterators leapfrog each other,
+// cheapest first, each seeking to the latest document any of them is
+// at until they all agree; an excluded iterator is only ever asked to
+// seek to a document they agree on, so a NOT skips the stretches of
+// its list between candidates instead of walking them.  There must be
+// at least one required iterator.
+class AndIterator : public PostingIterator {
+ public:
+  AndIterator(std::vector<std::unique_ptr<PostingIterator>> required,
+              std::vector<std::unique_ptr<PostingIterator>> excluded);
+
+  void Next() override;
+  void SeekTo(DocID_t target) override;
+  size_t cost() const override { return required_[0]->cost(); }
+
+ private:
+  // Moves to the first match at or after where required_[0] is.
+  void Settle();
+
+  std::vector<std::unique_ptr<PostingIterator>> required_;
+  std::vector<std::unique_ptr<PostingIterator>> excluded_;
+};
+
+// The documents that any of "children" matches; a document's count is
+// the sum of its counts in the children that match it.  The children
+// are k-way merged through a heap ordered by the document each is at,
+// so each step costs O(log k), however many children there are.
+class OrIterator : public PostingIterator {
+ public:
+  explicit OrIterator(std::vector<std::unique_ptr<PostingIterator>> children);
+
+  void Next() override;
+  void SeekTo(DocID_t target) override;
+  size_t cost() const override { return cost_; }
+
+ private:
+  // Puts the children in at_ back on the heap (unless they're done),
+  // and then moves the children at the heap's smallest document into
+  // at_, making it the current document.
+  void Settle();
+
+  // The heap's order: the child at the smallest document on top.
+  static bool Later(const PostingIterator* a, const PostingIterator* b) {
+    return a->doc_id() > b->doc_id();
+  }
+
+  std::vector<std::unique_ptr<PostingIterator>> children_;
+  std::vector<PostingIterator*> heap_;   // children not at doc_id_
+  std::vector<PostingIterator*> at_;     // children at doc_id_
+  size_t cost_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_POSTINGITERATOR_H_
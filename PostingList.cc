@@ -0,0 +1,261 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#include <immintrin.h>
+#define HW4_POSTINGLIST_AVX2 1
+#endif
+
+#include "./PostingList.h"
+
+using std::vector;
+
+namespace hw4 {
+
+const size_t PostingList::kBlockRatio = 16;
+const size_t PostingList::kGallopRatio = 128;
+
+// A function that returns the index of the first of the "n" docIDs in
+// "ids" (which are sorted) that is >= "x", or n if there isn't one.
+typedef size_t (*LowerBoundFn)(const DocID_t* ids, size_t n, DocID_t x);
+
+// Lower bound by galloping: probe positions 1, 2, 4, 8, ... until we
+// overshoot "x", then binary search the last gap.
+static size_t GallopLowerBound(const DocID_t* ids, size_t n, DocID_t x);
+
+// Lower bound by scanning kBlockSize docIDs at a time, one at a time.
+static size_t BlockLowerBoundScalar(const DocID_t* ids, size_t n,
+                                    DocID_t x);
+
+#ifdef HW4_POSTINGLIST_AVX2
+// Lower bound by scanning kBlockSize docIDs at a time, all at once.
+__attribute__((target("avx2")))
+static size_t BlockLowerBoundAVX2(const DocID_t* ids, size_t n, DocID_t x);
+#endif
+
+// Returns the block lower bound function to use on this CPU.
+static LowerBoundFn PickBlockLowerBound();
+
+// Calls keep(i, j) for every pair of positions where small[i] ==
+// large[j], in increasing order, finding each of small's docIDs in
+// "large" with "lower_bound".
+template <typename Fn>
+static void SearchIntersect(const DocID_t* small, size_t num_small,
+                            const DocID_t* large, size_t num_large,
+                            LowerBoundFn lower_bound, Fn keep) {
+  size_t j = 0;
+  for (size_t i = 0; i < num_small && j < num_large; i++) {
+    j += lower_bound(large + j, num_large - j, small[i]);
+    if (j < num_large && large[j] == small[i]) {
+      keep(i, j);
+      j++;
+    }
+  }
+}
+
+void PostingList::SortByDocID() {
+  // The permutation and the sorted copies are built in buffers that the
+  // thread keeps, and the copies are swapped with ours, so both sides'
+  // capacity survives to the next list sorted on this thread (up to
+  // kMaxKeptPostings).
+  static thread_local vector<size_t> order;
+  static thread_local vector<DocID_t> doc_ids;
+  static thread_local vector<int32_t> counts;
+  order.resize(doc_ids_.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  std::sort(order.begin(), order.end(),
+            [this](size_t a, size_t b) {
+              return doc_ids_[a] < doc_ids_[b];
+            });
+
+  doc_ids.resize(order.size());
+  counts.resize(order.size());
+  for (size_t i = 0; i < order.size(); i++) {
+    doc_ids[i] = doc_ids_[order[i]];
+    counts[i] = counts_[order[i]];
+  }
+  doc_ids_.swap(doc_ids);
+  counts_.swap(counts);
+  ClearImpacts();
+  TrimBuffer(&order, kMaxKeptPostings);
+  TrimBuffer(&doc_ids, kMaxKeptPostings);
+  TrimBuffer(&counts, kMaxKeptPostings);
+}
+
+void PostingList::RemoveDocs(const vector<DocID_t>& doc_ids) {
+  size_t out = 0, j = 0;
+  for (size_t i = 0; i < doc_ids_.size(); i++) {
+    while (j < doc_ids.size() && doc_ids[j] < doc_ids_[i]) {
+      j++;
+    }
+    if (j < doc_ids.size() && doc_ids[j] == doc_ids_[i]) {
+      continue;
+    }
+    doc_ids_[out] = doc_ids_[i];
+    counts_[out] = counts_[i];
+    out++;
+  }
+  if (out < doc_ids_.size()) {
+    doc_ids_.resize(out);
+    counts_.resize(out);
+    ClearImpacts();
+  }
+}
+
+void PostingList::IntersectWith(const PostingList& other,
+                                IntersectMethod method) {
+  const DocID_t* mine = doc_ids_.data();
+  const DocID_t* theirs = other.doc_ids_.data();
+  size_t num_mine = doc_ids_.size();
+  size_t num_theirs = other.doc_ids_.size();
+  size_t num_small = std::min(num_mine, num_theirs);
+  size_t num_large = std::max(num_mine, num_theirs);
+
+  if (method == kAuto) {
+    if (num_small == 0 || num_large / num_small >= kGallopRatio) {
+      method = kGallop;
+    } else if (num_large / num_small >= kBlockRatio) {
+      method = kBlock;
+    } else {
+      method = kMerge;
+    }
+  }
+
+  // Matches come out in increasing order, so they can be compacted
+  // into the front of our own arrays as we go.
+  size_t out = 0;
+  auto keep = [&](size_t i, size_t j) {
+    doc_ids_[out] = doc_ids_[i];
+    counts_[out] = counts_[i] + other.counts_[j];
+    out++;
+  };
+  auto keep_swapped = [&](size_t j, size_t i) { keep(i, j); };
+
+  if (method == kMerge) {
+    size_t i = 0, j = 0;
+    while (i < num_mine && j < num_theirs) {
+      if (mine[i] < theirs[j]) {
+        i++;
+      } else if (theirs[j] < mine[i]) {
+        j++;
+      } else {
+        keep(i++, j++);
+      }
+    }
+  } else {
+    LowerBoundFn lower_bound = method == kGallop ?
+        &GallopLowerBound : PickBlockLowerBound();
+    if (num_mine <= num_theirs) {
+      SearchIntersect(mine, num_mine, theirs, num_theirs, lower_bound, keep);
+    } else {
+      SearchIntersect(theirs, num_theirs, mine, num_mine, lower_bound,
+                      keep_swapped);
+    }
+  }
+  doc_ids_.resize(out);
+  counts_.resize(out);
+  ClearImpacts();
+}
+
+void PostingList::UnionWith(const PostingList& other) {
+  vector<DocID_t> doc_ids;
+  vector<int32_t> counts;
+  doc_ids.reserve(doc_ids_.size() + other.doc_ids_.size());
+  counts.reserve(doc_ids.capacity());
+  size_t i = 0, j = 0;
+  while (i < doc_ids_.size() || j < other.doc_ids_.size()) {
+    if (j == other.doc_ids_.size() ||
+        (i < doc_ids_.size() && doc_ids_[i] < other.doc_ids_[j])) {
+      doc_ids.push_back(doc_ids_[i]);
+      counts.push_back(counts_[i++]);
+    } else if (i == doc_ids_.size() || other.doc_ids_[j] < doc_ids_[i]) {
+      doc_ids.push_back(other.doc_ids_[j]);
+      counts.push_back(other.counts_[j++]);
+    } else {
+      doc_ids.push_back(doc_ids_[i]);
+      counts.push_back(counts_[i++] + other.counts_[j++]);
+    }
+  }
+  doc_ids_.swap(doc_ids);
+  counts_.swap(counts);
+  ClearImpacts();
+}
+
+static size_t GallopLowerBound(const DocID_t* ids, size_t n, DocID_t x) {
+  if (n == 0 || ids[0] >= x) {
+    return 0;
+  }
+  // Invariant: ids[lo] < x.
+  size_t lo = 0, step = 1;
+  while (lo + step < n && ids[lo + step] < x) {
+    lo += step;
+    step *= 2;
+  }
+  size_t hi = std::min(lo + step, n);
+  return std::lower_bound(ids + lo + 1, ids + hi, x) - ids;
+}
+
+static size_t BlockLowerBoundScalar(const DocID_t* ids, size_t n,
+                                    DocID_t x) {
+  size_t j = 0;
+  while (j + PostingList::kBlockSize <= n &&
+         ids[j + PostingList::kBlockSize - 1] < x) {
+    j += PostingList::kBlockSize;
+  }
+  while (j < n && ids[j] < x) {
+    j++;
+  }
+  return j;
+}
+
+#ifdef HW4_POSTINGLIST_AVX2
+__attribute__((target("avx2")))
+static size_t BlockLowerBoundAVX2(const DocID_t* ids, size_t n, DocID_t x) {
+  // AVX2 only has a signed 64-bit compare; flipping the sign bit of
+  // both sides turns it into an unsigned one.
+  const __m256i flip = _mm256_set1_epi64x(INT64_MIN);
+  const __m256i key = _mm256_xor_si256(
+      _mm256_set1_epi64x(static_cast<int64_t>(x)), flip);
+  size_t j = 0;
+  for (; j + 4 <= n; j += 4) {
+    __m256i block = _mm256_xor_si256(
+        _mm256_loadu_si256(reinterpret_cast<const __m256i*>(ids + j)), flip);
+    // One bit per docID in the block that is less than x.  The block is
+    // sorted, so those bits are always a prefix.
+    int less = _mm256_movemask_pd(
+        _mm256_castsi256_pd(_mm256_cmpgt_epi64(key, block)));
+    if (less != 0xF) {
+      return j + __builtin_popcount(less);
+    }
+  }
+  while (j < n && ids[j] < x) {
+    j++;
+  }
+  return j;
+}
+#endif
+
+static LowerBoundFn PickBlockLowerBound() {
+#ifdef HW4_POSTINGLIST_AVX2
+  static const bool has_avx2 = __builtin_cpu_supports("avx2");
+  if (has_avx2) {
+    return &BlockLowerBoundAVX2;
+  }
+#endif
+  return &BlockLowerBoundScalar;
+}
+
+}  // namespace hw4
@@ -0,0 +1,188 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_POSTINGLIST_H_
+#define HW4_POSTINGLIST_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include "./libhw3/LayoutStructs.h"
+
+namespace hw4 {
+
+// The most postings that a buffer reused from query to query (or from
+// lookup to lookup) on a thread keeps room for once it is done with.
+// Buffers that one unusually big query grows past this are given back
+// rather than held by the thread for good.
+static const size_t kMaxKeptPostings = 64 * 1024;
+
+// Empties "buffer" and gives its memory back if it has room for more
+// than "max_elements" elements.
+template <typename T>
+void TrimBuffer(std::vector<T>* const buffer, size_t max_elements) {
+  if (buffer->capacity() > max_elements) {
+    std::vector<T>().swap(*buffer);
+  }
+}
+
+// A PostingList holds the documents that contain a single word, along
+// with the number of times the word appears in each document.  The
+// documents are kept in increasing docID order (the on-disk docID
+// table is in hash order), which lets query processing intersect
+// posting lists without any hashing (see IntersectWith()).
+//
+// The docIDs and counts live in two parallel, contiguous arrays
+// rather than in a std::list of DocIDElementHeaders.
+class PostingList {
+ public:
+  PostingList() : max_impact_(0), impact_block_size_(0) { }
+  virtual ~PostingList() { }
+
+  // The number of documents in the list.
+  size_t size() const { return doc_ids_.size(); }
+  bool empty() const { return doc_ids_.empty(); }
+
+  // Accessors for the i'th document, 0 <= i < size().
+  DocID_t doc_id(size_t i) const { return doc_ids_[i]; }
+  int32_t count(size_t i) const { return counts_[i]; }
+
+  const std::vector<DocID_t>& doc_ids() const { return doc_ids_; }
+  const std::vector<int32_t>& counts() const { return counts_; }
+
+  // An upper bound on the word's impact in any of the documents (see
+  // Scoring.h), as stored in the index, or 0 if the index doesn't store
+  // one.  Combining lists with IntersectWith() or UnionWith() makes it
+  // 0, since the combined counts are no longer a single word's.
+  uint32_t max_impact() const { return max_impact_; }
+  void set_max_impact(uint32_t max_impact) { max_impact_ = max_impact; }
+
+  // Finer-grained bounds: the word's largest impact in each block of
+  // "block_size" documents, the i'th document being in block
+  // i / block_size.  Indices that store impacts store these too (see
+  // PostingCodec.h).  Like max_impact(), they are dropped when lists
+  // are combined.
+  // The bounds are copied into the list's own buffer, which is reused
+  // from lookup to lookup rather than reallocated.
+  void set_block_max_impacts(size_t block_size, const uint32_t* impacts,
+                             size_t num_blocks) {
+    impact_block_size_ = block_size;
+    block_max_impacts_.assign(impacts, impacts + num_blocks);
+  }
+  bool has_block_max_impacts() const { return impact_block_size_ != 0; }
+  size_t impact_block_size() const { return impact_block_size_; }
+
+  // An upper bound on the word's impact in the i'th document: the max
+  // impact of its block if there are block bounds, or else
+  // max_impact().
+  uint32_t block_max_impact(size_t i) const {
+    return impact_block_size_ != 0 ?
+           block_max_impacts_[i / impact_block_size_] : max_impact_;
+  }
+
+  // Adds a document to the end of the list.  Callers that can't add
+  // documents in docID order must call SortByDocID() when done.
+  void Append(DocID_t doc_id, int32_t count) {
+    doc_ids_.push_back(doc_id);
+    counts_.push_back(count);
+  }
+
+  // Reserve room for "n" documents.
+  void Reserve(size_t n) {
+    doc_ids_.reserve(n);
+    counts_.reserve(n);
+  }
+
+  void Clear() {
+    doc_ids_.clear();
+    counts_.clear();
+    ClearImpacts();
+  }
+
+  // How many documents the list has room for without reallocating.
+  size_t capacity() const { return doc_ids_.capacity(); }
+
+  // Empties the list and gives its memory back if it has room for more
+  // than "max_docs" documents (see TrimBuffer()).
+  void Trim(size_t max_docs) {
+    if (capacity() > max_docs || block_max_impacts_.capacity() > max_docs) {
+      std::vector<DocID_t>().swap(doc_ids_);
+      std::vector<int32_t>().swap(counts_);
+      std::vector<uint32_t>().swap(block_max_impacts_);
+      ClearImpacts();
+    }
+  }
+
+  // Restores increasing docID order after out-of-order Append()s.
+  void SortByDocID();
+
+  // The ways IntersectWith() can find the documents two lists share.
+  //
+  //  - kMerge walks both lists in step, one document at a time.
+  //
+  //  - kGallop walks the shorter list and, for each of its documents,
+  //    finds its place in the longer list with an exponential
+  //    ("galloping") search followed by a binary search.  This costs
+  //    O(m log(n/m)) instead of O(m + n), which wins big when one word
+  //    is much rarer than the other.
+  //
+  //  - kBlock walks the shorter list and skips through the longer one
+  //    a block of kBlockSize docIDs at a time, comparing each document
+  //    against a whole block at once (with AVX2 when the CPU has it,
+  //    and with plain loops when it doesn't).
+  //
+  //  - kAuto picks by how much longer one list is than the other:
+  //    kMerge below kBlockRatio times, where the extra compares the
+  //    searches spend per document cost more than the plain merge's
+  //    branch misses; kBlock from there up to kGallopRatio times, where
+  //    skipping a block at a time beats galloping's branchy probes; and
+  //    kGallop beyond that, where its log(n/m) steps win.
+  enum IntersectMethod { kMerge, kGallop, kBlock, kAuto };
+  static const size_t kBlockSize = 4;
+  static const size_t kBlockRatio;
+  static const size_t kGallopRatio;
+
+  // Keeps only the documents that also appear in "other", adding
+  // other's count to each surviving document's count.  This is how
+  // a multi-word query narrows its candidate set one word at a time.
+  void IntersectWith(const PostingList& other,
+                     IntersectMethod method = kAuto);
+
+  // Adds the documents in "other" to this list, summing the counts of
+  // documents that appear in both.  This is how a prefix or range term
+  // combines the posting lists of the words it stands for.
+  void UnionWith(const PostingList& other);
+
+  // Drops the documents "doc_ids", which must be in increasing order,
+  // from this list.  This is how documents that a newer index has
+  // deleted or replaced are hidden (see QueryEngine).
+  void RemoveDocs(const std::vector<DocID_t>& doc_ids);
+
+ private:
+  std::vector<DocID_t> doc_ids_;
+  // Forgets the impact bounds.
+  void ClearImpacts() {
+    max_impact_ = 0;
+    impact_block_size_ = 0;
+    block_max_impacts_.clear();
+  }
+
+  std::vector<int32_t> counts_;
+  uint32_t max_impact_;
+  size_t impact_block_size_;
+  std::vector<uint32_t> block_max_impacts_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_POSTINGLIST_H_
@@ -0,0 +1,291 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <ctype.h>
+#include <string.h>
+
+#include <algorithm>
+#include <functional>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "./QueryCache.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+using std::string;
+using std::stringstream;
+using std::unique_ptr;
+using std::vector;
+
+namespace hw4 {
+
+// Multipliers used to pick each sketch row's counter from a key's hash.
+static const uint64_t kSketchSeeds[] = {
+  0x9E3779B97F4A7C15ULL, 0xC2B2AE3D27D4EB4FULL,
+  0x165667B19E3779F9ULL, 0xD6E8FEB86659FD93ULL
+};
+
+// Returns which of the kSketchWidth counters in "row" a key with hash
+// "hash" maps to.
+static size_t SketchSlot(size_t hash, int row);
+
+QueryCache::QueryCache(size_t capacity_bytes, int num_shards)
+  : generation_(0), invalidations_(0), total_hit_us_(0),
+    total_miss_us_(0) {
+  Verify333(num_shards > 0);
+  shard_capacity_ = capacity_bytes / num_shards;
+  for (int i = 0; i < num_shards; i++) {
+    unique_ptr<Shard> shard(new Shard);
+    Verify333(pthread_mutex_init(&shard->lock, nullptr) == 0);
+    shard->bytes = 0;
+    shard->sketch.assign(kSketchDepth * kSketchWidth, 0);
+    shard->increments = 0;
+    shard->generation = 0;
+    memset(&shard->stats, 0, sizeof(shard->stats));
+    shards_.push_back(std::move(shard));
+  }
+  Verify333(pthread_mutex_init(&lock_, nullptr) == 0);
+}
+
+QueryCache::~QueryCache() {
+  for (const unique_ptr<Shard>& shard : shards_) {
+    Verify333(pthread_mutex_destroy(&shard->lock) == 0);
+  }
+  Verify333(pthread_mutex_destroy(&lock_) == 0);
+}
+
+string QueryCache::NormalizeQuery(const vector<string>& query) {
+  // Boolean operators are upper case, and "a OR b c" isn't "c OR a b".
+  vector<string> words;
+  for (string word : query) {
+    if (!QueryEngine::IsBooleanOperator(word)) {
+      std::transform(word.begin(), word.end(), word.begin(), ::tolower);
+    }
+    words.push_back(word);
+  }
+  if (!QueryEngine::HasPositionalOperators(words) &&
+      !QueryEngine::HasBooleanOperators(words)) {
+    std::sort(words.begin(), words.end());
+  }
+
+  // Length-prefix each word, so that no choice of words can produce
+  // the same key as a different choice of words.
+  stringstream key;
+  for (size_t i = 0; i < words.size(); ) {
+    size_t count = 1;
+    while (i + count < words.size() && words[i + count] == words[i]) {
+      count++;
+    }
+    key << words[i].size() << ":" << words[i] << "*" << count << ";";
+    i += count;
+  }
+  return key.str();
+}
+
+string QueryCache::PageKey(const vector<string>& query,
+                           size_t offset, size_t k) {
+  return NormalizeQuery(query) + "@" + std::to_string(offset) + "+" +
+         std::to_string(k);
+}
+
+QueryCache::Results QueryCache::Lookup(const string& key) {
+  size_t hash = std::hash<string>()(key);
+  Shard* shard = ShardFor(hash);
+  Results ret;
+
+  Verify333(pthread_mutex_lock(&shard->lock) == 0);
+  Touch(shard, hash);
+  auto it = shard->map.find(key);
+  if (it != shard->map.end()) {
+    // Move the entry to the front of the LRU list.
+    shard->lru.splice(shard->lru.begin(), shard->lru, it->second);
+    ret = it->second->results;
+    shard->stats.hits++;
+  } else {
+    shard->stats.misses++;
+  }
+  Verify333(pthread_mutex_unlock(&shard->lock) == 0);
+  return ret;
+}
+
+void QueryCache::Insert(const string& key, uint64_t generation,
+                        const Results& results) {
+  size_t hash = std::hash<string>()(key);
+  Shard* shard = ShardFor(hash);
+  size_t bytes = EntryBytes(key, results);
+
+  Verify333(pthread_mutex_lock(&shard->lock) == 0);
+  if (generation != shard->generation || bytes > shard_capacity_ ||
+      shard->map.find(key) != shard->map.end()) {
+    // Stale, too big to ever fit, or someone beat us to it.
+    Verify333(pthread_mutex_unlock(&shard->lock) == 0);
+    return;
+  }
+
+  // If the shard is full, the newcomer has to be more popular than the
+  // entry that would make room for it.
+  if (shard->bytes + bytes > shard_capacity_ &&
+      Frequency(shard, hash) <=
+      Frequency(shard, std::hash<string>()(shard->lru.back().key))) {
+    shard->stats.rejects++;
+    Verify333(pthread_mutex_unlock(&shard->lock) == 0);
+    return;
+  }
+  while (shard->bytes + bytes > shard_capacity_) {
+    const Entry& victim = shard->lru.back();
+    shard->bytes -= victim.bytes;
+    shard->map.erase(victim.key);
+    shard->lru.pop_back();
+    shard->stats.evictions++;
+  }
+
+  Entry entry;
+  entry.key = key;
+  entry.results = results;
+  entry.bytes = bytes;
+  shard->lru.push_front(entry);
+  shard->map[key] = shard->lru.begin();
+  shard->bytes += bytes;
+  shard->stats.inserts++;
+  Verify333(pthread_mutex_unlock(&shard->lock) == 0);
+}
+
+void QueryCache::Invalidate() {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  generation_++;
+  invalidations_++;
+  for (const unique_ptr<Shard>& shard : shards_) {
+    Verify333(pthread_mutex_lock(&shard->lock) == 0);
+    shard->lru.clear();
+    shard->map.clear();
+    shard->bytes = 0;
+    shard->generation = generation_;
+    Verify333(pthread_mutex_unlock(&shard->lock) == 0);
+  }
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+}
+
+uint64_t QueryCache::generation() const {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  uint64_t ret = generation_;
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return ret;
+}
+
+void QueryCache::RecordLatency(bool hit, uint64_t us) {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  if (hit) {
+    total_hit_us_ += us;
+  } else {
+    total_miss_us_ += us;
+  }
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+}
+
+QueryCache::Stats QueryCache::GetStats() const {
+  Stats ret;
+  memset(&ret, 0, sizeof(ret));
+
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  ret.invalidations = invalidations_;
+  ret.total_hit_us = total_hit_us_;
+  ret.total_miss_us = total_miss_us_;
+  for (const unique_ptr<Shard>& shard : shards_) {
+    Verify333(pthread_mutex_lock(&shard->lock) == 0);
+    ret.hits += shard->stats.hits;
+    ret.misses += shard->stats.misses;
+    ret.inserts += shard->stats.inserts;
+    ret.rejects += shard->stats.rejects;
+    ret.evictions += shard->stats.evictions;
+    ret.entries += shard->map.size();
+    ret.bytes += shard->bytes;
+    Verify333(pthread_mutex_unlock(&shard->lock) == 0);
+  }
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return ret;
+}
+
+string QueryCache::StatsString() const {
+  Stats s = GetStats();
+  uint64_t lookups = s.hits + s.misses;
+  uint64_t hit_pct = lookups == 0 ? 0 : 100 * s.hits / lookups;
+  uint64_t mean_hit = s.hits == 0 ? 0 : s.total_hit_us / s.hits;
+  uint64_t mean_miss = s.misses == 0 ? 0 : s.total_miss_us / s.misses;
+
+  stringstream ss;
+  ss << "cache: entries=" << s.entries
+     << " bytes=" << s.bytes << "/" << shard_capacity_ * shards_.size()
+     << " hits=" << s.hits
+     << " misses=" << s.misses
+     << " hit_pct=" << hit_pct
+     << " inserts=" << s.inserts
+     << " rejects=" << s.rejects
+     << " evictions=" << s.evictions
+     << " invalidations=" << s.invalidations
+     << " mean_hit_us=" << mean_hit
+     << " mean_miss_us=" << mean_miss;
+  return ss.str();
+}
+
+int QueryCache::Touch(Shard* shard, size_t hash) {
+  if (++shard->increments >= kSketchWidth * 8) {
+    // Age the sketch, so that yesterday's popular queries don't keep
+    // today's out forever.
+    for (uint8_t& counter : shard->sketch) {
+      counter >>= 1;
+    }
+    shard->increments = 0;
+  }
+
+  int ret = kSketchMax;
+  for (int row = 0; row < kSketchDepth; row++) {
+    uint8_t& counter =
+      shard->sketch[row * kSketchWidth + SketchSlot(hash, row)];
+    if (counter < kSketchMax) {
+      counter++;
+    }
+    ret = std::min(ret, static_cast<int>(counter));
+  }
+  return ret;
+}
+
+int QueryCache::Frequency(const Shard* shard, size_t hash) {
+  int ret = kSketchMax;
+  for (int row = 0; row < kSketchDepth; row++) {
+    ret = std::min(ret, static_cast<int>(
+        shard->sketch[row * kSketchWidth + SketchSlot(hash, row)]));
+  }
+  return ret;
+}
+
+size_t QueryCache::EntryBytes(const string& key, const Results& results) {
+  // The entry itself, its LRU list node and hash map node, the key
+  // (stored twice), and the results.
+  size_t bytes = sizeof(Entry) + 4 * sizeof(void*) + 2 * key.capacity() +
+                 sizeof(*results) +
+                 results->results.capacity() * sizeof(QueryResult);
+  for (const QueryResult& result : results->results) {
+    bytes += result.document_name.capacity();
+  }
+  return bytes;
+}
+
+static size_t SketchSlot(size_t hash, int row) {
+  // kSketchWidth is 2^12, so keep the top 12 bits of the product.
+  return static_cast<size_t>((static_cast<uint64_t>(hash) *
+                              kSketchSeeds[row]) >> 52);
+}
+
+}  // namespace hw4
@@ -0,0 +1,184 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_QUERYCACHE_H_
+#define HW4_QUERYCACHE_H_
+
+extern "C" {
+#include <pthread.h>  // for the pthread mutex functions
+}
+
+#include <stdint.h>
+#include <stddef.h>
+#include <list>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "./QueryEngine.h"
+
+namespace hw4 {
+
+// A QueryCache remembers pages of ranked results of recent queries, so
+// that a repeated search doesn't have to be run against the indices
+// again.
+//
+// Queries are cached under a normalized key (see NormalizeQuery()), so
+// "Quick brown", "brown quick" and "brown  QUICK" all share an entry.
+// The cache is split into shards, each with its own lock, LRU list and
+// byte budget, so that concurrent queries rarely contend with each
+// other.  Each shard also keeps a small, decaying frequency sketch of
+// the keys it has been asked about (TinyLFU): when a shard is full, a
+// new entry only gets in if its key has been asked for more often than
+// the least-recently-used entry it would evict, which keeps one-off
+// searches from flushing out the popular ones.
+//
+// The cache has a generation number, which Invalidate() bumps (and
+// empties the cache).  Callers pass in the generation they saw when
+// they started a query, so a result computed against indices that have
+// since been replaced is never inserted.
+class QueryCache {
+ public:
+  typedef QueryEngine::QueryResult QueryResult;
+  typedef std::shared_ptr<const QueryEngine::ResultPage> Results;
+
+  // A point-in-time copy of the cache's counters.
+  struct Stats {
+    uint64_t hits;            // Lookup()s that found an entry
+    uint64_t misses;          // Lookup()s that didn't
+    uint64_t inserts;         // entries added by Insert()
+    uint64_t rejects;         // Insert()s turned away by admission
+    uint64_t evictions;       // entries evicted to make room
+    uint64_t invalidations;   // calls to Invalidate()
+    uint64_t entries;         // entries in the cache right now
+    uint64_t bytes;           // (estimated) bytes in the cache right now
+    uint64_t total_hit_us;    // time spent answering cached queries
+    uint64_t total_miss_us;   // time spent answering uncached queries
+  };
+
+  // Construct a new, empty cache that holds at most (approximately)
+  // "capacity_bytes" bytes of keys and results, split evenly across
+  // "num_shards" shards.
+  QueryCache(size_t capacity_bytes, int num_shards);
+  virtual ~QueryCache();
+
+  // Returns the cache key for "query": the distinct lower-cased words
+  // of the query in sorted order, each with the number of times it
+  // appears (repeated words count twice towards a document's rank, so
+  // "fox fox" and "fox" are different queries).  Queries with phrases,
+  // NEAR/k or boolean operators keep their words in order, since there
+  // the order changes what the query means, and the operators keep
+  // their case.
+  static std::string NormalizeQuery(const std::vector<std::string>& query);
+
+  // Returns the cache key for the page of "query"'s results that
+  // QueryEngine::ProcessQuery(query, offset, k) returns.
+  static std::string PageKey(const std::vector<std::string>& query,
+                             size_t offset, size_t k);
+
+  // Looks up "key".  Returns the cached results, or nullptr if there
+  // are none.
+  Results Lookup(const std::string& key);
+
+  // Offers "results" for "key", computed when the cache was at
+  // "generation".  The cache may decline to keep them.
+  void Insert(const std::string& key, uint64_t generation,
+              const Results& results);
+
+  // Empties the cache and bumps its generation; call this whenever the
+  // set of indices behind the cache changes.
+  void Invalidate();
+
+  // Returns the cache's current generation.
+  uint64_t generation() const;
+
+  // Records that a query took "us" microseconds to answer, and whether
+  // it was answered from the cache.
+  void RecordLatency(bool hit, uint64_t us);
+
+  // Returns a copy of the cache's counters.
+  Stats GetStats() const;
+
+  // Returns a one-line, human-readable summary of the cache's counters.
+  std::string StatsString() const;
+
+ private:
+  // The TinyLFU sketch: a count-min sketch of small saturating
+  // counters, with kSketchDepth rows of kSketchWidth counters.  After
+  // kSketchWidth * 8 increments, every counter is halved, so that old
+  // popularity fades.
+  static const int kSketchDepth = 4;
+  static const size_t kSketchWidth = 4096;
+  static const uint8_t kSketchMax = 15;
+
+  struct Entry {
+    std::string key;
+    Results results;
+    size_t bytes;
+  };
+
+  struct Shard {
+    // Guards everything below.
+    pthread_mutex_t lock;
+
+    // The entries, most recently used first, and an index into them.
+    std::list<Entry> lru;
+    std::unordered_map<std::string, std::list<Entry>::iterator> map;
+    size_t bytes;
+
+    // The frequency sketch, and how many increments since it was last
+    // halved.
+    std::vector<uint8_t> sketch;
+    size_t increments;
+
+    // The cache generation this shard's entries belong to.
+    uint64_t generation;
+
+    // This shard's share of the counters.
+    Stats stats;
+  };
+
+  // Returns the shard responsible for a key with hash "hash".
+  Shard* ShardFor(size_t hash) const {
+    return shards_[hash % shards_.size()].get();
+  }
+
+  // Bumps the frequency estimate for a key with hash "hash" in
+  // "shard", and returns the new estimate.  Expects shard->lock held.
+  static int Touch(Shard* shard, size_t hash);
+
+  // Returns the frequency estimate for a key with hash "hash".
+  // Expects shard->lock held.
+  static int Frequency(const Shard* shard, size_t hash);
+
+  // Returns the estimated memory used by an entry.
+  static size_t EntryBytes(const std::string& key, const Results& results);
+
+  size_t shard_capacity_;
+  std::vector<std::unique_ptr<Shard>> shards_;
+
+  // Guards generation_ and the counters below it.  Taken before any
+  // shard lock, never after.
+  mutable pthread_mutex_t lock_;
+  uint64_t generation_;
+  uint64_t invalidations_;
+  uint64_t total_hit_us_;
+  uint64_t total_miss_us_;
+
+  // Disable copying; a QueryCache owns its locks.
+  QueryCache(const QueryCache&) = delete;
+  QueryCache& operator=(const QueryCache&) = delete;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_QUERYCACHE_H_
@@ -0,0 +1,1274 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <ctype.h>
+#include <strings.h>
+
+#include <algorithm>
+#include <functional>
+#include <iostream>
+#include <list>
+#include <map>
+#include <memory>
+#include <string>
+#include <unordered_set>
+#include <vector>
+
+#include "./QueryEngine.h"
+#include "./Scoring.h"
+#include "./TopKEvaluator.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+using std::cerr;
+using std::endl;
+using std::list;
+using std::shared_ptr;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace hw4 {
+
+const size_t QueryEngine::kMaxTermExpansion = 64;
+
+// Everything the threads working on one query share.  Indices are
+// claimed one at a time, so a slow index never holds up the others,
+// and the thread running the query never waits on a helper that
+// hasn't started: it just claims that helper's share of the work
+// itself.  Helpers the executor gets to late may find nothing left to
+// claim, and may even run after the query has returned, which is why
+// they hold a reference to the FanOut (and their own copy of the
+// query) rather than pointing into the caller's stack.
+struct QueryEngine::FanOut {
+  FanOut(const QueryEngine* e, ParsedQuery q, size_t d, bool x)
+    : engine(e), query(std::move(q)), depth(d), explain(x),
+      per_index(e->indices_.size()), plans(x ? e->indices_.size() : 0),
+      total(0), next(0), done(0) {
+    Verify333(pthread_mutex_init(&lock, nullptr) == 0);
+    Verify333(pthread_cond_init(&done_cond, nullptr) == 0);
+  }
+  ~FanOut() {
+    Verify333(pthread_mutex_destroy(&lock) == 0);
+    Verify333(pthread_cond_destroy(&done_cond) == 0);
+  }
+
+  const QueryEngine* engine;
+  ParsedQuery query;
+  size_t depth;
+
+  // per_index[i] and plans[i] are only touched by whichever thread
+  // claimed index i.  Plans are only made if explain is set.
+  bool explain;
+  vector<vector<Candidate>> per_index;
+  vector<string> plans;
+
+  // shard_dfs[i] is index i's ShardDFs if it is one of a complete set
+  // of shards and the query is ranked by BM25, and is empty otherwise;
+  // it is filled in before any index is claimed.
+  vector<ShardDFs> shard_dfs;
+
+  // Guards the fields below; done_cond is signaled when done reaches
+  // the number of indices.
+  pthread_mutex_t lock;
+  pthread_cond_t done_cond;
+  size_t total;    // matches found in the indices probed so far
+  uint32_t next;   // the next index to claim
+  uint32_t done;   // how many indices have been probed
+};
+
+// A request for an executor thread to help with a query.  "probe"
+// holds a reference to the query's FanOut, keeping it alive until the
+// task is done with it.
+class FanOutTask : public ThreadPool::Task {
+ public:
+  explicit FanOutTask(ThreadPool::thread_task_fn f)
+    : ThreadPool::Task(f) { }
+
+  std::function<void()> probe;
+};
+
+// The function executor threads run a FanOutTask with.
+static void FanOutTask_ThrFn(ThreadPool::Task* t);
+
+// If "token" is a NEAR/k operator (in any case), sets "k" and returns
+// true.
+static bool ParseNear(const string& token, uint32_t* k);
+
+// Returns how many documents are in at least one of the posting lists
+// "lists[words[i]]", walking them in docID order together.  "cursors"
+// is scratch space.
+static size_t CountUnion(const vector<PostingList>& lists,
+                         const vector<size_t>& words,
+                         vector<size_t>* const cursors);
+
+QueryEngine::QueryEngine(const list<string>& indices,
+                         const IndexReaderOptions& options,
+                         uint32_t fanout, Ranking ranking)
+  : index_names_(indices), options_(options),
+    fanout_(fanout == 0 ? 1 : fanout), ranking_(ranking) { }
+
+bool QueryEngine::Open(bool validate) {
+  indices_.clear();
+  for (const string& name : index_names_) {
+    unique_ptr<IndexReader> index(IndexReader::Create(name, options_));
+    if (!index->Open(validate)) {
+      cerr << "  couldn't open index file \"" << name << "\"" << endl;
+      indices_.clear();
+      return false;
+    }
+    indices_.push_back(std::move(index));
+  }
+
+  // Only a document whose name a newer index has a tombstone for is
+  // hidden, so an index's documents need to be listed by name only if
+  // there are tombstones before it.
+  hidden_.assign(indices_.size(), vector<DocID_t>());
+  std::unordered_set<string> tombstones;
+  vector<DocID_t> doc_ids;
+  string name;
+  for (size_t i = 0; i < indices_.size(); i++) {
+    if (!tombstones.empty() && indices_[i]->ListDocs(&doc_ids)) {
+      for (DocID_t doc_id : doc_ids) {
+        if (indices_[i]->LookupDocName(doc_id, &name) &&
+            tombstones.count(name) > 0) {
+          hidden_[i].push_back(doc_id);
+        }
+      }
+    }
+    tombstones.insert(indices_[i]->tombstones().begin(),
+                      indices_[i]->tombstones().end());
+  }
+
+  // Group the shards by collection, and keep the collections that have
+  // every one of their shards here (once each).
+  std::map<uint64_t, vector<uint32_t>> collections;
+  for (uint32_t i = 0; i < indices_.size(); i++) {
+    if (indices_[i]->is_shard() && indices_[i]->shard().num_shards > 1) {
+      collections[indices_[i]->shard().set_id].push_back(i);
+    }
+  }
+  shard_sets_.clear();
+  for (auto& collection : collections) {
+    vector<uint32_t>& set = collection.second;
+    std::sort(set.begin(), set.end(), [this](uint32_t a, uint32_t b) {
+      return indices_[a]->shard().shard < indices_[b]->shard().shard;
+    });
+    bool complete = set.size() == indices_[set[0]]->shard().num_shards;
+    for (size_t j = 0; complete && j < set.size(); j++) {
+      complete = indices_[set[j]]->shard().shard == j;
+    }
+    if (complete) {
+      shard_sets_.push_back(std::move(set));
+    }
+  }
+
+  if (fanout_ > 1 && pool_ == nullptr) {
+    pool_.reset(new ThreadPool(fanout_ - 1));
+  }
+  return true;
+}
+
+QueryEngine::ResultPage
+QueryEngine::ProcessQuery(const vector<string>& query,
+                          size_t offset, size_t k, bool explain) const {
+  ResultPage page;
+  page.total = 0;
+  if (query.empty() || k == 0) {
+    return page;
+  }
+  // Nobody can see past the page being asked for, so that's as deep as
+  // we ever need to rank.
+  size_t depth = offset + k < offset ? SIZE_MAX : offset + k;
+
+  // Rank each index's matches on its own, fanning the indices out
+  // across the executor if there's more than one of them...
+  shared_ptr<FanOut> fan_out = std::make_shared<FanOut>(this, ParseQuery(query),
+                                                      depth, explain);
+  if (ranking_ == kBM25 && !shard_sets_.empty()) {
+    LookupShardDFs(fan_out->query, &fan_out->shard_dfs);
+  }
+  if (pool_ != nullptr && indices_.size() > 1) {
+    uint32_t helpers = std::min(fanout_ - 1,
+                                static_cast<uint32_t>(indices_.size() - 1));
+    for (uint32_t i = 0; i < helpers; i++) {
+      FanOutTask* task = new FanOutTask(&FanOutTask_ThrFn);
+      task->probe = [fan_out]() {
+        fan_out->engine->ProbeIndices(fan_out.get());
+      };
+      pool_->Dispatch(task);
+    }
+  }
+  ProbeIndices(fan_out.get());
+
+  // Wait for any helpers still probing the indices they claimed.
+  Verify333(pthread_mutex_lock(&fan_out->lock) == 0);
+  while (fan_out->done < indices_.size()) {
+    Verify333(pthread_cond_wait(&fan_out->done_cond, &fan_out->lock) == 0);
+  }
+  page.total = fan_out->total;
+  Verify333(pthread_mutex_unlock(&fan_out->lock) == 0);
+  const vector<vector<Candidate>>& per_index = fan_out->per_index;
+  if (explain) {
+    const ParsedQuery& parsed = fan_out->query;
+    page.plan = "words:";
+    for (size_t i = 0; i < parsed.words.size(); i++) {
+      page.plan += " " + parsed.words[i];
+      if (parsed.repeats[i] > 1) {
+        page.plan += "(x" + std::to_string(parsed.repeats[i]) + ")";
+      }
+    }
+    for (const string& plan : fan_out->plans) {
+      page.plan += "; " + plan;
+    }
+  }
+
+  // ...and then merge the per-index rankings, keeping a heap of the
+  // best remaining candidate from each index.
+  struct Cursor {
+    const vector<Candidate>* list;
+    size_t pos;
+  };
+  auto worse = [](const Cursor& a, const Cursor& b) {
+    return Better((*b.list)[b.pos], (*a.list)[a.pos]);
+  };
+  vector<Cursor> heap;
+  heap.reserve(per_index.size());
+  for (const vector<Candidate>& list : per_index) {
+    if (!list.empty()) {
+      heap.push_back({&list, 0});
+    }
+  }
+  std::make_heap(heap.begin(), heap.end(), worse);
+
+  size_t num_candidates = 0;
+  for (const vector<Candidate>& list : per_index) {
+    num_candidates += list.size();
+  }
+  if (num_candidates > offset) {
+    page.results.reserve(std::min(num_candidates - offset, k));
+  }
+  for (size_t rank = 0; rank < depth && !heap.empty(); rank++) {
+    std::pop_heap(heap.begin(), heap.end(), worse);
+    Cursor& cursor = heap.back();
+    const Candidate& candidate = (*cursor.list)[cursor.pos];
+
+    // Only the documents on the page get their names looked up.
+    if (rank >= offset) {
+      QueryResult result;
+      if (indices_[candidate.index]->LookupDocName(
+              candidate.doc_id, &result.document_name)) {
+        result.rank = candidate.rank;
+        page.results.push_back(std::move(result));
+      }
+    }
+
+    if (++cursor.pos < cursor.list->size()) {
+      std::push_heap(heap.begin(), heap.end(), worse);
+    } else {
+      heap.pop_back();
+    }
+  }
+  return page;
+}
+
+// The buffers MatchIndex() works in.  Each thread keeps its own, and
+// they grow to fit the queries it answers, so once a thread has
+// answered a few queries it answers the rest without allocating:
+// posting lists are decoded into the memory the last query's lists
+// were decoded into.  They only keep up to kMaxKeptPostings postings
+// between queries, though; an unusually big query's buffers are given
+// back when it is done.
+struct QueryEngine::MatchScratch {
+  vector<bool> exact;
+  vector<size_t> dfs;
+  vector<size_t> order;
+  vector<size_t> cursors;
+  vector<PostingList> lists;
+  PostingList matches;
+  vector<TopKEvaluator::Hit> hits;
+
+  // Gives every buffer back if together they hold room for more than
+  // kMaxKeptPostings postings (or for more than kMaxKeptPostings words).
+  void Trim() {
+    size_t kept = matches.capacity() + hits.capacity();
+    for (const PostingList& list : lists) {
+      kept += list.capacity();
+    }
+    if (kept > kMaxKeptPostings || order.capacity() > kMaxKeptPostings ||
+        cursors.capacity() > kMaxKeptPostings) {
+      vector<bool>().swap(exact);
+      vector<size_t>().swap(dfs);
+      vector<size_t>().swap(order);
+      vector<size_t>().swap(cursors);
+      vector<PostingList>().swap(lists);
+      matches.Trim(0);
+      vector<TopKEvaluator::Hit>().swap(hits);
+    }
+  }
+};
+
+void QueryEngine::ProbeIndices(FanOut* const fan_out) const {
+  while (1) {
+    Verify333(pthread_mutex_lock(&fan_out->lock) == 0);
+    if (fan_out->next == indices_.size()) {
+      Verify333(pthread_mutex_unlock(&fan_out->lock) == 0);
+      return;
+    }
+    uint32_t index = fan_out->next++;
+    Verify333(pthread_mutex_unlock(&fan_out->lock) == 0);
+
+    const ShardDFs* shard_dfs =
+        index < fan_out->shard_dfs.size() &&
+        !fan_out->shard_dfs[index].dfs.empty() ?
+          &fan_out->shard_dfs[index] : nullptr;
+    size_t matches = MatchIndex(index, fan_out->query, shard_dfs,
+                                fan_out->depth, &fan_out->per_index[index],
+                                fan_out->explain ?
+                                  &fan_out->plans[index] : nullptr);
+
+    Verify333(pthread_mutex_lock(&fan_out->lock) == 0);
+    fan_out->total += matches;
+    if (++fan_out->done == indices_.size()) {
+      Verify333(pthread_cond_broadcast(&fan_out->done_cond) == 0);
+    }
+    Verify333(pthread_mutex_unlock(&fan_out->lock) == 0);
+  }
+}
+
+void QueryEngine::LookupShardDFs(const ParsedQuery& query,
+                                 vector<ShardDFs>* const shard_dfs) const {
+  // This happens on the calling thread, before the fan-out, since every
+  // shard needs every other shard's numbers; document frequencies are
+  // cheap to look up next to decoding postings, though.
+  size_t num_words = query.words.size();
+  shard_dfs->assign(indices_.size(), ShardDFs());
+  vector<size_t> collection_dfs;
+  for (const vector<uint32_t>& set : shard_sets_) {
+    collection_dfs.assign(num_words, 0);
+    for (size_t i = 0; i < num_words; i++) {
+      if (!query.literal[i] && !IsPlainWord(query.words[i])) {
+        collection_dfs[i] = SIZE_MAX;
+      }
+    }
+    for (uint32_t index : set) {
+      const IndexReader& reader = *indices_[index];
+      vector<size_t>& dfs = (*shard_dfs)[index].dfs;
+      dfs.assign(num_words, SIZE_MAX);
+      for (size_t i = 0; i < num_words; i++) {
+        if (collection_dfs[i] == SIZE_MAX) {
+          continue;
+        }
+        if (!reader.MayContain(query.words[i]) ||
+            !reader.LookupDocFrequency(query.words[i], &dfs[i])) {
+          dfs[i] = 0;
+        }
+        collection_dfs[i] += dfs[i];
+      }
+    }
+    for (uint32_t index : set) {
+      (*shard_dfs)[index].collection_dfs = collection_dfs;
+    }
+  }
+}
+
+size_t QueryEngine::MatchIndex(uint32_t index, const ParsedQuery& query,
+                               const ShardDFs* shard_dfs, size_t n,
+                               vector<Candidate>* const best,
+                               string* const plan) const {
+  const unique_ptr<IndexReader>& reader = indices_[index];
+  best->clear();
+  if (plan != nullptr) {
+    *plan = "[" + std::to_string(index) + "]";
+  }
+  auto skip = [plan](const string& why) {
+    if (plan != nullptr) {
+      *plan += " skipped: " + why;
+    }
+    return 0;
+  };
+  if (query.words.empty()) {
+    return skip("no words");
+  }
+  if (!query.constraints.empty() && !reader->has_word_positions()) {
+    return skip("no word positions");
+  }
+
+  // Plan the query before fetching any postings.  First, ask the
+  // index's term filter whether it could have every plain word; if it
+  // certainly hasn't one that every match needs, the index can be
+  // passed over without touching it.  (Prefix and range terms stand for
+  // words the filter doesn't know.)  Words that a boolean query can do
+  // without are just never fetched (a df of 0 says so).
+  static thread_local MatchScratch scratch;
+  struct TrimOnReturn {
+    ~TrimOnReturn() { scratch.Trim(); }
+  } trim_on_return;
+  size_t num_words = query.words.size();
+  bool boolean = !query.nodes.empty();
+  vector<bool>& exact = scratch.exact;
+  exact.assign(num_words, false);
+  vector<size_t>& dfs = scratch.dfs;
+  dfs.assign(num_words, SIZE_MAX);
+  for (size_t i = 0; i < num_words; i++) {
+    exact[i] = query.literal[i] || IsPlainWord(query.words[i]);
+    if (exact[i] && !reader->MayContain(query.words[i])) {
+      if (query.required[i]) {
+        return skip("no \"" + query.words[i] + "\" (filter)");
+      }
+      dfs[i] = 0;
+    }
+  }
+
+  // Then, if there's more than one word, look up how many documents
+  // each plain word is in, which is cheap next to decoding postings:
+  // a word in none rules the index out, and the rest are fetched and
+  // intersected rarest first.  The candidate set only ever shrinks, so
+  // that keeps every intersection as cheap as it can be, lets
+  // IntersectWith() gallop over the common words, and means the most
+  // common words' postings needn't be decoded at all if the rarer ones
+  // have nothing in common.  How many words a prefix or range term
+  // stands for isn't known until it is expanded, so those go last.  A
+  // shard's document frequencies have already been looked up.
+  if (shard_dfs != nullptr) {
+    for (size_t i = 0; i < num_words; i++) {
+      if (exact[i] && dfs[i] != 0) {
+        dfs[i] = shard_dfs->dfs[i];
+        if (dfs[i] == 0 && query.required[i]) {
+          return skip("no \"" + query.words[i] + "\"");
+        }
+      }
+    }
+  } else if (num_words > 1) {
+    for (size_t i = 0; i < num_words; i++) {
+      if (exact[i] && dfs[i] != 0 &&
+          !reader->LookupDocFrequency(query.words[i], &dfs[i])) {
+        if (query.required[i]) {
+          return skip("no \"" + query.words[i] + "\"");
+        }
+        dfs[i] = 0;
+      }
+    }
+  }
+  vector<size_t>& order = scratch.order;
+  order.resize(num_words);
+  for (size_t i = 0; i < order.size(); i++) {
+    order[i] = i;
+  }
+  // (Ties go in query order.  std::stable_sort() would do that too, but
+  // it allocates a buffer every time.)
+  std::sort(order.begin(), order.end(),
+            [&dfs](size_t a, size_t b) {
+              return dfs[a] != dfs[b] ? dfs[a] < dfs[b] : a < b;
+            });
+  if (plan != nullptr) {
+    for (size_t i : order) {
+      *plan += " " + query.words[i] + ":" +
+               (dfs[i] == SIZE_MAX ? "?" : std::to_string(dfs[i]));
+    }
+  }
+
+  // Fetch and intersect.  If any word is missing, so is the whole
+  // query.  The word lists themselves are left alone, since BM25 needs
+  // each word's own counts.  A boolean query's lists are only fetched
+  // here; its tree combines them below.
+  vector<PostingList>& lists = scratch.lists;
+  if (lists.size() < num_words) {
+    lists.resize(num_words);
+  }
+  PostingList& matches = scratch.matches;
+  for (size_t step = 0; step < order.size(); step++) {
+    size_t i = order[step];
+    bool found = dfs[i] != 0 &&
+                 (query.literal[i] ?
+                  reader->LookupWord(query.words[i], &lists[i]) :
+                  LookupTerm(*reader, query.words[i], &lists[i]));
+    if (!found && query.required[i]) {
+      return skip("no \"" + query.words[i] + "\"");
+    }
+    if (!found) {
+      lists[i].Clear();
+      continue;
+    }
+    if (boolean) {
+      continue;
+    }
+    if (step == 0) {
+      matches = lists[i];
+    } else {
+      matches.IntersectWith(lists[i]);
+    }
+    if (matches.empty()) {
+      return skip("nothing left after \"" + query.words[i] + "\"");
+    }
+  }
+
+  // BM25 scores a document by the query words it contains, so a
+  // disjunction of plain words can be ranked straight off the words'
+  // lists by TopKEvaluator::MatchAny(), which, like RankAll(), skips
+  // the documents whose bounds can't make the top n, but without the
+  // union ever being gathered into a list to rank.  Only how many
+  // documents are in it is still needed, and counting them takes just
+  // their docIDs.  (Documents that a newer index hides would have to be
+  // taken out of the union first, so those indices take the long way.)
+  vector<TopKEvaluator::Hit>& hits = scratch.hits;
+  auto add_words = [&](TopKEvaluator* const evaluator) {
+    for (size_t i : order) {
+      bool collection_idf = shard_dfs != nullptr &&
+                            shard_dfs->collection_dfs[i] != SIZE_MAX;
+      double idf = collection_idf ?
+          BM25Idf(shard_dfs->collection_dfs[i],
+                  reader->shard().collection_docs) : 0;
+      for (uint32_t r = 0; r < query.repeats[i] && !lists[i].empty(); r++) {
+        if (collection_idf) {
+          evaluator->AddWord(&lists[i], idf);
+        } else {
+          evaluator->AddWord(&lists[i]);
+        }
+      }
+    }
+  };
+  if (ranking_ == kBM25 && hidden_[index].empty() &&
+      IsWordDisjunction(query)) {
+    size_t total = CountUnion(lists, order, &scratch.cursors);
+    if (plan != nullptr) {
+      *plan += " -> " + std::to_string(total) + " (any)";
+    }
+    TopKEvaluator evaluator(*reader, TopKEvaluator::kBlockMaxWand);
+    add_words(&evaluator);
+    evaluator.MatchAny(n, &hits);
+    best->reserve(hits.size());
+    for (const TopKEvaluator::Hit& hit : hits) {
+      best->push_back({hit.rank, index, hit.doc_id});
+    }
+    return total;
+  }
+
+  if (boolean) {
+    matches.Clear();
+    unique_ptr<PostingIterator> it =
+      query.root == SIZE_MAX ? nullptr :
+                               BuildIterator(query, query.root, lists);
+    for (; it != nullptr && it->doc_id() != PostingIterator::kEnd;
+         it->Next()) {
+      matches.Append(it->doc_id(), it->count());
+    }
+  }
+
+  // Documents that a newer index deletes or replaces don't match here.
+  if (!hidden_[index].empty()) {
+    size_t before = matches.size();
+    matches.RemoveDocs(hidden_[index]);
+    if (plan != nullptr && matches.size() < before) {
+      *plan += " hidden:" + std::to_string(before - matches.size());
+    }
+  }
+
+  // A word that appears more than once in the query was only fetched
+  // once, but still counts once per appearance.  (A boolean query's
+  // tree has already counted each appearance.)
+  if (ranking_ == kOccurrences && !boolean) {
+    for (size_t i = 0; i < num_words; i++) {
+      for (uint32_t r = 1; r < query.repeats[i]; r++) {
+        matches.IntersectWith(lists[i]);
+      }
+    }
+  }
+
+  // Only now, with the candidates narrowed down by docID, check the
+  // positional constraints, decoding positions for just the candidates.
+  // Each constraint narrows the candidates for the next.
+  vector<vector<vector<DocPositionOffset_t>>> positions;
+  vector<const vector<DocPositionOffset_t>*> doc_positions;
+  for (const Proximity& constraint : query.constraints) {
+    if (matches.empty()) {
+      break;
+    }
+    positions.resize(constraint.words.size());
+    for (size_t i = 0; i < constraint.words.size(); i++) {
+      if (!reader->LookupPositions(query.words[constraint.words[i]],
+                                   matches.doc_ids(), &positions[i])) {
+        return 0;
+      }
+    }
+    PostingList survivors;
+    doc_positions.resize(constraint.words.size());
+    for (size_t d = 0; d < matches.size(); d++) {
+      for (size_t i = 0; i < constraint.words.size(); i++) {
+        doc_positions[i] = &positions[i][d];
+      }
+      if (Satisfies(constraint, doc_positions)) {
+        survivors.Append(matches.doc_id(d), matches.count(d));
+      }
+    }
+    matches = std::move(survivors);
+  }
+
+  if (plan != nullptr) {
+    *plan += " -> " + std::to_string(matches.size());
+  }
+
+  // Keep the best n matches in a bounded heap whose top is the worst
+  // one kept, so each match costs O(log n) instead of sorting them all.
+  // BM25 has its own top-k evaluation, which can skip most of the
+  // matches, and which visits the words rarest first too.  A shard's
+  // plain words are scored with their idfs in the whole collection.
+  if (ranking_ == kBM25) {
+    TopKEvaluator evaluator(*reader, TopKEvaluator::kBlockMaxWand);
+    add_words(&evaluator);
+    evaluator.RankAll(matches, n, &hits);
+    best->reserve(hits.size());
+    for (const TopKEvaluator::Hit& hit : hits) {
+      best->push_back({hit.rank, index, hit.doc_id});
+    }
+    return matches.size();
+  }
+  best->reserve(std::min(n, matches.size()));
+  for (size_t i = 0; i < matches.size(); i++) {
+    Offer({matches.count(i), index, matches.doc_id(i)}, n, best);
+  }
+  std::sort_heap(best->begin(), best->end(), Better);
+  return matches.size();
+}
+
+void QueryEngine::Offer(const Candidate& candidate, size_t n,
+                        vector<Candidate>* const best) {
+  if (best->size() < n) {
+    best->push_back(candidate);
+    std::push_heap(best->begin(), best->end(), Better);
+  } else if (n > 0 && Better(candidate, best->front())) {
+    std::pop_heap(best->begin(), best->end(), Better);
+    best->back() = candidate;
+    std::push_heap(best->begin(), best->end(), Better);
+  }
+}
+
+bool QueryEngine::HasPositionalOperators(const vector<string>& query) {
+  uint32_t k;
+  for (const string& token : query) {
+    if (token.find('"') != string::npos || ParseNear(token, &k)) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool QueryEngine::IsBooleanOperator(const string& token) {
+  return token == "OR" || token == "AND" || token == "NOT";
+}
+
+bool QueryEngine::HasBooleanOperators(const vector<string>& query) {
+  for (const string& token : query) {
+    if (IsBooleanOperator(token) || (token.size() > 1 && token[0] == '-') ||
+        (!token.empty() && (token[0] == '(' || token.back() == ')'))) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Parses a query that uses boolean operators, by recursive descent:
+//
+//   query    := or_expr
+//   or_expr  := and_expr ("OR" and_expr)*
+//   and_expr := operand+            (the operands are ANDed together;
+//                                    "AND" and "a NEAR/k b" go here)
+//   operand  := ("NOT" | "-") operand | "(" or_expr ")" | phrase | word
+//
+// The tokens are first split into lexemes, peeling any "(", "-" and
+// ")" off of the words they're attached to and dropping unbalanced
+// ")"s, so parsing is a single pass with no backtracking.
+struct QueryEngine::BooleanParser {
+  struct Lexeme {
+    enum Kind { kWord, kOpen, kClose, kOr, kNot, kNear };
+    Kind kind;
+    string word;    // kWord's word
+    uint32_t k;     // kNear's k
+  };
+
+  // What an operand parsed to: its node, and, if it is a word or a
+  // phrase, its first and last words (for NEAR/k).
+  struct Operand {
+    size_t node;
+    size_t first, last;
+  };
+
+  explicit BooleanParser(const vector<string>& query);
+
+  // Parses the whole query.
+  ParsedQuery Parse();
+
+  // Each of these parses what its name says, starting at lexemes[next]
+  // and inside "depth" parentheses.  They return the index of the node
+  // they add, or SIZE_MAX if there was nothing to add.
+  size_t ParseOr(uint32_t depth);
+  size_t ParseAnd(uint32_t depth);
+  Operand ParseOperand(uint32_t depth);
+
+  // Adds "node" to the tree, returning its index.
+  size_t AddNode(QueryNode::Kind kind, size_t word, vector<size_t> children);
+
+  // Sets required and repeats for the subtree at "node"; "spine" is
+  // true if every match must match the node, and "negated" if the node
+  // is under a NOT.  Also collects the nodes on the spine in "spine_nodes".
+  void Mark(size_t node, bool spine, bool negated,
+            vector<bool>* const spine_nodes);
+
+  vector<Lexeme> lexemes;
+  size_t next;
+  ParsedQuery parsed;
+
+  // The phrase and NEAR/k constraints, each with the node that must be
+  // on the spine for it to be checked.
+  vector<std::pair<Proximity, size_t>> constraints;
+};
+
+// How deeply parentheses may nest; any deeper, and they are ignored.
+static const uint32_t kMaxQueryDepth = 32;
+
+QueryEngine::BooleanParser::BooleanParser(const vector<string>& query)
+  : next(0) {
+  uint32_t depth = 0;
+  for (const string& token : query) {
+    uint32_t k;
+    if (token == "OR") {
+      lexemes.push_back({Lexeme::kOr, "", 0});
+      continue;
+    }
+    if (token == "NOT") {
+      lexemes.push_back({Lexeme::kNot, "", 0});
+      continue;
+    }
+    if (token == "AND") {
+      continue;
+    }
+    if (ParseNear(token, &k)) {
+      lexemes.push_back({Lexeme::kNear, "", k});
+      continue;
+    }
+
+    size_t begin = 0, end = token.size();
+    while (begin < end && (token[begin] == '(' ||
+                           (token[begin] == '-' && begin + 1 < end))) {
+      if (token[begin] == '(') {
+        lexemes.push_back({Lexeme::kOpen, "", 0});
+        depth++;
+      } else {
+        lexemes.push_back({Lexeme::kNot, "", 0});
+      }
+      begin++;
+    }
+    size_t closes = 0;
+    while (end > begin && token[end - 1] == ')') {
+      closes++;
+      end--;
+    }
+    if (end > begin) {
+      lexemes.push_back({Lexeme::kWord, token.substr(begin, end - begin), 0});
+    }
+    for (; closes > 0 && depth > 0; closes--, depth--) {
+      lexemes.push_back({Lexeme::kClose, "", 0});
+    }
+  }
+}
+
+QueryEngine::ParsedQuery QueryEngine::BooleanParser::Parse() {
+  parsed.root = ParseOr(0);
+  parsed.required.assign(parsed.words.size(), false);
+  parsed.repeats.assign(parsed.words.size(), 0);
+  vector<bool> spine_nodes(parsed.nodes.size(), false);
+  if (parsed.root != SIZE_MAX) {
+    Mark(parsed.root, true, false, &spine_nodes);
+  }
+  for (const std::pair<Proximity, size_t>& constraint : constraints) {
+    if (spine_nodes[constraint.second]) {
+      parsed.constraints.push_back(constraint.first);
+    }
+  }
+  return std::move(parsed);
+}
+
+size_t QueryEngine::BooleanParser::ParseOr(uint32_t depth) {
+  vector<size_t> alternatives;
+  while (next < lexemes.size() && lexemes[next].kind != Lexeme::kClose) {
+    if (lexemes[next].kind == Lexeme::kOr) {
+      next++;
+      continue;
+    }
+    size_t node = ParseAnd(depth);
+    if (node != SIZE_MAX) {
+      alternatives.push_back(node);
+    }
+  }
+  if (alternatives.size() <= 1) {
+    return alternatives.empty() ? SIZE_MAX : alternatives[0];
+  }
+  return AddNode(QueryNode::kOr, 0, std::move(alternatives));
+}
+
+size_t QueryEngine::BooleanParser::ParseAnd(uint32_t depth) {
+  vector<size_t> children;
+  vector<Proximity> nears;
+  Operand prev = {SIZE_MAX, SIZE_MAX, SIZE_MAX};
+  bool near_pending = false;
+  uint32_t near_k = 0;
+  while (next < lexemes.size() && lexemes[next].kind != Lexeme::kClose &&
+         lexemes[next].kind != Lexeme::kOr) {
+    // A NEAR/k ties together the words on either side of it, if they
+    // are plain words (or phrases).
+    if (lexemes[next].kind == Lexeme::kNear) {
+      near_pending = prev.last != SIZE_MAX;
+      near_k = lexemes[next++].k;
+      continue;
+    }
+
+    Operand operand = ParseOperand(depth);
+    if (operand.node == SIZE_MAX) {
+      near_pending = false;
+      continue;
+    }
+    children.push_back(operand.node);
+    if (near_pending && operand.first != SIZE_MAX &&
+        (parsed.literal[prev.last] ||
+         IsPlainWord(parsed.words[prev.last])) &&
+        (parsed.literal[operand.first] ||
+         IsPlainWord(parsed.words[operand.first]))) {
+      nears.push_back({{prev.last, operand.first}, false, near_k});
+    }
+    near_pending = false;
+    prev = operand;
+  }
+  if (children.size() <= 1) {
+    return children.empty() ? SIZE_MAX : children[0];
+  }
+
+  // The NEAR/k operands are both children of this conjunction, so the
+  // constraints hold wherever it has to.
+  size_t node = AddNode(QueryNode::kAnd, 0, std::move(children));
+  for (const Proximity& constraint : nears) {
+    constraints.push_back({constraint, node});
+  }
+  return node;
+}
+
+QueryEngine::BooleanParser::Operand
+QueryEngine::BooleanParser::ParseOperand(uint32_t depth) {
+  Operand none = {SIZE_MAX, SIZE_MAX, SIZE_MAX};
+  const Lexeme& lexeme = lexemes[next++];
+  switch (lexeme.kind) {
+    case Lexeme::kNot: {
+      if (next == lexemes.size() || lexemes[next].kind == Lexeme::kClose ||
+          lexemes[next].kind == Lexeme::kOr) {
+        return none;
+      }
+      Operand negated = ParseOperand(depth);
+      if (negated.node == SIZE_MAX) {
+        return none;
+      }
+      return {AddNode(QueryNode::kNot, 0, {negated.node}),
+              SIZE_MAX, SIZE_MAX};
+    }
+
+    case Lexeme::kOpen: {
+      size_t node;
+      if (depth < kMaxQueryDepth) {
+        node = ParseOr(depth + 1);
+      } else {
+        // Too deep; take what's inside as part of this group.
+        node = ParseAnd(depth);
+      }
+      if (next < lexemes.size() && lexemes[next].kind == Lexeme::kClose) {
+        next++;
+      }
+      return {node, SIZE_MAX, SIZE_MAX};
+    }
+
+    case Lexeme::kWord:
+      break;
+
+    default:
+      // A stray ")" or OR can't start an operand; skip it.
+      return none;
+  }
+
+  // A word that opens a quote starts a phrase, which runs to the word
+  // that closes it (or to the end of the group).
+  if (lexeme.word[0] != '"') {
+    size_t word = AddWord(&parsed, lexeme.word, false);
+    return {AddNode(QueryNode::kWord, word, {}), word, word};
+  }
+  vector<size_t> words;
+  string word = lexeme.word.substr(1);
+  while (true) {
+    bool closed = !word.empty() && word.back() == '"';
+    if (closed) {
+      word.pop_back();
+    }
+    if (!word.empty()) {
+      words.push_back(AddWord(&parsed, word, true));
+    }
+    if (closed || next == lexemes.size() ||
+        lexemes[next].kind != Lexeme::kWord) {
+      break;
+    }
+    word = lexemes[next++].word;
+  }
+  if (words.empty()) {
+    return none;
+  }
+  vector<size_t> children;
+  for (size_t w : words) {
+    children.push_back(AddNode(QueryNode::kWord, w, {}));
+  }
+  if (children.size() == 1) {
+    return {children[0], words[0], words[0]};
+  }
+  size_t node = AddNode(QueryNode::kAnd, 0, std::move(children));
+  constraints.push_back({{words, true, 0}, node});
+  return {node, words.front(), words.back()};
+}
+
+size_t QueryEngine::BooleanParser::AddNode(QueryNode::Kind kind, size_t word,
+                                           vector<size_t> children) {
+  parsed.nodes.push_back({kind, word, std::move(children)});
+  return parsed.nodes.size() - 1;
+}
+
+void QueryEngine::BooleanParser::Mark(size_t node, bool spine, bool negated,
+                                      vector<bool>* const spine_nodes) {
+  const QueryNode& n = parsed.nodes[node];
+  (*spine_nodes)[node] = spine;
+  if (n.kind == QueryNode::kWord) {
+    if (spine) {
+      parsed.required[n.word] = true;
+    }
+    if (!negated) {
+      parsed.repeats[n.word]++;
+    }
+    return;
+  }
+  for (size_t child : n.children) {
+    Mark(child, spine && n.kind == QueryNode::kAnd &&
+                parsed.nodes[child].kind != QueryNode::kNot,
+         negated || n.kind == QueryNode::kNot, spine_nodes);
+  }
+}
+
+QueryEngine::ParsedQuery
+QueryEngine::ParseQuery(const vector<string>& query) {
+  if (HasBooleanOperators(query)) {
+    return BooleanParser(query).Parse();
+  }
+
+  ParsedQuery parsed;
+  parsed.root = SIZE_MAX;
+  auto add_word = [&parsed](const string& word, bool literal) {
+    return AddWord(&parsed, word, literal);
+  };
+
+  // The last word of the previous term or phrase, and the k of a NEAR/k
+  // that is waiting for its right-hand operand.
+  size_t prev_word = SIZE_MAX;
+  bool near_pending = false;
+  uint32_t near_k = 0;
+  for (size_t t = 0; t < query.size(); t++) {
+    const string& token = query[t];
+    uint32_t k;
+    if (ParseNear(token, &k) && prev_word != SIZE_MAX &&
+        t + 1 < query.size()) {
+      near_pending = true;
+      near_k = k;
+      continue;
+    }
+
+    // A token that opens a quote starts a phrase, which runs to the
+    // token that closes it (or to the end of the query).
+    vector<string> phrase;
+    if (token.size() > 0 && token[0] == '"') {
+      string word = token.substr(1);
+      while (word.empty() || word.back() != '"') {
+        if (!word.empty()) {
+          phrase.push_back(word);
+        }
+        if (++t == query.size()) {
+          break;
+        }
+        word = query[t];
+      }
+      if (t < query.size() && word.size() > 1) {
+        phrase.push_back(word.substr(0, word.size() - 1));
+      }
+    } else {
+      phrase.push_back(token);
+    }
+    if (phrase.empty()) {
+      continue;
+    }
+
+    size_t first, last;
+    if (phrase.size() == 1) {
+      first = last = add_word(phrase[0], near_pending || token[0] == '"');
+    } else {
+      Proximity constraint = {{}, true, 0};
+      for (const string& word : phrase) {
+        constraint.words.push_back(add_word(word, true));
+      }
+      first = constraint.words.front();
+      last = constraint.words.back();
+      parsed.constraints.push_back(constraint);
+    }
+    if (near_pending) {
+      if (!parsed.literal[prev_word] &&
+          !IsPlainWord(parsed.words[prev_word]) &&
+          parsed.repeats[prev_word] > 1) {
+        // The left-hand operand is also expanded elsewhere in the query;
+        // only this appearance of it is taken literally.
+        parsed.repeats[prev_word]--;
+        prev_word = add_word(string(parsed.words[prev_word]), true);
+      }
+      parsed.literal[prev_word] = true;
+      parsed.constraints.push_back({{prev_word, first}, false, near_k});
+      near_pending = false;
+    }
+    prev_word = last;
+  }
+  parsed.required.assign(parsed.words.size(), true);
+  return parsed;
+}
+
+size_t QueryEngine::AddWord(ParsedQuery* const parsed, const string& word,
+                            bool literal) {
+  // Whether a plain word is literal makes no difference.
+  for (size_t i = 0; i < parsed->words.size(); i++) {
+    if (parsed->words[i] == word &&
+        (parsed->literal[i] == literal || IsPlainWord(word))) {
+      parsed->repeats[i]++;
+      return i;
+    }
+  }
+  parsed->words.push_back(word);
+  parsed->literal.push_back(literal);
+  parsed->repeats.push_back(1);
+  return parsed->words.size() - 1;
+}
+
+bool QueryEngine::Satisfies(
+    const Proximity& constraint,
+    const vector<const vector<DocPositionOffset_t>*>& positions) {
+  if (constraint.phrase) {
+    // Walk the first word's positions, and look for each following word
+    // one position further along.  All of the lists are sorted, so each
+    // only ever needs to be scanned forward.
+    vector<size_t> next(positions.size(), 0);
+    for (DocPositionOffset_t start : *positions[0]) {
+      bool found = true;
+      for (size_t i = 1; i < positions.size() && found; i++) {
+        const vector<DocPositionOffset_t>& list = *positions[i];
+        int64_t want = static_cast<int64_t>(start) + i;
+        while (next[i] < list.size() && list[next[i]] < want) {
+          next[i]++;
+        }
+        if (next[i] == list.size()) {
+          return false;
+        }
+        found = list[next[i]] == want;
+      }
+      if (found) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  // NEAR/k: merge the two lists, checking each neighbouring pair.
+  const vector<DocPositionOffset_t>& a = *positions[0];
+  const vector<DocPositionOffset_t>& b = *positions[1];
+  size_t i = 0, j = 0;
+  while (i < a.size() && j < b.size()) {
+    int64_t distance = static_cast<int64_t>(a[i]) - b[j];
+    if (distance <= constraint.max_distance &&
+        -distance <= constraint.max_distance) {
+      return true;
+    }
+    if (a[i] < b[j]) {
+      i++;
+    } else {
+      j++;
+    }
+  }
+  return false;
+}
+
+unique_ptr<PostingIterator> QueryEngine::BuildIterator(
+    const ParsedQuery& query, size_t node, const vector<PostingList>& lists) {
+  const QueryNode& n = query.nodes[node];
+  switch (n.kind) {
+    case QueryNode::kWord:
+      if (lists[n.word].empty()) {
+        return nullptr;
+      }
+      return unique_ptr<PostingIterator>(new TermIterator(&lists[n.word]));
+
+    case QueryNode::kAnd: {
+      // Any required child that can't match rules the whole conjunction
+      // out; an excluded one that can't excludes nothing.
+      vector<unique_ptr<PostingIterator>> required, excluded;
+      for (size_t child : n.children) {
+        bool negated = query.nodes[child].kind == QueryNode::kNot;
+        unique_ptr<PostingIterator> it =
+          BuildIterator(query, negated ? query.nodes[child].children[0] :
+                                         child, lists);
+        if (negated) {
+          if (it != nullptr) {
+            excluded.push_back(std::move(it));
+          }
+        } else if (it == nullptr) {
+          return nullptr;
+        } else {
+          required.push_back(std::move(it));
+        }
+      }
+      if (required.empty()) {
+        return nullptr;
+      }
+      if (required.size() == 1 && excluded.empty()) {
+        return std::move(required[0]);
+      }
+      return unique_ptr<PostingIterator>(
+          new AndIterator(std::move(required), std::move(excluded)));
+    }
+
+    case QueryNode::kOr: {
+      vector<unique_ptr<PostingIterator>> children;
+      for (size_t child : n.children) {
+        unique_ptr<PostingIterator> it = BuildIterator(query, child, lists);
+        if (it != nullptr) {
+          children.push_back(std::move(it));
+        }
+      }
+      if (children.size() <= 1) {
+        return children.empty() ? nullptr : std::move(children[0]);
+      }
+      return unique_ptr<PostingIterator>(new OrIterator(std::move(children)));
+    }
+
+    case QueryNode::kNot:
+      // There are no documents to take a lone NOT's away from.
+      return nullptr;
+  }
+  return nullptr;
+}
+
+bool QueryEngine::IsWordDisjunction(const ParsedQuery& query) {
+  if (query.root == SIZE_MAX || !query.constraints.empty() ||
+      query.nodes[query.root].kind != QueryNode::kOr) {
+    return false;
+  }
+  for (size_t child : query.nodes[query.root].children) {
+    const QueryNode& node = query.nodes[child];
+    if (node.kind != QueryNode::kWord ||
+        !(query.literal[node.word] || IsPlainWord(query.words[node.word]))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool QueryEngine::IsPlainWord(const string& term) {
+  return !(term.size() > 1 && term.back() == '*') &&
+         term.find("..") == string::npos;
+}
+
+bool QueryEngine::LookupTerm(const IndexReader& reader, const string& term,
+                             PostingList* const postings) {
+  if (IsPlainWord(term)) {
+    return reader.LookupWord(term, postings);
+  }
+  vector<string> words;
+  if (term.back() == '*') {
+    reader.ExpandPrefix(term.substr(0, term.size() - 1), kMaxTermExpansion,
+                        &words);
+  } else {
+    size_t dots = term.find("..");
+    reader.ExpandRange(term.substr(0, dots), term.substr(dots + 2),
+                       kMaxTermExpansion, &words);
+  }
+
+  // The dictionary only holds words that are in the index, so every
+  // lookup should succeed; the union is the term's posting list.
+  postings->Clear();
+  PostingList word_postings;
+  for (const string& word : words) {
+    if (reader.LookupWord(word, &word_postings)) {
+      postings->UnionWith(word_postings);
+    }
+  }
+  return !postings->empty();
+}
+
+static void FanOutTask_ThrFn(ThreadPool::Task* t) {
+  unique_ptr<FanOutTask> task(static_cast<FanOutTask*>(t));
+  task->probe();
+}
+
+static bool ParseNear(const string& token, uint32_t* k) {
+  if (token.size() < 6 || token.size() > 14 ||
+      strncasecmp(token.c_str(), "near/", 5) != 0) {
+    return false;
+  }
+  uint64_t value = 0;
+  for (size_t i = 5; i < token.size(); i++) {
+    if (!isdigit(static_cast<unsigned char>(token[i]))) {
+      return false;
+    }
+    value = value * 10 + (token[i] - '0');
+  }
+  if (value > UINT32_MAX) {
+    return false;
+  }
+  *k = value;
+  return true;
+}
+
+static size_t CountUnion(const vector<PostingList>& lists,
+                         const vector<size_t>& words,
+                         vector<size_t>* const cursors) {
+  cursors->assign(words.size(), 0);
+  size_t count = 0;
+  while (1) {
+    // The next document is the smallest any list is at; every list at
+    // it moves past it.
+    DocID_t next = 0;
+    bool any = false;
+    for (size_t i = 0; i < words.size(); i++) {
+      const PostingList& list = lists[words[i]];
+      if ((*cursors)[i] < list.size() &&
+          (!any || list.doc_id((*cursors)[i]) < next)) {
+        next = list.doc_id((*cursors)[i]);
+        any = true;
+      }
+    }
+    if (!any) {
+      return count;
+    }
+    count++;
+    for (size_t i = 0; i < words.size(); i++) {
+      const PostingList& list = lists[words[i]];
+      if ((*cursors)[i] < list.size() && list.doc_id((*cursors)[i]) == next) {
+        (*cursors)[i]++;
+      }
+    }
+  }
+}
+
+}  // namespace hw4
@@ -0,0 +1,381 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_QUERYENGINE_H_
+#define HW4_QUERYENGINE_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./IndexReader.h"
+#include "./PostingIterator.h"
+#include "./ThreadPool.h"
+#include "./libhw3/QueryProcessor.h"
+
+namespace hw4 {
+
+// A QueryEngine answers search queries against a fixed list of index
+// files.  By default it ranks the documents that match by their Okapi
+// BM25 scores (see Scoring.h), so both its ranks and its order differ
+// from hw3::QueryProcessor's; an engine built with kOccurrences ranking
+// returns the same results as hw3::QueryProcessor instead.  It is meant
+// to be built once, when the server starts, and then shared by every
+// worker thread: the index files are opened (and, optionally,
+// checksummed) a single time, and ProcessQuery() is const and safe to
+// call concurrently.
+//
+// A query probes its indices concurrently: the calling thread and up
+// to fanout - 1 helpers from an executor that all queries share each
+// take the next unprobed index until there are none left, and the
+// per-index rankings are then k-way merged.
+//
+// The indices can also be the segments of a single index that is kept
+// up to date incrementally: a base index, and then delta indices of
+// the documents added or changed since, each with tombstones for the
+// documents it deletes or replaces (see kTombstoneSection in
+// IndexWriter.h).  The list goes newest first, and a tombstone hides
+// the document it names in every index after the one that holds it,
+// so only the newest copy of a document ever matches.  (Hidden
+// documents still count towards BM25's document frequencies and
+// average document length until the deltas are merged into the base;
+// see MergeIndexFiles().)
+//
+// Or they can be the shards of one collection, each holding some of its
+// documents (see WriteShardedIndex()), so that a single query is spread
+// across as many threads as there are shards and each file stays
+// small.  Each shard's matches are ranked as they would be in one index
+// of the whole collection: when every shard of a collection is in the
+// list, a word's BM25 idf comes from its document frequency across all
+// of them, which is looked up before any shard is probed.
+class QueryEngine {
+ public:
+  typedef hw3::QueryProcessor::QueryResult QueryResult;
+
+  // How results are ranked:
+  //  - kOccurrences: a result's rank is the total number of times the
+  //    query words appear in the document, as hw3::QueryProcessor
+  //    ranks them.
+  //  - kBM25: a result's rank is its Okapi BM25 score (see Scoring.h),
+  //    in thousandths.
+  enum Ranking { kOccurrences, kBM25 };
+
+  // One page of a query's ranked results.
+  struct ResultPage {
+    std::vector<QueryResult> results;   // this page's results, best first
+    size_t total;                       // how many documents matched
+    std::string plan;                   // if asked for, how the query
+                                        // was evaluated
+  };
+
+  // Memorizes the list of index files, how to read them, how many
+  // threads (at most) may work on a single query, and how to rank
+  // results; does not open them.  A "fanout" of 1 probes the indices
+  // one after another on the calling thread.
+  explicit QueryEngine(const std::list<std::string>& indices,
+                       const IndexReaderOptions& options =
+                         IndexReaderOptions(),
+                       uint32_t fanout = 1, Ranking ranking = kBM25);
+  virtual ~QueryEngine() { }
+
+  // Opens every index file in the list, validating their checksums if
+  // "validate" is true, works out which documents the tombstones hide,
+  // and starts the fan-out executor's threads.  Returns false if any of
+  // the index files can't be opened.
+  bool Open(bool validate);
+
+  // Processes a query against all of the indices.  The query is a
+  // vector of lower-case words; a document matches if it contains every
+  // word.  Results are ranked as ranking() says, and are returned in
+  // order of decreasing rank.
+  //
+  // Under kBM25, each word's idf comes from its document frequency in
+  // the index being probed (or, for a plain word and a complete set of
+  // shards, in the whole collection), and the matches are ranked by a
+  // TopKEvaluator, which uses bounds on each word's contribution to
+  // skip the matches that can't make the page.
+  //
+  // A query word can also stand for a set of words: "comput*" for every
+  // word starting with "comput", and "apple..apricot" for every word
+  // from "apple" to "apricot", inclusive.  A document matches such a
+  // term if it contains any of those words, and the term's frequency
+  // in it is the total number of times those words appear there.  Only
+  // the first kMaxTermExpansion words (in sorted order) of a set are
+  // used, and indices without a term dictionary (see
+  // IndexReader::has_term_dictionary()) match no documents for it.
+  //
+  // Words can also be tied together by where they appear:
+  //
+  //  - a quoted phrase, like "quick brown fox", matches documents in
+  //    which the words appear one right after the other, in order;
+  //
+  //  - "a NEAR/k b" matches documents in which some occurrence of "a"
+  //    is within k words of some occurrence of "b", in either order.
+  //    Its operands are the words next to it, so in "a NEAR/3 "b c""
+  //    it ties "a" to "b".
+  //
+  // Positional terms are taken literally (a "*" or ".." in one isn't
+  // expanded), and only match in indices with word positions (see
+  // IndexReader::has_word_positions()).  They are checked only after
+  // the docIDs of all of the query's words have been intersected, and
+  // positions are decoded only for the documents that survive that.
+  // They don't change how a document is ranked.
+  //
+  // Finally, terms can be combined with boolean operators, which must
+  // be in upper case (a lower-case "or" is just a word):
+  //
+  //  - "a OR b" matches documents that match either side; OR binds
+  //    more loosely than the implicit AND between neighbouring terms,
+  //    so "a b OR c" is "(a b) OR c";
+  //
+  //  - "NOT a", or "-a", excludes the documents that match "a" from
+  //    the conjunction it is part of, so "fox -dog" matches documents
+  //    with "fox" but not "dog".  A NOT with nothing to exclude from
+  //    (e.g. a query that is only "-dog") matches nothing;
+  //
+  //  - parentheses group terms, e.g. "(fox OR dog) -cat"; "AND" may be
+  //    written out, but changes nothing.
+  //
+  // Such a query is evaluated as a tree of PostingIterators over the
+  // posting lists of its words, so no subexpression's matches are ever
+  // gathered into a list of their own.  Under kBM25, a query of plain
+  // words ORed together isn't even evaluated as a tree: a TopKEvaluator
+  // ranks the documents straight off the words' posting lists (see
+  // TopKEvaluator::MatchAny()).  A document's rank counts every term it
+  // matches that isn't negated.  Phrases and NEAR/k are only checked
+  // where every match must satisfy them, i.e. outside of any OR or NOT;
+  // elsewhere, they just require their words.
+  std::vector<QueryResult>
+    ProcessQuery(const std::vector<std::string>& query) const {
+    return ProcessQuery(query, 0, SIZE_MAX).results;
+  }
+
+  // Like ProcessQuery() above, but only returns the "k" results that
+  // come "offset" places into the ranking (i.e., the results that
+  // ProcessQuery() would return at positions offset .. offset + k - 1).
+  // Only the best offset + k matches are ever sorted, and only the
+  // returned results have their document names looked up, so asking
+  // for the first page of a common word's results is cheap no matter
+  // how many documents contain it.
+  //
+  // Repeated words are looked up once (but still count once per
+  // appearance), and each index is planned before any postings are
+  // fetched from it: plain words the index's term filter rules out, or
+  // that it has no documents for, rule the whole index out, and the
+  // rest are fetched and intersected in order of how many documents
+  // they are in, fewest first.  If "explain" is true, the page's plan
+  // says what was decided, e.g.
+  //
+  //   words: fox naps(x2); [0] naps:1 fox:3 -> 1;
+  //   [1] skipped: no "naps" (filter)
+  //
+  // i.e. the distinct words, and then, for each index, either why it
+  // was skipped or each word's document frequency in evaluation order
+  // ("?" for prefix and range terms, which go last) and how many
+  // documents matched ("(any)" after it if they were ranked by
+  // TopKEvaluator::MatchAny()).
+  ResultPage ProcessQuery(const std::vector<std::string>& query,
+                          size_t offset, size_t k,
+                          bool explain = false) const;
+
+  // The index files, in query order.
+  const std::vector<std::unique_ptr<IndexReader>>& indices() const {
+    return indices_;
+  }
+
+  // How many documents of each index are hidden by tombstones in the
+  // indices before it.
+  size_t num_hidden(uint32_t index) const { return hidden_[index].size(); }
+
+  uint32_t fanout() const { return fanout_; }
+  Ranking ranking() const { return ranking_; }
+
+  // The most words a single prefix or range term expands to, per index.
+  static const size_t kMaxTermExpansion;
+
+  // Returns true if "query" uses phrases or NEAR/k, i.e. if the order
+  // of its words matters.
+  static bool HasPositionalOperators(const std::vector<std::string>& query);
+
+  // Returns true if "token" is one of the boolean operators OR, AND and
+  // NOT, which (unlike query words) are upper case.
+  static bool IsBooleanOperator(const std::string& token);
+
+  // Returns true if "query" uses boolean operators, "-" or parentheses,
+  // i.e. if the order of its words (and case of its operators) matters.
+  static bool HasBooleanOperators(const std::vector<std::string>& query);
+
+ private:
+  // A matching document that hasn't had its name looked up yet.
+  struct Candidate {
+    int32_t rank;
+    uint32_t index;   // which of indices_ the document is in
+    DocID_t doc_id;
+  };
+
+  // The order results are returned in: decreasing rank, with ties
+  // broken by index order and then docID order.
+  static bool Better(const Candidate& a, const Candidate& b) {
+    if (a.rank != b.rank) {
+      return a.rank > b.rank;
+    }
+    if (a.index != b.index) {
+      return a.index < b.index;
+    }
+    return a.doc_id < b.doc_id;
+  }
+
+  // A constraint on where some of a query's words appear in a document:
+  // either a phrase, or a NEAR/k between two words.
+  struct Proximity {
+    std::vector<size_t> words;   // indices into ParsedQuery::words
+    bool phrase;                 // true for a phrase, false for NEAR/k
+    uint32_t max_distance;       // NEAR/k's k
+  };
+
+  // A node of a boolean query's tree: a word, or the conjunction or
+  // disjunction of other nodes, or the negation of another node (which
+  // only means something as a child of a conjunction).
+  struct QueryNode {
+    enum Kind { kWord, kAnd, kOr, kNot };
+    Kind kind;
+    size_t word;                    // kWord: index into ParsedQuery::words
+    std::vector<size_t> children;   // the others: indices into
+                                    // ParsedQuery::nodes
+  };
+
+  // A query, split into its words and the positional constraints on
+  // them.  Each word is listed once, no matter how many times the
+  // query has it.  Unless the query uses boolean operators, nodes is
+  // empty, and every match must contain every word.
+  struct ParsedQuery {
+    std::vector<std::string> words;
+    std::vector<bool> literal;       // literal[i]: don't expand words[i]
+    std::vector<bool> required;      // required[i]: every match must
+                                     // contain words[i]
+    std::vector<uint32_t> repeats;   // repeats[i]: how many times the
+                                     // query has words[i], not counting
+                                     // negated appearances
+    std::vector<Proximity> constraints;
+    std::vector<QueryNode> nodes;    // a boolean query's tree...
+    size_t root;                     // ...and its root, or SIZE_MAX if
+                                     // it has none
+  };
+
+  // Pulls the phrases and NEAR/k operators out of "query", and folds
+  // repeated words together.  Hands queries that use boolean operators
+  // to a BooleanParser (see QueryEngine.cc).
+  static ParsedQuery ParseQuery(const std::vector<std::string>& query);
+  struct BooleanParser;
+
+  // Adds "word" to "parsed" (unless it's already there) and counts an
+  // appearance of it.  Returns its index in parsed->words.
+  static size_t AddWord(ParsedQuery* const parsed, const std::string& word,
+                        bool literal);
+
+  // Returns an iterator over the documents that node "node" of boolean
+  // query "query" matches, where lists[i] holds the documents that
+  // query.words[i] matches, or null if the node can match nothing.
+  static std::unique_ptr<PostingIterator> BuildIterator(
+      const ParsedQuery& query, size_t node,
+      const std::vector<PostingList>& lists);
+
+  // Returns true if "query" is a boolean query that is nothing but
+  // plain words ORed together: no phrases, NEARs, NOTs, ANDs, or prefix
+  // or range terms.
+  static bool IsWordDisjunction(const ParsedQuery& query);
+
+  // Returns true if "positions" (the positions in one document of each
+  // of constraint's words, in the constraint's order) satisfy
+  // "constraint".
+  static bool Satisfies(
+      const Proximity& constraint,
+      const std::vector<const std::vector<DocPositionOffset_t>*>& positions);
+
+  // Returns true if query word "term" is just a word, rather than a
+  // prefix ("comput*") or range ("cat..dog") term.
+  static bool IsPlainWord(const std::string& term);
+
+  // Fills "postings" with the documents in "reader" that match query
+  // word "term", expanding it first if it is a prefix or range term.
+  // Returns false if no document matches.
+  static bool LookupTerm(const IndexReader& reader, const std::string& term,
+                         PostingList* const postings);
+
+  // The document frequencies of a query's words in one shard of a
+  // complete set of shards: dfs[i] in the shard itself, and
+  // collection_dfs[i] in every shard of the set together, which is
+  // what the word's idf comes from.  Both are SIZE_MAX for words that
+  // aren't plain.
+  struct ShardDFs {
+    std::vector<size_t> dfs;
+    std::vector<size_t> collection_dfs;
+  };
+
+  // Fills "shard_dfs", by index, with the document frequencies of the
+  // words of "query" in each index that is in one of shard_sets_, and
+  // leaves the others' empty.
+  void LookupShardDFs(const ParsedQuery& query,
+                      std::vector<ShardDFs>* const shard_dfs) const;
+
+  // Finds the documents in index "index" that match "query", and
+  // returns (through "best") the "n" best of them, best first.  Returns
+  // the total number of matching documents.  If the index is a shard,
+  // "shard_dfs" holds its ShardDFs; otherwise it is null.  If "plan"
+  // isn't null, also describes there how the query was evaluated
+  // against the index.
+  size_t MatchIndex(uint32_t index, const ParsedQuery& query,
+                    const ShardDFs* shard_dfs, size_t n,
+                    std::vector<Candidate>* const best,
+                    std::string* const plan = nullptr) const;
+
+  // Adds "candidate" to "best", a heap of at most "n" candidates whose
+  // top is the worst one, if it is among the n best seen so far.
+  static void Offer(const Candidate& candidate, size_t n,
+                    std::vector<Candidate>* const best);
+
+  // The state of one query's fan-out across the indices, and the
+  // per-thread buffers a query is matched in; see QueryEngine.cc.
+  struct FanOut;
+  struct MatchScratch;
+
+  // Runs MatchIndex() on indices claimed from "fan_out" until every
+  // index has been claimed.
+  void ProbeIndices(FanOut* const fan_out) const;
+
+  std::list<std::string> index_names_;
+  IndexReaderOptions options_;
+  uint32_t fanout_;
+  Ranking ranking_;
+  std::vector<std::unique_ptr<IndexReader>> indices_;
+
+  // hidden_[i] holds the docIDs of the documents in indices_[i] that
+  // tombstones in indices_[0 .. i - 1] hide, in increasing order.
+  std::vector<std::vector<DocID_t>> hidden_;
+
+  // The indices of each collection that all of the shards of are in
+  // the list (see IndexReader::is_shard()), in shard order.  Shards of
+  // a collection that is only partly there are ranked as if they were
+  // indices of their own.
+  std::vector<std::vector<uint32_t>> shard_sets_;
+
+  // The helper threads, shared by every query; null if fanout_ is 1.
+  // Declared after indices_ so that its threads are gone before the
+  // indices are closed.
+  std::unique_ptr<ThreadPool> pool_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_QUERYENGINE_H_
@@ -0,0 +1,153 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <string.h>
+#include <time.h>
+#include <sstream>
+#include <string>
+
+#include "./RequestLane.h"
+
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+
+using std::string;
+using std::stringstream;
+
+namespace hw4 {
+
+// Returns the histogram bucket for a request that took "us" microseconds,
+// i.e., the number of significant bits in "us".
+static int LatencyBucket(uint64_t us);
+
+RequestLane::RequestLane(const string& name,
+                         uint32_t max_workers,
+                         uint32_t queue_limit)
+  : name_(name), max_workers_(max_workers), queue_limit_(queue_limit) {
+  Verify333(max_workers_ > 0);
+  memset(&stats_, 0, sizeof(stats_));
+  Verify333(pthread_mutex_init(&lock_, nullptr) == 0);
+  Verify333(pthread_cond_init(&slot_cond_, nullptr) == 0);
+}
+
+RequestLane::~RequestLane() {
+  Verify333(pthread_cond_destroy(&slot_cond_) == 0);
+  Verify333(pthread_mutex_destroy(&lock_) == 0);
+}
+
+bool RequestLane::Enter(uint64_t* const wait_us) {
+  uint64_t start = NowMicros();
+
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  if (stats_.active >= max_workers_) {
+    // No free worker; queue up behind the others, unless the queue is
+    // already full, in which case we shed the request right away.
+    if (stats_.queued >= queue_limit_) {
+      stats_.rejected++;
+      Verify333(pthread_mutex_unlock(&lock_) == 0);
+      return false;
+    }
+    stats_.queued++;
+    while (stats_.active >= max_workers_) {
+      Verify333(pthread_cond_wait(&slot_cond_, &lock_) == 0);
+    }
+    stats_.queued--;
+  }
+  stats_.active++;
+
+  uint64_t waited = NowMicros() - start;
+  stats_.total_wait_us += waited;
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+
+  if (wait_us != nullptr) {
+    *wait_us = waited;
+  }
+  return true;
+}
+
+void RequestLane::Exit(uint64_t service_us) {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  Verify333(stats_.active > 0);
+  stats_.active--;
+  stats_.completed++;
+  stats_.total_service_us += service_us;
+  if (service_us > stats_.max_service_us) {
+    stats_.max_service_us = service_us;
+  }
+  stats_.histogram[LatencyBucket(service_us)]++;
+  Verify333(pthread_cond_signal(&slot_cond_) == 0);
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+}
+
+RequestLane::Stats RequestLane::GetStats() const {
+  Verify333(pthread_mutex_lock(&lock_) == 0);
+  Stats copy = stats_;
+  Verify333(pthread_mutex_unlock(&lock_) == 0);
+  return copy;
+}
+
+string RequestLane::StatsString() const {
+  Stats s = GetStats();
+  uint64_t mean_service = 0, mean_wait = 0;
+  if (s.completed > 0) {
+    mean_service = s.total_service_us / s.completed;
+    mean_wait = s.total_wait_us / s.completed;
+  }
+
+  stringstream ss;
+  ss << name_ << ": workers=" << max_workers_
+     << " active=" << s.active
+     << " queued=" << s.queued << "/" << queue_limit_
+     << " completed=" << s.completed
+     << " rejected=" << s.rejected
+     << " mean_wait_us=" << mean_wait
+     << " mean_us=" << mean_service
+     << " p50_us<=" << s.Percentile(0.50)
+     << " p99_us<=" << s.Percentile(0.99)
+     << " max_us=" << s.max_service_us;
+  return ss.str();
+}
+
+uint64_t RequestLane::Stats::Percentile(double pct) const {
+  if (completed == 0) {
+    return 0;
+  }
+
+  // Walk the histogram until we've covered "pct" of the requests; the
+  // answer is the upper edge of the bucket we stopped in.
+  uint64_t target = static_cast<uint64_t>(pct * completed);
+  uint64_t seen = 0;
+  for (int i = 0; i < kNumLatencyBuckets; i++) {
+    seen += histogram[i];
+    if (seen > target || seen == completed) {
+      return static_cast<uint64_t>(1) << i;
+    }
+  }
+  return max_service_us;
+}
+
+uint64_t RequestLane::NowMicros() {
+  struct timespec ts;
+  Verify333(clock_gettime(CLOCK_MONOTONIC, &ts) == 0);
+  return static_cast<uint64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int LatencyBucket(uint64_t us) {
+  int bucket = 0;
+  while (us != 0 && bucket < RequestLane::kNumLatencyBuckets - 1) {
+    us >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+}  // namespace hw4
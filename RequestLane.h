@@ -0,0 +1,109 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_REQUESTLANE_H_
+#define HW4_REQUESTLANE_H_
+
+extern "C" {
+#include <pthread.h>  // for the pthread mutex/condition variable functions
+}
+
+#include <stdint.h>   // for uint32_t, uint64_t, etc.
+#include <string>     // for std::string
+
+namespace hw4 {
+
+// A RequestLane is an admission gate for one class of HTTP request
+// (e.g., static file requests or search queries).  Each lane has its
+// own budget of concurrently-running workers and its own limit on how
+// many requests may wait for a worker, so that a burst of expensive
+// requests in one lane cannot delay the cheap requests in another.
+//
+// A connection thread calls Enter() once it has parsed and classified a
+// request, processes the request, and then calls Exit().  The lane also
+// keeps latency statistics for the requests that pass through it.
+class RequestLane {
+ public:
+  // The number of power-of-two latency histogram buckets; bucket "i"
+  // counts requests that took less than 2^i microseconds.
+  static const int kNumLatencyBuckets = 32;
+
+  // A point-in-time copy of the lane's counters.
+  struct Stats {
+    uint64_t completed;       // requests that finished processing
+    uint64_t rejected;        // requests turned away because of queue_limit
+    uint64_t total_wait_us;   // sum of time spent waiting for a worker
+    uint64_t total_service_us;  // sum of time spent processing
+    uint64_t max_service_us;  // slowest request seen
+    uint32_t active;          // requests being processed right now
+    uint32_t queued;          // requests waiting for a worker right now
+    uint64_t histogram[kNumLatencyBuckets];  // service time histogram
+
+    // Returns an upper bound (in microseconds) on the service time of
+    // the "pct" percentile request, e.g. pct = 0.99 for p99.
+    uint64_t Percentile(double pct) const;
+  };
+
+  // Construct a new lane.  Arguments:
+  //
+  //  - name:  a human-readable name used when reporting statistics.
+  //
+  //  - max_workers:  the number of requests that may be processed in
+  //    this lane at the same time.  Must be at least 1.
+  //
+  //  - queue_limit:  the number of requests that may block in Enter()
+  //    waiting for a worker.  Once that many are waiting, further
+  //    calls to Enter() fail immediately.
+  RequestLane(const std::string& name,
+              uint32_t max_workers,
+              uint32_t queue_limit);
+  virtual ~RequestLane();
+
+  // Waits for a worker slot in this lane.  Returns true once the caller
+  // holds a slot, in which case it must call Exit() when done.  Returns
+  // false if the lane's queue is full; the caller should shed the
+  // request and must not call Exit().
+  //
+  // On success, "wait_us" (if non-null) returns the number of
+  // microseconds the caller spent waiting for a slot.
+  bool Enter(uint64_t* const wait_us);
+
+  // Releases the caller's worker slot and records that the request took
+  // "service_us" microseconds to process.
+  void Exit(uint64_t service_us);
+
+  // Returns a copy of this lane's counters.
+  Stats GetStats() const;
+
+  // Returns a one-line, human-readable summary of this lane's counters.
+  std::string StatsString() const;
+
+  const std::string& name() const { return name_; }
+
+  // Returns the current value of a monotonic clock, in microseconds.
+  // Useful for computing the arguments to Exit().
+  static uint64_t NowMicros();
+
+ private:
+  std::string name_;
+  uint32_t max_workers_;
+  uint32_t queue_limit_;
+
+  // Guards all of the fields below; slot_cond_ is signaled each time a
+  // worker slot frees up.
+  mutable pthread_mutex_t lock_;
+  pthread_cond_t slot_cond_;
+  Stats stats_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_REQUESTLANE_H_
@@ -0,0 +1,464 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "./CRC32.h"
+#include "./ResidentIndex.h"
+#include "./PostingCodec.h"
+#include "./Scoring.h"
+#include "./libhw3/Utils.h"
+
+using std::pair;
+using std::string;
+using std::vector;
+using hw3::BucketListHeader;
+using hw3::BucketRecord;
+using hw3::DoctableElementHeader;
+using hw3::ElementPositionRecord;
+using hw3::IndexFileHeader;
+using hw3::IndexFileOffset_t;
+using hw3::WordPostingsHeader;
+
+namespace hw4 {
+
+const uint32_t ResidentIndex::kEmptySlot = UINT32_MAX;
+
+// Reads all of file "file_name" into "contents".  Returns false on
+// error.
+static bool ReadWholeFile(const string& file_name,
+                          vector<uint8_t>* const contents);
+
+ResidentIndex::ResidentIndex(const string& file_name)
+  : IndexReader(file_name), num_words_(0) { }
+
+template <typename Fn>
+bool ResidentIndex::ForEachElement(const vector<uint8_t>& file,
+                                   IndexFileOffset_t table_offset, Fn fn) {
+  BucketListHeader blh;
+  if (!ParseAt(file.data(), file.size(), table_offset, &blh)) {
+    return false;
+  }
+  for (int32_t b = 0; b < blh.num_buckets; b++) {
+    BucketRecord br;
+    if (!ParseAt(file.data(), file.size(),
+                 table_offset + sizeof(blh) + b * sizeof(br), &br)) {
+      return false;
+    }
+    for (int32_t e = 0; e < br.chain_num_elements; e++) {
+      ElementPositionRecord epr;
+      if (!ParseAt(file.data(), file.size(),
+                   br.position + e * sizeof(epr), &epr) ||
+          !fn(epr.position)) {
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+bool ResidentIndex::Open(bool validate) {
+  vector<uint8_t> file;
+  if (!ReadWholeFile(file_name(), &file)) {
+    return false;
+  }
+
+  IndexFileHeader header;
+  if (!ParseAt(file.data(), file.size(), 0, &header) ||
+      !CheckHeader(header, file.size())) {
+    return false;
+  }
+  if (validate) {
+    CRC32 crc;
+    crc.Fold(file.data() + sizeof(IndexFileHeader),
+             file.size() - sizeof(IndexFileHeader));
+    if (crc.GetFinalCRC() != header.checksum) {
+      return false;
+    }
+  }
+
+  IndexFileOffset_t doctable_offset = sizeof(IndexFileHeader);
+  IndexFileOffset_t index_offset = doctable_offset + header.doctable_bytes;
+  size_t sections_offset = index_offset + header.index_bytes;
+  if (!CopySections(&file[0] + sections_offset,
+                    file.size() - sections_offset)) {
+    return false;
+  }
+
+  // With a document name pool, which CopySections() has kept, there is
+  // no need to hold a second copy of the names.
+  if (has_doc_name_pool()) {
+    set_num_docs(doc_names().size());
+  } else if (!DecodeDoctable(file, doctable_offset)) {
+    return false;
+  }
+  if (!DecodeWords(file, index_offset)) {
+    return false;
+  }
+  ComputeImpacts();
+
+  // Files without a term dictionary get one made from the words we
+  // just decoded, so that prefix and range queries work on them too.
+  if (!has_term_dictionary()) {
+    vector<string> words;
+    words.reserve(num_words_);
+    for (const WordSlot& slot : word_slots_) {
+      if (slot.word_len != kEmptySlot) {
+        words.emplace_back(words_, slot.word_offset, slot.word_len);
+      }
+    }
+    std::sort(words.begin(), words.end());
+    BuildTermDictionary(words);
+  }
+  return true;
+}
+
+bool ResidentIndex::LookupWord(const string& word,
+                               PostingList* const postings) const {
+  const WordSlot* slot = FindWord(word);
+  if (slot == nullptr) {
+    return false;
+  }
+  postings->Clear();
+  postings->Reserve(slot->num_docs);
+  for (uint32_t j = slot->first; j < slot->first + slot->num_docs; j++) {
+    postings->Append(doc_ids_[j], counts_[j]);
+  }
+  postings->set_max_impact(slot->max_impact);
+  size_t num_blocks =
+      (slot->num_docs + kPostingsBlockSize - 1) / kPostingsBlockSize;
+  postings->set_block_max_impacts(
+      kPostingsBlockSize, block_impacts_.data() + slot->first_block,
+      num_blocks);
+  return true;
+}
+
+bool ResidentIndex::LookupDocFrequency(const string& word,
+                                       size_t* const df) const {
+  const WordSlot* slot = FindWord(word);
+  if (slot == nullptr) {
+    return false;
+  }
+  *df = slot->num_docs;
+  return true;
+}
+
+bool ResidentIndex::LookupPositions(
+    const string& word, const vector<DocID_t>& doc_ids,
+    vector<vector<DocPositionOffset_t>>* const positions) const {
+  const WordSlot* slot = FindWord(word);
+  if (slot == nullptr || position_starts_.empty()) {
+    return false;
+  }
+  positions->resize(doc_ids.size());
+  auto it = doc_ids_.begin() + slot->first;
+  auto end = doc_ids_.begin() + slot->first + slot->num_docs;
+  for (size_t i = 0; i < doc_ids.size(); i++) {
+    it = std::lower_bound(it, end, doc_ids[i]);
+    if (it == end || *it != doc_ids[i]) {
+      return false;
+    }
+    size_t j = it - doc_ids_.begin();
+    (*positions)[i].assign(
+        positions_.begin() + position_starts_[j],
+        positions_.begin() + position_starts_[j] + counts_[j]);
+  }
+  return true;
+}
+
+const ResidentIndex::WordSlot*
+ResidentIndex::FindWord(const string& word) const {
+  if (word_slots_.empty()) {
+    return nullptr;
+  }
+  uint64_t hash = FNVHash64((unsigned char*) word.c_str(), word.size());
+  size_t mask = word_slots_.size() - 1;
+  for (size_t i = HomeSlot(hash, word_slots_.size()); ; i = (i + 1) & mask) {
+    const WordSlot& slot = word_slots_[i];
+    if (slot.word_len == kEmptySlot) {
+      return nullptr;
+    }
+    if (slot.hash == hash && slot.word_len == word.size() &&
+        memcmp(&words_[slot.word_offset], word.data(), word.size()) == 0) {
+      return &slot;
+    }
+  }
+}
+
+bool ResidentIndex::LookupDocName(DocID_t doc_id,
+                                  string* const name) const {
+  if (has_doc_name_pool()) {
+    return doc_names().Lookup(doc_id, name);
+  }
+  if (doc_slots_.empty()) {
+    return false;
+  }
+  size_t mask = doc_slots_.size() - 1;
+  for (size_t i = HomeSlot(doc_id, doc_slots_.size()); ; i = (i + 1) & mask) {
+    const DocSlot& slot = doc_slots_[i];
+    if (slot.name_len == kEmptySlot) {
+      return false;
+    }
+    if (slot.doc_id == doc_id) {
+      name->assign(names_, slot.name_offset, slot.name_len);
+      return true;
+    }
+  }
+}
+
+bool ResidentIndex::ListDocs(vector<DocID_t>* const doc_ids) const {
+  if (has_doc_name_pool()) {
+    ListPooledDocs(doc_ids);
+    return true;
+  }
+  doc_ids->clear();
+  for (const DocSlot& slot : doc_slots_) {
+    if (slot.name_len != kEmptySlot) {
+      doc_ids->push_back(slot.doc_id);
+    }
+  }
+  std::sort(doc_ids->begin(), doc_ids->end());
+  return true;
+}
+
+size_t ResidentIndex::MemoryFootprint() const {
+  return word_slots_.capacity() * sizeof(WordSlot) + words_.capacity() +
+         doc_ids_.capacity() * sizeof(DocID_t) +
+         counts_.capacity() * sizeof(int32_t) +
+         position_starts_.capacity() * sizeof(uint32_t) +
+         positions_.capacity() * sizeof(DocPositionOffset_t) +
+         block_impacts_.capacity() * sizeof(uint32_t) +
+         doc_slots_.capacity() * sizeof(DocSlot) + names_.capacity() +
+         sections_footprint();
+}
+
+bool ResidentIndex::DecodeDoctable(const vector<uint8_t>& file,
+                                   IndexFileOffset_t table_offset) {
+  // First pull out every (docID, name) pair, so that we know how big
+  // to make the table.
+  vector<DocSlot> docs;
+  names_.clear();
+  bool ok = ForEachElement(file, table_offset,
+      [&](IndexFileOffset_t element) {
+        DoctableElementHeader deh;
+        if (!ParseAt(file.data(), file.size(), element, &deh) ||
+            deh.file_name_bytes < 0 ||
+            element + sizeof(deh) + deh.file_name_bytes > file.size()) {
+          return false;
+        }
+        DocSlot slot;
+        slot.doc_id = deh.doc_id;
+        slot.name_offset = names_.size();
+        slot.name_len = deh.file_name_bytes;
+        names_.append(reinterpret_cast<const char*>(&file[element]) +
+                      sizeof(deh), deh.file_name_bytes);
+        docs.push_back(slot);
+        return true;
+      });
+  if (!ok) {
+    return false;
+  }
+  names_.shrink_to_fit();
+
+  DocSlot empty;
+  empty.doc_id = 0;
+  empty.name_offset = 0;
+  empty.name_len = kEmptySlot;
+  doc_slots_.assign(TableSize(docs.size()), empty);
+  size_t mask = doc_slots_.size() - 1;
+  for (const DocSlot& doc : docs) {
+    size_t i = HomeSlot(doc.doc_id, doc_slots_.size());
+    while (doc_slots_[i].name_len != kEmptySlot) {
+      i = (i + 1) & mask;
+    }
+    doc_slots_[i] = doc;
+  }
+  set_num_docs(docs.size());
+  return true;
+}
+
+bool ResidentIndex::DecodeWords(const vector<uint8_t>& file,
+                                IndexFileOffset_t table_offset) {
+  // Decode every word and its posting list, appending the postings
+  // to the shared arrays as we go.
+  vector<WordSlot> words;
+  words_.clear();
+  doc_ids_.clear();
+  counts_.clear();
+  position_starts_.clear();
+  positions_.clear();
+  PostingList postings;
+  vector<vector<DocPositionOffset_t>> positions;
+  bool ok = ForEachElement(file, table_offset,
+      [&](IndexFileOffset_t element) {
+        WordPostingsHeader wph;
+        if (!ParseAt(file.data(), file.size(), element, &wph) ||
+            wph.word_bytes < 0 || wph.postings_bytes < 0) {
+          return false;
+        }
+        IndexFileOffset_t word = element + sizeof(wph);
+        IndexFileOffset_t table = word + wph.word_bytes;
+        if (static_cast<size_t>(table) + wph.postings_bytes > file.size() ||
+            !ParsePostings(&file[table], wph.postings_bytes, table,
+                           &postings)) {
+          return false;
+        }
+
+        // Positions are only worth keeping if phrase queries can use them.
+        if (has_word_positions()) {
+          if (!ParsePositions(&file[table], wph.postings_bytes, table,
+                              postings.doc_ids(), &positions)) {
+            return false;
+          }
+          for (const vector<DocPositionOffset_t>& doc : positions) {
+            if (positions_.size() > UINT32_MAX) {
+              return false;
+            }
+            position_starts_.push_back(positions_.size());
+            positions_.insert(positions_.end(), doc.begin(), doc.end());
+          }
+        }
+
+        WordSlot slot;
+        slot.hash = FNVHash64(const_cast<unsigned char*>(&file[word]),
+                              wph.word_bytes);
+        slot.word_offset = words_.size();
+        slot.word_len = wph.word_bytes;
+        slot.first = doc_ids_.size();
+        slot.num_docs = postings.size();
+        words_.append(reinterpret_cast<const char*>(&file[word]),
+                      wph.word_bytes);
+        doc_ids_.insert(doc_ids_.end(), postings.doc_ids().begin(),
+                        postings.doc_ids().end());
+        counts_.insert(counts_.end(), postings.counts().begin(),
+                       postings.counts().end());
+        words.push_back(slot);
+        return true;
+      });
+  if (!ok) {
+    return false;
+  }
+  words_.shrink_to_fit();
+  doc_ids_.shrink_to_fit();
+  counts_.shrink_to_fit();
+  position_starts_.shrink_to_fit();
+  positions_.shrink_to_fit();
+
+  WordSlot empty;
+  memset(&empty, 0, sizeof(empty));
+  empty.word_len = kEmptySlot;
+  word_slots_.assign(TableSize(words.size()), empty);
+  size_t mask = word_slots_.size() - 1;
+  for (const WordSlot& word : words) {
+    size_t i = HomeSlot(word.hash, word_slots_.size());
+    while (word_slots_[i].word_len != kEmptySlot) {
+      i = (i + 1) & mask;
+    }
+    word_slots_[i] = word;
+  }
+  num_words_ = words.size();
+  return true;
+}
+
+void ResidentIndex::ComputeImpacts() {
+  // A document's length is the sum of its words' counts.
+  if (!has_doc_lengths()) {
+    vector<pair<DocID_t, uint32_t>> docs;
+    docs.reserve(doc_ids_.size());
+    for (size_t j = 0; j < doc_ids_.size(); j++) {
+      docs.push_back({doc_ids_[j], std::max(counts_[j], 0)});
+    }
+    std::sort(docs.begin(), docs.end());
+    vector<DocID_t> doc_ids;
+    vector<uint32_t> lengths;
+    for (const auto& doc : docs) {
+      if (!doc_ids.empty() && doc_ids.back() == doc.first) {
+        lengths.back() += doc.second;
+      } else {
+        doc_ids.push_back(doc.first);
+        lengths.push_back(doc.second);
+      }
+    }
+    SetDocLengths(std::move(doc_ids), std::move(lengths));
+  }
+
+  // These are the same impacts a version 3 file stores, so there's no
+  // need to keep the stored ones around while decoding.
+  double avgdl = average_doc_length();
+  block_impacts_.clear();
+  for (WordSlot& slot : word_slots_) {
+    slot.max_impact = 0;
+    slot.first_block = block_impacts_.size();
+    if (slot.word_len == kEmptySlot) {
+      continue;
+    }
+    for (uint32_t j = 0; j < slot.num_docs; j++) {
+      if (j % kPostingsBlockSize == 0) {
+        block_impacts_.push_back(0);
+      }
+      uint32_t k = slot.first + j;
+      uint32_t impact = QuantizeImpact(
+          BM25Weight(counts_[k], doc_length(doc_ids_[k]), avgdl));
+      block_impacts_.back() = std::max(block_impacts_.back(), impact);
+      slot.max_impact = std::max(slot.max_impact, impact);
+    }
+  }
+  block_impacts_.shrink_to_fit();
+}
+
+size_t ResidentIndex::TableSize(size_t n) {
+  size_t size = 1;
+  while (size < 2 * n) {
+    size *= 2;
+  }
+  return size;
+}
+
+static bool ReadWholeFile(const string& file_name,
+                          vector<uint8_t>* const contents) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  if (fd == -1) {
+    return false;
+  }
+  struct stat st;
+  if (fstat(fd, &st) == -1) {
+    close(fd);
+    return false;
+  }
+  contents->resize(st.st_size);
+  size_t done = 0;
+  while (done < contents->size()) {
+    ssize_t res = read(fd, contents->data() + done,
+                       contents->size() - done);
+    if (res == -1 && errno == EINTR) {
+      continue;
+    }
+    if (res <= 0) {
+      close(fd);
+      return false;
+    }
+    done += res;
+  }
+  close(fd);
+  return true;
+}
+
+}  // namespace hw4
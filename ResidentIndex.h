@@ -0,0 +1,147 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_RESIDENTINDEX_H_
+#define HW4_RESIDENTINDEX_H_
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+#include <vector>
+
+#include "./libhw3/LayoutStructs.h"
+#include "./IndexReader.h"
+#include "./PostingList.h"
+
+namespace hw4 {
+
+// A ResidentIndex is an IndexReader that decodes the entire index file
+// into memory when it is opened, and never touches the file again.
+// It is meant for corpora that fit comfortably in RAM: loading costs a
+// pass over the whole file, but afterwards a lookup is just a few
+// memory accesses with no on-disk hash chains to follow and no
+// big-endian records to convert.
+//
+// The decoded index is kept in a handful of flat arrays:
+//
+//  - the words live back to back in one string, and every word's
+//    posting list is a contiguous, docID-sorted slice of one docID
+//    array and one (parallel) count array;
+//
+//  - if the file has word positions (see has_word_positions()), every
+//    posting's positions are a slice of one position array, starting
+//    where a third parallel array says;
+//
+//  - the word dictionary is an open-addressing hash table (linear
+//    probing, at most half full) of small fixed-size slots that point
+//    into those arrays;
+//
+//  - the doctable is a second open-addressing table, from docID to a
+//    slice of one string holding all of the document names, unless
+//    the file has a document name pool (see DocNamePool.h), in which
+//    case the names are looked up in the pool instead.
+class ResidentIndex : public IndexReader {
+ public:
+  // Memorizes the name of the index file; does not open it.
+  explicit ResidentIndex(const std::string& file_name);
+  virtual ~ResidentIndex() { }
+
+  // IndexReader methods.  Open() reads and decodes the whole file.
+  bool Open(bool validate) override;
+  bool LookupWord(const std::string& word,
+                  PostingList* const postings) const override;
+  bool LookupDocFrequency(const std::string& word,
+                          size_t* const df) const override;
+  bool LookupPositions(
+      const std::string& word, const std::vector<DocID_t>& doc_ids,
+      std::vector<std::vector<DocPositionOffset_t>>* const positions)
+      const override;
+  bool LookupDocName(DocID_t doc_id,
+                     std::string* const name) const override;
+  bool ListDocs(std::vector<DocID_t>* const doc_ids) const override;
+  size_t MemoryFootprint() const override;
+
+  // How many distinct words the index holds.
+  size_t num_words() const { return num_words_; }
+
+ private:
+  // One slot of the word dictionary.  A slot is empty if its
+  // word_len is kEmptySlot.
+  struct WordSlot {
+    uint64_t hash;          // FNVHash64 of the word
+    uint32_t word_offset;   // where the word starts in words_
+    uint32_t word_len;      // the word's length, or kEmptySlot
+    uint32_t first;         // where its postings start in doc_ids_
+    uint32_t num_docs;      // how many postings it has
+    uint32_t max_impact;    // its largest impact (see Scoring.h)
+    uint32_t first_block;   // where its block impacts start in
+                            // block_impacts_
+  };
+
+  // One slot of the doctable.  A slot is empty if its name_len is
+  // kEmptySlot.
+  struct DocSlot {
+    DocID_t doc_id;
+    uint32_t name_offset;   // where the name starts in names_
+    uint32_t name_len;      // the name's length, or kEmptySlot
+  };
+
+  // Calls fn(element_offset) for every element of the on-disk hash
+  // table that starts at "table_offset" in "file".  Returns false if
+  // the table runs off the end of the file or fn returns false.
+  template <typename Fn>
+  static bool ForEachElement(const std::vector<uint8_t>& file,
+                             hw3::IndexFileOffset_t table_offset, Fn fn);
+
+  // Decodes the doctable hash table that starts at "table_offset".
+  bool DecodeDoctable(const std::vector<uint8_t>& file,
+                      hw3::IndexFileOffset_t table_offset);
+
+  // Returns the dictionary slot holding "word", or nullptr if the word
+  // isn't in the index.
+  const WordSlot* FindWord(const std::string& word) const;
+
+  // Decodes the index hash table that starts at "table_offset".
+  bool DecodeWords(const std::vector<uint8_t>& file,
+                   hw3::IndexFileOffset_t table_offset);
+
+  // Works out each document's length from the decoded postings, if the
+  // file didn't carry them, and then each word's max_impact and the
+  // max impact of each block of kPostingsBlockSize of its postings.
+  void ComputeImpacts();
+
+  // Returns the slot index to start probing at for "hash" in a table
+  // with "num_slots" (a power of two) slots.
+  static size_t HomeSlot(uint64_t hash, size_t num_slots) {
+    return (hash * 0x9E3779B97F4A7C15ULL) >> 32 & (num_slots - 1);
+  }
+
+  // Returns the smallest power of two that is at least twice "n".
+  static size_t TableSize(size_t n);
+
+  static const uint32_t kEmptySlot;
+
+  std::vector<WordSlot> word_slots_;
+  std::string words_;
+  std::vector<DocID_t> doc_ids_;
+  std::vector<int32_t> counts_;
+  std::vector<uint32_t> position_starts_;
+  std::vector<DocPositionOffset_t> positions_;
+  std::vector<uint32_t> block_impacts_;
+  size_t num_words_;
+
+  std::vector<DocSlot> doc_slots_;
+  std::string names_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_RESIDENTINDEX_H_
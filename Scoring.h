@@ -0,0 +1,82 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_SCORING_H_
+#define HW4_SCORING_H_
+
+#include <stdint.h>
+#include <math.h>
+
+namespace hw4 {
+
+// The QueryEngine ranks documents with Okapi BM25.  A document's score
+// for a query is the sum, over the query's words, of
+//
+//   idf(word) * weight(tf, dl)
+//
+// where tf is how many times the word appears in the document, dl is
+// how many words the document has, and
+//
+//   idf(word)      = ln(1 + (N - df + 0.5) / (df + 0.5))
+//   weight(tf, dl) = tf * (k1 + 1) / (tf + k1 * (1 - b + b * dl / avgdl))
+//
+// for an index of N documents, averaging avgdl words, df of which hold
+// the word.
+//
+// A word's "impact" in a document is its weight there.  Version 3
+// index files store, for every word, the largest impact the word has
+// in any document (and in any block of its posting list), as a
+// fixed-point number with kImpactScale units per 1.0, rounded up.
+// Multiplied by the word's idf, that bounds how much the word can add
+// to any document's score, which is what lets query processing skip
+// documents that can't make the top k.  The writer and the readers
+// must agree on k1 and b for those bounds to hold.
+static const double kBM25K1 = 1.2;
+static const double kBM25B = 0.75;
+static const uint32_t kImpactScale = 1000;
+
+// Returns the idf of a word that appears in "df" of "n" documents.
+inline double BM25Idf(uint64_t df, uint64_t n) {
+  if (df > n) {
+    n = df;
+  }
+  return log(1.0 + (n - df + 0.5) / (df + 0.5));
+}
+
+// Returns the weight of a word that appears "tf" times in a document of
+// "dl" words, in an index whose documents average "avgdl" words.  With
+// no length information (avgdl of 0), every document counts as
+// average.
+inline double BM25Weight(uint32_t tf, uint32_t dl, double avgdl) {
+  double norm = avgdl > 0 ? 1.0 - kBM25B + kBM25B * dl / avgdl : 1.0;
+  return tf * (kBM25K1 + 1) / (tf + kBM25K1 * norm);
+}
+
+// Returns "weight" as a fixed-point impact, rounded up so that it
+// stays an upper bound.
+inline uint32_t QuantizeImpact(double weight) {
+  return static_cast<uint32_t>(ceil(weight * kImpactScale)) + 1;
+}
+
+// Returns the rank a QueryEngine gives a document with BM25 score
+// "score": the score in thousandths.
+inline int32_t BM25Rank(double score) {
+  return static_cast<int32_t>(llround(score * 1000));
+}
+
+// The impact bound to assume for a word whose index doesn't store one:
+// no weight can reach k1 + 1.
+static const uint32_t kMaxImpact =
+    static_cast<uint32_t>((kBM25K1 + 1) * kImpactScale) + 1;
+
+}  // namespace hw4
+
+#endif  // HW4_SCORING_H_
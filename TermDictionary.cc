@@ -0,0 +1,230 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <arpa/inet.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "./TermDictionary.h"
+#include "./PostingCodec.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+const size_t TermDictionary::kBlockTerms;
+
+// Appends "value" to "out" in network byte order.
+static void PutUint32(uint32_t value, vector<uint8_t>* const out);
+
+// Reads the network byte order uint32 at "p".
+static uint32_t GetUint32(const uint8_t* p);
+
+void TermDictionary::Build(const vector<string>& terms,
+                           vector<uint8_t>* const out) {
+  Builder builder(terms.size(), out);
+  for (const string& term : terms) {
+    builder.Add(term);
+  }
+}
+
+TermDictionary::Builder::Builder(size_t num_terms, vector<uint8_t>* const out)
+  : out_(out), start_(out->size()), num_added_(0) {
+  uint32_t num_blocks = (num_terms + kBlockTerms - 1) / kBlockTerms;
+  PutUint32(num_terms, out_);
+  PutUint32(num_blocks, out_);
+  out_->resize(out_->size() + num_blocks * sizeof(uint32_t));
+}
+
+void TermDictionary::Builder::Add(const string& term) {
+  size_t i = num_added_++;
+  if (i % kBlockTerms == 0) {
+    uint32_t offset = htonl(out_->size() - start_);
+    memcpy(&(*out_)[start_ + 2 * sizeof(uint32_t) +
+                    i / kBlockTerms * sizeof(uint32_t)],
+           &offset, sizeof(offset));
+    PutVarint(term.size(), out_);
+    out_->insert(out_->end(), term.begin(), term.end());
+    prev_ = term;
+    return;
+  }
+  size_t shared = 0;
+  while (shared < term.size() && shared < prev_.size() &&
+         term[shared] == prev_[shared]) {
+    shared++;
+  }
+  PutVarint(shared, out_);
+  PutVarint(term.size() - shared, out_);
+  out_->insert(out_->end(), term.begin() + shared, term.end());
+  prev_ = term;
+}
+
+bool TermDictionary::Parse(const uint8_t* data, size_t len) {
+  data_ = nullptr;
+  len_ = num_terms_ = num_blocks_ = 0;
+  if (len < 2 * sizeof(uint32_t)) {
+    return false;
+  }
+  uint32_t num_terms = GetUint32(data);
+  uint32_t num_blocks = GetUint32(data + sizeof(uint32_t));
+  if (num_blocks != (static_cast<uint64_t>(num_terms) + kBlockTerms - 1) /
+                    kBlockTerms ||
+      (2 + static_cast<uint64_t>(num_blocks)) * sizeof(uint32_t) > len) {
+    return false;
+  }
+
+  // The blocks must come one after the other, after the offsets.
+  uint64_t prev = (2 + static_cast<uint64_t>(num_blocks)) * sizeof(uint32_t);
+  for (uint32_t b = 0; b < num_blocks; b++) {
+    uint32_t offset = GetUint32(data + (2 + b) * sizeof(uint32_t));
+    if (offset < prev || offset >= len) {
+      return false;
+    }
+    prev = offset + 1;
+  }
+
+  data_ = data;
+  len_ = len;
+  num_terms_ = num_terms;
+  num_blocks_ = num_blocks;
+  return true;
+}
+
+bool TermDictionary::ExpandPrefix(const string& prefix, size_t max_terms,
+                                  vector<string>* const terms) const {
+  bool complete = true;
+  size_t found = 0;
+  ScanFrom(prefix, [&](const string& word) {
+    if (word.compare(0, prefix.size(), prefix) != 0) {
+      return false;
+    }
+    if (found == max_terms) {
+      complete = false;
+      return false;
+    }
+    terms->push_back(word);
+    found++;
+    return true;
+  });
+  return complete;
+}
+
+bool TermDictionary::ExpandRange(const string& first, const string& last,
+                                 size_t max_terms,
+                                 vector<string>* const terms) const {
+  bool complete = true;
+  size_t found = 0;
+  ScanFrom(first, [&](const string& word) {
+    if (word > last) {
+      return false;
+    }
+    if (found == max_terms) {
+      complete = false;
+      return false;
+    }
+    terms->push_back(word);
+    found++;
+    return true;
+  });
+  return complete;
+}
+
+bool TermDictionary::ExpandFrom(const string& first, size_t max_terms,
+                                vector<string>* const terms) const {
+  bool complete = true;
+  size_t found = 0;
+  ScanFrom(first, [&](const string& word) {
+    if (found == max_terms) {
+      complete = false;
+      return false;
+    }
+    terms->push_back(word);
+    found++;
+    return true;
+  });
+  return complete;
+}
+
+bool TermDictionary::FirstTerm(size_t block, string* const word) const {
+  const uint8_t* p = data_ + GetUint32(data_ + (2 + block) * sizeof(uint32_t));
+  const uint8_t* end = data_ + len_;
+  uint64_t word_len;
+  if (!GetVarint(&p, end, &word_len) ||
+      word_len > static_cast<uint64_t>(end - p)) {
+    return false;
+  }
+  word->assign(reinterpret_cast<const char*>(p), word_len);
+  return true;
+}
+
+template <typename Fn>
+void TermDictionary::ScanFrom(const string& from, Fn fn) const {
+  if (!valid() || num_blocks_ == 0) {
+    return;
+  }
+
+  // Find the last block whose first word is <= from; "from" can't be
+  // in any block before it.
+  size_t lo = 0, hi = num_blocks_;
+  string word;
+  while (hi - lo > 1) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (!FirstTerm(mid, &word)) {
+      return;
+    }
+    if (word <= from) {
+      lo = mid;
+    } else {
+      hi = mid;
+    }
+  }
+
+  const uint8_t* end = data_ + len_;
+  for (size_t block = lo; block < num_blocks_; block++) {
+    const uint8_t* p =
+        data_ + GetUint32(data_ + (2 + block) * sizeof(uint32_t));
+    size_t n = std::min<size_t>(kBlockTerms,
+                                num_terms_ - block * kBlockTerms);
+    for (size_t i = 0; i < n; i++) {
+      uint64_t shared = 0, suffix_len;
+      if ((i > 0 && !GetVarint(&p, end, &shared)) ||
+          !GetVarint(&p, end, &suffix_len) ||
+          shared > word.size() ||
+          suffix_len > static_cast<uint64_t>(end - p)) {
+        return;
+      }
+      word.resize(shared);
+      word.append(reinterpret_cast<const char*>(p), suffix_len);
+      p += suffix_len;
+      if (word >= from && !fn(word)) {
+        return;
+      }
+    }
+  }
+}
+
+static void PutUint32(uint32_t value, vector<uint8_t>* const out) {
+  value = htonl(value);
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&value);
+  out->insert(out->end(), bytes, bytes + sizeof(value));
+}
+
+static uint32_t GetUint32(const uint8_t* p) {
+  uint32_t value;
+  memcpy(&value, p, sizeof(value));
+  return ntohl(value);
+}
+
+}  // namespace hw4
@@ -0,0 +1,118 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_TERMDICTIONARY_H_
+#define HW4_TERMDICTIONARY_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+namespace hw4 {
+
+// A TermDictionary is a sorted list of an index's words, stored
+// front-coded: the words are cut into blocks of kBlockTerms, the first
+// word of each block is stored whole, and every other word is stored as
+// the length of the prefix it shares with the word before it plus the
+// rest of the word.  Sorted words share long prefixes, so this is much
+// smaller than the words themselves, and it is what makes prefix
+// ("comput*") and range queries possible: the index's hash table can
+// only find words it is given exactly.
+//
+// The encoded form (all fixed-width fields in network byte order) is:
+//
+//   uint32 num_terms
+//   uint32 num_blocks
+//   uint32 block_offsets[num_blocks]   (from the start of the encoding)
+//   num_blocks blocks, each:
+//     varint word_len, then the word's bytes
+//     for each of the block's other words:
+//       varint shared_len, varint suffix_len, then the suffix's bytes
+//
+// A lookup binary searches the blocks by their first words and then
+// decodes one block at a time from there.  A TermDictionary doesn't own
+// its bytes; whoever calls Parse() must keep them alive.
+class TermDictionary {
+ public:
+  static const size_t kBlockTerms = 16;
+
+  TermDictionary() : data_(nullptr), len_(0), num_terms_(0),
+                     num_blocks_(0) { }
+  virtual ~TermDictionary() { }
+
+  // Appends the encoded form of "terms", which must be sorted and have
+  // no duplicates, to "out".
+  static void Build(const std::vector<std::string>& terms,
+                    std::vector<uint8_t>* const out);
+
+  // Builds the same encoding a word at a time, for callers that never
+  // hold all of the words at once: each of the "num_terms" words is
+  // Add()ed in turn, in sorted order and with no duplicates, and once
+  // the last has been, "out" holds the whole encoding.
+  class Builder {
+   public:
+    Builder(size_t num_terms, std::vector<uint8_t>* const out);
+    void Add(const std::string& term);
+
+   private:
+    std::vector<uint8_t>* out_;
+    size_t start_;       // where in *out_ the encoding starts
+    size_t num_added_;
+    std::string prev_;   // the word added last
+  };
+
+  // Makes this a view of the encoded dictionary held in the "len" bytes
+  // at "data".  Returns false (and leaves the dictionary empty) if the
+  // bytes aren't a well-formed dictionary.
+  bool Parse(const uint8_t* data, size_t len);
+
+  // Returns true if Parse() has succeeded.
+  bool valid() const { return data_ != nullptr; }
+
+  // The number of words in the dictionary.
+  size_t size() const { return num_terms_; }
+
+  // Appends the words that start with "prefix" to "terms", in sorted
+  // order, stopping after "max_terms" of them.  Returns false if it had
+  // to stop, i.e. if there are more matching words than were returned.
+  bool ExpandPrefix(const std::string& prefix, size_t max_terms,
+                    std::vector<std::string>* const terms) const;
+
+  // Like ExpandPrefix(), but for the words w with first <= w <= last.
+  bool ExpandRange(const std::string& first, const std::string& last,
+                   size_t max_terms,
+                   std::vector<std::string>* const terms) const;
+
+  // Like ExpandPrefix(), but for the words w with first <= w, which
+  // lets a caller walk the whole dictionary a batch at a time.
+  bool ExpandFrom(const std::string& first, size_t max_terms,
+                  std::vector<std::string>* const terms) const;
+
+ private:
+  // Decodes the first word of block "block" into "word".
+  bool FirstTerm(size_t block, std::string* const word) const;
+
+  // Calls fn(word) on each word >= "from", in order, until fn returns
+  // false or the words run out.
+  template <typename Fn>
+  void ScanFrom(const std::string& from, Fn fn) const;
+
+  const uint8_t* data_;
+  size_t len_;
+  uint32_t num_terms_;
+  uint32_t num_blocks_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_TERMDICTIONARY_H_
@@ -0,0 +1,140 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <arpa/inet.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "./TermFilter.h"
+
+extern "C" {
+  #include "libhw1/HashTable.h"
+}
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+const uint32_t TermFilter::kBlockBits;
+const uint32_t TermFilter::kBitsPerTerm;
+const uint8_t TermFilter::kNumProbes;
+
+// How many bytes come before the blocks.
+static const size_t kFilterHeaderBytes = sizeof(uint32_t) + sizeof(uint8_t);
+
+// Calls fn(block, bit) for each of the "num_probes" bits "hash" picks
+// in a filter of "num_blocks" blocks.  The bits are picked by double
+// hashing (Kirsch and Mitzenmacher, "Less hashing, same performance"),
+// stepping through the block from one half of the hash by an amount
+// taken from the other.
+template <typename Fn>
+static void ForEachProbe(uint64_t hash, uint32_t num_blocks,
+                         uint8_t num_probes, Fn fn);
+
+void TermFilter::Build(const vector<string>& terms,
+                       vector<uint8_t>* const out) {
+  Builder builder(terms.size(), out);
+  for (const string& term : terms) {
+    builder.Add(term);
+  }
+}
+
+TermFilter::Builder::Builder(size_t num_terms, vector<uint8_t>* const out)
+  : out_(out) {
+  uint64_t bits = static_cast<uint64_t>(num_terms) * kBitsPerTerm;
+  num_blocks_ = (bits + kBlockBits - 1) / kBlockBits;
+  if (num_blocks_ == 0) {
+    num_blocks_ = 1;
+  }
+  uint32_t disk_blocks = htonl(num_blocks_);
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&disk_blocks);
+  out_->insert(out_->end(), bytes, bytes + sizeof(disk_blocks));
+  out_->push_back(kNumProbes);
+
+  start_ = out_->size();
+  out_->resize(start_ + static_cast<size_t>(num_blocks_) * kBlockBits / 8, 0);
+}
+
+void TermFilter::Builder::Add(const string& term) {
+  uint8_t* blocks = out_->data() + start_;
+  ForEachProbe(Hash(term), num_blocks_, kNumProbes,
+               [blocks](uint32_t block, uint32_t bit) {
+                 blocks[block * (kBlockBits / 8) + bit / 8] |=
+                     1 << (bit % 8);
+               });
+}
+
+bool TermFilter::Parse(const uint8_t* data, size_t len) {
+  data_ = nullptr;
+  num_blocks_ = 0;
+  num_probes_ = 0;
+  if (len < kFilterHeaderBytes) {
+    return false;
+  }
+  uint32_t num_blocks;
+  memcpy(&num_blocks, data, sizeof(num_blocks));
+  num_blocks = ntohl(num_blocks);
+  uint8_t num_probes = data[sizeof(num_blocks)];
+  if (num_blocks == 0 || num_probes == 0 ||
+      (len - kFilterHeaderBytes) / (kBlockBits / 8) != num_blocks ||
+      (len - kFilterHeaderBytes) % (kBlockBits / 8) != 0) {
+    return false;
+  }
+  data_ = data + kFilterHeaderBytes;
+  num_blocks_ = num_blocks;
+  num_probes_ = num_probes;
+  return true;
+}
+
+bool TermFilter::MayContain(const string& term) const {
+  if (data_ == nullptr) {
+    return true;
+  }
+  bool found = true;
+  const uint8_t* blocks = data_;
+  ForEachProbe(Hash(term), num_blocks_, num_probes_,
+               [blocks, &found](uint32_t block, uint32_t bit) {
+                 found = found &&
+                         (blocks[block * (kBlockBits / 8) + bit / 8] &
+                          (1 << (bit % 8))) != 0;
+               });
+  return found;
+}
+
+uint64_t TermFilter::Hash(const string& term) {
+  // The same FNV hash the index's hash table uses, but FNV's low bits
+  // depend only on the low bits of the input, so mix them up first
+  // (MurmurHash3's finalizer).
+  uint64_t h = FNVHash64((unsigned char*) term.data(), term.size());
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+template <typename Fn>
+static void ForEachProbe(uint64_t hash, uint32_t num_blocks,
+                         uint8_t num_probes, Fn fn) {
+  uint32_t block = static_cast<uint32_t>(hash % num_blocks);
+  uint32_t probe = static_cast<uint32_t>(hash >> 32);
+  uint32_t delta = (probe >> 17) | (probe << 15);
+  for (uint8_t i = 0; i < num_probes; i++) {
+    fn(block, probe % TermFilter::kBlockBits);
+    probe += delta;
+  }
+}
+
+}  // namespace hw4
@@ -0,0 +1,95 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_TERMFILTER_H_
+#define HW4_TERMFILTER_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <string>
+#include <vector>
+
+namespace hw4 {
+
+// A TermFilter is a Bloom filter over an index's words: it can say for
+// certain that a word is *not* in the index, without walking the
+// index's hash table (and, for an IndexFile, without reading anything
+// from disk), and is wrong about a word that is only about 1% of the
+// time.  Queries mostly ask for words most indices don't have, so this
+// is the common case.
+//
+// It is a "blocked" Bloom filter (Putze, Sanders, and Singler, "Cache-,
+// hash- and space-efficient Bloom filters"): each word hashes to one
+// block of kBlockBits bits, and sets (or, when looked up, tests)
+// num_probes bits within that block, so a lookup touches a single
+// cache line.  At kBitsPerTerm bits per word, that costs a little
+// accuracy over a plain Bloom filter of the same size.
+//
+// The encoded form (the fixed-width field in network byte order) is:
+//
+//   uint32 num_blocks
+//   uint8  num_probes
+//   num_blocks blocks of kBlockBits / 8 bytes, bit i of a block being
+//     bit (i % 8) of its (i / 8)'th byte
+//
+// A TermFilter doesn't own its bytes; whoever calls Parse() must keep
+// them alive.
+class TermFilter {
+ public:
+  static const uint32_t kBlockBits = 512;
+  static const uint32_t kBitsPerTerm = 10;
+  static const uint8_t kNumProbes = 7;
+
+  TermFilter() : data_(nullptr), num_blocks_(0), num_probes_(0) { }
+  virtual ~TermFilter() { }
+
+  // Appends the encoded filter of "terms" to "out".
+  static void Build(const std::vector<std::string>& terms,
+                    std::vector<uint8_t>* const out);
+
+  // Builds the same filter a word at a time: it is sized for
+  // "num_terms" words, each of which is Add()ed in turn (in any order).
+  class Builder {
+   public:
+    Builder(size_t num_terms, std::vector<uint8_t>* const out);
+    void Add(const std::string& term);
+
+   private:
+    std::vector<uint8_t>* out_;
+    size_t start_;         // where in *out_ the blocks start
+    uint32_t num_blocks_;
+  };
+
+  // Makes this a view of the encoded filter held in the "len" bytes at
+  // "data".  Returns false (and leaves the filter empty) if the bytes
+  // aren't a well-formed filter.
+  bool Parse(const uint8_t* data, size_t len);
+
+  // Returns true if Parse() has succeeded.
+  bool valid() const { return data_ != nullptr; }
+
+  // Returns false if "term" is certainly not one of the filter's words,
+  // and true if it may be.
+  bool MayContain(const std::string& term) const;
+
+ private:
+  // Returns the hash a term's block and bits are picked by.
+  static uint64_t Hash(const std::string& term);
+
+  const uint8_t* data_;
+  uint32_t num_blocks_;
+  uint8_t num_probes_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_TERMFILTER_H_
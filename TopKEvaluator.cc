@@ -0,0 +1,285 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <algorithm>
+#include <vector>
+
+#include "./TopKEvaluator.h"
+#include "./Scoring.h"
+
+using std::vector;
+
+namespace hw4 {
+
+const DocID_t TopKEvaluator::kEnd = UINT64_MAX;
+
+// Restores docID order to "cursors" after some of them have moved
+// forward.  There are only ever a few, so insertion sort it is.
+template <typename Cursor, typename DocAtFn>
+static void SortCursors(vector<Cursor*>* const cursors, DocAtFn doc_at);
+
+void TopKEvaluator::AddWord(const PostingList* postings) {
+  AddWord(postings, BM25Idf(postings->size(), reader_.num_docs()));
+}
+
+void TopKEvaluator::AddWord(const PostingList* postings, double idf) {
+  Word word;
+  word.postings = postings;
+  word.idf = idf;
+  uint32_t max_impact = postings->max_impact();
+  word.bound = word.idf * (max_impact != 0 ? max_impact : kMaxImpact) /
+               kImpactScale;
+  words_.push_back(word);
+}
+
+void TopKEvaluator::MatchAny(size_t k, vector<Hit>* const best,
+                             Stats* const stats) const {
+  best->clear();
+  if (k == 0) {
+    return;
+  }
+  vector<Cursor> cursors;
+  for (const Word& word : words_) {
+    cursors.push_back({&word, 0});
+  }
+  vector<Cursor*> order;
+  for (Cursor& cursor : cursors) {
+    order.push_back(&cursor);
+  }
+
+  while (true) {
+    SortCursors(&order, DocAt);
+    if (order.empty() || DocAt(*order[0]) == kEnd) {
+      break;
+    }
+
+    // Until the heap fills up, every document gets in, so the pivot is
+    // just the next document.  After that, it's where the words' bounds
+    // first add up to more than the worst document kept.  (Documents
+    // come in docID order, so one that only ties the worst loses.)
+    bool full = best->size() == k;
+    int32_t worst = full ? best->front().rank : 0;
+    size_t pivot = 0;
+    if (full && method_ != kExhaustive) {
+      double bound = 0;
+      for (pivot = 0; pivot < order.size(); pivot++) {
+        if (DocAt(*order[pivot]) == kEnd) {
+          break;
+        }
+        bound += order[pivot]->word->bound;
+        if (BM25Rank(bound) > worst) {
+          break;
+        }
+      }
+      if (pivot == order.size() || DocAt(*order[pivot]) == kEnd) {
+        break;
+      }
+    }
+    DocID_t pivot_doc = DocAt(*order[pivot]);
+    if (DocAt(*order[0]) != pivot_doc) {
+      // Nothing before the pivot can make it.
+      for (size_t i = 0; i < pivot; i++) {
+        SeekTo(order[i], pivot_doc);
+      }
+      continue;
+    }
+
+    // Every word at the pivot counts, not just those up to it.
+    size_t at_pivot = pivot + 1;
+    while (at_pivot < order.size() &&
+           DocAt(*order[at_pivot]) == pivot_doc) {
+      at_pivot++;
+    }
+
+    if (full && method_ == kBlockMaxWand) {
+      double bound = 0;
+      for (size_t i = 0; i < at_pivot; i++) {
+        bound += BlockBound(*order[i]->word, order[i]->pos);
+      }
+      if (BM25Rank(bound) <= worst) {
+        // No document can make it until one of these words leaves its
+        // block, or another word joins in.
+        DocID_t target =
+            at_pivot < order.size() ? DocAt(*order[at_pivot]) : kEnd;
+        for (size_t i = 0; i < at_pivot; i++) {
+          target = std::min(target, BlockLast(*order[i]) + 1);
+        }
+        for (size_t i = 0; i < at_pivot; i++) {
+          SeekTo(order[i], target);
+        }
+        continue;
+      }
+    }
+
+    uint32_t dl = reader_.doc_length(pivot_doc);
+    double score = 0;
+    for (size_t i = 0; i < at_pivot; i++) {
+      const Word& word = *order[i]->word;
+      score += Score(word, word.postings->count(order[i]->pos), dl);
+      order[i]->pos++;
+    }
+    if (stats != nullptr) {
+      stats->scored++;
+    }
+    Offer({BM25Rank(score), pivot_doc}, k, best);
+  }
+  std::sort_heap(best->begin(), best->end(), Better);
+}
+
+void TopKEvaluator::RankAll(const PostingList& candidates, size_t k,
+                            vector<Hit>* const best,
+                            Stats* const stats) const {
+  best->clear();
+  if (k == 0 || words_.empty()) {
+    return;
+  }
+
+  // bounds[w] is the most that words w, w + 1, ... can add between
+  // them to any document's score; for kBlockMaxWand, it is worked out
+  // afresh from the blocks the candidates fall in whenever one of them
+  // moves on to its next block.
+  size_t num_words = words_.size();
+  vector<double> bounds(num_words + 1, 0.0);
+  for (size_t w = num_words; w-- > 0; ) {
+    bounds[w] = bounds[w + 1] + words_[w].bound;
+  }
+  double max_score = bounds[0];
+
+  // The candidates come in docID order, so each word's list is walked
+  // once, front to back, to find their counts.  A word's cursor is only
+  // moved up to a candidate when its count or its block is wanted.
+  vector<Cursor> cursors;
+  for (const Word& word : words_) {
+    cursors.push_back({&word, 0});
+  }
+  // For kBlockMaxWand: one past the last docID of each word's current
+  // block, and that block's bound.
+  vector<DocID_t> block_ends(num_words, 0);
+  vector<double> block_bounds(num_words, 0.0);
+  for (size_t i = 0; i < candidates.size(); i++) {
+    bool prune = method_ != kExhaustive && best->size() == k;
+    int32_t worst = prune ? best->front().rank : 0;
+    if (prune && BM25Rank(max_score) <= worst) {
+      break;
+    }
+
+    DocID_t doc_id = candidates.doc_id(i);
+    if (prune && method_ == kBlockMaxWand) {
+      bool moved = false;
+      for (size_t w = 0; w < num_words; w++) {
+        if (doc_id >= block_ends[w]) {
+          // (A word that has run out can add nothing more.)
+          SeekTo(&cursors[w], doc_id);
+          bool done = DocAt(cursors[w]) == kEnd;
+          block_ends[w] = done ? kEnd : BlockLast(cursors[w]) + 1;
+          block_bounds[w] = done ? 0 : BlockBound(words_[w], cursors[w].pos);
+          moved = true;
+        }
+      }
+      if (moved) {
+        for (size_t w = num_words; w-- > 0; ) {
+          bounds[w] = bounds[w + 1] + block_bounds[w];
+        }
+      }
+      if (BM25Rank(bounds[0]) <= worst) {
+        // Neither can any other candidate before one of the words
+        // leaves its block.
+        DocID_t target = *std::min_element(block_ends.begin(),
+                                           block_ends.end());
+        const vector<DocID_t>& doc_ids = candidates.doc_ids();
+        i = std::lower_bound(doc_ids.begin() + i, doc_ids.end(), target) -
+            doc_ids.begin() - 1;
+        continue;
+      }
+    }
+
+    uint32_t dl = reader_.doc_length(doc_id);
+    double score = 0;
+    size_t w = 0;
+    for (; w < num_words; w++) {
+      if (prune && BM25Rank(score + bounds[w]) <= worst) {
+        break;
+      }
+      SeekTo(&cursors[w], doc_id);
+      if (DocAt(cursors[w]) == doc_id) {
+        score += Score(words_[w], words_[w].postings->count(cursors[w].pos),
+                       dl);
+      }
+    }
+    if (w < num_words) {
+      continue;
+    }
+    if (stats != nullptr) {
+      stats->scored++;
+    }
+    Offer({BM25Rank(score), doc_id}, k, best);
+  }
+  std::sort_heap(best->begin(), best->end(), Better);
+}
+
+void TopKEvaluator::SeekTo(Cursor* const cursor, DocID_t doc_id) {
+  // Cursors mostly move a short way, so gallop ahead from where this
+  // one is before searching, rather than searching the rest of the list.
+  const vector<DocID_t>& doc_ids = cursor->word->postings->doc_ids();
+  size_t lo = cursor->pos, step = 1;
+  while (lo + step < doc_ids.size() && doc_ids[lo + step] < doc_id) {
+    lo += step;
+    step *= 2;
+  }
+  size_t hi = std::min(lo + step + 1, doc_ids.size());
+  cursor->pos = std::lower_bound(doc_ids.begin() + lo, doc_ids.begin() + hi,
+                                 doc_id) - doc_ids.begin();
+}
+
+double TopKEvaluator::Score(const Word& word, int32_t count,
+                            uint32_t dl) const {
+  return word.idf * BM25Weight(std::max(count, 0), dl,
+                               reader_.average_doc_length());
+}
+
+double TopKEvaluator::BlockBound(const Word& word, size_t pos) {
+  uint32_t impact = word.postings->block_max_impact(pos);
+  return word.idf * (impact != 0 ? impact : kMaxImpact) / kImpactScale;
+}
+
+DocID_t TopKEvaluator::BlockLast(const Cursor& cursor) {
+  const PostingList& postings = *cursor.word->postings;
+  size_t block_size = postings.impact_block_size();
+  size_t block_end = block_size == 0 ? postings.size() :
+      std::min((cursor.pos / block_size + 1) * block_size, postings.size());
+  return postings.doc_id(block_end - 1);
+}
+
+void TopKEvaluator::Offer(const Hit& hit, size_t k, vector<Hit>* const best) {
+  if (best->size() < k) {
+    best->push_back(hit);
+    std::push_heap(best->begin(), best->end(), Better);
+  } else if (Better(hit, best->front())) {
+    std::pop_heap(best->begin(), best->end(), Better);
+    best->back() = hit;
+    std::push_heap(best->begin(), best->end(), Better);
+  }
+}
+
+template <typename Cursor, typename DocAtFn>
+static void SortCursors(vector<Cursor*>* const cursors, DocAtFn doc_at) {
+  for (size_t i = 1; i < cursors->size(); i++) {
+    Cursor* cursor = (*cursors)[i];
+    DocID_t doc_id = doc_at(*cursor);
+    size_t j = i;
+    for (; j > 0 && doc_at(*(*cursors)[j - 1]) > doc_id; j--) {
+      (*cursors)[j] = (*cursors)[j - 1];
+    }
+    (*cursors)[j] = cursor;
+  }
+}
+
+}  // namespace hw4
@@ -0,0 +1,158 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#ifndef HW4_TOPKEVALUATOR_H_
+#define HW4_TOPKEVALUATOR_H_
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <vector>
+
+#include "./IndexReader.h"
+#include "./PostingList.h"
+
+namespace hw4 {
+
+// A TopKEvaluator finds the k documents of one index that score best
+// under BM25 (see Scoring.h) for a set of query words, without scoring
+// every document that contains them if it can help it.
+//
+// Each word's score in any document is bounded above by its idf times
+// its largest impact, and, more tightly, by its idf times the largest
+// impact in the block of its posting list the document falls in (see
+// PostingList::max_impact() and PostingList::block_max_impact()).  Once
+// k documents have been found, the worst of them sets a threshold, and
+// documents whose bound can't beat it are passed over:
+//
+//  - kExhaustive scores every document, for comparison.
+//
+//  - kWand is WAND (Broder et al., "Efficient query evaluation using a
+//    two-level retrieval process"): the words' cursors are kept in
+//    docID order, and the "pivot" is the first document at which the
+//    bounds of the words up to and including it could beat the
+//    threshold.  Every document before the pivot is skipped, since the
+//    only words it can contain can't lift it far enough.
+//
+//  - kBlockMaxWand is Block-Max WAND (Ding and Suel, "Faster top-k
+//    document retrieval using block-max indexes"): WAND, but before a
+//    pivot is scored, the block bounds of the words at it are summed,
+//    and if they can't beat the threshold, every document up to the
+//    end of the first of those blocks to end is skipped too.
+//
+// Ties are broken by docID, lower first, so every method returns
+// exactly the same results.  Documents are ranked as a QueryEngine
+// ranks them: by BM25Rank() of their score.
+class TopKEvaluator {
+ public:
+  enum Method { kExhaustive, kWand, kBlockMaxWand };
+
+  // One ranked document.
+  struct Hit {
+    int32_t rank;
+    DocID_t doc_id;
+  };
+
+  // What an evaluation did, for benchmarking.
+  struct Stats {
+    size_t scored = 0;    // documents whose score was computed in full
+  };
+
+  // Memorizes the reader whose document lengths (and document count,
+  // for the words' idfs) score the documents, and how to evaluate.
+  TopKEvaluator(const IndexReader& reader, Method method)
+    : reader_(reader), method_(method) { }
+  virtual ~TopKEvaluator() { }
+
+  // Adds a query word, whose posting list must outlive the evaluator.
+  // For conjunctive evaluation, words are scored in the order they are
+  // added, so adding the rarest (and so highest-scoring) first lets a
+  // document be given up on soonest.
+  void AddWord(const PostingList* postings);
+
+  // Like AddWord() above, but scores the word with idf "idf" rather than
+  // the idf its document frequency in the reader's index gives it, as
+  // for a word of a shard (see IndexReader::is_shard()), whose idf is
+  // its idf in the whole collection.
+  void AddWord(const PostingList* postings, double idf);
+
+  // Fills "best" with the "k" best documents that contain any of the
+  // words, best first.  Unless the method is kExhaustive, documents
+  // that can't make the top k may never be looked at, so how many
+  // documents match isn't known afterwards.
+  void MatchAny(size_t k, std::vector<Hit>* const best,
+                Stats* const stats = nullptr) const;
+
+  // Fills "best" with the "k" best of "candidates", best first.  A
+  // word adds nothing to the score of a candidate that doesn't contain
+  // it (as when a boolean query's candidates match only some of its
+  // words).  Unless the method is kExhaustive, candidates whose block
+  // bounds (or, for kWand, word bounds) can't beat the threshold aren't
+  // scored, and evaluation stops as soon as no remaining candidate
+  // could.
+  void RankAll(const PostingList& candidates, size_t k,
+               std::vector<Hit>* const best,
+               Stats* const stats = nullptr) const;
+
+ private:
+  // A query word: its postings, its idf, and the most it can add to
+  // any document's score.
+  struct Word {
+    const PostingList* postings;
+    double idf;
+    double bound;
+  };
+
+  // A position in a word's posting list.
+  struct Cursor {
+    const Word* word;
+    size_t pos;
+  };
+
+  // The docID a cursor is at, or kEnd past the end of its list.
+  static DocID_t DocAt(const Cursor& cursor) {
+    return cursor.pos < cursor.word->postings->size() ?
+           cursor.word->postings->doc_id(cursor.pos) : kEnd;
+  }
+  static const DocID_t kEnd;
+
+  // Moves "cursor" to the first document >= "doc_id" in its list.
+  static void SeekTo(Cursor* const cursor, DocID_t doc_id);
+
+  // Returns how much "word" adds to the score of a document of "dl"
+  // words in which it appears "count" times.
+  double Score(const Word& word, int32_t count, uint32_t dl) const;
+
+  // The most "word" can add to the score of its pos'th document.
+  static double BlockBound(const Word& word, size_t pos);
+
+  // The last docID in the block "cursor" is in, which must not be past
+  // the end of its list.
+  static DocID_t BlockLast(const Cursor& cursor);
+
+  // Adds "hit" to "best", a heap of at most "k" hits whose top is the
+  // worst one, if it is among the k best seen so far.
+  static void Offer(const Hit& hit, size_t k, std::vector<Hit>* const best);
+
+  // The order hits are returned in: decreasing rank, then increasing
+  // docID.
+  static bool Better(const Hit& a, const Hit& b) {
+    return a.rank != b.rank ? a.rank > b.rank : a.doc_id < b.doc_id;
+  }
+
+  const IndexReader& reader_;
+  Method method_;
+  std::vector<Word> words_;
+};
+
+}  // namespace hw4
+
+#endif  // HW4_TOPKEVALUATOR_H_
@@ -0,0 +1,169 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// allocbench counts the heap allocations it takes to answer search
+// queries.  It reads one query per line from stdin (words separated by
+// spaces) and runs every query against the given index files: through
+// a hw3::QueryProcessor (which hands its postings around in std::lists,
+// a node per docID and per position) if they are all version 1 files,
+// and then through a shared QueryEngine, for each kind of IndexReader,
+// asking for a first page of results as the server does.  It counts
+// allocations by replacing the global operator new, and also reports
+// how much memory is still allocated once the queries are done, which
+// is what the query engine's per-thread buffers keep between queries.
+
+#include <boost/algorithm/string.hpp>
+#include <malloc.h>
+#include <stdlib.h>
+#include <atomic>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <new>
+#include <string>
+#include <vector>
+
+#include "./QueryEngine.h"
+#include "./libhw3/QueryProcessor.h"
+
+using std::cerr;
+using std::cin;
+using std::cout;
+using std::endl;
+using std::list;
+using std::string;
+using std::vector;
+
+// How many allocations, and how many bytes, operator new has made, and
+// how many of those bytes haven't been deleted yet.
+static std::atomic<uint64_t> num_allocations(0);
+static std::atomic<uint64_t> allocated_bytes(0);
+static std::atomic<int64_t> live_bytes(0);
+
+void* operator new(size_t size) {
+  num_allocations++;
+  allocated_bytes += size;
+  void* p = malloc(size == 0 ? 1 : size);
+  if (p == nullptr) {
+    throw std::bad_alloc();
+  }
+  live_bytes += malloc_usable_size(p);
+  return p;
+}
+
+void operator delete(void* p) noexcept {
+  live_bytes -= malloc_usable_size(p);
+  free(p);
+}
+
+void operator delete(void* p, size_t) noexcept {
+  live_bytes -= malloc_usable_size(p);
+  free(p);
+}
+
+// Print out program usage, and exit() with EXIT_FAILURE.
+static void Usage(char* prog_name) {
+  cerr << "Usage: " << prog_name << " [--page=k] indices+ < queries" << endl;
+  exit(EXIT_FAILURE);
+}
+
+// Runs run(query) on every query in "queries", and prints how many
+// allocations (and bytes) that took per query, and how many more bytes
+// are allocated afterwards than before.
+template <typename Fn>
+static void Count(const string& label,
+                  const vector<vector<string>>& queries, Fn run) {
+  uint64_t allocations = num_allocations, bytes = allocated_bytes;
+  int64_t live = live_bytes;
+  for (const vector<string>& query : queries) {
+    run(query);
+  }
+  allocations = num_allocations - allocations;
+  bytes = allocated_bytes - bytes;
+  live = live_bytes - live;
+  size_t n = std::max<size_t>(1, queries.size());
+  cout << "  " << std::left << std::setw(40) << label << std::right
+       << std::setw(10) << allocations / n << " allocations/query"
+       << std::setw(12) << bytes / n << " bytes/query"
+       << std::setw(12) << live << " bytes kept" << endl;
+}
+
+int main(int argc, char** argv) {
+  size_t page = 10;
+  int arg = 1;
+  if (arg < argc && string(argv[arg]).substr(0, 7) == "--page=") {
+    page = atoi(argv[arg] + 7);
+    arg++;
+  }
+  if (arg == argc || page == 0) {
+    Usage(argv[0]);
+  }
+  list<string> indices;
+  for (; arg < argc; arg++) {
+    indices.push_back(argv[arg]);
+  }
+
+  vector<vector<string>> queries;
+  string line;
+  while (std::getline(cin, line)) {
+    boost::algorithm::trim(line);
+    if (line.empty()) {
+      continue;
+    }
+    vector<string> query;
+    boost::algorithm::split(query, line, boost::is_any_of(" "),
+                            boost::token_compress_on);
+    for (string& word : query) {
+      if (!hw4::QueryEngine::IsBooleanOperator(word)) {
+        boost::algorithm::to_lower(word);
+      }
+    }
+    queries.push_back(query);
+  }
+  cout << indices.size() << " indices, " << queries.size() << " queries"
+       << endl;
+
+  bool all_v1 = true;
+  for (const string& index : indices) {
+    std::unique_ptr<hw4::IndexReader> reader(hw4::IndexReader::Create(
+        index, hw4::IndexReaderOptions()));
+    all_v1 = all_v1 && reader->Open(false) && reader->format_version() == 1;
+  }
+  if (all_v1) {
+    hw3::QueryProcessor qp(indices, false);
+    Count("hw3::QueryProcessor", queries,
+          [&qp](const vector<string>& query) { qp.ProcessQuery(query); });
+  }
+
+  struct Backend {
+    const char* label;
+    hw4::IndexReaderOptions::Backend backend;
+  };
+  for (const Backend& backend : {
+           Backend{"QueryEngine (pread)", hw4::IndexReaderOptions::kPread},
+           Backend{"QueryEngine (mmap)", hw4::IndexReaderOptions::kMmap},
+           Backend{"QueryEngine (resident)",
+                   hw4::IndexReaderOptions::kResident}}) {
+    hw4::IndexReaderOptions options;
+    options.backend = backend.backend;
+    hw4::QueryEngine engine(indices, options);
+    if (!engine.Open(false)) {
+      cerr << "couldn't open the indices" << endl;
+      return EXIT_FAILURE;
+    }
+    Count(backend.label, queries,
+          [&engine, page](const vector<string>& query) {
+            engine.ProcessQuery(query, 0, page);
+          });
+  }
+  return EXIT_SUCCESS;
+}
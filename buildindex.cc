@@ -0,0 +1,169 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// buildindex crawls a directory tree and writes an index of it that
+// http333d can serve, in any version of the index file format (see
+// IndexWriter.h).  Version 3, with compressed posting lists and BM25
+// impact bounds, is the default; version 1 is what hw3::WriteIndex
+// writes (though it is written with hw4::WriteIndex, which writes the
+// file front to back in large blocks).  The crawl reads and parses
+// files on as many threads as there are cores, unless --threads says
+// otherwise.
+//
+// With --shards=n, the documents are split among n index files instead,
+// index_file.0 through index_file.<n-1>, which are crawled and written
+// in parallel and which http333d queries in parallel (see
+// WriteShardedIndex() and QueryEngine).  --partition says how: by
+// "range" of crawl order (the default), or by a "hash" of each file's
+// name.  Shards are version 2 or 3 files.
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "./IndexBuilder.h"
+#include "./IndexWriter.h"
+#include "./RequestLane.h"
+
+extern "C" {
+  #include "libhw2/DocTable.h"
+  #include "libhw2/MemIndex.h"
+}
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+// Print out program usage, and exit() with EXIT_FAILURE.
+static void Usage(char* prog_name) {
+  cerr << "Usage: " << prog_name
+       << " [--format=1|2|3] [--threads=n] [--shards=n]"
+       << " [--partition=range|hash] crawl_root_directory index_file"
+       << endl;
+  exit(EXIT_FAILURE);
+}
+
+// Crawls "root" into "shards" shards split up as "partition" says, and
+// writes them to "index_file".0, .1, and so on.  Returns main()'s exit
+// status.
+static int BuildShards(const char* root, const string& index_file,
+                       int version, int threads, int shards,
+                       hw4::ShardPartition partition) {
+  uint64_t start = hw4::RequestLane::NowMicros();
+  vector<string> files;
+  if (!hw4::ListFileTree(root, &files)) {
+    cerr << "couldn't crawl " << root << endl;
+    return EXIT_FAILURE;
+  }
+  vector<vector<string>> shard_files;
+  hw4::ShardFiles(files, shards, partition, &shard_files);
+  vector<DocTable*> dts;
+  vector<MemIndex*> mis;
+  hw4::ParallelParseShards(shard_files, threads, &dts, &mis);
+  uint64_t crawled = hw4::RequestLane::NowMicros();
+
+  vector<string> file_names;
+  for (int i = 0; i < shards; i++) {
+    file_names.push_back(index_file + "." + std::to_string(i));
+  }
+  int64_t bytes = hw4::WriteShardedIndex(mis, dts, file_names, version);
+  uint64_t written = hw4::RequestLane::NowMicros();
+  int num_docs = 0;
+  for (int i = 0; i < shards; i++) {
+    num_docs += DocTable_NumDocs(dts[i]);
+    if (bytes > 0) {
+      cout << "wrote " << file_names[i] << ": "
+           << DocTable_NumDocs(dts[i]) << " documents, "
+           << MemIndex_NumWords(mis[i]) << " words" << endl;
+    }
+    DocTable_Free(dts[i]);
+    MemIndex_Free(mis[i]);
+  }
+  if (bytes <= 0) {
+    cerr << "couldn't write the shards of " << index_file << endl;
+    return EXIT_FAILURE;
+  }
+
+  cout << "wrote " << shards << " shards of " << index_file
+       << " (format version " << version << "): " << bytes << " bytes, "
+       << num_docs << " documents" << endl;
+  cout << "  crawl (" << threads << " threads) took "
+       << (crawled - start) / 1000 << " ms, write took "
+       << (written - crawled) / 1000 << " ms" << endl;
+  return EXIT_SUCCESS;
+}
+
+int main(int argc, char** argv) {
+  int version = 3;
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int shards = 1;
+  hw4::ShardPartition partition = hw4::kShardByRange;
+  int arg = 1;
+  for (; arg < argc && string(argv[arg]).substr(0, 2) == "--"; arg++) {
+    string option(argv[arg]);
+    if (option.substr(0, 9) == "--format=") {
+      version = atoi(argv[arg] + 9);
+    } else if (option.substr(0, 10) == "--threads=") {
+      threads = atoi(argv[arg] + 10);
+    } else if (option.substr(0, 9) == "--shards=") {
+      shards = atoi(argv[arg] + 9);
+    } else if (option == "--partition=range") {
+      partition = hw4::kShardByRange;
+    } else if (option == "--partition=hash") {
+      partition = hw4::kShardByHash;
+    } else {
+      Usage(argv[0]);
+    }
+  }
+  if (argc - arg != 2 || (version < 1 || version > 3) || threads < 1 ||
+      shards < 1 || (shards > 1 && version == 1)) {
+    Usage(argv[0]);
+  }
+  if (shards > 1) {
+    return BuildShards(argv[arg], argv[arg + 1], version, threads, shards,
+                       partition);
+  }
+
+  uint64_t start = hw4::RequestLane::NowMicros();
+  uint64_t crawl_time = hw4::CrawlStartTime();
+  DocTable* dt;
+  MemIndex* mi;
+  if (!hw4::ParallelCrawlFileTree(argv[arg], threads, &dt, &mi)) {
+    cerr << "couldn't crawl " << argv[arg] << endl;
+    return EXIT_FAILURE;
+  }
+  uint64_t crawled = hw4::RequestLane::NowMicros();
+
+  int64_t bytes = version == 1 ? hw4::WriteIndex(mi, dt, argv[arg + 1]) :
+                  hw4::WriteCompressedIndex(mi, dt, argv[arg + 1], version,
+                                            {}, nullptr, crawl_time);
+  uint64_t written = hw4::RequestLane::NowMicros();
+  int num_docs = DocTable_NumDocs(dt);
+  int num_words = MemIndex_NumWords(mi);
+  DocTable_Free(dt);
+  MemIndex_Free(mi);
+  if (bytes <= 0) {
+    cerr << "couldn't write " << argv[arg + 1] << endl;
+    return EXIT_FAILURE;
+  }
+
+  cout << "wrote " << argv[arg + 1] << " (format version " << version
+       << "): " << bytes << " bytes, " << num_docs << " documents, "
+       << num_words << " words" << endl;
+  cout << "  crawl (" << threads << " threads) took "
+       << (crawled - start) / 1000 << " ms, write took "
+       << (written - crawled) / 1000 << " ms" << endl;
+  return EXIT_SUCCESS;
+}
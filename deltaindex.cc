@@ -0,0 +1,131 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+
+// deltaindex brings an index up to date with the directory tree it was
+// built from without rebuilding it: it writes a delta index of just the
+// files that are new or have changed since the index's newest segment
+// was written, with tombstones for the copies of them (and of the files
+// that have since been deleted) that the older segments hold.  http333d
+// serves the base index and its deltas together, and can fold the
+// deltas into the base in the background (see its --compact option);
+// mergeindex does the same thing offline.
+//
+// Given just the base index, deltaindex finds the deltas already on top
+// of it by name, and names the new one after them (see
+// hw4::ListSegments()), so that a running http333d picks it up the next
+// time it reloads its indices.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "./IndexBuilder.h"
+#include "./IndexWriter.h"
+#include "./RequestLane.h"
+
+extern "C" {
+  #include "libhw2/DocTable.h"
+  #include "libhw2/MemIndex.h"
+}
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+// Print out program usage, and exit() with EXIT_FAILURE.
+static void Usage(char* prog_name) {
+  cerr << "Usage: " << prog_name
+       << " [--threads=n] crawl_root_directory [delta_index_file]"
+       << " index_file+" << endl;
+  cerr << "  (the index files are the base index and any deltas already"
+       << " on top of it, oldest first; given just the base index, the"
+       << " deltas are found, and the new one named, after it)" << endl;
+  exit(EXIT_FAILURE);
+}
+
+int main(int argc, char** argv) {
+  int threads = sysconf(_SC_NPROCESSORS_ONLN);
+  int arg = 1;
+  for (; arg < argc && string(argv[arg]).substr(0, 2) == "--"; arg++) {
+    string option(argv[arg]);
+    if (option.substr(0, 10) == "--threads=") {
+      threads = atoi(argv[arg] + 10);
+    } else {
+      Usage(argv[0]);
+    }
+  }
+  if (argc - arg < 2 || threads < 1) {
+    Usage(argv[0]);
+  }
+  const char* root = argv[arg];
+  string delta;
+  vector<string> segments;
+  if (argc - arg == 2) {
+    if (!hw4::ListSegments(argv[arg + 1], &segments)) {
+      cerr << "couldn't look for the deltas on top of " << argv[arg + 1]
+           << endl;
+      return EXIT_FAILURE;
+    }
+    delta = hw4::NextDeltaName(argv[arg + 1]);
+  } else {
+    delta = argv[arg + 1];
+    segments.assign(argv + arg + 2, argv + argc);
+  }
+
+  // A file modified from here on may or may not make it into the delta
+  // as it is now, so the next delta has to look at it again.
+  uint64_t start = hw4::RequestLane::NowMicros();
+  uint64_t crawl_time = hw4::CrawlStartTime();
+  vector<string> changed, tombstones;
+  if (!hw4::PlanDelta(root, segments, &changed, &tombstones)) {
+    cerr << "couldn't compare " << root << " with its index" << endl;
+    return EXIT_FAILURE;
+  }
+  if (changed.empty() && tombstones.empty()) {
+    cout << "nothing has changed; no delta written" << endl;
+    return EXIT_SUCCESS;
+  }
+
+  DocTable* dt;
+  MemIndex* mi;
+  hw4::ParallelParseFiles(changed, threads, &dt, &mi);
+  // The delta only takes its name once it is whole, so that nothing
+  // looking for deltas by name can find it half written.
+  string writing = delta + ".writing";
+  int64_t bytes = hw4::WriteCompressedIndex(mi, dt, writing.c_str(), 3,
+                                            tombstones, nullptr, crawl_time);
+  if (bytes > 0 && rename(writing.c_str(), delta.c_str()) != 0) {
+    unlink(writing.c_str());
+    bytes = 0;
+  }
+  uint64_t written = hw4::RequestLane::NowMicros();
+  int num_docs = DocTable_NumDocs(dt);
+  int num_words = MemIndex_NumWords(mi);
+  DocTable_Free(dt);
+  MemIndex_Free(mi);
+  if (bytes <= 0) {
+    cerr << "couldn't write " << delta << endl;
+    return EXIT_FAILURE;
+  }
+
+  cout << "wrote " << delta << ": " << bytes << " bytes, " << num_docs
+       << " new or changed documents, " << num_words << " words, "
+       << tombstones.size() << " tombstones" << endl;
+  cout << "  took " << (written - start) / 1000 << " ms ("
+       << threads << " threads)" << endl;
+  return EXIT_SUCCESS;
+}
@@ -15,6 +15,7 @@
 #include <sys/stat.h>
 #include <unistd.h>
 #include <signal.h>
+#include <pthread.h>
 #include <cstdlib>
 #include <cstdio>
 #include <iostream>
@@ -51,6 +52,11 @@ static void GetPortAndPath(int argc,
                     string* const path,
                     list<string>* const indices);
 
+// The start routine of the thread that takes SIGHUPs, which must be
+// blocked in every other thread; "arg" is the HttpServer, which it has
+// reload its indices for each one.
+static void* HangupThread(void* arg);
+
 int main(int argc, char** argv) {
   // Print out welcome message.
   cout << "Welcome to http333d, the UW cse333 web server!" << endl;
@@ -64,6 +70,54 @@ int main(int argc, char** argv) {
   // disconnects unexpectedly.
   signal(SIGPIPE, SIG_IGN);
 
+  // Leading options:
+  //  --resident:  decode the indices into memory at startup instead of
+  //    reading them from their files.
+  //  --fanout=N:  let each query probe up to N indices at once.  The
+  //    default is one per CPU.
+  //  --compact=S:  treat the indices as a base index followed by the
+  //    deltas that deltaindex wrote on top of it, oldest first, and
+  //    fold the deltas into the base every S seconds.  The base must be
+  //    a version 3 index, as buildindex writes by default.  Deltas that
+  //    deltaindex names for the base are found without being listed,
+  //    and those it writes later are picked up on the next reload.
+  //  --verify=background:  start serving before the indices' checksums
+  //    have been verified, and verify them in the background instead;
+  //    --verify=startup (the default) verifies them first.
+  hw4::IndexReaderOptions index_options;
+  hw4::HttpServer::Verification verification =
+      hw4::HttpServer::kVerifyAtStartup;
+  long fanout = sysconf(_SC_NPROCESSORS_ONLN);  // NOLINT(runtime/int)
+  long compact = 0;  // NOLINT(runtime/int)
+  while (argc > 1 && string(argv[1]).substr(0, 2) == "--") {
+    string option = argv[1];
+    if (option == "--resident") {
+      index_options.backend = hw4::IndexReaderOptions::kResident;
+    } else if (option.substr(0, 9) == "--fanout=") {
+      fanout = atol(option.c_str() + 9);
+      if (fanout <= 0) {
+        Usage(argv[0]);
+      }
+    } else if (option == "--verify=startup") {
+      verification = hw4::HttpServer::kVerifyAtStartup;
+    } else if (option == "--verify=background") {
+      verification = hw4::HttpServer::kVerifyInBackground;
+    } else if (option.substr(0, 10) == "--compact=") {
+      compact = atol(option.c_str() + 10);
+      if (compact <= 0) {
+        Usage(argv[0]);
+      }
+    } else {
+      Usage(argv[0]);
+    }
+    argv[1] = argv[0];
+    argc--;
+    argv++;
+  }
+  if (fanout <= 0) {
+    fanout = 1;
+  }
+
   // Get the port number and list of index files.
   uint16_t port_num;
   string static_dir;
@@ -71,9 +125,26 @@ int main(int argc, char** argv) {
   GetPortAndPath(argc, argv, &port_num, &static_dir, &indices);
   cout << "    port: " << port_num << endl;
   cout << "    path: " << static_dir << endl;
+  cout << "    query fan-out: " << fanout << endl;
 
   // Run the server.
-  hw4::HttpServer hs(port_num, static_dir, indices);
+  hw4::HttpServer hs(port_num, static_dir, indices, index_options,
+                     static_cast<uint32_t>(fanout),
+                     static_cast<uint32_t>(compact), verification);
+
+  // Reload the indices whenever we get a SIGHUP, e.g. after an index
+  // has been rebuilt and renamed over its old file.  Blocking it here,
+  // before the server starts any threads, leaves HangupThread() as the
+  // only thread that ever takes it.
+  sigset_t hangup;
+  sigemptyset(&hangup);
+  sigaddset(&hangup, SIGHUP);
+  pthread_sigmask(SIG_BLOCK, &hangup, nullptr);
+  pthread_t hangup_thread;
+  if (pthread_create(&hangup_thread, nullptr, &HangupThread, &hs) == 0) {
+    pthread_detach(hangup_thread);
+  }
+
   if (!hs.Run()) {
     cerr << "  server failed to run!?" << endl;
   }
@@ -83,8 +154,27 @@ int main(int argc, char** argv) {
 }
 
 
+static void* HangupThread(void* arg) {
+  hw4::HttpServer* server = static_cast<hw4::HttpServer*>(arg);
+  sigset_t hangup;
+  sigemptyset(&hangup);
+  sigaddset(&hangup, SIGHUP);
+  while (1) {
+    int sig;
+    if (sigwait(&hangup, &sig) != 0) {
+      continue;
+    }
+    cout << "  got SIGHUP; reloading the search indices..." << endl;
+    server->RequestReload();
+  }
+  return nullptr;
+}
+
 static void Usage(char* prog_name) {
-  cerr << "Usage: " << prog_name << " port staticfiles_directory indices+";
+  cerr << "Usage: " << prog_name
+       << " [--resident] [--fanout=N] [--compact=S]"
+       << " [--verify=startup|background]"
+       << " port staticfiles_directory indices+";
   cerr << endl;
   exit(EXIT_FAILURE);
 }
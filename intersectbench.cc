@@ -0,0 +1,144 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// intersectbench measures how fast PostingList::IntersectWith() is with
+// each of its intersection methods.  It makes up a corpus of "num_docs"
+// documents and "num_words" words whose document frequencies follow
+// Zipf's law (the word of rank r appears in about num_docs / r
+// documents, like real text), and then intersects pairs of words drawn
+// from different parts of the frequency range: two common words, a rare
+// word and a common word, and two rare words.
+
+#include <stdlib.h>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "./PostingList.h"
+#include "./RequestLane.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+using hw4::PostingList;
+
+// Print out program usage, and exit() with EXIT_FAILURE.
+static void Usage(char* prog_name) {
+  cerr << "Usage: " << prog_name << " num_docs num_words rounds" << endl;
+  exit(EXIT_FAILURE);
+}
+
+// Returns a random word rank in [lo, hi).
+static size_t RandomRank(size_t lo, size_t hi) {
+  return lo + static_cast<size_t>(rand()) % (hi - lo);
+}
+
+int main(int argc, char** argv) {
+  if (argc != 4) {
+    Usage(argv[0]);
+  }
+  int num_docs = atoi(argv[1]);
+  int num_words = atoi(argv[2]);
+  int rounds = atoi(argv[3]);
+  if (num_docs <= 0 || num_words < 100 || rounds <= 0) {
+    Usage(argv[0]);
+  }
+
+  // Build the posting lists.  Word r (counting from 1) is in each
+  // document with probability 1/r.
+  srand(333);
+  vector<PostingList> lists(num_words);
+  size_t total_postings = 0;
+  for (int r = 0; r < num_words; r++) {
+    double p = 1.0 / (r + 1);
+    for (int d = 0; d < num_docs; d++) {
+      if (rand() < p * RAND_MAX) {
+        lists[r].Append(d, 1 + rand() % 4);
+      }
+    }
+    total_postings += lists[r].size();
+  }
+  cout << num_docs << " docs, " << num_words << " words, "
+       << total_postings << " postings" << endl;
+
+  struct Mix {
+    const char* label;
+    size_t lo1, hi1, lo2, hi2;   // the rank ranges to draw words from
+  };
+  const size_t common = 10, rare = num_words / 10, all = num_words;
+  const Mix mixes[] = {
+    {"common x common", 0, common, 0, common},
+    {"rare x common", rare, all, 0, common},
+    {"rare x rare", rare, all, rare, all},
+  };
+  const struct {
+    const char* label;
+    PostingList::IntersectMethod method;
+  } methods[] = {
+    {"merge", PostingList::kMerge},
+    {"gallop", PostingList::kGallop},
+    {"block", PostingList::kBlock},
+    {"auto", PostingList::kAuto},
+  };
+  const int kPairs = 200;
+
+  for (const Mix& mix : mixes) {
+    vector<std::pair<size_t, size_t>> pairs;
+    for (int i = 0; i < kPairs; i++) {
+      size_t a = RandomRank(mix.lo1, mix.hi1);
+      size_t b = RandomRank(mix.lo2, mix.hi2);
+      // Rarest first, as QueryEngine does.
+      if (lists[a].size() > lists[b].size()) {
+        std::swap(a, b);
+      }
+      pairs.push_back({a, b});
+    }
+
+    cout << mix.label << ":" << endl;
+    size_t expected_matches = 0;
+    for (const auto& m : methods) {
+      size_t matches = 0;
+      uint64_t elapsed = 0;
+      for (int r = 0; r < rounds; r++) {
+        // IntersectWith() works in place, so make fresh copies of the
+        // rarer lists outside of the timed region.
+        vector<PostingList> candidates;
+        for (const auto& pair : pairs) {
+          candidates.push_back(lists[pair.first]);
+        }
+        uint64_t start = hw4::RequestLane::NowMicros();
+        for (size_t i = 0; i < pairs.size(); i++) {
+          candidates[i].IntersectWith(lists[pairs[i].second], m.method);
+        }
+        elapsed += hw4::RequestLane::NowMicros() - start;
+        for (const PostingList& c : candidates) {
+          matches += c.size();
+        }
+      }
+      if (expected_matches == 0) {
+        expected_matches = matches;
+      } else if (matches != expected_matches) {
+        cerr << m.label << " found " << matches << " matches, expected "
+             << expected_matches << endl;
+        return EXIT_FAILURE;
+      }
+      cout << "  " << std::left << std::setw(8) << m.label << std::right
+           << std::setw(10)
+           << std::fixed << std::setprecision(2)
+           << 1000.0 * elapsed / (rounds * pairs.size())
+           << " ns/intersection" << endl;
+    }
+  }
+  return EXIT_SUCCESS;
+}
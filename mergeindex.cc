@@ -0,0 +1,108 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// mergeindex compacts several index files (say, the indices of a few
+// crawls of overlapping trees) into one, renumbering the documents and
+// keeping one copy of each, or folds the deltas that deltaindex writes
+// into their base index; see hw4::MergeIndexFiles() for the details.
+// It reports how fast it read its inputs and wrote its output.
+//
+// A version 1 index can only go into a version 2 merge, and its
+// positions are byte offsets, which leaves the merged index without
+// phrase and proximity queries.  Rebuilding it with buildindex (whose
+// default is version 3) gives an index that has both.
+
+#include <stdlib.h>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./IndexReader.h"
+#include "./IndexWriter.h"
+#include "./RequestLane.h"
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+using std::vector;
+
+// Print out program usage, and exit() with EXIT_FAILURE.
+static void Usage(char* prog_name) {
+  cerr << "Usage: " << prog_name
+       << " [--format=2|3] merged_index_file index_file+" << endl;
+  exit(EXIT_FAILURE);
+}
+
+// Returns true if index file "file_name" can go into a version
+// "version" merge, and otherwise says why not.
+static bool CheckInput(const string& file_name, int version) {
+  hw4::IndexReaderOptions options;
+  options.backend = hw4::IndexReaderOptions::kPread;
+  std::unique_ptr<hw4::IndexReader> reader(
+      hw4::IndexReader::Create(file_name, options));
+  if (!reader->Open(false)) {
+    cerr << "couldn't open " << file_name << endl;
+    return false;
+  }
+  if (version == 3 && reader->format_version() < 3) {
+    cerr << file_name << " is a version " << reader->format_version()
+         << " index, which can't go into a version " << version
+         << " merge; use --format=2" << endl;
+    return false;
+  }
+  if (!reader->has_word_positions()) {
+    cout << "  note: " << file_name << "'s positions are byte offsets,"
+         << " so phrase and proximity queries won't work on the merged"
+         << " index" << endl;
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  int version = 3;
+  int arg = 1;
+  if (argc > 1 && string(argv[1]).substr(0, 9) == "--format=") {
+    version = atoi(argv[1] + 9);
+    arg++;
+  }
+  if (argc - arg < 2 || (version < 2 || version > 3)) {
+    Usage(argv[0]);
+  }
+  vector<string> inputs(argv + arg + 1, argv + argc);
+  for (const string& input : inputs) {
+    if (!CheckInput(input, version)) {
+      return EXIT_FAILURE;
+    }
+  }
+
+  uint64_t start = hw4::RequestLane::NowMicros();
+  hw4::MergeStats stats;
+  int64_t bytes = hw4::MergeIndexFiles(inputs, argv[arg], version, &stats);
+  uint64_t elapsed = hw4::RequestLane::NowMicros() - start;
+  if (bytes <= 0) {
+    cerr << "couldn't merge into " << argv[arg] << endl;
+    return EXIT_FAILURE;
+  }
+
+  double seconds = elapsed > 0 ? elapsed / 1e6 : 1e-6;
+  cout << "wrote " << argv[arg] << " (format version " << version
+       << "): " << bytes << " bytes, " << stats.docs_out << " documents ("
+       << stats.docs_in - stats.docs_out << " duplicates or deletions "
+       << "dropped, " << stats.tombstones << " tombstones applied), "
+       << stats.words << " words" << endl;
+  cout << "  merge of " << inputs.size() << " files took "
+       << elapsed / 1000 << " ms: "
+       << stats.bytes_in / seconds / 1e6 << " MB/s read, "
+       << bytes / seconds / 1e6 << " MB/s written" << endl;
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,161 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// querybench measures how long it takes to answer search queries.  It
+// reads one query per line from stdin (words separated by spaces) and
+// runs every query "rounds" times against the given index files, first
+// the way the server used to (a fresh hw3::QueryProcessor per query)
+// and then through a single shared QueryEngine, once for each kind of
+// IndexReader.
+
+#include <boost/algorithm/string.hpp>
+#include <stdlib.h>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./QueryEngine.h"
+#include "./RequestLane.h"
+#include "./libhw3/QueryProcessor.h"
+
+using std::cerr;
+using std::cin;
+using std::cout;
+using std::endl;
+using std::list;
+using std::string;
+using std::vector;
+
+// Print out program usage, and exit() with EXIT_FAILURE.
+static void Usage(char* prog_name) {
+  cerr << "Usage: " << prog_name << " rounds indices+ < queries" << endl;
+  exit(EXIT_FAILURE);
+}
+
+// Prints the mean per-query latency of a benchmark run.
+static void Report(const string& label, uint64_t elapsed_us,
+                   size_t num_queries) {
+  cout << "  " << std::left << std::setw(40) << label
+       << std::right << std::setw(10)
+       << (num_queries == 0 ? 0 : elapsed_us / num_queries)
+       << " us/query" << endl;
+}
+
+int main(int argc, char** argv) {
+  if (argc < 3) {
+    Usage(argv[0]);
+  }
+  int rounds = atoi(argv[1]);
+  if (rounds <= 0) {
+    Usage(argv[0]);
+  }
+  list<string> indices;
+  for (int i = 2; i < argc; i++) {
+    indices.push_back(argv[i]);
+  }
+
+  vector<vector<string>> queries;
+  string line;
+  while (std::getline(cin, line)) {
+    boost::algorithm::trim(line);
+    if (line.empty()) {
+      continue;
+    }
+    vector<string> query;
+    boost::algorithm::split(query, line, boost::is_any_of(" "),
+                            boost::token_compress_on);
+    for (string& word : query) {
+      if (!hw4::QueryEngine::IsBooleanOperator(word)) {
+        boost::algorithm::to_lower(word);
+      }
+    }
+    queries.push_back(query);
+  }
+  size_t num_queries = queries.size() * rounds;
+  cout << indices.size() << " indices, " << queries.size()
+       << " queries x " << rounds << " rounds" << endl;
+
+  // The old way: every query builds its own QueryProcessor, which
+  // reopens (and re-checksums) every index file.  It can only read
+  // version 1 index files.
+  bool all_v1 = true;
+  for (const string& index : indices) {
+    std::unique_ptr<hw4::IndexReader> reader(hw4::IndexReader::Create(
+        index, hw4::IndexReaderOptions()));
+    all_v1 = all_v1 && reader->Open(false) && reader->format_version() == 1;
+  }
+  uint64_t start = hw4::RequestLane::NowMicros();
+  if (all_v1) {
+    for (int r = 0; r < rounds; r++) {
+      for (const vector<string>& query : queries) {
+        hw3::QueryProcessor qp(indices, true);
+        qp.ProcessQuery(query);
+      }
+    }
+    Report("QueryProcessor per query",
+           hw4::RequestLane::NowMicros() - start, num_queries);
+  }
+
+  // The new way: open the indices once, then share the engine.  Try
+  // each of the ways the engine can read its index files.
+  struct Backend {
+    const char* label;
+    hw4::IndexReaderOptions options;
+    uint32_t fanout;
+  };
+  vector<Backend> backends(6);
+  backends[0].label = "shared QueryEngine (pread)";
+  backends[0].options.backend = hw4::IndexReaderOptions::kPread;
+  backends[1].label = "shared QueryEngine (mmap)";
+  backends[1].options.backend = hw4::IndexReaderOptions::kMmap;
+  backends[2].label = "  + MAP_POPULATE";
+  backends[2].options.backend = hw4::IndexReaderOptions::kMmap;
+  backends[2].options.populate = true;
+  backends[3].label = "shared QueryEngine (resident)";
+  backends[3].options.backend = hw4::IndexReaderOptions::kResident;
+  backends[4].label = "shared QueryEngine (mmap, fan-out 4)";
+  backends[4].options.backend = hw4::IndexReaderOptions::kMmap;
+  backends[4].fanout = 4;
+  backends[5].label = "shared QueryEngine (resident, fan-out 4)";
+  backends[5].options.backend = hw4::IndexReaderOptions::kResident;
+  backends[5].fanout = 4;
+  for (int i = 0; i < 4; i++) {
+    backends[i].fanout = 1;
+  }
+
+  for (const Backend& backend : backends) {
+    start = hw4::RequestLane::NowMicros();
+    hw4::QueryEngine engine(indices, backend.options, backend.fanout);
+    if (!engine.Open(true)) {
+      cerr << "couldn't open the indices" << endl;
+      return EXIT_FAILURE;
+    }
+    uint64_t opened = hw4::RequestLane::NowMicros();
+    for (int r = 0; r < rounds; r++) {
+      for (const vector<string>& query : queries) {
+        engine.ProcessQuery(query);
+      }
+    }
+    uint64_t done = hw4::RequestLane::NowMicros();
+    size_t footprint = 0;
+    for (const auto& index : engine.indices()) {
+      footprint += index->MemoryFootprint();
+    }
+    Report(backend.label, done - opened, num_queries);
+    cout << "    (QueryEngine::Open took " << (opened - start) << " us, "
+         << footprint / 1024 << " KB in memory)" << endl;
+  }
+
+  return EXIT_SUCCESS;
+}
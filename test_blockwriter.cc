@@ -0,0 +1,103 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./BlockWriter.h"
+#include "./CRC32.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// Returns the contents of file "file_name".
+static vector<uint8_t> ReadFile(const string& file_name) {
+  int fd = open(file_name.c_str(), O_RDONLY);
+  vector<uint8_t> contents(lseek(fd, 0, SEEK_END));
+  pread(fd, contents.data(), contents.size(), 0);
+  close(fd);
+  return contents;
+}
+
+TEST(Test_BlockWriter, TestBlockWriterBasic) {
+  char file_name[] = "/tmp/hw4_test_block_XXXXXX";
+  close(mkstemp(file_name));
+
+  vector<uint8_t> data(10000);
+  srand(333);
+  for (uint8_t& byte : data) {
+    byte = rand();
+  }
+
+  // Appends smaller than a block are gathered up, and ones at least a
+  // block long go straight out.
+  {
+    BlockWriter out(file_name, 1024);
+    ASSERT_TRUE(out.Open(4));
+    ASSERT_EQ(4, out.offset());
+    ASSERT_TRUE(out.Append(data.data(), 1000));
+    ASSERT_EQ(0U, out.num_writes());
+    ASSERT_TRUE(out.Append(data.data() + 1000, 100));
+    ASSERT_EQ(1U, out.num_writes());
+    ASSERT_TRUE(out.Append(data.data() + 1100, 5000));
+    ASSERT_EQ(3U, out.num_writes());
+    ASSERT_TRUE(out.Append(data.data() + 6100, 3900));
+    ASSERT_EQ(10004, out.offset());
+
+    CRC32 crc;
+    crc.Fold(data.data(), data.size());
+    ASSERT_EQ(crc.GetFinalCRC(), out.checksum());
+
+    // Finish() can't write more than was reserved.
+    uint8_t header[5] = {1, 2, 3, 4, 5};
+    ASSERT_TRUE(out.Finish(header, 4));
+    ASSERT_EQ(5U, out.num_writes());
+  }
+  vector<uint8_t> contents = ReadFile(file_name);
+  ASSERT_EQ(10004U, contents.size());
+  ASSERT_EQ(vector<uint8_t>({1, 2, 3, 4}),
+            vector<uint8_t>(contents.begin(), contents.begin() + 4));
+  ASSERT_TRUE(std::equal(data.begin(), data.end(), contents.begin() + 4));
+
+  {
+    BlockWriter out(file_name, 1024);
+    ASSERT_TRUE(out.Open(4));
+    ASSERT_TRUE(out.Append(data.data(), 10));
+    uint8_t header[5] = {1, 2, 3, 4, 5};
+    ASSERT_FALSE(out.Finish(header, 5));
+  }
+  struct stat st;
+  ASSERT_EQ(-1, stat(file_name, &st));
+
+  // A writer that is never finished leaves no file behind either.
+  {
+    BlockWriter out(file_name, 1024);
+    ASSERT_TRUE(out.Open(0));
+    ASSERT_TRUE(out.Append(data.data(), data.size()));
+  }
+  ASSERT_EQ(-1, stat(file_name, &st));
+
+  BlockWriter nowhere("/tmp/no_such_dir/hw4_test_block");
+  ASSERT_FALSE(nowhere.Open(0));
+  ASSERT_FALSE(nowhere.Append(data.data(), 10));
+}
+
+}  // namespace hw4
@@ -0,0 +1,87 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./CRC32.h"
+#include "./libhw3/Utils.h"
+
+using std::vector;
+
+namespace hw4 {
+
+static const CRC32::Method kAllMethods[] = {
+  CRC32::kBytewise, CRC32::kSliceBy8, CRC32::kPclmul, CRC32::kAuto
+};
+
+TEST(Test_CRC32, TestCRC32MatchesHw3) {
+  vector<uint8_t> buf(20000);
+  srand(333);
+  for (uint8_t& byte : buf) {
+    byte = rand();
+  }
+
+  // Lengths around the slice and fold sizes, at unaligned starts too,
+  // folded in as one buffer and as three uneven ones.
+  for (size_t len : {0, 1, 7, 8, 9, 15, 16, 63, 64, 65, 80, 127, 128, 129,
+                     1000, 4096, 19997}) {
+    for (size_t start : {0, 1, 3}) {
+      hw3::CRC32 expected;
+      for (size_t i = 0; i < len; i++) {
+        expected.FoldByteIntoCRC(buf[start + i]);
+      }
+      uint32_t crc = expected.GetFinalCRC();
+
+      for (CRC32::Method method : kAllMethods) {
+        CRC32 whole(method);
+        whole.Fold(buf.data() + start, len);
+        ASSERT_EQ(crc, whole.GetFinalCRC());
+
+        CRC32 pieces(method);
+        size_t first = len / 3, second = len / 2;
+        pieces.Fold(buf.data() + start, first);
+        pieces.Fold(buf.data() + start + first, second - first);
+        pieces.Fold(buf.data() + start + second, len - second);
+        ASSERT_EQ(crc, pieces.GetFinalCRC());
+      }
+
+      // The checksums of two halves combine into the whole's.
+      size_t half = len / 2;
+      CRC32 front, back;
+      front.Fold(buf.data() + start, half);
+      back.Fold(buf.data() + start + half, len - half);
+      ASSERT_EQ(crc, CRC32::Combine(front.GetFinalCRC(), back.GetFinalCRC(),
+                                    len - half));
+    }
+  }
+}
+
+TEST(Test_CRC32, TestCRC32Methods) {
+  // The check value of CRC-32: the checksum of "123456789".
+  for (CRC32::Method method : kAllMethods) {
+    CRC32 crc(method);
+    crc.Fold("123456789", 9);
+    ASSERT_EQ(0xCBF43926U, crc.GetFinalCRC());
+  }
+
+  // kAuto and kPclmul use PCLMULQDQ exactly when the CPU has it.
+  CRC32::Method fast = CRC32::HasPclmul() ? CRC32::kPclmul : CRC32::kSliceBy8;
+  ASSERT_EQ(fast, CRC32(CRC32::kAuto).method());
+  ASSERT_EQ(fast, CRC32(CRC32::kPclmul).method());
+  ASSERT_EQ(CRC32::kBytewise, CRC32(CRC32::kBytewise).method());
+}
+
+}  // namespace hw4
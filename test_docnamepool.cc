@@ -0,0 +1,93 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./DocNamePool.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+TEST(Test_DocNamePool, TestDocNamePoolLookup) {
+  // Paths as a crawl numbers them: a directory's files one after the
+  // other, so that neighbours share long prefixes.
+  vector<string> names;
+  size_t total = 0;
+  char buf[64];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(buf, sizeof(buf), "./test_tree/dir%02d/sub%d/file%03d.txt",
+             i / 100, i / 10 % 10, i);
+    names.push_back(buf);
+    total += names.back().size();
+  }
+  names.push_back("");
+  names.push_back("./a");
+
+  vector<uint8_t> encoded;
+  DocNamePool::Build(names, &encoded);
+  ASSERT_LT(encoded.size(), total / 2);
+  DocNamePool pool;
+  ASSERT_FALSE(pool.valid());
+  string name = "left over";
+  ASSERT_FALSE(pool.Lookup(1, &name));
+  ASSERT_TRUE(pool.Parse(encoded.data(), encoded.size()));
+  ASSERT_TRUE(pool.valid());
+  ASSERT_EQ(names.size(), pool.size());
+
+  // In any order, so that every lookup starts afresh.
+  for (DocID_t doc_id = names.size(); doc_id >= 1; doc_id--) {
+    ASSERT_TRUE(pool.Lookup(doc_id, &name));
+    ASSERT_EQ(names[doc_id - 1], name);
+  }
+  ASSERT_FALSE(pool.Lookup(0, &name));
+  ASSERT_FALSE(pool.Lookup(names.size() + 1, &name));
+
+  // An empty pool is fine too.
+  encoded.clear();
+  DocNamePool::Build({}, &encoded);
+  ASSERT_TRUE(pool.Parse(encoded.data(), encoded.size()));
+  ASSERT_EQ(0U, pool.size());
+  ASSERT_FALSE(pool.Lookup(1, &name));
+}
+
+TEST(Test_DocNamePool, TestDocNamePoolBadInput) {
+  vector<string> names = {"./x/one", "./x/two", "./x/three"};
+  vector<uint8_t> encoded;
+  DocNamePool::Build(names, &encoded);
+  DocNamePool pool;
+
+  // Cut short anywhere, the pool either doesn't parse or fails the
+  // lookups that run off its end.
+  for (size_t len = 0; len < encoded.size(); len++) {
+    if (!pool.Parse(encoded.data(), len)) {
+      continue;
+    }
+    string name;
+    for (DocID_t doc_id = 1; doc_id <= names.size(); doc_id++) {
+      if (pool.Lookup(doc_id, &name)) {
+        ASSERT_EQ(names[doc_id - 1].substr(0, name.size()), name);
+      }
+    }
+  }
+
+  // More names than there are block offsets for.
+  encoded[3] = 100;
+  ASSERT_FALSE(pool.Parse(encoded.data(), encoded.size()));
+  ASSERT_FALSE(pool.valid());
+}
+
+}  // namespace hw4
@@ -0,0 +1,186 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include "gtest/gtest.h"
+#include "./HttpServer.h"
+#include "./IndexBuilder.h"
+#include "./IndexWriter.h"
+#include "./test_suite.h"
+
+using std::shared_ptr;
+using std::string;
+
+namespace hw4 {
+
+// The servers here are never Run(), so never bind to this port.
+static const uint16_t kTestPort = 5333;
+
+// Thread start routine that reloads the indices of the server passed in
+// as the argument, and records how that went.
+static volatile bool reload_done = false;
+static volatile bool reload_ok = false;
+static void* ReloadIndicesFn(void* arg) {
+  HttpServer* server = static_cast<HttpServer*>(arg);
+  reload_ok = server->ReloadIndices();
+  reload_done = true;
+  return nullptr;
+}
+
+TEST(Test_HttpServer, TestHttpServerReload) {
+  string idx = WriteTestIndex("./test_files/tiny/sub", 2);
+  HttpServer server(kTestPort, "./test_files", {idx});
+  ASSERT_TRUE(server.ReloadIndices());
+  ASSERT_EQ(0U, server.engine()->ProcessQuery({"fox"}).size());
+  ASSERT_EQ(1U, server.engine()->ProcessQuery({"bread"}).size());
+
+  // An index rebuilt and renamed over the old file is picked up.
+  string rebuilt = WriteTestIndex("./test_files/tiny", 2);
+  ASSERT_EQ(0, rename(rebuilt.c_str(), idx.c_str()));
+  ASSERT_TRUE(server.ReloadIndices());
+  ASSERT_EQ(3U, server.engine()->ProcessQuery({"fox"}).size());
+  ASSERT_EQ(1U, server.engine()->ProcessQuery({"bread"}).size());
+  ASSERT_EQ("indices: files=1 reloads=2 failed_reloads=0",
+            server.StatsString());
+
+  // Nothing would ever do a reload asked for before the server runs.
+  ASSERT_FALSE(server.RequestReload());
+  unlink(idx.c_str());
+}
+
+TEST(Test_HttpServer, TestHttpServerFailedReload) {
+  string idx = WriteTestIndex("./test_files/tiny", 2);
+  HttpServer server(kTestPort, "./test_files", {idx});
+  ASSERT_TRUE(server.ReloadIndices());
+  shared_ptr<const QueryEngine> engine = server.engine();
+
+  // A file that isn't an index can't be opened, so the old engine
+  // stays, and keeps answering queries from the old index.
+  string garbage = idx + ".new";
+  FILE* f = fopen(garbage.c_str(), "w");
+  ASSERT_NE(nullptr, f);
+  fputs("not an index\n", f);
+  fclose(f);
+  ASSERT_EQ(0, rename(garbage.c_str(), idx.c_str()));
+  ASSERT_FALSE(server.ReloadIndices());
+  ASSERT_EQ(engine, server.engine());
+  ASSERT_EQ(3U, server.engine()->ProcessQuery({"fox"}).size());
+  ASSERT_EQ("indices: files=1 reloads=1 failed_reloads=1",
+            server.StatsString());
+
+  // ...and so can't a file that is gone.
+  unlink(idx.c_str());
+  ASSERT_FALSE(server.ReloadIndices());
+  ASSERT_EQ(engine, server.engine());
+  ASSERT_EQ("indices: files=1 reloads=1 failed_reloads=2",
+            server.StatsString());
+}
+
+TEST(Test_HttpServer, TestHttpServerReloadFindsDeltas) {
+  // With compaction on, the indices are the segments of one index, and
+  // a reload picks up the deltas written for the base since.
+  string base = WriteTestIndex("./test_files/tiny/sub", 3);
+  HttpServer server(kTestPort, "./test_files", {base}, IndexReaderOptions(),
+                    1, 3600);
+  ASSERT_TRUE(server.ReloadIndices());
+  ASSERT_EQ(0U, server.engine()->ProcessQuery({"fox"}).size());
+
+  string delta = NextDeltaName(base);
+  ASSERT_EQ(base + ".delta.1", delta);
+  DocTable* dt;
+  MemIndex* mi;
+  ParallelParseFiles({"./test_files/tiny/a.txt"}, 1, &dt, &mi);
+  ASSERT_LT(0, WriteCompressedIndex(mi, dt, delta.c_str()));
+  DocTable_Free(dt);
+  MemIndex_Free(mi);
+  ASSERT_EQ(base + ".delta.2", NextDeltaName(base));
+  ASSERT_TRUE(server.ReloadIndices());
+  ASSERT_EQ(1U, server.engine()->ProcessQuery({"fox"}).size());
+  ASSERT_EQ(1U, server.engine()->ProcessQuery({"bread"}).size());
+  ASSERT_EQ("indices: files=2 reloads=2 failed_reloads=0",
+            server.StatsString());
+
+  // A delta that is gone (folded into the base offline, say) drops out.
+  unlink(delta.c_str());
+  ASSERT_TRUE(server.ReloadIndices());
+  ASSERT_EQ(0U, server.engine()->ProcessQuery({"fox"}).size());
+  ASSERT_EQ("indices: files=1 reloads=3 failed_reloads=0",
+            server.StatsString());
+  unlink(base.c_str());
+}
+
+TEST(Test_HttpServer, TestHttpServerReloadWhileQuerying) {
+  string idx = WriteTestIndex("./test_files/tiny/sub", 2);
+  HttpServer server(kTestPort, "./test_files", {idx});
+  ASSERT_TRUE(server.ReloadIndices());
+
+  // A query in flight holds on to the engine it started with.
+  shared_ptr<const QueryEngine> old = server.engine();
+  string rebuilt = WriteTestIndex("./test_files/tiny", 2);
+  ASSERT_EQ(0, rename(rebuilt.c_str(), idx.c_str()));
+  reload_done = false;
+  reload_ok = false;
+  pthread_t reloader;
+  ASSERT_EQ(0, pthread_create(&reloader, nullptr, &ReloadIndicesFn,
+                              &server));
+
+  // The reload doesn't wait for the query: new queries get the new
+  // engine as soon as it is swapped in, while the old engine keeps
+  // answering from the old index for as long as the query holds it.
+  ASSERT_EQ(0, pthread_join(reloader, nullptr));
+  ASSERT_TRUE(reload_done);
+  ASSERT_TRUE(reload_ok);
+  ASSERT_NE(old, server.engine());
+  ASSERT_EQ(3U, server.engine()->ProcessQuery({"fox"}).size());
+  ASSERT_EQ(0U, old->ProcessQuery({"fox"}).size());
+  ASSERT_EQ(1U, old->ProcessQuery({"bread"}).size());
+
+  // Once the query lets go, the old engine is freed.
+  std::weak_ptr<const QueryEngine> gone = old;
+  old.reset();
+  ASSERT_TRUE(gone.expired());
+  unlink(idx.c_str());
+}
+
+TEST(Test_HttpServer, TestHttpServerMatchAny) {
+  // The server's engine ranks a disjunction of plain words with
+  // TopKEvaluator::MatchAny(), except in segments with documents that a
+  // newer one hides: here the delta replaces a.txt.
+  string base = WriteTestIndex("./test_files/tiny", 3);
+  HttpServer server(kTestPort, "./test_files", {base}, IndexReaderOptions(),
+                    1, 3600);
+  string delta = NextDeltaName(base);
+  DocTable* dt;
+  MemIndex* mi;
+  ParallelParseFiles({"./test_files/tiny/a.txt"}, 1, &dt, &mi);
+  ASSERT_LT(0, WriteCompressedIndex(mi, dt, delta.c_str(), 3,
+                                    {"./test_files/tiny/a.txt"}));
+  DocTable_Free(dt);
+  MemIndex_Free(mi);
+  ASSERT_TRUE(server.ReloadIndices());
+
+  QueryEngine::ResultPage page =
+    server.engine()->ProcessQuery({"fox", "OR", "wine"}, 0, 10, true);
+  ASSERT_EQ("words: fox wine; [0] wine:0 fox:1 -> 1 (any); "
+            "[1] wine:1 fox:3 hidden:1 -> 3", page.plan);
+  ASSERT_EQ(4U, page.total);
+  ASSERT_EQ(4U, page.results.size());
+  unlink(delta.c_str());
+  unlink(base.c_str());
+}
+
+}  // namespace hw4
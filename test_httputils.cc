@@ -43,6 +43,18 @@ TEST(Test_HttpUtils, TestHttpUtilsURIDecode) {
   ASSERT_EQ(string("  blah blah"), URIDecode(spacey));
 }
 
+TEST(Test_HttpUtils, TestHttpUtilsURIEncode) {
+  ASSERT_EQ(string(""), URIEncode(""));
+  ASSERT_EQ(string("foo-bar_1.2~"), URIEncode("foo-bar_1.2~"));
+  ASSERT_EQ(string("quick%20brown%26fox%3D%25"),
+            URIEncode("quick brown&fox=%"));
+  ASSERT_EQ(string("%C3%A9"), URIEncode("\xC3\xA9"));
+
+  // Decoding undoes encoding.
+  string tricky("a+b c&d=e?f/g%h\"i\"");
+  ASSERT_EQ(tricky, URIDecode(URIEncode(tricky)));
+}
+
 TEST(Test_HttpUtils, TestHttpUtilsURLParser) {
   // Test out URL parsing.
   string easy("/foo/bar");
@@ -0,0 +1,122 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./IndexBuilder.h"
+#include "./IndexWriter.h"
+#include "./test_suite.h"
+
+extern "C" {
+  #include "libhw2/CrawlFileTree.h"
+}
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// Writes "mi" and "dt" to a temporary version 3 index file, frees
+// them, and returns the file's contents.
+static vector<char> IndexBytes(DocTable* dt, MemIndex* mi) {
+  char name[] = "/tmp/hw4_test_index_XXXXXX";
+  close(mkstemp(name));
+  int64_t bytes = WriteCompressedIndex(mi, dt, name, 3);
+  DocTable_Free(dt);
+  MemIndex_Free(mi);
+  EXPECT_LT(0, bytes);
+
+  vector<char> contents(bytes > 0 ? bytes : 0);
+  int fd = open(name, O_RDONLY);
+  EXPECT_EQ(bytes, read(fd, contents.data(), contents.size()));
+  close(fd);
+  unlink(name);
+  return contents;
+}
+
+TEST(Test_IndexBuilder, TestParallelCrawlFileTree) {
+  // However many threads parse the files, the crawl comes out exactly
+  // as CrawlFileTree()'s does: the same documents, with the same
+  // docIDs, and so the same index file.
+  for (const char* root : {"./test_files", "./test_files/tiny"}) {
+    DocTable* dt;
+    MemIndex* mi;
+    ASSERT_TRUE(CrawlFileTree(const_cast<char*>(root), &dt, &mi));
+    int num_docs = DocTable_NumDocs(dt);
+    ASSERT_LT(0, num_docs);
+    vector<char> expected = IndexBytes(dt, mi);
+
+    for (uint32_t threads : {1, 2, 4, 16}) {
+      ASSERT_TRUE(ParallelCrawlFileTree(root, threads, &dt, &mi));
+      ASSERT_EQ(num_docs, DocTable_NumDocs(dt));
+      ASSERT_TRUE(expected == IndexBytes(dt, mi));
+    }
+  }
+
+  DocTable* dt;
+  MemIndex* mi;
+  ASSERT_FALSE(ParallelCrawlFileTree("./test_files/no_such_dir", 4, &dt,
+                                     &mi));
+  ASSERT_FALSE(ParallelCrawlFileTree("./test_files/hextext.txt", 4, &dt,
+                                     &mi));
+}
+
+TEST(Test_IndexBuilder, TestShardFiles) {
+  vector<string> files;
+  ASSERT_TRUE(ListFileTree("./test_files", &files));
+  ASSERT_LT(3U, files.size());
+
+  // Either way, every file goes to exactly one shard, in crawl order.
+  // By range, the shards are runs of the crawl; by hash, a file goes to
+  // the same shard whatever else is crawled with it.
+  for (ShardPartition partition : {kShardByRange, kShardByHash}) {
+    vector<vector<string>> shards;
+    ShardFiles(files, 3, partition, &shards);
+    ASSERT_EQ(3U, shards.size());
+    vector<string> all;
+    for (const vector<string>& shard : shards) {
+      if (partition == kShardByRange) {
+        ASSERT_LE(files.size() / 3, shard.size());
+      }
+      auto pos = files.begin();
+      for (const string& file : shard) {
+        pos = std::find(pos, files.end(), file);
+        ASSERT_TRUE(pos != files.end());
+        all.push_back(file);
+      }
+    }
+    if (partition == kShardByRange) {
+      ASSERT_EQ(files, all);
+    }
+    std::sort(all.begin(), all.end());
+    vector<string> sorted = files;
+    std::sort(sorted.begin(), sorted.end());
+    ASSERT_EQ(sorted, all);
+  }
+
+  vector<vector<string>> shards, just_one;
+  ShardFiles(files, 3, kShardByHash, &shards);
+  ShardFiles({files[1]}, 3, kShardByHash, &just_one);
+  for (size_t i = 0; i < 3; i++) {
+    bool has = std::find(shards[i].begin(), shards[i].end(), files[1]) !=
+               shards[i].end();
+    ASSERT_EQ(has, !just_one[i].empty());
+  }
+}
+
+}  // namespace hw4
@@ -0,0 +1,669 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./IndexBuilder.h"
+#include "./IndexReader.h"
+#include "./IndexFile.h"
+#include "./IndexWriter.h"
+#include "./MappedIndexFile.h"
+#include "./ResidentIndex.h"
+#include "./Scoring.h"
+#include "./test_suite.h"
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace hw4 {
+
+// The different kinds of reader the tests run against.
+static vector<IndexReaderOptions> AllReaderOptions() {
+  vector<IndexReaderOptions> ret;
+  IndexReaderOptions options;
+  options.backend = IndexReaderOptions::kPread;
+  ret.push_back(options);
+  options.backend = IndexReaderOptions::kMmap;
+  ret.push_back(options);
+  options.populate = true;
+  options.huge_pages = true;
+  ret.push_back(options);
+  options = IndexReaderOptions();
+  options.backend = IndexReaderOptions::kResident;
+  ret.push_back(options);
+  return ret;
+}
+
+// Copies file "from" to a new temporary file, flipping the bits of the
+// byte at "flip" (if flip >= 0) and keeping only the first "keep" bytes
+// (if keep >= 0).  Returns the new file's name.
+static string CopyIndex(const string& from, off_t flip, off_t keep) {
+  char name[] = "/tmp/hw4_test_index_XXXXXX";
+  int out = mkstemp(name);
+  int in = open(from.c_str(), O_RDONLY);
+  vector<char> buf(lseek(in, 0, SEEK_END));
+  pread(in, buf.data(), buf.size(), 0);
+  close(in);
+  if (flip >= 0) {
+    buf[flip] = ~buf[flip];
+  }
+  if (keep >= 0) {
+    buf.resize(keep);
+  }
+  write(out, buf.data(), buf.size());
+  close(out);
+  return name;
+}
+
+TEST(Test_IndexReader, TestIndexReaderLookups) {
+  string idx = WriteTestIndex("./test_files/tiny");
+
+  // The pread()-based reader is the reference for the others.
+  IndexFile reference(idx);
+  ASSERT_TRUE(reference.Open(true));
+
+  for (const IndexReaderOptions& options : AllReaderOptions()) {
+    unique_ptr<IndexReader> reader(IndexReader::Create(idx, options));
+    ASSERT_TRUE(reader->Open(true));
+    ASSERT_EQ(idx, reader->file_name());
+
+    for (const char* word : {"fox", "the", "quick", "naps", "wine"}) {
+      PostingList expected, actual;
+      ASSERT_TRUE(reference.LookupWord(word, &expected));
+      ASSERT_TRUE(reader->LookupWord(word, &actual));
+      ASSERT_EQ(expected.doc_ids(), actual.doc_ids());
+      ASSERT_EQ(expected.counts(), actual.counts());
+
+      for (DocID_t doc_id : actual.doc_ids()) {
+        string expected_name, actual_name;
+        ASSERT_TRUE(reference.LookupDocName(doc_id, &expected_name));
+        ASSERT_TRUE(reader->LookupDocName(doc_id, &actual_name));
+        ASSERT_EQ(expected_name, actual_name);
+      }
+    }
+
+    // Looking words up into the same list, as a QueryEngine does from
+    // query to query, must give what a fresh list gets.
+    PostingList reused;
+    for (const char* word : {"the", "naps", "fox", "the"}) {
+      PostingList fresh;
+      ASSERT_TRUE(reader->LookupWord(word, &fresh));
+      ASSERT_TRUE(reader->LookupWord(word, &reused));
+      ASSERT_EQ(fresh.doc_ids(), reused.doc_ids());
+      ASSERT_EQ(fresh.counts(), reused.counts());
+      ASSERT_EQ(fresh.max_impact(), reused.max_impact());
+      for (size_t i = 0; i < fresh.size(); i++) {
+        ASSERT_EQ(fresh.block_max_impact(i), reused.block_max_impact(i));
+      }
+    }
+
+    PostingList postings;
+    ASSERT_FALSE(reader->LookupWord("zebra", &postings));
+    ASSERT_FALSE(reader->LookupWord("", &postings));
+    string name;
+    ASSERT_FALSE(reader->LookupDocName(12345, &name));
+  }
+
+  unlink(idx.c_str());
+}
+
+TEST(Test_IndexReader, TestResidentIndex) {
+  string idx = WriteTestIndex("./test_files/tiny");
+  ResidentIndex resident(idx);
+  ASSERT_TRUE(resident.Open(true));
+
+  // test_files/tiny has four documents and 22 distinct words.
+  ASSERT_EQ(4U, resident.num_docs());
+  ASSERT_EQ(22U, resident.num_words());
+  ASSERT_LT(0U, resident.MemoryFootprint());
+
+  // Each word's postings are in docID order, with no duplicates.
+  PostingList postings;
+  ASSERT_TRUE(resident.LookupWord("the", &postings));
+  for (size_t i = 1; i < postings.size(); i++) {
+    ASSERT_LT(postings.doc_id(i - 1), postings.doc_id(i));
+  }
+
+  // Reopening decodes the file again from scratch.
+  ASSERT_TRUE(resident.Open(false));
+  ASSERT_EQ(4U, resident.num_docs());
+  PostingList again;
+  ASSERT_TRUE(resident.LookupWord("the", &again));
+  ASSERT_EQ(postings.doc_ids(), again.doc_ids());
+
+  unlink(idx.c_str());
+}
+
+TEST(Test_IndexReader, TestIndexReaderFormats) {
+  string v1 = WriteTestIndex("./test_files/tiny", 1);
+  string v2 = WriteTestIndex("./test_files/tiny", 2);
+
+  // Compressed postings take up less room.
+  struct stat st1, st2;
+  ASSERT_EQ(0, stat(v1.c_str(), &st1));
+  ASSERT_EQ(0, stat(v2.c_str(), &st2));
+  ASSERT_LT(st2.st_size, st1.st_size);
+
+  IndexFile reference(v1);
+  ASSERT_TRUE(reference.Open(true));
+  ASSERT_EQ(1, reference.format_version());
+
+  // Every reader must find the same documents, counts and names in the
+  // version 2 file as in the version 1 file.
+  for (const IndexReaderOptions& options : AllReaderOptions()) {
+    unique_ptr<IndexReader> reader(IndexReader::Create(v2, options));
+    ASSERT_TRUE(reader->Open(true));
+    ASSERT_EQ(2, reader->format_version());
+
+    // The names come from the document name pool, and must be the
+    // ones the doctable has.
+    ASSERT_TRUE(reader->has_doc_name_pool());
+    vector<DocID_t> expected_docs, actual_docs;
+    ASSERT_TRUE(reference.ListDocs(&expected_docs));
+    ASSERT_TRUE(reader->ListDocs(&actual_docs));
+    ASSERT_EQ(expected_docs, actual_docs);
+    ASSERT_EQ(expected_docs.size(), reader->num_docs());
+    string name;
+    for (DocID_t doc_id : actual_docs) {
+      string expected_name;
+      ASSERT_TRUE(reference.LookupDocName(doc_id, &expected_name));
+      ASSERT_TRUE(reader->LookupDocName(doc_id, &name));
+      ASSERT_EQ(expected_name, name);
+    }
+    ASSERT_FALSE(reader->LookupDocName(0, &name));
+    ASSERT_FALSE(reader->LookupDocName(actual_docs.size() + 1, &name));
+
+    for (const char* word : {"fox", "the", "quick", "brown", "naps",
+                             "wine", "dog", "red", "lazy"}) {
+      PostingList expected, actual;
+      ASSERT_EQ(reference.LookupWord(word, &expected),
+                reader->LookupWord(word, &actual));
+      ASSERT_EQ(expected.doc_ids(), actual.doc_ids());
+      ASSERT_EQ(expected.counts(), actual.counts());
+
+      // Document frequencies come without decoding postings, in both
+      // versions.
+      size_t expected_df = SIZE_MAX, actual_df = SIZE_MAX;
+      ASSERT_EQ(!expected.empty(),
+                reference.LookupDocFrequency(word, &expected_df));
+      ASSERT_EQ(!actual.empty(), reader->LookupDocFrequency(word, &actual_df));
+      if (!actual.empty()) {
+        ASSERT_EQ(expected.size(), expected_df);
+        ASSERT_EQ(actual.size(), actual_df);
+      }
+      for (DocID_t doc_id : actual.doc_ids()) {
+        string expected_name, actual_name;
+        ASSERT_TRUE(reference.LookupDocName(doc_id, &expected_name));
+        ASSERT_TRUE(reader->LookupDocName(doc_id, &actual_name));
+        ASSERT_EQ(expected_name, actual_name);
+      }
+    }
+    PostingList postings;
+    ASSERT_FALSE(reader->LookupWord("zebra", &postings));
+    size_t df;
+    ASSERT_FALSE(reader->LookupDocFrequency("zebra", &df));
+  }
+
+  ResidentIndex resident(v2);
+  ASSERT_TRUE(resident.Open(true));
+  ASSERT_EQ(4U, resident.num_docs());
+  ASSERT_EQ(22U, resident.num_words());
+
+  unlink(v1.c_str());
+  unlink(v2.c_str());
+}
+
+TEST(Test_IndexReader, TestIndexReaderWriteIndex) {
+  // hw4::WriteIndex() must write a version 1 file that reads back the
+  // same as hw3::WriteIndex()'s, positions and all.
+  string reference_file = WriteTestIndex("./test_files/tiny", 1);
+  char file_name[] = "/tmp/hw4_test_index_XXXXXX";
+  close(mkstemp(file_name));
+  DocTable* dt;
+  MemIndex* mi;
+  ASSERT_TRUE(ParallelCrawlFileTree("./test_files/tiny", 1, &dt, &mi));
+  int64_t bytes = WriteIndex(mi, dt, file_name);
+  ASSERT_EQ(0, WriteIndex(mi, dt, "/tmp/no_such_dir/hw4_test.idx"));
+  DocTable_Free(dt);
+  MemIndex_Free(mi);
+  struct stat st;
+  ASSERT_EQ(0, stat(file_name, &st));
+  ASSERT_EQ(st.st_size, bytes);
+
+  IndexFile reference(reference_file);
+  ASSERT_TRUE(reference.Open(true));
+  vector<DocID_t> expected_docs, actual_docs;
+  ASSERT_TRUE(reference.ListDocs(&expected_docs));
+  for (const IndexReaderOptions& options : AllReaderOptions()) {
+    unique_ptr<IndexReader> reader(IndexReader::Create(file_name, options));
+    ASSERT_TRUE(reader->Open(true));
+    ASSERT_EQ(1, reader->format_version());
+    ASSERT_TRUE(reader->ListDocs(&actual_docs));
+    ASSERT_EQ(expected_docs, actual_docs);
+    for (DocID_t doc_id : actual_docs) {
+      string expected_name, actual_name;
+      ASSERT_TRUE(reference.LookupDocName(doc_id, &expected_name));
+      ASSERT_TRUE(reader->LookupDocName(doc_id, &actual_name));
+      ASSERT_EQ(expected_name, actual_name);
+    }
+
+    for (const char* word : {"fox", "the", "quick", "brown", "naps",
+                             "wine", "dog", "red", "lazy", "zebra"}) {
+      PostingList expected, actual;
+      ASSERT_EQ(reference.LookupWord(word, &expected),
+                reader->LookupWord(word, &actual));
+      ASSERT_EQ(expected.doc_ids(), actual.doc_ids());
+      ASSERT_EQ(expected.counts(), actual.counts());
+      vector<vector<DocPositionOffset_t>> expected_positions,
+                                          actual_positions;
+      // (A ResidentIndex only keeps the positions of files with word
+      // positions.)
+      if (!actual.empty() &&
+          options.backend != IndexReaderOptions::kResident) {
+        ASSERT_TRUE(reference.LookupPositions(word, expected.doc_ids(),
+                                              &expected_positions));
+        ASSERT_TRUE(reader->LookupPositions(word, actual.doc_ids(),
+                                            &actual_positions));
+        ASSERT_EQ(expected_positions, actual_positions);
+      }
+    }
+  }
+
+  unlink(reference_file.c_str());
+  unlink(file_name);
+}
+
+TEST(Test_IndexReader, TestIndexReaderTermDictionary) {
+  string v1 = WriteTestIndex("./test_files/tiny", 1);
+  string v2 = WriteTestIndex("./test_files/tiny", 2);
+
+  for (const IndexReaderOptions& options : AllReaderOptions()) {
+    for (const string& idx : {v1, v2}) {
+      unique_ptr<IndexReader> reader(IndexReader::Create(idx, options));
+      ASSERT_TRUE(reader->Open(true));
+
+      // Version 1 files have no dictionary, but a resident index makes
+      // one for itself.
+      vector<string> words;
+      if (reader->format_version() == 1 &&
+          options.backend != IndexReaderOptions::kResident) {
+        ASSERT_FALSE(reader->has_term_dictionary());
+        ASSERT_TRUE(reader->ExpandPrefix("a", 10, &words));
+        ASSERT_TRUE(words.empty());
+        continue;
+      }
+      ASSERT_TRUE(reader->has_term_dictionary());
+
+      ASSERT_TRUE(reader->ExpandPrefix("a", 10, &words));
+      ASSERT_EQ(vector<string>({"a", "about", "afternoons", "and"}), words);
+      words.clear();
+      ASSERT_FALSE(reader->ExpandPrefix("", 5, &words));
+      ASSERT_EQ(vector<string>({"a", "about", "afternoons", "and", "bread"}),
+                words);
+      words.clear();
+      ASSERT_TRUE(reader->ExpandRange("dog", "jumps", 10, &words));
+      ASSERT_EQ(vector<string>({"dog", "fox", "it", "jumps"}), words);
+      words.clear();
+      ASSERT_TRUE(reader->ExpandRange("quib", "rat", 10, &words));
+      ASSERT_EQ(vector<string>({"quick"}), words);
+      words.clear();
+      ASSERT_TRUE(reader->ExpandPrefix("zebra", 10, &words));
+      ASSERT_TRUE(words.empty());
+
+      // Every word the dictionary has can be looked up.
+      words.clear();
+      ASSERT_TRUE(reader->ExpandPrefix("", 100, &words));
+      ASSERT_EQ(22U, words.size());
+      for (const string& word : words) {
+        PostingList postings;
+        ASSERT_TRUE(reader->LookupWord(word, &postings));
+      }
+    }
+  }
+
+  unlink(v1.c_str());
+  unlink(v2.c_str());
+}
+
+TEST(Test_IndexReader, TestIndexReaderTermFilter) {
+  string v1 = WriteTestIndex("./test_files/tiny", 1);
+  string v3 = WriteTestIndex("./test_files/tiny", 3);
+
+  for (const IndexReaderOptions& options : AllReaderOptions()) {
+    for (const string& idx : {v1, v3}) {
+      unique_ptr<IndexReader> reader(IndexReader::Create(idx, options));
+      ASSERT_TRUE(reader->Open(true));
+
+      // Version 1 files have no filter, so any word may be there.
+      if (reader->format_version() == 1) {
+        ASSERT_FALSE(reader->has_term_filter());
+        ASSERT_TRUE(reader->MayContain("zebra"));
+        continue;
+      }
+      ASSERT_TRUE(reader->has_term_filter());
+
+      // Every word in the index may be there, and lookups of words that
+      // aren't still fail, whether the filter catches them or not.
+      vector<string> words;
+      ASSERT_TRUE(reader->ExpandPrefix("", 100, &words));
+      for (const string& word : words) {
+        ASSERT_TRUE(reader->MayContain(word));
+      }
+      int ruled_out = 0;
+      char buf[32];
+      for (int i = 0; i < 100; i++) {
+        snprintf(buf, sizeof(buf), "absent%d", i);
+        ruled_out += !reader->MayContain(buf);
+        PostingList postings;
+        ASSERT_FALSE(reader->LookupWord(buf, &postings));
+      }
+      ASSERT_GT(ruled_out, 90);
+    }
+  }
+
+  unlink(v1.c_str());
+  unlink(v3.c_str());
+}
+
+TEST(Test_IndexReader, TestIndexReaderPositions) {
+  string v1 = WriteTestIndex("./test_files/tiny", 1);
+  string v2 = WriteTestIndex("./test_files/tiny", 2);
+
+  for (const IndexReaderOptions& options : AllReaderOptions()) {
+    // Version 2 files count positions in words: in a.txt, "The quick
+    // brown fox jumps over the lazy dog.  The dog sleeps."
+    unique_ptr<IndexReader> reader(IndexReader::Create(v2, options));
+    ASSERT_TRUE(reader->Open(true));
+    ASSERT_TRUE(reader->has_word_positions());
+
+    PostingList the, dog;
+    ASSERT_TRUE(reader->LookupWord("the", &the));
+    ASSERT_TRUE(reader->LookupWord("dog", &dog));
+    PostingList both_list = the;
+    both_list.IntersectWith(dog);
+    ASSERT_EQ(2U, both_list.size());   // a.txt and c.txt
+
+    vector<vector<DocPositionOffset_t>> positions;
+    ASSERT_TRUE(reader->LookupPositions("the", both_list.doc_ids(),
+                                        &positions));
+    ASSERT_EQ(2U, positions.size());
+    for (size_t i = 0; i < positions.size(); i++) {
+      ASSERT_EQ(static_cast<size_t>(3), positions[i].size());
+    }
+    ASSERT_TRUE(reader->LookupPositions("dog", both_list.doc_ids(),
+                                        &positions));
+    string name;
+    for (size_t i = 0; i < both_list.size(); i++) {
+      ASSERT_TRUE(reader->LookupDocName(both_list.doc_id(i), &name));
+      ASSERT_EQ(name == "./test_files/tiny/a.txt" ?
+                vector<DocPositionOffset_t>({8, 10}) :
+                vector<DocPositionOffset_t>({6}), positions[i]);
+    }
+
+    // Documents the word isn't in, and words that aren't there, fail.
+    PostingList red;
+    ASSERT_TRUE(reader->LookupWord("red", &red));
+    ASSERT_FALSE(reader->LookupPositions("red", dog.doc_ids(), &positions));
+    ASSERT_FALSE(reader->LookupPositions("zebra", {}, &positions));
+
+    // Version 1 files have byte offsets, which only the on-disk readers
+    // hand back.
+    reader.reset(IndexReader::Create(v1, options));
+    ASSERT_TRUE(reader->Open(true));
+    ASSERT_FALSE(reader->has_word_positions());
+    PostingList fox;
+    ASSERT_TRUE(reader->LookupWord("fox", &fox));
+    if (options.backend == IndexReaderOptions::kResident) {
+      ASSERT_FALSE(reader->LookupPositions("fox", fox.doc_ids(),
+                                           &positions));
+      continue;
+    }
+    ASSERT_TRUE(reader->LookupPositions("fox", fox.doc_ids(), &positions));
+    ASSERT_EQ(3U, positions.size());
+    for (size_t i = 0; i < fox.size(); i++) {
+      ASSERT_TRUE(reader->LookupDocName(fox.doc_id(i), &name));
+      if (name == "./test_files/tiny/a.txt") {
+        ASSERT_EQ(vector<DocPositionOffset_t>({16}), positions[i]);
+      }
+    }
+  }
+
+  unlink(v1.c_str());
+  unlink(v2.c_str());
+}
+
+TEST(Test_IndexReader, TestIndexReaderDocLengths) {
+  string v1 = WriteTestIndex("./test_files/tiny", 1);
+  string v3 = WriteTestIndex("./test_files/tiny", 3);
+  IndexFile reference(v1);
+  ASSERT_TRUE(reference.Open(true));
+  const vector<const char*> words = {"fox", "the", "quick", "brown", "naps",
+                                     "wine", "dog", "red", "lazy"};
+
+  // Word counts, from a.txt's "The quick brown fox jumps over the lazy
+  // dog.  The dog sleeps." on.
+  const std::map<string, uint32_t> lengths = {
+    {"./test_files/tiny/a.txt", 12}, {"./test_files/tiny/b.txt", 9},
+    {"./test_files/tiny/c.txt", 11}, {"./test_files/tiny/sub/d.txt", 9}
+  };
+  for (const IndexReaderOptions& options : AllReaderOptions()) {
+    for (const string& file : {v1, v3}) {
+      unique_ptr<IndexReader> reader(IndexReader::Create(file, options));
+      ASSERT_TRUE(reader->Open(true));
+      ASSERT_EQ(4U, reader->num_docs());
+
+      // Only version 3 files carry lengths, but resident indices work
+      // them out for older ones.
+      bool v3_file = reader->format_version() == 3;
+      if (!v3_file && options.backend != IndexReaderOptions::kResident) {
+        ASSERT_FALSE(reader->has_doc_lengths());
+        ASSERT_EQ(0U, reader->doc_length(1));
+        ASSERT_EQ(0.0, reader->average_doc_length());
+        continue;
+      }
+      ASSERT_TRUE(reader->has_doc_lengths());
+      ASSERT_DOUBLE_EQ(10.25, reader->average_doc_length());
+      ASSERT_EQ(0U, reader->doc_length(12345));
+
+      for (const char* word : words) {
+        PostingList expected, actual;
+        ASSERT_TRUE(reference.LookupWord(word, &expected));
+        ASSERT_TRUE(reader->LookupWord(word, &actual));
+        ASSERT_EQ(expected.doc_ids(), actual.doc_ids());
+        ASSERT_EQ(expected.counts(), actual.counts());
+
+        // The word's impact bound holds in every one of its documents,
+        // and is tight in at least one.
+        ASSERT_LT(0U, actual.max_impact());
+        uint32_t max_impact = 0;
+        for (size_t i = 0; i < actual.size(); i++) {
+          string name;
+          ASSERT_TRUE(reader->LookupDocName(actual.doc_id(i), &name));
+          uint32_t dl = reader->doc_length(actual.doc_id(i));
+          ASSERT_EQ(lengths.at(name), dl);
+          max_impact = std::max(max_impact, QuantizeImpact(BM25Weight(
+              actual.count(i), dl, reader->average_doc_length())));
+        }
+        ASSERT_EQ(max_impact, actual.max_impact());
+      }
+    }
+  }
+
+  unlink(v1.c_str());
+  unlink(v3.c_str());
+}
+
+TEST(Test_IndexReader, TestIndexReaderMerge) {
+  // test_files/tiny/sub's one document is also in test_files/tiny, so
+  // the merge keeps it from the second input, and numbers it last.
+  string tiny = WriteTestIndex("./test_files/tiny", 3);
+  string sub = WriteTestIndex("./test_files/tiny/sub", 3);
+  string merged = CopyIndex(tiny, -1, 0);
+  MergeStats stats;
+  ASSERT_LT(0, MergeIndexFiles({tiny, sub}, merged.c_str(), 3, &stats));
+  ASSERT_EQ(5U, stats.docs_in);
+  ASSERT_EQ(4U, stats.docs_out);
+  ASSERT_EQ(22U, stats.words);
+
+  IndexFile reference(tiny);
+  ASSERT_TRUE(reference.Open(true));
+  vector<string> words;
+  ASSERT_TRUE(reference.ExpandPrefix("", SIZE_MAX, &words));
+  ASSERT_EQ(22U, words.size());
+  for (const IndexReaderOptions& options : AllReaderOptions()) {
+    unique_ptr<IndexReader> reader(IndexReader::Create(merged, options));
+    ASSERT_TRUE(reader->Open(true));
+    ASSERT_EQ(3, reader->format_version());
+    ASSERT_TRUE(reader->has_doc_name_pool());
+    ASSERT_EQ(4U, reader->num_docs());
+    vector<DocID_t> doc_ids;
+    ASSERT_TRUE(reader->ListDocs(&doc_ids));
+    ASSERT_EQ(vector<DocID_t>({1, 2, 3, 4}), doc_ids);
+    string name;
+    ASSERT_TRUE(reader->LookupDocName(4, &name));
+    ASSERT_EQ("./test_files/tiny/sub/d.txt", name);
+    ASSERT_DOUBLE_EQ(10.25, reader->average_doc_length());
+
+    // Every word has the same documents (by name), counts, positions,
+    // and impact bound as in the original index.
+    vector<string> merged_words;
+    ASSERT_TRUE(reader->ExpandPrefix("", SIZE_MAX, &merged_words));
+    ASSERT_EQ(words, merged_words);
+    for (const string& word : words) {
+      PostingList expected, actual;
+      ASSERT_TRUE(reference.LookupWord(word, &expected));
+      ASSERT_TRUE(reader->LookupWord(word, &actual));
+      ASSERT_EQ(expected.max_impact(), actual.max_impact());
+      std::map<string, int32_t> expected_counts, actual_counts;
+      for (size_t i = 0; i < expected.size(); i++) {
+        ASSERT_TRUE(reference.LookupDocName(expected.doc_id(i), &name));
+        expected_counts[name] = expected.count(i);
+      }
+      for (size_t i = 0; i < actual.size(); i++) {
+        ASSERT_TRUE(reader->LookupDocName(actual.doc_id(i), &name));
+        actual_counts[name] = actual.count(i);
+      }
+      ASSERT_EQ(expected_counts, actual_counts);
+
+      vector<vector<DocPositionOffset_t>> expected_positions, positions;
+      ASSERT_TRUE(reference.LookupPositions(word, expected.doc_ids(),
+                                            &expected_positions));
+      ASSERT_TRUE(reader->LookupPositions(word, actual.doc_ids(),
+                                          &positions));
+      std::sort(expected_positions.begin(), expected_positions.end());
+      std::sort(positions.begin(), positions.end());
+      ASSERT_EQ(expected_positions, positions);
+    }
+  }
+
+  // Version 2 merges take version 3 inputs, but not the other way
+  // around.
+  ASSERT_LT(0, MergeIndexFiles({merged}, sub.c_str(), 2));
+  IndexFile v2(sub);
+  ASSERT_TRUE(v2.Open(true));
+  ASSERT_EQ(2, v2.format_version());
+  ASSERT_EQ(4U, v2.num_docs());
+  unlink(tiny.c_str());
+  ASSERT_EQ(0, MergeIndexFiles({sub}, tiny.c_str(), 3));
+
+  // Nor do version 1 inputs, which have no document lengths.  Their
+  // words are read out of their hash tables, and their positions, byte
+  // offsets, are copied as they are.
+  string v1 = WriteTestIndex("./test_files/tiny", 1);
+  ASSERT_EQ(0, MergeIndexFiles({v1}, tiny.c_str(), 3));
+  ASSERT_NE(0, access(tiny.c_str(), F_OK));
+  IndexReaderOptions build_dictionary;
+  build_dictionary.backend = IndexReaderOptions::kPread;
+  build_dictionary.build_term_dictionary = true;
+  unique_ptr<IndexReader> original(IndexReader::Create(v1, build_dictionary));
+  ASSERT_TRUE(original->Open(true));
+  vector<string> v1_words;
+  ASSERT_TRUE(original->ExpandPrefix("", SIZE_MAX, &v1_words));
+  ASSERT_EQ(words, v1_words);
+  ASSERT_LT(0, MergeIndexFiles({v1}, tiny.c_str(), 2));
+  IndexFile from_v1(tiny);
+  ASSERT_TRUE(from_v1.Open(true));
+  ASSERT_EQ(2, from_v1.format_version());
+  ASSERT_FALSE(from_v1.has_word_positions());
+  ASSERT_EQ(4U, from_v1.num_docs());
+  v1_words.clear();
+  ASSERT_TRUE(from_v1.ExpandPrefix("", SIZE_MAX, &v1_words));
+  ASSERT_EQ(words, v1_words);
+  for (const string& word : words) {
+    PostingList expected, actual;
+    ASSERT_TRUE(original->LookupWord(word, &expected));
+    ASSERT_TRUE(from_v1.LookupWord(word, &actual));
+    ASSERT_EQ(expected.doc_ids(), actual.doc_ids());
+    ASSERT_EQ(expected.counts(), actual.counts());
+    vector<vector<DocPositionOffset_t>> expected_positions, positions;
+    ASSERT_TRUE(original->LookupPositions(word, expected.doc_ids(),
+                                          &expected_positions));
+    ASSERT_TRUE(from_v1.LookupPositions(word, actual.doc_ids(),
+                                        &positions));
+    ASSERT_EQ(expected_positions, positions);
+  }
+
+  unlink(tiny.c_str());
+  unlink(sub.c_str());
+  unlink(merged.c_str());
+  unlink(v1.c_str());
+}
+
+TEST(Test_IndexReader, TestIndexReaderBadFiles) {
+  for (int version : {1, 2}) {
+    string idx = WriteTestIndex("./test_files/tiny", version);
+    string corrupt = CopyIndex(idx, 100, -1);
+    string truncated = CopyIndex(idx, -1, 100);
+    string empty = CopyIndex(idx, -1, 0);
+
+    for (const IndexReaderOptions& options : AllReaderOptions()) {
+      unique_ptr<IndexReader> reader;
+
+      // A flipped byte is only caught when the checksum is validated,
+      // at open or afterwards.
+      reader.reset(IndexReader::Create(corrupt, options));
+      ASSERT_FALSE(reader->Open(true));
+      reader.reset(IndexReader::Create(corrupt, options));
+      ASSERT_TRUE(reader->Open(false));
+      ASSERT_FALSE(reader->VerifyChecksum());
+      reader.reset(IndexReader::Create(idx, options));
+      ASSERT_TRUE(reader->Open(false));
+      ASSERT_TRUE(reader->VerifyChecksum());
+
+      reader.reset(IndexReader::Create(truncated, options));
+      ASSERT_FALSE(reader->Open(false));
+      reader.reset(IndexReader::Create(empty, options));
+      ASSERT_FALSE(reader->Open(false));
+      reader.reset(IndexReader::Create("./test_files/hextext.txt", options));
+      ASSERT_FALSE(reader->Open(false));
+      reader.reset(IndexReader::Create("./test_files/no_such.idx", options));
+      ASSERT_FALSE(reader->Open(false));
+    }
+
+    unlink(idx.c_str());
+    unlink(corrupt.c_str());
+    unlink(truncated.c_str());
+    unlink(empty.c_str());
+  }
+}
+
+}  // namespace hw4
@@ -0,0 +1,168 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdlib.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./PostingCodec.h"
+
+using std::vector;
+
+namespace hw4 {
+
+TEST(Test_PostingCodec, TestPostingCodecVarint) {
+  const uint64_t values[] = {
+    0, 1, 127, 128, 300, 16383, 16384, UINT32_MAX, 1ULL << 35, UINT64_MAX
+  };
+  vector<uint8_t> buf;
+  for (uint64_t value : values) {
+    PutVarint(value, &buf);
+  }
+  const uint8_t* p = buf.data();
+  const uint8_t* end = buf.data() + buf.size();
+  for (uint64_t value : values) {
+    uint64_t decoded;
+    ASSERT_TRUE(GetVarint(&p, end, &decoded));
+    ASSERT_EQ(value, decoded);
+  }
+  ASSERT_EQ(end, p);
+
+  // Running off the end, or past 64 bits, is an error.
+  uint64_t decoded;
+  ASSERT_FALSE(GetVarint(&p, end, &decoded));
+  vector<uint8_t> endless(11, 0xFF);
+  p = endless.data();
+  ASSERT_FALSE(GetVarint(&p, endless.data() + endless.size(), &decoded));
+}
+
+TEST(Test_PostingCodec, TestPostingCodecStreamVByte) {
+  // Every length of run, so that the four-at-a-time decoder and its
+  // one-at-a-time tail both get exercised, with values of every width.
+  srand(333);
+  for (size_t n = 0; n < 70; n++) {
+    vector<uint32_t> in(n);
+    for (size_t i = 0; i < n; i++) {
+      int width = rand() % 4;
+      in[i] = static_cast<uint32_t>(rand()) >> (8 * (3 - width));
+    }
+    vector<uint8_t> buf;
+    StreamVByteEncode(in.data(), n, &buf);
+
+    vector<uint32_t> out(n);
+    const uint8_t* p = buf.data();
+    ASSERT_TRUE(StreamVByteDecode(&p, buf.data() + buf.size(), n,
+                                  out.data()));
+    ASSERT_EQ(buf.data() + buf.size(), p);
+    ASSERT_EQ(in, out);
+
+    // Cutting off the last byte must be caught.
+    if (n > 0) {
+      p = buf.data();
+      ASSERT_FALSE(StreamVByteDecode(&p, buf.data() + buf.size() - 1, n,
+                                     out.data()));
+    }
+  }
+}
+
+TEST(Test_PostingCodec, TestPostingCodecPostings) {
+  // Enough documents for several blocks, including a docID gap too big
+  // for 32 bits.
+  vector<DocID_t> doc_ids;
+  vector<vector<DocPositionOffset_t>> positions;
+  DocID_t doc = 0;
+  for (int i = 0; i < 1000; i++) {
+    doc += 1 + i % 7;
+    if (i == 500) {
+      doc += 1ULL << 40;
+    }
+    doc_ids.push_back(doc);
+    vector<DocPositionOffset_t> pos;
+    for (int j = 0; j <= i % 5; j++) {
+      pos.push_back(j * 1000 + i);
+    }
+    positions.push_back(pos);
+  }
+
+  vector<uint8_t> buf;
+  EncodePostings(doc_ids, positions, &buf);
+  PostingList postings;
+  ASSERT_TRUE(DecodePostings(buf.data(), buf.size(), &postings));
+  ASSERT_EQ(doc_ids, postings.doc_ids());
+  for (size_t i = 0; i < positions.size(); i++) {
+    ASSERT_EQ(static_cast<int32_t>(positions[i].size()), postings.count(i));
+  }
+
+  // Any sorted subset of the documents gets its positions back, whether
+  // its documents share blocks or not.
+  for (size_t step : {1, 3, 200, 999}) {
+    vector<DocID_t> wanted;
+    vector<vector<DocPositionOffset_t>> expected, actual;
+    for (size_t i = step / 2; i < doc_ids.size(); i += step) {
+      wanted.push_back(doc_ids[i]);
+      expected.push_back(positions[i]);
+    }
+    ASSERT_TRUE(DecodePositions(buf.data(), buf.size(), wanted, &actual));
+    ASSERT_EQ(expected, actual);
+  }
+  vector<vector<DocPositionOffset_t>> found;
+  ASSERT_TRUE(DecodePositions(buf.data(), buf.size(), {}, &found));
+  ASSERT_TRUE(found.empty());
+
+  // Asking for a document that isn't there is an error.
+  ASSERT_FALSE(DecodePositions(buf.data(), buf.size(),
+                               {doc_ids[0], doc_ids[1] + 1}, &found));
+  ASSERT_FALSE(DecodePositions(buf.data(), buf.size(),
+                               {doc_ids.back() + 1}, &found));
+
+  // An empty list, and a single document.
+  buf.clear();
+  EncodePostings({}, {}, &buf);
+  ASSERT_TRUE(DecodePostings(buf.data(), buf.size(), &postings));
+  ASSERT_TRUE(postings.empty());
+  buf.clear();
+  EncodePostings({42}, {{3, 9}}, &buf);
+  ASSERT_TRUE(DecodePostings(buf.data(), buf.size(), &postings));
+  ASSERT_EQ(vector<DocID_t>({42}), postings.doc_ids());
+  ASSERT_EQ(vector<int32_t>({2}), postings.counts());
+
+  // No prefix of a posting list is a valid posting list.
+  buf.clear();
+  EncodePostings(doc_ids, positions, &buf);
+  for (size_t len = 0; len < buf.size(); len += 7) {
+    ASSERT_FALSE(DecodePostings(buf.data(), len, &postings));
+  }
+
+  // With impacts, the list also carries the largest of them, and
+  // decodes to the same documents and positions.
+  vector<uint32_t> impacts;
+  for (size_t i = 0; i < doc_ids.size(); i++) {
+    impacts.push_back(1000 + (i * 7919) % 1200);
+  }
+  vector<uint8_t> with_impacts;
+  EncodePostings(doc_ids, positions, &with_impacts, &impacts);
+  ASSERT_LT(buf.size(), with_impacts.size());
+  ASSERT_TRUE(DecodePostings(with_impacts.data(), with_impacts.size(),
+                             &postings, true));
+  ASSERT_EQ(doc_ids, postings.doc_ids());
+  ASSERT_EQ(*std::max_element(impacts.begin(), impacts.end()),
+            postings.max_impact());
+  vector<vector<DocPositionOffset_t>> actual;
+  ASSERT_TRUE(DecodePositions(with_impacts.data(), with_impacts.size(),
+                              doc_ids, &actual, true));
+  ASSERT_EQ(positions, actual);
+  ASSERT_TRUE(DecodePostings(buf.data(), buf.size(), &postings));
+  ASSERT_EQ(0U, postings.max_impact());
+}
+
+}  // namespace hw4
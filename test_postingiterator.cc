@@ -0,0 +1,151 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+
+#include <stdlib.h>
+
+#include <map>
+#include <memory>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./PostingIterator.h"
+#include "./test_suite.h"
+
+using std::map;
+using std::unique_ptr;
+using std::vector;
+
+namespace hw4 {
+
+static unique_ptr<PostingIterator> Term(const PostingList& list) {
+  return unique_ptr<PostingIterator>(new TermIterator(&list));
+}
+
+// Walks "it" to the end, returning each document's count.
+static map<DocID_t, int32_t> Drain(PostingIterator* it) {
+  map<DocID_t, int32_t> ret;
+  DocID_t prev = 0;
+  for (; it->doc_id() != PostingIterator::kEnd; it->Next()) {
+    EXPECT_TRUE(ret.empty() || it->doc_id() > prev);
+    prev = it->doc_id();
+    ret[it->doc_id()] = it->count();
+  }
+  return ret;
+}
+
+TEST(Test_PostingIterator, TestTermIterator) {
+  PostingList list = MakeList(3, 1000, 7, 2);
+  TermIterator it(&list);
+  ASSERT_EQ(3U, it.doc_id());
+  ASSERT_EQ(2, it.count());
+  it.SeekTo(3);
+  ASSERT_EQ(3U, it.doc_id());
+  it.SeekTo(4);
+  ASSERT_EQ(10U, it.doc_id());
+  it.SeekTo(500);
+  ASSERT_EQ(500U, it.doc_id());   // 3 + 71 * 7
+  it.SeekTo(2);                   // never moves back
+  ASSERT_EQ(500U, it.doc_id());
+  it.Next();
+  ASSERT_EQ(507U, it.doc_id());
+  it.SeekTo(998);   // past 997, the last
+  ASSERT_EQ(PostingIterator::kEnd, it.doc_id());
+  ASSERT_EQ(0, it.count());
+
+  PostingList empty;
+  TermIterator none(&empty);
+  ASSERT_EQ(PostingIterator::kEnd, none.doc_id());
+  ASSERT_EQ(500U, Drain(Term(MakeList(0, 1000, 2, 1)).get()).size());
+}
+
+TEST(Test_PostingIterator, TestAndOrIterators) {
+  PostingList twos = MakeList(0, 3000, 2, 1);
+  PostingList threes = MakeList(0, 3000, 3, 10);
+  PostingList fives = MakeList(0, 3000, 5, 100);
+  PostingList sevens = MakeList(0, 3000, 7, 1000);
+
+  // (twos OR threes) AND NOT fives AND NOT sevens, and twos AND
+  // threes, against the same worked out one document at a time.
+  vector<unique_ptr<PostingIterator>> either, required, excluded;
+  either.push_back(Term(twos));
+  either.push_back(Term(threes));
+  required.push_back(unique_ptr<PostingIterator>(
+      new OrIterator(std::move(either))));
+  excluded.push_back(Term(fives));
+  excluded.push_back(Term(sevens));
+  AndIterator and_not(std::move(required), std::move(excluded));
+
+  vector<unique_ptr<PostingIterator>> both;
+  both.push_back(Term(sevens));   // the cheapest goes first regardless
+  both.push_back(Term(twos));
+  both.push_back(Term(threes));
+  AndIterator all(std::move(both), {});
+
+  map<DocID_t, int32_t> expected_and_not, expected_all;
+  for (DocID_t d = 0; d < 3000; d++) {
+    if ((d % 2 == 0 || d % 3 == 0) && d % 5 != 0 && d % 7 != 0) {
+      expected_and_not[d] = (d % 2 == 0 ? 1 : 0) + (d % 3 == 0 ? 10 : 0);
+    }
+    if (d % 42 == 0) {
+      expected_all[d] = 1011;
+    }
+  }
+  ASSERT_EQ(expected_and_not, Drain(&and_not));
+  ASSERT_EQ(expected_all, Drain(&all));
+}
+
+TEST(Test_PostingIterator, TestIteratorSeeks) {
+  // Seeking a tree lands on the same documents as stepping through it.
+  PostingList a = MakeList(0, 5000, 3, 1);
+  PostingList b = MakeList(1, 5000, 4, 1);
+  PostingList c = MakeList(0, 5000, 11, 1);
+  srand(333);
+  for (int trial = 0; trial < 20; trial++) {
+    vector<unique_ptr<PostingIterator>> any, required, excluded;
+    any.push_back(Term(a));
+    any.push_back(Term(b));
+    OrIterator or_it(std::move(any));
+    required.push_back(Term(a));
+    excluded.push_back(Term(c));
+    AndIterator and_it(std::move(required), std::move(excluded));
+    map<DocID_t, int32_t> or_docs = Drain(&or_it);
+
+    vector<unique_ptr<PostingIterator>> any2, required2, excluded2;
+    any2.push_back(Term(a));
+    any2.push_back(Term(b));
+    OrIterator or_seek(std::move(any2));
+    required2.push_back(Term(a));
+    excluded2.push_back(Term(c));
+    AndIterator and_seek(std::move(required2), std::move(excluded2));
+    DocID_t target = 0;
+    while (target < 5000) {
+      target += rand() % 100;
+      or_seek.SeekTo(target);
+      and_seek.SeekTo(target);
+      auto expected = or_docs.lower_bound(target);
+      if (expected == or_docs.end()) {
+        ASSERT_EQ(PostingIterator::kEnd, or_seek.doc_id());
+      } else {
+        ASSERT_EQ(expected->first, or_seek.doc_id());
+        ASSERT_EQ(expected->second, or_seek.count());
+      }
+      DocID_t want = target;
+      while (want < 5000 && (want % 3 != 0 || want % 11 == 0)) {
+        want++;
+      }
+      ASSERT_EQ(want < 5000 ? want : PostingIterator::kEnd,
+                and_seek.doc_id());
+    }
+  }
+}
+
+}  // namespace hw4
@@ -0,0 +1,194 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <malloc.h>
+#include <stdlib.h>
+
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./PostingList.h"
+#include "./test_suite.h"
+
+using std::vector;
+
+namespace hw4 {
+
+static const PostingList::IntersectMethod kAllMethods[] = {
+  PostingList::kMerge, PostingList::kGallop,
+  PostingList::kBlock, PostingList::kAuto
+};
+
+TEST(Test_PostingList, TestPostingListSort) {
+  PostingList list;
+  list.Append(5, 50);
+  list.Append(1, 10);
+  list.Append(3, 30);
+  list.SortByDocID();
+  ASSERT_EQ(vector<DocID_t>({1, 3, 5}), list.doc_ids());
+  ASSERT_EQ(vector<int32_t>({10, 30, 50}), list.counts());
+}
+
+TEST(Test_PostingList, TestPostingListTrim) {
+  PostingList small, big;
+  small.Reserve(10);
+  big.Reserve(kMaxKeptPostings + 1);
+  big.Append(1, 10);
+  small.Trim(kMaxKeptPostings);
+  big.Trim(kMaxKeptPostings);
+  ASSERT_LE(10U, small.capacity());
+  ASSERT_EQ(0U, big.capacity());
+  ASSERT_TRUE(big.empty());
+
+  vector<int> buffer(100);
+  TrimBuffer(&buffer, 100);
+  ASSERT_EQ(100U, buffer.size());
+  TrimBuffer(&buffer, 99);
+  ASSERT_EQ(0U, buffer.capacity());
+
+  // Sorting a huge list mustn't leave the thread's sort buffers holding
+  // room for all of it once the list is gone.
+  size_t before = mallinfo2().uordblks;
+  {
+    PostingList huge;
+    for (DocID_t d = 16 * kMaxKeptPostings; d > 0; d--) {
+      huge.Append(d, 1);
+    }
+    huge.SortByDocID();
+    ASSERT_EQ(1U, huge.doc_id(0));
+  }
+  size_t after = mallinfo2().uordblks;
+  ASSERT_LT(after, before + kMaxKeptPostings *
+                   (sizeof(size_t) + sizeof(DocID_t) + sizeof(int32_t)));
+}
+
+TEST(Test_PostingList, TestPostingListUnion) {
+  // Multiples of 2 and of 3 together, with the multiples of 6 in both.
+  PostingList a = MakeList(0, 1000, 2, 1);
+  a.UnionWith(MakeList(0, 1000, 3, 10));
+  PostingList expected;
+  for (DocID_t d = 0; d < 1000; d++) {
+    if (d % 2 == 0 || d % 3 == 0) {
+      expected.Append(d, (d % 2 == 0 ? 1 : 0) + (d % 3 == 0 ? 10 : 0));
+    }
+  }
+  ASSERT_EQ(expected.doc_ids(), a.doc_ids());
+  ASSERT_EQ(expected.counts(), a.counts());
+
+  // Either side can be empty.
+  PostingList empty;
+  empty.UnionWith(MakeList(5, 8, 1, 2));
+  ASSERT_EQ(vector<DocID_t>({5, 6, 7}), empty.doc_ids());
+  empty.UnionWith(PostingList());
+  ASSERT_EQ(vector<int32_t>({2, 2, 2}), empty.counts());
+}
+
+TEST(Test_PostingList, TestPostingListRemoveDocs) {
+  // Drop the multiples of 3 from the multiples of 2, including docIDs
+  // the list doesn't have and one past its end.
+  PostingList a = MakeList(0, 1000, 2, 1);
+  a.RemoveDocs(MakeList(0, 1003, 3, 1).doc_ids());
+  PostingList expected;
+  for (DocID_t d = 0; d < 1000; d += 2) {
+    if (d % 3 != 0) {
+      expected.Append(d, 1);
+    }
+  }
+  ASSERT_EQ(expected.doc_ids(), a.doc_ids());
+  ASSERT_EQ(expected.counts(), a.counts());
+
+  // Removing nothing, or everything.
+  a.RemoveDocs({});
+  ASSERT_EQ(expected.doc_ids(), a.doc_ids());
+  a.RemoveDocs(MakeList(0, 1000, 1, 1).doc_ids());
+  ASSERT_TRUE(a.empty());
+}
+
+TEST(Test_PostingList, TestPostingListIntersect) {
+  for (PostingList::IntersectMethod method : kAllMethods) {
+    // Multiples of 2 and of 3 meet at the multiples of 6, in both
+    // directions and whichever list is shorter.
+    PostingList a = MakeList(0, 1000, 2, 1);
+    a.IntersectWith(MakeList(0, 1000, 3, 10), method);
+    ASSERT_EQ(MakeList(0, 1000, 6, 11).doc_ids(), a.doc_ids());
+    ASSERT_EQ(MakeList(0, 1000, 6, 11).counts(), a.counts());
+
+    PostingList b = MakeList(0, 1000, 3, 10);
+    b.IntersectWith(MakeList(0, 1000, 2, 1), method);
+    ASSERT_EQ(MakeList(0, 1000, 6, 11).doc_ids(), b.doc_ids());
+    ASSERT_EQ(MakeList(0, 1000, 6, 11).counts(), b.counts());
+
+    // A very short list against a very long one.
+    PostingList rare;
+    rare.Append(7, 1);
+    rare.Append(500, 1);
+    rare.Append(999, 1);
+    rare.Append(5000, 1);
+    PostingList common = MakeList(0, 1000, 1, 2);
+    rare.IntersectWith(common, method);
+    ASSERT_EQ(vector<DocID_t>({7, 500, 999}), rare.doc_ids());
+    ASSERT_EQ(vector<int32_t>({3, 3, 3}), rare.counts());
+    common.IntersectWith(MakeList(990, 2000, 1, 1), method);
+    ASSERT_EQ(MakeList(990, 1000, 1, 3).doc_ids(), common.doc_ids());
+
+    // Empty and disjoint lists.
+    PostingList empty;
+    PostingList c = MakeList(0, 100, 1, 1);
+    c.IntersectWith(empty, method);
+    ASSERT_TRUE(c.empty());
+    empty.IntersectWith(MakeList(0, 100, 1, 1), method);
+    ASSERT_TRUE(empty.empty());
+    PostingList d = MakeList(0, 100, 2, 1);
+    d.IntersectWith(MakeList(1, 100, 2, 1), method);
+    ASSERT_TRUE(d.empty());
+
+    // Docs with the top bit set must still compare as unsigned.
+    PostingList big;
+    big.Append(1, 1);
+    big.Append(0x8000000000000000ULL, 1);
+    big.Append(0xFFFFFFFFFFFFFFFFULL, 1);
+    PostingList big2 = big;
+    big2.Append(0, 1);
+    big2.SortByDocID();
+    big.IntersectWith(big2, method);
+    ASSERT_EQ(3U, big.size());
+  }
+}
+
+TEST(Test_PostingList, TestPostingListIntersectRandom) {
+  // All of the methods must agree with a plain merge on random lists
+  // of very different lengths.
+  srand(333);
+  for (int round = 0; round < 200; round++) {
+    PostingList a, b;
+    int a_stride = 1 + rand() % 50, b_stride = 1 + rand() % 3;
+    for (DocID_t d = rand() % 5; d < 3000; d += 1 + rand() % a_stride) {
+      a.Append(d, 1);
+    }
+    for (DocID_t d = rand() % 5; d < 3000; d += 1 + rand() % b_stride) {
+      b.Append(d, 2);
+    }
+
+    PostingList expected = a;
+    expected.IntersectWith(b, PostingList::kMerge);
+    for (PostingList::IntersectMethod method : kAllMethods) {
+      PostingList x = a, y = b;
+      x.IntersectWith(b, method);
+      y.IntersectWith(a, method);
+      ASSERT_EQ(expected.doc_ids(), x.doc_ids());
+      ASSERT_EQ(expected.counts(), x.counts());
+      ASSERT_EQ(expected.doc_ids(), y.doc_ids());
+      ASSERT_EQ(expected.counts(), y.counts());
+    }
+  }
+}
+
+}  // namespace hw4
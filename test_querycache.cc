@@ -0,0 +1,166 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./QueryCache.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// Returns a page of results with "n" documents on it.
+static QueryCache::Results MakeResults(int n) {
+  QueryEngine::ResultPage page;
+  page.results.resize(n);
+  for (int i = 0; i < n; i++) {
+    page.results[i].document_name = "doc" + std::to_string(i) + ".txt";
+    page.results[i].rank = n - i;
+  }
+  page.total = n;
+  return std::make_shared<const QueryEngine::ResultPage>(page);
+}
+
+TEST(Test_QueryCache, TestQueryCacheNormalize) {
+  string key = QueryCache::NormalizeQuery({"quick", "brown"});
+  ASSERT_EQ(key, QueryCache::NormalizeQuery({"brown", "quick"}));
+  ASSERT_EQ(key, QueryCache::NormalizeQuery({"Brown", "QUICK"}));
+
+  // Repeated words change the ranking, so they change the key.
+  ASSERT_NE(QueryCache::NormalizeQuery({"fox"}),
+            QueryCache::NormalizeQuery({"fox", "fox"}));
+  ASSERT_EQ(QueryCache::NormalizeQuery({"fox", "dog", "fox"}),
+            QueryCache::NormalizeQuery({"fox", "fox", "dog"}));
+
+  // Different words can't run together into the same key.
+  ASSERT_NE(QueryCache::NormalizeQuery({"ab", "c"}),
+            QueryCache::NormalizeQuery({"a", "bc"}));
+  ASSERT_NE(QueryCache::NormalizeQuery({}),
+            QueryCache::NormalizeQuery({""}));
+
+  // Order matters once a query has phrases or NEAR/k in it.
+  ASSERT_NE(QueryCache::NormalizeQuery({"a", "NEAR/2", "b", "c"}),
+            QueryCache::NormalizeQuery({"a", "b", "near/2", "c"}));
+  ASSERT_NE(QueryCache::NormalizeQuery({"\"a", "b\"", "c"}),
+            QueryCache::NormalizeQuery({"\"a", "c\"", "b"}));
+  ASSERT_EQ(QueryCache::NormalizeQuery({"a", "NEAR/2", "b"}),
+            QueryCache::NormalizeQuery({"A", "near/2", "B"}));
+
+  // ...and boolean operators, which keep their case.
+  ASSERT_NE(QueryCache::NormalizeQuery({"a", "OR", "b", "c"}),
+            QueryCache::NormalizeQuery({"c", "OR", "a", "b"}));
+  ASSERT_NE(QueryCache::NormalizeQuery({"a", "OR", "b"}),
+            QueryCache::NormalizeQuery({"a", "or", "b"}));
+  ASSERT_NE(QueryCache::NormalizeQuery({"a", "-b"}),
+            QueryCache::NormalizeQuery({"-a", "b"}));
+
+  // Every page of a query gets its own key.
+  ASSERT_EQ(QueryCache::PageKey({"quick", "brown"}, 10, 10),
+            QueryCache::PageKey({"brown", "quick"}, 10, 10));
+  ASSERT_NE(QueryCache::PageKey({"fox"}, 0, 10),
+            QueryCache::PageKey({"fox"}, 10, 10));
+  ASSERT_NE(QueryCache::PageKey({"fox"}, 0, 10),
+            QueryCache::PageKey({"fox"}, 0, 20));
+}
+
+TEST(Test_QueryCache, TestQueryCacheBasic) {
+  QueryCache cache(1024 * 1024, 4);
+  string key = QueryCache::NormalizeQuery({"fox"});
+  ASSERT_EQ(nullptr, cache.Lookup(key));
+
+  QueryCache::Results results = MakeResults(3);
+  cache.Insert(key, cache.generation(), results);
+  QueryCache::Results found = cache.Lookup(key);
+  ASSERT_NE(nullptr, found);
+  ASSERT_EQ(3U, found->results.size());
+  ASSERT_EQ(3U, found->total);
+  ASSERT_EQ("doc0.txt", found->results[0].document_name);
+
+  cache.RecordLatency(true, 10);
+  cache.RecordLatency(false, 1000);
+  QueryCache::Stats stats = cache.GetStats();
+  ASSERT_EQ(1U, stats.hits);
+  ASSERT_EQ(1U, stats.misses);
+  ASSERT_EQ(1U, stats.inserts);
+  ASSERT_EQ(1U, stats.entries);
+  ASSERT_LT(0U, stats.bytes);
+  ASSERT_EQ(10U, stats.total_hit_us);
+  ASSERT_EQ(1000U, stats.total_miss_us);
+}
+
+TEST(Test_QueryCache, TestQueryCacheInvalidate) {
+  QueryCache cache(1024 * 1024, 4);
+  string key = QueryCache::NormalizeQuery({"fox"});
+  uint64_t old_generation = cache.generation();
+  cache.Insert(key, old_generation, MakeResults(3));
+  ASSERT_NE(nullptr, cache.Lookup(key));
+
+  cache.Invalidate();
+  ASSERT_EQ(nullptr, cache.Lookup(key));
+  ASSERT_EQ(0U, cache.GetStats().entries);
+  ASSERT_EQ(1U, cache.GetStats().invalidations);
+
+  // Results computed before the invalidation must not get back in.
+  cache.Insert(key, old_generation, MakeResults(3));
+  ASSERT_EQ(nullptr, cache.Lookup(key));
+  cache.Insert(key, cache.generation(), MakeResults(3));
+  ASSERT_NE(nullptr, cache.Lookup(key));
+}
+
+TEST(Test_QueryCache, TestQueryCacheCapacity) {
+  const size_t kCapacity = 64 * 1024;
+  QueryCache cache(kCapacity, 2);
+
+  // Fill the cache well past its capacity.  Later keys are asked for
+  // more often than earlier ones, so that admission lets them in.
+  for (int i = 0; i < 1000; i++) {
+    string key = QueryCache::NormalizeQuery({"word" + std::to_string(i)});
+    for (int j = 0; j <= i / 70; j++) {
+      cache.Lookup(key);
+    }
+    cache.Insert(key, cache.generation(), MakeResults(5));
+    ASSERT_LE(cache.GetStats().bytes, kCapacity);
+  }
+  QueryCache::Stats stats = cache.GetStats();
+  ASSERT_LT(0U, stats.evictions);
+  ASSERT_LT(0U, stats.entries);
+
+  // An entry bigger than a whole shard is never kept.
+  string big = QueryCache::NormalizeQuery({"big"});
+  cache.Insert(big, cache.generation(), MakeResults(10000));
+  ASSERT_EQ(nullptr, cache.Lookup(big));
+}
+
+TEST(Test_QueryCache, TestQueryCacheAdmission) {
+  // One shard, with room for only a few entries.
+  QueryCache cache(4096, 1);
+  string popular = QueryCache::NormalizeQuery({"popular"});
+  for (int i = 0; i < 10; i++) {
+    cache.Lookup(popular);
+  }
+  cache.Insert(popular, cache.generation(), MakeResults(5));
+
+  // A stream of one-off queries shouldn't push out the popular one,
+  // even though it becomes the least recently used entry.
+  for (int i = 0; i < 200; i++) {
+    string key = QueryCache::NormalizeQuery({"once" + std::to_string(i)});
+    cache.Lookup(key);
+    cache.Insert(key, cache.generation(), MakeResults(5));
+  }
+  ASSERT_NE(nullptr, cache.Lookup(popular));
+  ASSERT_LT(0U, cache.GetStats().rejects);
+}
+
+}  // namespace hw4
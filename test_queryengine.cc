@@ -0,0 +1,767 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <list>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./IndexBuilder.h"
+#include "./IndexWriter.h"
+#include "./QueryEngine.h"
+#include "./Scoring.h"
+#include "./libhw3/QueryProcessor.h"
+#include "./test_suite.h"
+
+using std::list;
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// Returns the results as sorted (name, rank) strings, so that results
+// from engines that break rank ties differently can be compared.
+static vector<string> Canonicalize(
+    const vector<hw3::QueryProcessor::QueryResult>& results) {
+  vector<string> ret;
+  for (const auto& r : results) {
+    ret.push_back(r.document_name + ":" + std::to_string(r.rank));
+  }
+  std::sort(ret.begin(), ret.end());
+  return ret;
+}
+
+static const vector<vector<string>> kQueries = {
+  {"fox"}, {"the"}, {"quick", "brown"}, {"brown", "quick"},
+  {"the", "dog", "fox"}, {"red"}, {"naps", "naps"}, {"zebra"},
+  {"quick", "zebra"}, {""}
+};
+
+TEST(Test_QueryEngine, TestQueryEngineBasic) {
+  string idx = WriteTestIndex("./test_files/tiny");
+  QueryEngine engine({idx}, IndexReaderOptions(), 1,
+                     QueryEngine::kOccurrences);
+  ASSERT_TRUE(engine.Open(true));
+
+  vector<QueryEngine::QueryResult> res = engine.ProcessQuery({"fox"});
+  ASSERT_EQ(3U, res.size());
+
+  res = engine.ProcessQuery({"quick", "brown"});
+  ASSERT_EQ(3U, res.size());
+  ASSERT_EQ("./test_files/tiny/b.txt", res[0].document_name);
+  ASSERT_EQ(3, res[0].rank);
+  ASSERT_EQ(2, res[1].rank);
+  ASSERT_EQ(2, res[2].rank);
+
+  res = engine.ProcessQuery({"the"});
+  ASSERT_EQ(2U, res.size());
+  ASSERT_EQ(3, res[0].rank);
+
+  ASSERT_EQ(0U, engine.ProcessQuery({"zebra"}).size());
+  ASSERT_EQ(0U, engine.ProcessQuery({"quick", "zebra"}).size());
+  ASSERT_EQ(0U, engine.ProcessQuery({}).size());
+
+  unlink(idx.c_str());
+}
+
+TEST(Test_QueryEngine, TestQueryEngineMatchesQueryProcessor) {
+  // Index the same files twice, so that results come from two indices.
+  string idx1 = WriteTestIndex("./test_files/tiny");
+  string idx2 = WriteTestIndex("./test_files/tiny/sub");
+  list<string> indices = {idx1, idx2};
+
+  QueryEngine engine(indices, IndexReaderOptions(), 1,
+                     QueryEngine::kOccurrences);
+  ASSERT_TRUE(engine.Open(true));
+  hw3::QueryProcessor qp(indices, true);
+
+  for (const vector<string>& query : kQueries) {
+    ASSERT_EQ(Canonicalize(qp.ProcessQuery(query)),
+              Canonicalize(engine.ProcessQuery(query)));
+  }
+
+  unlink(idx1.c_str());
+  unlink(idx2.c_str());
+}
+
+TEST(Test_QueryEngine, TestQueryEnginePages) {
+  string idx1 = WriteTestIndex("./test_files/tiny");
+  string idx2 = WriteTestIndex("./test_files/tiny/sub");
+  QueryEngine engine({idx1, idx2});
+  ASSERT_TRUE(engine.Open(true));
+
+  // Every page must be exactly the matching slice of the full ranking.
+  for (const vector<string>& query : kQueries) {
+    vector<QueryEngine::QueryResult> all = engine.ProcessQuery(query);
+    for (size_t k = 1; k <= 4; k++) {
+      for (size_t offset = 0; offset <= all.size() + 1; offset++) {
+        QueryEngine::ResultPage page = engine.ProcessQuery(query, offset, k);
+        ASSERT_EQ(all.size(), page.total);
+        size_t expected = offset >= all.size() ?
+                          0 : std::min(k, all.size() - offset);
+        ASSERT_EQ(expected, page.results.size());
+        for (size_t i = 0; i < page.results.size(); i++) {
+          ASSERT_EQ(all[offset + i].document_name,
+                    page.results[i].document_name);
+          ASSERT_EQ(all[offset + i].rank, page.results[i].rank);
+        }
+      }
+    }
+  }
+
+  // Asking for nothing, or for a page past the end, is fine.
+  ASSERT_EQ(0U, engine.ProcessQuery({"fox"}, 0, 0).results.size());
+  QueryEngine::ResultPage past = engine.ProcessQuery({"fox"}, SIZE_MAX, 10);
+  ASSERT_EQ(0U, past.results.size());
+  ASSERT_EQ(engine.ProcessQuery({"fox"}).size(), past.total);
+
+  unlink(idx1.c_str());
+  unlink(idx2.c_str());
+}
+
+TEST(Test_QueryEngine, TestQueryEngineTermExpansion) {
+  string v1 = WriteTestIndex("./test_files/tiny", 1);
+  string v2 = WriteTestIndex("./test_files/tiny", 2);
+  IndexReaderOptions resident;
+  resident.backend = IndexReaderOptions::kResident;
+  QueryEngine engine({v2}, IndexReaderOptions(), 1,
+                     QueryEngine::kOccurrences);
+  QueryEngine resident_engine({v1}, resident, 1, QueryEngine::kOccurrences);
+  QueryEngine no_dictionary({v1});
+  ASSERT_TRUE(engine.Open(true));
+  ASSERT_TRUE(resident_engine.Open(true));
+  ASSERT_TRUE(no_dictionary.Open(true));
+
+  for (const QueryEngine* e : {&engine, &resident_engine}) {
+    // "b*" is "bread" or "brown", and the counts add up.
+    vector<QueryEngine::QueryResult> res = e->ProcessQuery({"b*"});
+    ASSERT_EQ(vector<string>({"./test_files/tiny/a.txt:1",
+                              "./test_files/tiny/b.txt:1",
+                              "./test_files/tiny/sub/d.txt:2"}),
+              Canonicalize(res));
+    ASSERT_EQ("./test_files/tiny/sub/d.txt", res[0].document_name);
+
+    // Expanded terms are intersected with the rest of the query.
+    res = e->ProcessQuery({"a*", "fox"});
+    ASSERT_EQ(vector<string>({"./test_files/tiny/b.txt:3",
+                              "./test_files/tiny/c.txt:2"}),
+              Canonicalize(res));
+
+    // A prefix that is a whole word is the same as the word.
+    ASSERT_EQ(Canonicalize(e->ProcessQuery({"quick"})),
+              Canonicalize(e->ProcessQuery({"quick*"})));
+
+    // Ranges are inclusive.
+    ASSERT_EQ(Canonicalize(e->ProcessQuery({"lazy"})),
+              Canonicalize(e->ProcessQuery({"lazy..lazy"})));
+    res = e->ProcessQuery({"naps..nothing"});
+    ASSERT_EQ(vector<string>({"./test_files/tiny/c.txt:2",
+                              "./test_files/tiny/sub/d.txt:1"}),
+              Canonicalize(res));
+
+    ASSERT_EQ(0U, e->ProcessQuery({"zz*"}).size());
+    ASSERT_EQ(0U, e->ProcessQuery({"z..a"}).size());
+    ASSERT_EQ(0U, e->ProcessQuery({"b*", "zebra"}).size());
+  }
+
+  // Without a dictionary, expanded terms match nothing.
+  ASSERT_EQ(0U, no_dictionary.ProcessQuery({"b*"}).size());
+  ASSERT_EQ(3U, no_dictionary.ProcessQuery({"fox"}).size());
+
+  unlink(v1.c_str());
+  unlink(v2.c_str());
+}
+
+TEST(Test_QueryEngine, TestQueryEnginePhrases) {
+  string v1 = WriteTestIndex("./test_files/tiny", 1);
+  string v2 = WriteTestIndex("./test_files/tiny", 2);
+  IndexReaderOptions resident;
+  resident.backend = IndexReaderOptions::kResident;
+  QueryEngine engine({v2}, IndexReaderOptions(), 1,
+                     QueryEngine::kOccurrences);
+  QueryEngine resident_engine({v2}, resident, 1, QueryEngine::kOccurrences);
+  QueryEngine byte_positions({v1});
+  ASSERT_TRUE(engine.Open(true));
+  ASSERT_TRUE(resident_engine.Open(true));
+  ASSERT_TRUE(byte_positions.Open(true));
+
+  const string a = "./test_files/tiny/a.txt";
+  const string b = "./test_files/tiny/b.txt";
+  const string c = "./test_files/tiny/c.txt";
+  const string d = "./test_files/tiny/sub/d.txt";
+  for (const QueryEngine* e : {&engine, &resident_engine}) {
+    // Phrases need their words in order, next to each other; the rank
+    // still counts every occurrence of the words.
+    ASSERT_EQ(vector<string>({a + ":2", b + ":3"}),
+              Canonicalize(e->ProcessQuery({"\"quick", "brown\""})));
+    ASSERT_EQ(0U, e->ProcessQuery({"\"brown", "quick\""}).size());
+    ASSERT_EQ(vector<string>({a + ":5", c + ":4"}),
+              Canonicalize(e->ProcessQuery({"\"the", "dog\""})));
+    ASSERT_EQ(vector<string>({a + ":3"}),
+              Canonicalize(e->ProcessQuery({"\"lazy", "dog\""})));
+    ASSERT_EQ(vector<string>({a + ":3"}),
+              Canonicalize(e->ProcessQuery({"\"quick", "brown", "fox\""})));
+
+    // A phrase plus other words, an unclosed phrase, and one-word
+    // phrases.
+    ASSERT_EQ(vector<string>({c + ":6"}),
+              Canonicalize(e->ProcessQuery({"\"the", "dog\"", "naps"})));
+    ASSERT_EQ(2U, e->ProcessQuery({"\"quick", "brown"}).size());
+    ASSERT_EQ(Canonicalize(e->ProcessQuery({"fox"})),
+              Canonicalize(e->ProcessQuery({"\"fox\""})));
+    ASSERT_EQ(0U, e->ProcessQuery({"\""}).size());
+
+    // NEAR/k is within k words, either way round.
+    ASSERT_EQ(0U, e->ProcessQuery({"quick", "NEAR/1", "fox"}).size());
+    ASSERT_EQ(vector<string>({a + ":2", b + ":3"}),
+              Canonicalize(e->ProcessQuery({"quick", "near/2", "fox"})));
+    ASSERT_EQ(vector<string>({a + ":2", b + ":3"}),
+              Canonicalize(e->ProcessQuery({"fox", "near/2", "quick"})));
+    ASSERT_EQ(vector<string>({b + ":2"}),
+              Canonicalize(e->ProcessQuery({"red", "near/1", "fox"})));
+    ASSERT_EQ(vector<string>({d + ":2"}),
+              Canonicalize(e->ProcessQuery({"brown", "near/4", "wine"})));
+    ASSERT_EQ(0U, e->ProcessQuery({"brown", "near/3", "wine"}).size());
+
+    // NEAR/k ties the words next to it, even inside phrases.
+    ASSERT_EQ(vector<string>({b + ":4"}),
+              Canonicalize(e->ProcessQuery(
+                  {"\"quick", "red\"", "near/4", "dog"})));
+    ASSERT_EQ(0U, e->ProcessQuery(
+                  {"\"quick", "red\"", "near/3", "dog"}).size());
+
+    // A NEAR/k with nothing on one side is just a word.
+    ASSERT_EQ(0U, e->ProcessQuery({"near/2", "fox"}).size());
+  }
+
+  // Byte offsets can't answer positional queries, but the rest still
+  // works.
+  ASSERT_EQ(0U, byte_positions.ProcessQuery({"\"quick", "brown\""}).size());
+  ASSERT_EQ(3U, byte_positions.ProcessQuery({"quick", "brown"}).size());
+
+  unlink(v1.c_str());
+  unlink(v2.c_str());
+}
+
+TEST(Test_QueryEngine, TestQueryEngineBoolean) {
+  string v2 = WriteTestIndex("./test_files/tiny", 2);
+  IndexReaderOptions resident;
+  resident.backend = IndexReaderOptions::kResident;
+  QueryEngine engine({v2}, IndexReaderOptions(), 1,
+                     QueryEngine::kOccurrences);
+  QueryEngine resident_engine({v2}, resident, 1, QueryEngine::kOccurrences);
+  ASSERT_TRUE(engine.Open(true));
+  ASSERT_TRUE(resident_engine.Open(true));
+
+  const string a = "./test_files/tiny/a.txt";
+  const string b = "./test_files/tiny/b.txt";
+  const string c = "./test_files/tiny/c.txt";
+  const string d = "./test_files/tiny/sub/d.txt";
+  for (const QueryEngine* e : {&engine, &resident_engine}) {
+    // OR's rank counts every word a document has.
+    ASSERT_EQ(vector<string>({a + ":1", b + ":1", c + ":3"}),
+              Canonicalize(e->ProcessQuery({"fox", "OR", "naps"})));
+    ASSERT_EQ(vector<string>({b + ":1", d + ":2"}),
+              Canonicalize(e->ProcessQuery({"red", "OR", "wine"})));
+    ASSERT_EQ(vector<string>({a + ":2", b + ":2", c + ":2"}),
+              Canonicalize(e->ProcessQuery({"fox", "OR", "fox"})));
+
+    // NOT and "-" take documents away, and only count towards nothing.
+    ASSERT_EQ(vector<string>({d + ":1"}),
+              Canonicalize(e->ProcessQuery({"red", "-fox"})));
+    ASSERT_EQ(vector<string>({d + ":1"}),
+              Canonicalize(e->ProcessQuery({"red", "NOT", "fox"})));
+    ASSERT_EQ(0U, e->ProcessQuery({"fox", "-dog"}).size());
+    ASSERT_EQ(vector<string>({a + ":1", b + ":2"}),
+              Canonicalize(e->ProcessQuery(
+                  {"quick", "-(naps", "OR", "wine)"})));
+    ASSERT_EQ(0U, e->ProcessQuery({"quick", "-(fox", "OR", "wine)"}).size());
+
+    // Nothing to take away from.
+    ASSERT_EQ(0U, e->ProcessQuery({"-fox"}).size());
+    ASSERT_EQ(Canonicalize(e->ProcessQuery({"fox"})),
+              Canonicalize(e->ProcessQuery({"fox", "OR", "-dog"})));
+
+    // Parentheses group; OR binds more loosely than AND.
+    ASSERT_EQ(vector<string>({b + ":2", d + ":2"}),
+              Canonicalize(e->ProcessQuery(
+                  {"(fox", "OR", "wine)", "red"})));
+    ASSERT_EQ(vector<string>({b + ":1", d + ":1"}),
+              Canonicalize(e->ProcessQuery({"red", "OR", "wine", "fox"})));
+    ASSERT_EQ(Canonicalize(e->ProcessQuery({"fox", "dog"})),
+              Canonicalize(e->ProcessQuery({"fox", "AND", "(dog)"})));
+
+    // Unbalanced parentheses are forgiven.
+    ASSERT_EQ(Canonicalize(e->ProcessQuery({"fox", "OR", "wine"})),
+              Canonicalize(e->ProcessQuery({"((fox", "OR", "wine"})));
+    ASSERT_EQ(Canonicalize(e->ProcessQuery({"fox", "red"})),
+              Canonicalize(e->ProcessQuery({"fox))", "red"})));
+
+    // Operators must be upper case; "or" is a word no document has.
+    ASSERT_EQ(0U, e->ProcessQuery({"fox", "or", "naps"}).size());
+
+    // Phrases are checked where every match needs them.
+    ASSERT_EQ(vector<string>({a + ":5"}),
+              Canonicalize(e->ProcessQuery({"\"the", "dog\"", "-naps"})));
+    ASSERT_EQ(vector<string>({a + ":3", b + ":4"}),
+              Canonicalize(e->ProcessQuery(
+                  {"\"quick", "brown\"", "(fox", "OR", "wine)"})));
+  }
+
+  // Under BM25, the same documents match.
+  QueryEngine bm25({v2});
+  ASSERT_TRUE(bm25.Open(true));
+  QueryEngine::ResultPage page =
+    bm25.ProcessQuery({"(fox", "OR", "wine)", "-dog"}, 0, 10, true);
+  ASSERT_EQ(1U, page.total);
+  ASSERT_EQ(d, page.results[0].document_name);
+  ASSERT_EQ(3U, bm25.ProcessQuery({"fox", "OR", "naps"}).size());
+
+  // A disjunction of plain words is ranked straight off its words'
+  // lists, but ranks (and pages) just as the tree would.  A NOT that
+  // excludes nothing keeps the tree.
+  page = bm25.ProcessQuery({"fox", "OR", "naps", "OR", "wine"}, 0, 10, true);
+  ASSERT_EQ("words: fox naps wine; [0] naps:1 wine:1 fox:3 -> 4 (any)",
+            page.plan);
+  QueryEngine::ResultPage tree =
+    bm25.ProcessQuery({"fox", "OR", "naps", "OR", "wine", "OR", "-dog"},
+                      0, 10, true);
+  ASSERT_EQ(string::npos, tree.plan.find("(any)"));
+  ASSERT_EQ(4U, tree.total);
+  ASSERT_EQ(Canonicalize(tree.results), Canonicalize(page.results));
+  for (size_t k = 1; k <= 4; k++) {
+    for (size_t offset = 0; offset + k <= 4; offset++) {
+      page = bm25.ProcessQuery({"fox", "OR", "naps", "OR", "wine"},
+                               offset, k);
+      ASSERT_EQ(4U, page.total);
+      ASSERT_EQ(k, page.results.size());
+      for (size_t i = 0; i < k; i++) {
+        ASSERT_EQ(tree.results[offset + i].document_name,
+                  page.results[i].document_name);
+      }
+    }
+  }
+
+  unlink(v2.c_str());
+}
+
+TEST(Test_QueryEngine, TestQueryEngineBM25) {
+  string v1 = WriteTestIndex("./test_files/tiny", 1);
+  string v2 = WriteTestIndex("./test_files/tiny", 2);
+  string v3 = WriteTestIndex("./test_files/tiny", 3);
+  IndexReaderOptions pread, resident;
+  pread.backend = IndexReaderOptions::kPread;
+  resident.backend = IndexReaderOptions::kResident;
+  QueryEngine engine({v3});
+  QueryEngine pread_engine({v3}, pread);
+  QueryEngine resident_v1({v1}, resident);
+  QueryEngine resident_v2({v2}, resident);
+  QueryEngine unnormalized({v2});
+  for (QueryEngine* e : {&engine, &pread_engine, &resident_v1, &resident_v2,
+                         &unnormalized}) {
+    ASSERT_TRUE(e->Open(true));
+  }
+
+  const string a = "./test_files/tiny/a.txt";
+  const string b = "./test_files/tiny/b.txt";
+  const string c = "./test_files/tiny/c.txt";
+  const string d = "./test_files/tiny/sub/d.txt";
+
+  // "fox" is once in each of a (12 words), b (9) and c (11); the
+  // shortest document wins.  In 4 documents averaging 10.25 words, its
+  // idf is ln(1 + 1.5 / 3.5), and b's score is
+  // idf * 2.2 / (1 + 1.2 * (0.25 + 0.75 * 9 / 10.25)).
+  vector<QueryEngine::QueryResult> res = engine.ProcessQuery({"fox"});
+  ASSERT_EQ(3U, res.size());
+  ASSERT_EQ(b, res[0].document_name);
+  ASSERT_EQ(c, res[1].document_name);
+  ASSERT_EQ(a, res[2].document_name);
+  ASSERT_EQ(BM25Rank(BM25Idf(3, 4) * BM25Weight(1, 9, 10.25)), res[0].rank);
+  ASSERT_EQ(BM25Rank(BM25Idf(3, 4) * 2.2 /
+                     (1 + 1.2 * (0.25 + 0.75 * 9 / 10.25))), res[0].rank);
+
+  // Rare words count for more than common ones: "dog" is in three
+  // documents, "red" in two.
+  res = engine.ProcessQuery({"red"});
+  ASSERT_EQ(2U, res.size());
+  ASSERT_GT(res[0].rank, engine.ProcessQuery({"dog"})[0].rank);
+
+  // Resident indices work lengths out for older files, so every reader
+  // of every version agrees once lengths are known.
+  for (const vector<string>& query : kQueries) {
+    vector<string> expected = Canonicalize(engine.ProcessQuery(query));
+    ASSERT_EQ(expected, Canonicalize(pread_engine.ProcessQuery(query)));
+    ASSERT_EQ(expected, Canonicalize(resident_v1.ProcessQuery(query)));
+    ASSERT_EQ(expected, Canonicalize(resident_v2.ProcessQuery(query)));
+  }
+
+  // Without lengths, every document counts as average, so only the
+  // counts tell documents apart.
+  res = unnormalized.ProcessQuery({"fox"});
+  ASSERT_EQ(3U, res.size());
+  ASSERT_EQ(res[0].rank, res[2].rank);
+  ASSERT_EQ(BM25Rank(BM25Idf(3, 4) * BM25Weight(1, 0, 0)), res[0].rank);
+  res = unnormalized.ProcessQuery({"quick"});
+  ASSERT_EQ(b, res[0].document_name);
+  ASSERT_GT(res[0].rank, res[1].rank);
+
+  // Skipping documents that can't make the top k never changes the
+  // top k: every page is still a slice of the full ranking.
+  for (const vector<string>& query : kQueries) {
+    vector<QueryEngine::QueryResult> all = engine.ProcessQuery(query);
+    for (size_t k = 1; k <= all.size(); k++) {
+      QueryEngine::ResultPage page = engine.ProcessQuery(query, 0, k);
+      ASSERT_EQ(all.size(), page.total);
+      for (size_t i = 0; i < k; i++) {
+        ASSERT_EQ(all[i].document_name, page.results[i].document_name);
+        ASSERT_EQ(all[i].rank, page.results[i].rank);
+      }
+    }
+  }
+
+  unlink(v1.c_str());
+  unlink(v2.c_str());
+  unlink(v3.c_str());
+}
+
+TEST(Test_QueryEngine, TestQueryEnginePlan) {
+  string idx1 = WriteTestIndex("./test_files/tiny", 3);
+  string idx2 = WriteTestIndex("./test_files/tiny/sub", 3);
+  QueryEngine engine({idx1, idx2});
+  ASSERT_TRUE(engine.Open(true));
+
+  // Plans are only made when asked for.
+  ASSERT_EQ("", engine.ProcessQuery({"fox"}, 0, 10).plan);
+
+  // Repeated words are looked up once, but still count twice.  The
+  // rarer word goes first, and the second index has no "fox" at all.
+  QueryEngine::ResultPage page =
+      engine.ProcessQuery({"fox", "red", "fox"}, 0, 10, true);
+  ASSERT_EQ(1U, page.total);
+  ASSERT_EQ("./test_files/tiny/b.txt", page.results[0].document_name);
+  ASSERT_EQ(0U, page.plan.find("words: fox(x2) red; [0] red:2 fox:3 -> 1; "
+                               "[1] skipped: no \"fox\""));
+  ASSERT_EQ(BM25Rank(2 * BM25Idf(3, 4) * BM25Weight(1, 9, 10.25) +
+                     BM25Idf(2, 4) * BM25Weight(1, 9, 10.25)),
+            page.results[0].rank);
+
+  // Words in the same number of documents keep their query order.
+  page = engine.ProcessQuery({"quick", "brown", "lazy"}, 0, 10, true);
+  ASSERT_EQ(1U, page.total);
+  ASSERT_EQ(0U, page.plan.find("words: quick brown lazy; "
+                               "[0] lazy:2 quick:3 brown:3 -> 1; "
+                               "[1] skipped: no \"lazy\""));
+
+  // Once the rarer words have nothing in common, the rest aren't
+  // fetched.
+  page = engine.ProcessQuery({"dog", "naps", "red"}, 0, 10, true);
+  ASSERT_EQ(0U, page.total);
+  ASSERT_EQ(0U, page.plan.find("words: dog naps red; [0] naps:1 red:2 dog:3 "
+                               "skipped: nothing left after \"red\"; [1] "));
+
+  // Prefix terms go last.
+  page = engine.ProcessQuery({"qu*", "red"}, 0, 10, true);
+  ASSERT_EQ(3U, page.total);
+  ASSERT_EQ("words: qu* red; [0] red:2 qu*:? -> 2; [1] red:1 qu*:? -> 1",
+            page.plan);
+
+  unlink(idx1.c_str());
+  unlink(idx2.c_str());
+}
+
+TEST(Test_QueryEngine, TestQueryEngineFanOut) {
+  list<string> indices;
+  for (int i = 0; i < 3; i++) {
+    indices.push_back(WriteTestIndex("./test_files/tiny"));
+    indices.push_back(WriteTestIndex("./test_files/tiny/sub"));
+  }
+  QueryEngine serial(indices);
+  ASSERT_TRUE(serial.Open(true));
+
+  // Fanning out must give exactly the same results (ties included) as
+  // probing the indices one at a time, whether there are fewer helpers
+  // than indices or more.
+  for (uint32_t fanout : {2U, 4U, 16U}) {
+    QueryEngine engine(indices, IndexReaderOptions(), fanout);
+    ASSERT_TRUE(engine.Open(true));
+    for (const vector<string>& query : kQueries) {
+      vector<QueryEngine::QueryResult> expected = serial.ProcessQuery(query);
+      vector<QueryEngine::QueryResult> actual = engine.ProcessQuery(query);
+      ASSERT_EQ(expected.size(), actual.size());
+      for (size_t i = 0; i < expected.size(); i++) {
+        ASSERT_EQ(expected[i].document_name, actual[i].document_name);
+        ASSERT_EQ(expected[i].rank, actual[i].rank);
+      }
+      ASSERT_EQ(serial.ProcessQuery(query, 1, 2).total,
+                engine.ProcessQuery(query, 1, 2).total);
+    }
+  }
+
+  for (const string& idx : indices) {
+    unlink(idx.c_str());
+  }
+}
+
+// Writes "contents" to the file "name".
+static void WriteFile(const string& name, const string& contents) {
+  FILE* f = fopen(name.c_str(), "w");
+  ASSERT_NE(nullptr, f);
+  ASSERT_EQ(contents.size(), fwrite(contents.data(), 1, contents.size(), f));
+  ASSERT_EQ(0, fclose(f));
+}
+
+// Returns the names of the documents "results" holds, sorted.
+static vector<string> DocNames(
+    const vector<hw3::QueryProcessor::QueryResult>& results) {
+  vector<string> names;
+  for (const auto& r : results) {
+    names.push_back(r.document_name);
+  }
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+TEST(Test_QueryEngine, TestQueryEngineSegments) {
+  char dir[] = "/tmp/hw4_test_segments_XXXXXX";
+  ASSERT_NE(nullptr, mkdtemp(dir));
+  string a = string(dir) + "/a.txt", b = string(dir) + "/b.txt",
+         c = string(dir) + "/c.txt";
+  WriteFile(a, "The quick brown fox.");
+  WriteFile(b, "The lazy dog.");
+
+  // The base index.  Back-date it, and the files it was built from
+  // further still, so that files written from here on are newer than
+  // it.
+  string base = string(dir) + ".base.idx";
+  string delta = string(dir) + ".delta.idx";
+  DocTable* dt;
+  MemIndex* mi;
+  ASSERT_TRUE(ParallelCrawlFileTree(dir, 1, &dt, &mi));
+  ASSERT_LT(0, WriteCompressedIndex(mi, dt, base.c_str()));
+  DocTable_Free(dt);
+  MemIndex_Free(mi);
+  struct timeval past[2];
+  gettimeofday(&past[0], nullptr);
+  past[0].tv_sec -= 60;
+  past[1] = past[0];
+  ASSERT_EQ(0, utimes(base.c_str(), past));
+  past[0].tv_sec -= 60;
+  past[1] = past[0];
+  ASSERT_EQ(0, utimes(a.c_str(), past));
+  ASSERT_EQ(0, utimes(b.c_str(), past));
+
+  vector<string> changed, tombstones;
+  ASSERT_TRUE(PlanDelta(dir, {base}, &changed, &tombstones));
+  ASSERT_TRUE(changed.empty());
+  ASSERT_TRUE(tombstones.empty());
+
+  // Change a, delete b, and add c.
+  WriteFile(a, "The slow green turtle.");
+  ASSERT_EQ(0, unlink(b.c_str()));
+  WriteFile(c, "A quick cat.");
+  ASSERT_TRUE(PlanDelta(dir, {base}, &changed, &tombstones));
+  std::sort(changed.begin(), changed.end());
+  ASSERT_EQ(vector<string>({a, c}), changed);
+  ASSERT_EQ(vector<string>({a, b}), tombstones);
+
+  // The delta records when its crawl started.  c changes again after
+  // that, while the crawl is still going, and so is out of date even
+  // though the delta is written after the change.
+  ASSERT_EQ(0, utimes(a.c_str(), past));
+  ASSERT_EQ(0, utimes(c.c_str(), past));
+  uint64_t crawl_time = CrawlStartTime();
+  ParallelParseFiles(changed, 2, &dt, &mi);
+  WriteFile(c, "A quick cat sat.");
+  ASSERT_LT(0, WriteCompressedIndex(mi, dt, delta.c_str(), 3, tombstones,
+                                    nullptr, crawl_time));
+  DocTable_Free(dt);
+  MemIndex_Free(mi);
+  vector<string> stale, stale_tombstones;
+  ASSERT_TRUE(PlanDelta(dir, {base, delta}, &stale, &stale_tombstones));
+  ASSERT_EQ(vector<string>({c}), stale);
+  ASSERT_EQ(vector<string>({c}), stale_tombstones);
+
+  // Queried together, newest first, only the live copies match: the
+  // old a and b are hidden, though the base still has them.
+  QueryEngine engine({delta, base});
+  ASSERT_TRUE(engine.Open(true));
+  ASSERT_EQ(tombstones, engine.indices()[0]->tombstones());
+  ASSERT_EQ(0U, engine.num_hidden(0));
+  ASSERT_EQ(2U, engine.num_hidden(1));
+  ASSERT_EQ(vector<string>({c}), DocNames(engine.ProcessQuery({"quick"})));
+  ASSERT_EQ(vector<string>({a}), DocNames(engine.ProcessQuery({"turtle"})));
+  ASSERT_EQ(vector<string>({a}), DocNames(engine.ProcessQuery({"the"})));
+  ASSERT_TRUE(engine.ProcessQuery({"fox"}).empty());
+  QueryEngine::ResultPage page = engine.ProcessQuery({"the"}, 0, 10, true);
+  ASSERT_EQ(1U, page.total);
+  ASSERT_NE(string::npos, page.plan.find("hidden:2"));
+
+  // Folding the delta into the base gives an index that stands on its
+  // own, and matches the same documents.  (Their BM25 ranks differ,
+  // since the hidden documents no longer count towards the statistics.)
+  string merged = string(dir) + ".merged.idx";
+  MergeStats stats;
+  ASSERT_LT(0, MergeIndexFiles({base, delta}, merged.c_str(), 3, &stats));
+  ASSERT_EQ(4U, stats.docs_in);
+  ASSERT_EQ(2U, stats.docs_out);
+  ASSERT_EQ(2U, stats.tombstones);
+  QueryEngine compacted({merged});
+  ASSERT_TRUE(compacted.Open(true));
+  ASSERT_TRUE(compacted.indices()[0]->tombstones().empty());
+  ASSERT_EQ(2U, compacted.indices()[0]->num_docs());
+  for (const vector<string>& query : kQueries) {
+    ASSERT_EQ(DocNames(engine.ProcessQuery(query)),
+              DocNames(compacted.ProcessQuery(query)));
+  }
+
+  // The merged index keeps each document's crawl time, so c is still
+  // out of date, though the merged file is newer than the change.
+  ASSERT_EQ(crawl_time, compacted.indices()[0]->crawl_time(2));
+  ASSERT_TRUE(PlanDelta(dir, {merged}, &stale, &stale_tombstones));
+  ASSERT_EQ(vector<string>({c}), stale);
+  ASSERT_EQ(vector<string>({c}), stale_tombstones);
+
+  unlink(a.c_str());
+  unlink(c.c_str());
+  rmdir(dir);
+  unlink(base.c_str());
+  unlink(delta.c_str());
+  unlink(merged.c_str());
+}
+
+TEST(Test_QueryEngine, TestQueryEngineShards) {
+  string whole = WriteTestIndex("./test_files", 3);
+  QueryEngine monolithic({whole});
+  ASSERT_TRUE(monolithic.Open(true));
+  vector<string> files;
+  ASSERT_TRUE(ListFileTree("./test_files", &files));
+
+  for (ShardPartition partition : {kShardByRange, kShardByHash}) {
+    vector<vector<string>> shard_files;
+    ShardFiles(files, 3, partition, &shard_files);
+    vector<DocTable*> dts;
+    vector<MemIndex*> mis;
+    ParallelParseShards(shard_files, 4, &dts, &mis);
+    ASSERT_EQ(3U, dts.size());
+    vector<string> shards;
+    for (int i = 0; i < 3; i++) {
+      char name[] = "/tmp/hw4_test_shard_XXXXXX";
+      close(mkstemp(name));
+      shards.push_back(name);
+    }
+    ASSERT_LT(0, WriteShardedIndex(mis, dts, shards));
+    for (size_t i = 0; i < dts.size(); i++) {
+      DocTable_Free(dts[i]);
+      MemIndex_Free(mis[i]);
+    }
+
+    // Each shard knows the collection it is part of...
+    QueryEngine engine(list<string>(shards.begin(), shards.end()),
+                       IndexReaderOptions(), 3);
+    ASSERT_TRUE(engine.Open(true));
+    size_t num_docs = 0;
+    for (uint32_t i = 0; i < 3; i++) {
+      const IndexReader& shard = *engine.indices()[i];
+      ASSERT_TRUE(shard.is_shard());
+      ASSERT_EQ(i, shard.shard().shard);
+      ASSERT_EQ(3U, shard.shard().num_shards);
+      ASSERT_EQ(engine.indices()[0]->shard().set_id, shard.shard().set_id);
+      ASSERT_EQ(monolithic.indices()[0]->num_docs(),
+                shard.shard().collection_docs);
+      ASSERT_EQ(monolithic.indices()[0]->average_doc_length(),
+                shard.average_doc_length());
+      num_docs += shard.num_docs();
+    }
+    ASSERT_EQ(monolithic.indices()[0]->num_docs(), num_docs);
+    ASSERT_FALSE(monolithic.indices()[0]->is_shard());
+
+    // ...so the shards, queried together, rank every document just as
+    // one index of the whole collection does.
+    for (const vector<string>& query : kQueries) {
+      ASSERT_EQ(Canonicalize(monolithic.ProcessQuery(query)),
+                Canonicalize(engine.ProcessQuery(query)));
+    }
+
+    // Without all of its shards, a collection's shards are ranked as
+    // indices of their own, but still match what they hold.
+    QueryEngine partial({shards[0], shards[1]});
+    ASSERT_TRUE(partial.Open(true));
+    for (const vector<string>& query : kQueries) {
+      vector<string> names = DocNames(partial.ProcessQuery(query));
+      vector<string> all = DocNames(engine.ProcessQuery(query));
+      ASSERT_TRUE(std::includes(all.begin(), all.end(),
+                                names.begin(), names.end()));
+    }
+
+    for (const string& shard : shards) {
+      unlink(shard.c_str());
+    }
+  }
+  unlink(whole.c_str());
+}
+
+TEST(Test_QueryEngine, TestQueryEngineBadIndex) {
+  QueryEngine missing({"./test_files/no_such.idx"});
+  ASSERT_FALSE(missing.Open(false));
+
+  QueryEngine not_an_index({"./test_files/hextext.txt"});
+  ASSERT_FALSE(not_an_index.Open(false));
+}
+
+// Thread start routine that runs every query in kQueries against the
+// QueryEngine passed in as the argument, and checks that it gets the
+// same answers as a single-threaded run.
+static void* RunQueriesFn(void* arg) {
+  const QueryEngine* engine = static_cast<const QueryEngine*>(arg);
+  for (int round = 0; round < 20; round++) {
+    for (const vector<string>& query : kQueries) {
+      vector<QueryEngine::QueryResult> res = engine->ProcessQuery(query);
+      if (query == vector<string>{"fox"} && res.size() != 3) {
+        return arg;
+      }
+    }
+  }
+  return nullptr;
+}
+
+TEST(Test_QueryEngine, TestQueryEngineConcurrent) {
+  string idx = WriteTestIndex("./test_files/tiny");
+  string sub = WriteTestIndex("./test_files/tiny/sub");
+  QueryEngine engine({idx, sub}, IndexReaderOptions(), 2);
+  ASSERT_TRUE(engine.Open(true));
+
+  // Many threads sharing one engine (and one file descriptor per index,
+  // and one fan-out executor) must all see correct results.
+  const int kNumThreads = 8;
+  pthread_t threads[kNumThreads];
+  for (int i = 0; i < kNumThreads; i++) {
+    ASSERT_EQ(0, pthread_create(&threads[i], nullptr, &RunQueriesFn,
+                                &engine));
+  }
+  for (int i = 0; i < kNumThreads; i++) {
+    void* failed;
+    ASSERT_EQ(0, pthread_join(threads[i], &failed));
+    ASSERT_EQ(nullptr, failed);
+  }
+
+  unlink(idx.c_str());
+  unlink(sub.c_str());
+}
+
+}  // namespace hw4
@@ -0,0 +1,85 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <unistd.h>
+
+#include "gtest/gtest.h"
+extern "C" {
+  #include "libhw1/CSE333.h"
+}
+#include "./RequestLane.h"
+#include "./test_suite.h"
+
+namespace hw4 {
+
+// Thread start routine that enters the lane passed in as the argument,
+// records that it got in, and leaves again.
+static volatile bool entered = false;
+static void* EnterLaneFn(void* arg) {
+  RequestLane* lane = static_cast<RequestLane*>(arg);
+  Verify333(lane->Enter(nullptr));
+  entered = true;
+  lane->Exit(10);
+  return nullptr;
+}
+
+TEST(Test_RequestLane, TestRequestLaneAdmission) {
+  RequestLane lane("test", 2, 1);
+
+  // The first two requests get a worker right away.
+  ASSERT_TRUE(lane.Enter(nullptr));
+  ASSERT_TRUE(lane.Enter(nullptr));
+  ASSERT_EQ(2U, lane.GetStats().active);
+
+  // The third has to wait in the queue...
+  pthread_t waiter;
+  ASSERT_EQ(0, pthread_create(&waiter, nullptr, &EnterLaneFn, &lane));
+  while (lane.GetStats().queued != 1) {
+    usleep(1000);
+  }
+  ASSERT_FALSE(entered);
+
+  // ...and since the queue is now full, the fourth is shed.
+  ASSERT_FALSE(lane.Enter(nullptr));
+  ASSERT_EQ(1U, lane.GetStats().rejected);
+
+  // Freeing up a worker lets the queued request through.
+  lane.Exit(100);
+  ASSERT_EQ(0, pthread_join(waiter, nullptr));
+  ASSERT_TRUE(entered);
+  lane.Exit(1000);
+
+  RequestLane::Stats stats = lane.GetStats();
+  ASSERT_EQ(0U, stats.active);
+  ASSERT_EQ(0U, stats.queued);
+  ASSERT_EQ(3U, stats.completed);
+  ASSERT_EQ(1110U, stats.total_service_us);
+  ASSERT_EQ(1000U, stats.max_service_us);
+}
+
+TEST(Test_RequestLane, TestRequestLanePercentiles) {
+  RequestLane lane("test", 1, 0);
+
+  // 99 fast requests and one slow one.
+  for (int i = 0; i < 99; i++) {
+    ASSERT_TRUE(lane.Enter(nullptr));
+    lane.Exit(50);
+  }
+  ASSERT_TRUE(lane.Enter(nullptr));
+  lane.Exit(5000);
+
+  RequestLane::Stats stats = lane.GetStats();
+  ASSERT_EQ(64U, stats.Percentile(0.50));
+  ASSERT_EQ(8192U, stats.Percentile(0.99));
+  ASSERT_EQ(5000U, stats.max_service_us);
+}
+
+}  // namespace hw4
@@ -11,11 +11,23 @@
 
 #include "./test_suite.h"
 
+#include <stdlib.h>
+#include <unistd.h>
 #include <iostream>
+#include <string>
 #include "gtest/gtest.h"
 
+extern "C" {
+  #include "libhw2/CrawlFileTree.h"
+  #include "libhw2/DocTable.h"
+  #include "libhw2/MemIndex.h"
+}
+#include "./libhw3/WriteIndex.h"
+#include "./IndexWriter.h"
+
 using std::cout;
 using std::endl;
+using std::string;
 
 // static
 int HW4Environment::total_points_ = 0;
@@ -49,6 +61,34 @@ void HW4Environment::OpenTestCase() {
   ::testing::Test::RecordProperty("points", curr_test_points_);
 }
 
+string WriteTestIndex(const string& dir, int version) {
+  char file_name[] = "/tmp/hw4_test_index_XXXXXX";
+  int fd = mkstemp(file_name);
+  EXPECT_NE(-1, fd);
+  close(fd);
+
+  DocTable* dt;
+  MemIndex* mi;
+  string root(dir);
+  EXPECT_TRUE(CrawlFileTree(const_cast<char*>(root.c_str()), &dt, &mi));
+  if (version == 1) {
+    EXPECT_LT(0, hw3::WriteIndex(mi, dt, file_name));
+  } else {
+    EXPECT_LT(0, hw4::WriteCompressedIndex(mi, dt, file_name, version));
+  }
+  DocTable_Free(dt);
+  MemIndex_Free(mi);
+  return file_name;
+}
+
+hw4::PostingList MakeList(DocID_t first, DocID_t last, DocID_t step,
+                          int32_t count) {
+  hw4::PostingList ret;
+  for (DocID_t d = first; d < last; d += step) {
+    ret.Append(d, count);
+  }
+  return ret;
+}
 
 int main(int argc, char **argv) {
   ::testing::InitGoogleTest(&argc, argv);
@@ -12,7 +12,10 @@
 #ifndef HW4_TEST_SUITE_H_
 #define HW4_TEST_SUITE_H_
 
+#include <string>
+
 #include "gtest/gtest.h"
+#include "./PostingList.h"
 
 class HW4Environment : public ::testing::Environment {
  public:
@@ -29,5 +32,15 @@ class HW4Environment : public ::testing::Environment {
   static int curr_test_points_;
 };
 
+// Crawls the directory "dir" with libhw2 and writes an index of it into
+// a fresh temporary file, in format version "version": 1 with
+// hw3::WriteIndex, or 2 or 3 with hw4::WriteCompressedIndex.  Returns the
+// name of the index file, which the caller should unlink() when done.
+std::string WriteTestIndex(const std::string& dir, int version = 1);
+
+// Returns a list of every "step"th docID in [first, last), each with a
+// count of "count".
+hw4::PostingList MakeList(DocID_t first, DocID_t last, DocID_t step,
+                          int32_t count);
 
 #endif  // HW4_TEST_SUITE_H_
@@ -0,0 +1,160 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdio.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./TermDictionary.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+// Returns the sorted words from "words" that "keep" accepts.
+template <typename Fn>
+static vector<string> Filter(const vector<string>& words, Fn keep) {
+  vector<string> ret;
+  for (const string& word : words) {
+    if (keep(word)) {
+      ret.push_back(word);
+    }
+  }
+  return ret;
+}
+
+TEST(Test_TermDictionary, TestTermDictionaryExpand) {
+  // Enough words for many blocks, with lots of shared prefixes.
+  vector<string> words;
+  char buf[32];
+  for (int i = 0; i < 1000; i++) {
+    snprintf(buf, sizeof(buf), "w%d", i * 7);
+    words.push_back(buf);
+  }
+  words.push_back("a");
+  words.push_back("comput");
+  words.push_back("computation");
+  words.push_back("compute");
+  words.push_back("computer");
+  words.push_back("computing");
+  words.push_back("con");
+  std::sort(words.begin(), words.end());
+
+  vector<uint8_t> encoded;
+  TermDictionary::Build(words, &encoded);
+  TermDictionary dict;
+  ASSERT_FALSE(dict.valid());
+  ASSERT_TRUE(dict.Parse(encoded.data(), encoded.size()));
+  ASSERT_TRUE(dict.valid());
+  ASSERT_EQ(words.size(), dict.size());
+
+  // Every prefix of every tenth word, and some that match nothing.
+  for (size_t i = 0; i < words.size(); i += 10) {
+    for (size_t len = 0; len <= words[i].size(); len++) {
+      string prefix = words[i].substr(0, len);
+      vector<string> expected = Filter(words, [&](const string& w) {
+        return w.compare(0, prefix.size(), prefix) == 0;
+      });
+      vector<string> actual;
+      ASSERT_TRUE(dict.ExpandPrefix(prefix, SIZE_MAX, &actual));
+      ASSERT_EQ(expected, actual);
+    }
+  }
+  for (const char* prefix : {"b", "zz", "w99999", "compx", "0"}) {
+    vector<string> actual;
+    ASSERT_TRUE(dict.ExpandPrefix(prefix, SIZE_MAX, &actual));
+    ASSERT_TRUE(actual.empty());
+  }
+
+  vector<string> actual;
+  ASSERT_TRUE(dict.ExpandPrefix("comput", 10, &actual));
+  ASSERT_EQ(vector<string>({"comput", "computation", "compute", "computer",
+                            "computing"}), actual);
+
+  // Stopping short is reported.
+  actual.clear();
+  ASSERT_FALSE(dict.ExpandPrefix("comput", 2, &actual));
+  ASSERT_EQ(vector<string>({"comput", "computation"}), actual);
+
+  // Ranges are inclusive at both ends, and needn't start or end on a
+  // word in the dictionary.
+  const vector<vector<string>> ranges = {
+    {"compute", "con"}, {"b", "computer"}, {"w1", "w2"}, {"w5", "w5"},
+    {"w70", "w700"}, {"", "a"}, {"x", "z"}, {"con", "a"}
+  };
+  for (const vector<string>& range : ranges) {
+    vector<string> expected = Filter(words, [&](const string& w) {
+      return w >= range[0] && w <= range[1];
+    });
+    actual.clear();
+    ASSERT_TRUE(dict.ExpandRange(range[0], range[1], SIZE_MAX, &actual));
+    ASSERT_EQ(expected, actual);
+  }
+  actual.clear();
+  ASSERT_FALSE(dict.ExpandRange("w1", "w2", 5, &actual));
+  ASSERT_EQ(5U, actual.size());
+
+  // Walking the dictionary a batch at a time, each batch starting from
+  // the last word of the one before, finds every word.
+  actual.clear();
+  bool complete = dict.ExpandFrom("", 7, &actual);
+  vector<string> walked = actual;
+  while (!complete) {
+    string last = actual.back();
+    actual.clear();
+    complete = dict.ExpandFrom(last, 8, &actual);
+    ASSERT_EQ(last, actual.front());
+    walked.insert(walked.end(), actual.begin() + 1, actual.end());
+  }
+  ASSERT_EQ(words, walked);
+}
+
+TEST(Test_TermDictionary, TestTermDictionaryBadInput) {
+  // An empty dictionary is fine, and finds nothing.
+  vector<uint8_t> encoded;
+  TermDictionary::Build({}, &encoded);
+  TermDictionary dict;
+  ASSERT_TRUE(dict.Parse(encoded.data(), encoded.size()));
+  ASSERT_EQ(0U, dict.size());
+  vector<string> words;
+  ASSERT_TRUE(dict.ExpandPrefix("", SIZE_MAX, &words));
+  ASSERT_TRUE(words.empty());
+
+  // Too short, and a block count that doesn't match the word count.
+  ASSERT_FALSE(dict.Parse(encoded.data(), 3));
+  ASSERT_FALSE(dict.valid());
+  encoded.clear();
+  TermDictionary::Build({"apple", "banana"}, &encoded);
+  vector<uint8_t> bad = encoded;
+  bad[7] = 2;
+  ASSERT_FALSE(dict.Parse(bad.data(), bad.size()));
+
+  // A block offset past the end.
+  bad = encoded;
+  bad[11] = 0xFF;
+  ASSERT_FALSE(dict.Parse(bad.data(), bad.size()));
+
+  // Truncated words are never read past the end of the buffer; the
+  // scan just stops.
+  for (size_t len = 13; len < encoded.size(); len++) {
+    if (dict.Parse(encoded.data(), len)) {
+      words.clear();
+      dict.ExpandPrefix("", SIZE_MAX, &words);
+      ASSERT_LT(words.size(), 2U);
+    }
+  }
+}
+
+}  // namespace hw4
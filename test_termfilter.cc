@@ -0,0 +1,87 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdio.h>
+
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./TermFilter.h"
+
+using std::string;
+using std::vector;
+
+namespace hw4 {
+
+TEST(Test_TermFilter, TestTermFilterMayContain) {
+  vector<string> words;
+  char buf[32];
+  for (int i = 0; i < 5000; i++) {
+    snprintf(buf, sizeof(buf), "w%d", i);
+    words.push_back(buf);
+  }
+
+  vector<uint8_t> encoded;
+  TermFilter::Build(words, &encoded);
+  // 50000 bits round up to 98 blocks of 64 bytes.
+  ASSERT_EQ(5U + 98 * 64, encoded.size());
+  TermFilter filter;
+  ASSERT_FALSE(filter.valid());
+  ASSERT_TRUE(filter.MayContain("anything"));
+  ASSERT_TRUE(filter.Parse(encoded.data(), encoded.size()));
+  ASSERT_TRUE(filter.valid());
+
+  // Never a false negative...
+  for (const string& word : words) {
+    ASSERT_TRUE(filter.MayContain(word));
+  }
+
+  // ...and not many false positives, among words much like the real
+  // ones.
+  int false_positives = 0;
+  for (int i = 0; i < 20000; i++) {
+    snprintf(buf, sizeof(buf), "x%d", i);
+    false_positives += filter.MayContain(buf);
+  }
+  ASSERT_LT(false_positives, 20000 * 3 / 100);
+}
+
+TEST(Test_TermFilter, TestTermFilterBadInput) {
+  // An empty filter is fine, and has nothing in it.
+  vector<uint8_t> encoded;
+  TermFilter::Build({}, &encoded);
+  TermFilter filter;
+  ASSERT_TRUE(filter.Parse(encoded.data(), encoded.size()));
+  ASSERT_FALSE(filter.MayContain("apple"));
+
+  // Too short, a block count that doesn't match the length, and no
+  // probes.
+  encoded.clear();
+  TermFilter::Build({"apple", "banana"}, &encoded);
+  ASSERT_FALSE(filter.Parse(encoded.data(), 4));
+  ASSERT_FALSE(filter.valid());
+  ASSERT_FALSE(filter.Parse(encoded.data(), encoded.size() - 1));
+  vector<uint8_t> bad = encoded;
+  bad[3] = 2;
+  ASSERT_FALSE(filter.Parse(bad.data(), bad.size()));
+  bad = encoded;
+  bad[3] = 0;
+  ASSERT_FALSE(filter.Parse(bad.data(), bad.size()));
+  bad = encoded;
+  bad[4] = 0;
+  ASSERT_FALSE(filter.Parse(bad.data(), bad.size()));
+  ASSERT_TRUE(filter.Parse(encoded.data(), encoded.size()));
+  ASSERT_TRUE(filter.MayContain("apple"));
+  ASSERT_TRUE(filter.MayContain("banana"));
+}
+
+}  // namespace hw4
@@ -0,0 +1,224 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "gtest/gtest.h"
+#include "./IndexReader.h"
+#include "./PostingCodec.h"
+#include "./Scoring.h"
+#include "./TopKEvaluator.h"
+#include "./test_suite.h"
+
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+namespace hw4 {
+
+// The made-up words of the test corpus, most common first.
+static const vector<string> kWords = {
+  "alpha", "bravo", "charlie", "delta", "echo", "foxtrot", "golf",
+  "hotel", "india", "juliet", "kilo", "lima", "mike", "november"
+};
+
+// A word in only every 100th document.
+static const char kRareWord[] = "zulu";
+
+// Writes "num_docs" documents of made-up words, drawn so that earlier
+// words in kWords are more common, plus kRareWord, into a new temporary
+// directory, and returns its name.
+static string WriteCorpus(int num_docs) {
+  char dir[] = "/tmp/hw4_test_corpus_XXXXXX";
+  EXPECT_NE(nullptr, mkdtemp(dir));
+  srand(333);
+  for (int d = 0; d < num_docs; d++) {
+    string file = string(dir) + "/doc" + std::to_string(d) + ".txt";
+    FILE* f = fopen(file.c_str(), "w");
+    EXPECT_NE(nullptr, f);
+    int length = 5 + rand() % 40;
+    for (int i = 0; i < length; i++) {
+      // Word w is picked with probability about 1 / (w + 1).
+      size_t w = 0;
+      while (w + 1 < kWords.size() && rand() % (w + 2) != 0) {
+        w++;
+      }
+      fprintf(f, "%s ", kWords[w].c_str());
+    }
+    if (d % 100 == 0) {
+      fprintf(f, "%s %s", kRareWord, kRareWord);
+    }
+    fclose(f);
+  }
+  return dir;
+}
+
+// Removes what WriteCorpus() made.
+static void RemoveCorpus(const string& dir, int num_docs) {
+  for (int d = 0; d < num_docs; d++) {
+    unlink((dir + "/doc" + std::to_string(d) + ".txt").c_str());
+  }
+  rmdir(dir.c_str());
+}
+
+// Returns every document containing any of "lists" (or, if "all", every
+// one of them), scored the slow way, best first.
+static vector<TopKEvaluator::Hit> ScoreAll(
+    const IndexReader& reader, const vector<const PostingList*>& lists,
+    bool all) {
+  PostingList docs = *lists[0];
+  for (size_t i = 1; i < lists.size(); i++) {
+    if (all) {
+      docs.IntersectWith(*lists[i]);
+    } else {
+      docs.UnionWith(*lists[i]);
+    }
+  }
+  vector<TopKEvaluator::Hit> hits;
+  for (DocID_t doc_id : docs.doc_ids()) {
+    double score = 0;
+    for (const PostingList* list : lists) {
+      auto it = std::lower_bound(list->doc_ids().begin(),
+                                 list->doc_ids().end(), doc_id);
+      if (it != list->doc_ids().end() && *it == doc_id) {
+        score += BM25Idf(list->size(), reader.num_docs()) *
+                 BM25Weight(list->count(it - list->doc_ids().begin()),
+                            reader.doc_length(doc_id),
+                            reader.average_doc_length());
+      }
+    }
+    hits.push_back({BM25Rank(score), doc_id});
+  }
+  std::stable_sort(hits.begin(), hits.end(),
+                   [](const TopKEvaluator::Hit& a,
+                      const TopKEvaluator::Hit& b) {
+                     return a.rank > b.rank;
+                   });
+  return hits;
+}
+
+TEST(Test_TopKEvaluator, TestTopKEvaluatorMethods) {
+  // Enough documents that common words span several blocks.
+  const int kNumDocs = 1500;
+  string dir = WriteCorpus(kNumDocs);
+  string v2 = WriteTestIndex(dir, 2);
+  string v3 = WriteTestIndex(dir, 3);
+  RemoveCorpus(dir, kNumDocs);
+
+  IndexReaderOptions resident;
+  resident.backend = IndexReaderOptions::kResident;
+  for (const string& file : {v3, v2}) {
+    for (const IndexReaderOptions& options :
+         {IndexReaderOptions(), resident}) {
+      unique_ptr<IndexReader> reader(IndexReader::Create(file, options));
+      ASSERT_TRUE(reader->Open(true));
+      vector<PostingList> lists(kWords.size());
+      for (size_t w = 0; w < kWords.size(); w++) {
+        ASSERT_TRUE(reader->LookupWord(kWords[w], &lists[w]));
+      }
+      ASSERT_LT(kPostingsBlockSize, lists[0].size());
+
+      const vector<vector<size_t>> queries = {
+        {0}, {0, 1}, {1, 0, 2}, {0, 13}, {12, 13}, {0, 1, 2, 3, 4}, {6, 6}
+      };
+      for (const vector<size_t>& words : queries) {
+        vector<const PostingList*> query;
+        for (size_t w : words) {
+          query.push_back(&lists[w]);
+        }
+        vector<TopKEvaluator::Hit> any = ScoreAll(*reader, query, false);
+        vector<TopKEvaluator::Hit> all = ScoreAll(*reader, query, true);
+        PostingList candidates = *query[0];
+        for (size_t i = 1; i < query.size(); i++) {
+          candidates.IntersectWith(*query[i]);
+        }
+
+        for (size_t k : {1, 3, 10, 100, 5000}) {
+          TopKEvaluator::Stats stats[3];
+          for (TopKEvaluator::Method method :
+               {TopKEvaluator::kExhaustive, TopKEvaluator::kWand,
+                TopKEvaluator::kBlockMaxWand}) {
+            TopKEvaluator evaluator(*reader, method);
+            for (const PostingList* list : query) {
+              evaluator.AddWord(list);
+            }
+
+            // Every method finds exactly the top k, ties going to the
+            // lower docID.
+            vector<TopKEvaluator::Hit> best;
+            evaluator.MatchAny(k, &best, &stats[method]);
+            ASSERT_EQ(std::min(k, any.size()), best.size());
+            for (size_t i = 0; i < best.size(); i++) {
+              ASSERT_EQ(any[i].doc_id, best[i].doc_id);
+              ASSERT_EQ(any[i].rank, best[i].rank);
+            }
+            evaluator.RankAll(candidates, k, &best);
+            ASSERT_EQ(std::min(k, all.size()), best.size());
+            for (size_t i = 0; i < best.size(); i++) {
+              ASSERT_EQ(all[i].doc_id, best[i].doc_id);
+              ASSERT_EQ(all[i].rank, best[i].rank);
+            }
+          }
+
+          // Exhaustive evaluation scores every match; the others never
+          // score more than it does.
+          ASSERT_EQ(any.size(), stats[TopKEvaluator::kExhaustive].scored);
+          ASSERT_LE(stats[TopKEvaluator::kWand].scored, any.size());
+          ASSERT_LE(stats[TopKEvaluator::kBlockMaxWand].scored, any.size());
+        }
+      }
+
+      // A common word with a rare one: once the rare word's documents
+      // fill the heap, most of the common word's can be skipped.
+      PostingList rare;
+      ASSERT_TRUE(reader->LookupWord(kRareWord, &rare));
+      TopKEvaluator::Stats exhaustive, wand;
+      vector<TopKEvaluator::Hit> best;
+      TopKEvaluator e1(*reader, TopKEvaluator::kExhaustive);
+      TopKEvaluator e2(*reader, TopKEvaluator::kBlockMaxWand);
+      for (TopKEvaluator* e : {&e1, &e2}) {
+        e->AddWord(&rare);
+        e->AddWord(&lists[0]);
+      }
+      e1.MatchAny(3, &best, &exhaustive);
+      e2.MatchAny(3, &best, &wand);
+      ASSERT_LT(wand.scored * 2, exhaustive.scored);
+    }
+  }
+
+  // No words, or no room, find nothing.
+  unique_ptr<IndexReader> reader(
+      IndexReader::Create(v3, IndexReaderOptions()));
+  ASSERT_TRUE(reader->Open(true));
+  TopKEvaluator empty(*reader, TopKEvaluator::kBlockMaxWand);
+  vector<TopKEvaluator::Hit> best;
+  empty.MatchAny(10, &best);
+  ASSERT_TRUE(best.empty());
+  PostingList postings;
+  ASSERT_TRUE(reader->LookupWord("alpha", &postings));
+  empty.AddWord(&postings);
+  empty.MatchAny(0, &best);
+  ASSERT_TRUE(best.empty());
+  empty.RankAll(postings, 0, &best);
+  ASSERT_TRUE(best.empty());
+
+  unlink(v2.c_str());
+  unlink(v3.c_str());
+}
+
+}  // namespace hw4
@@ -0,0 +1,321 @@
+/*
+ * Copyright ©2023 Chris Thachuk.  All rights reserved.  Permission is
+ * hereby granted to students registered for University of Washington
+ * CSE 333 for use solely during Fall Quarter 2023 for purposes of
+ * the course.  No other use, copying, distribution, or modification
+ * is permitted without prior written consent. Copyrights for
+ * third-party components of this work must be honored.  Instructors
+ * interested in reusing these course materials should contact the
+ * author.
+ */
+
+// topkbench measures how much of the work of finding the top 10 BM25
+// results TopKEvaluator's WAND and Block-Max WAND save over scoring
+// every match, for both disjunctive (any word) and conjunctive (every
+// word) queries.  Queries are made up from each index's own words:
+// pairs of common words, a common word with a rare one, and longer
+// mixes.  Every method must return exactly the results exhaustive
+// evaluation does.
+//
+// Besides the given index files, it can make up a corpus of its own
+// ("-s num_docs"): documents of 50 to 300 words whose frequencies follow
+// Zipf's law, crawled and written as a version 3 index like any other.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <algorithm>
+#include <iomanip>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "./IndexReader.h"
+#include "./IndexWriter.h"
+#include "./RequestLane.h"
+#include "./TopKEvaluator.h"
+
+extern "C" {
+  #include "libhw2/CrawlFileTree.h"
+  #include "libhw2/DocTable.h"
+  #include "libhw2/MemIndex.h"
+}
+
+using std::cerr;
+using std::cout;
+using std::endl;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+using hw4::IndexReader;
+using hw4::IndexReaderOptions;
+using hw4::PostingList;
+using hw4::TopKEvaluator;
+
+// How many results each query asks for.
+static const size_t kTopK = 10;
+
+// How many queries of each kind to make up.
+static const int kQueriesPerMix = 100;
+
+// Print out program usage, and exit() with EXIT_FAILURE.
+static void Usage(char* prog_name) {
+  cerr << "Usage: " << prog_name << " [-s num_docs] rounds index_file*"
+       << endl;
+  exit(EXIT_FAILURE);
+}
+
+// Returns the made-up word of rank "rank": letters only, since hw2's
+// parser splits words at anything else.
+static string SyntheticWord(size_t rank) {
+  string word = "z";
+  do {
+    word += static_cast<char>('a' + rank % 26);
+    rank /= 26;
+  } while (rank > 0);
+  return word;
+}
+
+// Writes "num_docs" Zipf-distributed documents into a new temporary
+// directory, indexes them into a new temporary version 3 index file,
+// and removes the documents again.  Returns the index file's name, or
+// "" on failure.
+static string MakeSyntheticIndex(int num_docs) {
+  const size_t kVocabulary = 20000;
+  vector<double> cumulative(kVocabulary);
+  double total = 0;
+  for (size_t r = 0; r < kVocabulary; r++) {
+    total += 1.0 / (r + 1);
+    cumulative[r] = total;
+  }
+  vector<string> words(kVocabulary);
+  for (size_t r = 0; r < kVocabulary; r++) {
+    words[r] = SyntheticWord(r);
+  }
+
+  char dir[] = "/tmp/topkbench_XXXXXX";
+  if (mkdtemp(dir) == nullptr) {
+    return "";
+  }
+  srand(333);
+  vector<string> files;
+  for (int d = 0; d < num_docs; d++) {
+    string file = string(dir) + "/doc" + std::to_string(d) + ".txt";
+    FILE* f = fopen(file.c_str(), "w");
+    if (f == nullptr) {
+      break;
+    }
+    files.push_back(file);
+    int length = 50 + rand() % 251;
+    for (int i = 0; i < length; i++) {
+      double x = total * rand() / RAND_MAX;
+      size_t r = std::lower_bound(cumulative.begin(), cumulative.end(), x) -
+                 cumulative.begin();
+      fprintf(f, "%s ", words[std::min(r, kVocabulary - 1)].c_str());
+    }
+    fclose(f);
+  }
+
+  string index;
+  DocTable* dt;
+  MemIndex* mi;
+  if (files.size() == static_cast<size_t>(num_docs) &&
+      CrawlFileTree(dir, &dt, &mi)) {
+    char file_name[] = "/tmp/topkbench_index_XXXXXX";
+    int fd = mkstemp(file_name);
+    if (fd != -1) {
+      close(fd);
+      if (hw4::WriteCompressedIndex(mi, dt, file_name) > 0) {
+        index = file_name;
+      } else {
+        unlink(file_name);
+      }
+    }
+    DocTable_Free(dt);
+    MemIndex_Free(mi);
+  }
+  for (const string& file : files) {
+    unlink(file.c_str());
+  }
+  rmdir(dir);
+  return index;
+}
+
+// Benchmarks the made-up queries against "reader".  Returns false if
+// any method's results differ from exhaustive evaluation's.
+static bool RunBenchmark(const IndexReader& reader, int rounds) {
+  // Every word of the index, most common first.
+  vector<string> words;
+  reader.ExpandPrefix("", SIZE_MAX, &words);
+  vector<PostingList> lists(words.size());
+  vector<size_t> by_df;
+  for (size_t i = 0; i < words.size(); i++) {
+    if (reader.LookupWord(words[i], &lists[i])) {
+      by_df.push_back(i);
+    }
+  }
+  std::stable_sort(by_df.begin(), by_df.end(), [&lists](size_t a, size_t b) {
+    return lists[a].size() > lists[b].size();
+  });
+  cout << reader.file_name() << ": " << reader.num_docs() << " docs, "
+       << by_df.size() << " words" << endl;
+  if (by_df.size() < 100) {
+    cout << "  too few words to benchmark" << endl;
+    return true;
+  }
+
+  struct Mix {
+    const char* label;
+    size_t num_common, num_rare;
+  };
+  const Mix mixes[] = {
+    {"2 common words", 2, 0},
+    {"common + rare word", 1, 1},
+    {"3 common words", 3, 0},
+    {"2 common + 2 rare words", 2, 2},
+  };
+  const struct {
+    const char* label;
+    TopKEvaluator::Method method;
+  } methods[] = {
+    {"exhaustive", TopKEvaluator::kExhaustive},
+    {"wand", TopKEvaluator::kWand},
+    {"block-max wand", TopKEvaluator::kBlockMaxWand},
+  };
+
+  // Common words are the 20 most frequent; rare ones come from the
+  // rest of the top 10% (below that, words are in only a document or
+  // two).
+  const size_t common = 20, rare = std::max<size_t>(common + 1,
+                                                    by_df.size() / 10);
+  srand(333);
+  for (const Mix& mix : mixes) {
+    vector<vector<const PostingList*>> queries;
+    vector<PostingList> intersections;
+    for (int q = 0; q < kQueriesPerMix; q++) {
+      vector<const PostingList*> query;
+      for (size_t i = 0; i < mix.num_common + mix.num_rare; i++) {
+        size_t r = i < mix.num_common ? rand() % common :
+                   common + rand() % (rare - common);
+        query.push_back(&lists[by_df[r]]);
+      }
+      // Rarest first, as QueryEngine does.
+      std::stable_sort(query.begin(), query.end(),
+                       [](const PostingList* a, const PostingList* b) {
+                         return a->size() < b->size();
+                       });
+      PostingList intersection = *query[0];
+      for (size_t i = 1; i < query.size(); i++) {
+        intersection.IntersectWith(*query[i]);
+      }
+      queries.push_back(query);
+      intersections.push_back(intersection);
+    }
+
+    cout << "  " << mix.label << ":" << endl;
+    for (bool any : {true, false}) {
+      vector<vector<TopKEvaluator::Hit>> expected;
+      for (const auto& m : methods) {
+        uint64_t elapsed = 0;
+        size_t scored = 0;
+        vector<vector<TopKEvaluator::Hit>> results(queries.size());
+        for (int round = 0; round < rounds; round++) {
+          TopKEvaluator::Stats stats;
+          uint64_t start = hw4::RequestLane::NowMicros();
+          for (size_t q = 0; q < queries.size(); q++) {
+            TopKEvaluator evaluator(reader, m.method);
+            for (const PostingList* list : queries[q]) {
+              evaluator.AddWord(list);
+            }
+            if (any) {
+              evaluator.MatchAny(kTopK, &results[q], &stats);
+            } else {
+              evaluator.RankAll(intersections[q], kTopK, &results[q],
+                                &stats);
+            }
+          }
+          elapsed += hw4::RequestLane::NowMicros() - start;
+          scored = stats.scored;
+        }
+
+        if (expected.empty()) {
+          expected = results;
+        }
+        for (size_t q = 0; q < queries.size(); q++) {
+          bool same = results[q].size() == expected[q].size();
+          for (size_t i = 0; same && i < expected[q].size(); i++) {
+            same = results[q][i].doc_id == expected[q][i].doc_id &&
+                   results[q][i].rank == expected[q][i].rank;
+          }
+          if (!same) {
+            cerr << m.label << " disagrees with exhaustive evaluation"
+                 << endl;
+            return false;
+          }
+        }
+        cout << "    " << (any ? "any " : "all ") << std::left
+             << std::setw(16) << m.label << std::right << std::setw(10)
+             << std::fixed << std::setprecision(1)
+             << static_cast<double>(elapsed) / (rounds * queries.size())
+             << " us/query" << std::setw(10)
+             << static_cast<double>(scored) / queries.size()
+             << " docs scored/query" << endl;
+      }
+    }
+  }
+  return true;
+}
+
+int main(int argc, char** argv) {
+  int arg = 1, synthetic_docs = 0;
+  if (argc > 2 && strcmp(argv[1], "-s") == 0) {
+    synthetic_docs = atoi(argv[2]);
+    if (synthetic_docs <= 0) {
+      Usage(argv[0]);
+    }
+    arg += 2;
+  }
+  if (argc - arg < 1) {
+    Usage(argv[0]);
+  }
+  int rounds = atoi(argv[arg++]);
+  if (rounds <= 0 || (arg == argc && synthetic_docs == 0)) {
+    Usage(argv[0]);
+  }
+
+  vector<string> indices(argv + arg, argv + argc);
+  string synthetic;
+  if (synthetic_docs > 0) {
+    uint64_t start = hw4::RequestLane::NowMicros();
+    synthetic = MakeSyntheticIndex(synthetic_docs);
+    if (synthetic.empty()) {
+      cerr << "couldn't make a synthetic index" << endl;
+      return EXIT_FAILURE;
+    }
+    cout << "made a synthetic index of " << synthetic_docs
+         << " documents in "
+         << (hw4::RequestLane::NowMicros() - start) / 1000 << " ms" << endl;
+    indices.push_back(synthetic);
+  }
+
+  bool ok = true;
+  for (const string& index : indices) {
+    unique_ptr<IndexReader> reader(
+        IndexReader::Create(index, IndexReaderOptions()));
+    if (!reader->Open(false)) {
+      cerr << "couldn't open " << index << endl;
+      ok = false;
+      break;
+    }
+    if (!RunBenchmark(*reader, rounds)) {
+      ok = false;
+      break;
+    }
+  }
+  if (!synthetic.empty()) {
+    unlink(synthetic.c_str());
+  }
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}